@@ -54,6 +54,7 @@
 #include "replay/replay_ragdoll.h"
 #include "studio_stats.h"
 #include "tier1/callqueue.h"
+#include "tier0/fasttimer.h"
 
 #ifdef TF_CLIENT_DLL
 #include "c_tf_player.h"
@@ -677,6 +678,7 @@ C_BaseAnimating::C_BaseAnimating() :
 	m_pRagdoll		= NULL;
 	m_builtRagdoll = false;
 	m_hitboxBoneCacheHandle = 0;
+	m_pHitboxBVH = NULL;
 	int i;
 	for ( i = 0; i < ARRAYSIZE( m_flEncodedController ); i++ )
 	{
@@ -752,6 +754,7 @@ C_BaseAnimating::~C_BaseAnimating()
 	delete m_pIk;
 	delete m_pBoneMergeCache;
 	Studio_DestroyBoneCache( m_hitboxBoneCacheHandle );
+	delete m_pHitboxBVH;
 	delete m_pJiggleBones;
 	InvalidateMdlCache();
 
@@ -4961,7 +4964,18 @@ bool C_BaseAnimating::TestHitboxes( const Ray_t &ray, unsigned int fContentsMask
 	matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
 	pCache->ReadCachedBonePointers( hitboxbones, pStudioHdr->numbones() );
 
-	if ( TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, GetRenderOrigin(), GetModelScale(), tr ) )
+	CHitboxBVH *pBVH = NULL;
+	if ( CHitboxBVH::IsEnabled() )
+	{
+		if ( !m_pHitboxBVH )
+		{
+			m_pHitboxBVH = new CHitboxBVH;
+		}
+		m_pHitboxBVH->Update( pStudioHdr, set, hitboxbones, pCache->m_nSerial );
+		pBVH = m_pHitboxBVH;
+	}
+
+	if ( TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, GetRenderOrigin(), GetModelScale(), tr, pBVH ) )
 	{
 		mstudiobbox_t *pbox = set->pHitbox( tr.hitbox );
 		mstudiobone_t *pBone = pStudioHdr->pBone(pbox->bone);
@@ -6431,3 +6445,122 @@ void C_BaseAnimating::MoveBoneAttachments( C_BaseAnimating* attachTarget )
 		}
 	}
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: time pose setup for a simulated crowd on real models, with the
+//			scalar blend, the SIMD blend, and the SIMD blend plus pose cache
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( anim_posebench, "Time pose setup for a crowd. Usage: anim_posebench [entities] [model ...]", FCVAR_CHEAT )
+{
+	static const char *s_pDefaultModels[] =
+	{
+		"models/combine_soldier.mdl",
+		"models/humans/group01/male_07.mdl",
+		"models/zombie/classic.mdl",
+	};
+	static const char *s_pModeNames[] = { "scalar", "simd", "simd+cache" };
+	const int nFrames = 60;
+
+	int nEntities = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 64;
+
+	CUtlVector< const char * > models;
+	for ( int i = 2; i < args.ArgC(); i++ )
+	{
+		models.AddToTail( args[i] );
+	}
+	if ( !models.Count() )
+	{
+		models.AddMultipleToTail( ARRAYSIZE( s_pDefaultModels ), s_pDefaultModels );
+	}
+
+	ConVarRef anim_simdblend( "anim_simdblend" );
+	ConVarRef anim_posecache( "anim_posecache" );
+	bool bOldSIMDBlend = anim_simdblend.GetBool();
+	bool bOldPoseCache = anim_posecache.GetBool();
+
+	Vector pos[MAXSTUDIOBONES];
+	QuaternionAligned q[MAXSTUDIOBONES];
+
+	for ( int m = 0; m < models.Count(); m++ )
+	{
+		MDLHandle_t hMDL = mdlcache->FindMDL( models[m] );
+		if ( hMDL == MDLHANDLE_INVALID )
+		{
+			Warning( "anim_posebench: couldn't find %s\n", models[m] );
+			continue;
+		}
+		if ( mdlcache->IsErrorModel( hMDL ) )
+		{
+			Warning( "anim_posebench: couldn't load %s\n", models[m] );
+			mdlcache->Release( hMDL );
+			continue;
+		}
+
+		CStudioHdr studioHdr( mdlcache->GetStudioHdr( hMDL ), mdlcache );
+
+		// the crowd plays a few looping sequences in eight phase groups
+		CUtlVector< int > sequences;
+		for ( int i = 0; i < studioHdr.GetNumSeq() && sequences.Count() < 4; i++ )
+		{
+			if ( studioHdr.pSeqdesc( i ).flags & STUDIO_LOOPING )
+			{
+				sequences.AddToTail( i );
+			}
+		}
+		if ( !sequences.Count() )
+		{
+			sequences.AddToTail( 0 );
+		}
+
+		float poseParameter[MAXSTUDIOPOSEPARAM];
+		Studio_CalcDefaultPoseParameters( &studioHdr, poseParameter, MAXSTUDIOPOSEPARAM );
+
+		float flMilliseconds[ ARRAYSIZE( s_pModeNames ) ];
+		int nHits = 0, nMisses = 0, nUncacheable = 0;
+		for ( int nMode = 0; nMode < ARRAYSIZE( s_pModeNames ); nMode++ )
+		{
+			anim_simdblend.SetValue( nMode >= 1 );
+			anim_posecache.SetValue( nMode >= 2 );
+			Studio_ResetPoseCache();
+
+			CFastTimer timer;
+			timer.Start();
+			for ( int nFrame = 0; nFrame < nFrames; nFrame++ )
+			{
+				float flTime = nFrame / 30.0f;
+				for ( int e = 0; e < nEntities; e++ )
+				{
+					float flCycle = flTime * 0.5f + ( e % 8 ) * 0.125f + e * 0.00001f;
+					flCycle -= (int)flCycle;
+
+					IBoneSetup boneSetup( &studioHdr, BONE_USED_BY_ANYTHING, poseParameter );
+					boneSetup.InitPose( pos, q );
+					boneSetup.AccumulatePose( pos, q, sequences[ e % sequences.Count() ], flCycle, 1.0f, flTime, NULL );
+
+					// half the crowd blends a second sequence on top, which goes through SlerpBones
+					if ( e & 1 )
+					{
+						boneSetup.AccumulatePose( pos, q, sequences[ ( e / 2 ) % sequences.Count() ], flCycle, 0.5f, flTime, NULL );
+					}
+				}
+			}
+			timer.End();
+
+			flMilliseconds[nMode] = timer.GetDuration().GetMillisecondsF();
+			Studio_GetPoseCacheStats( nHits, nMisses, nUncacheable );
+		}
+
+		Msg( "%s: %d bones, %d entities x %d frames\n", models[m], studioHdr.numbones(), nEntities, nFrames );
+		for ( int nMode = 0; nMode < ARRAYSIZE( s_pModeNames ); nMode++ )
+		{
+			Msg( "  %-10s %8.2f ms  (%.2fx)\n", s_pModeNames[nMode], flMilliseconds[nMode], flMilliseconds[0] / MAX( flMilliseconds[nMode], 0.001f ) );
+		}
+		Msg( "  pose cache: %d hits, %d misses, %d uncacheable\n", nHits, nMisses, nUncacheable );
+
+		mdlcache->Release( hMDL );
+	}
+
+	anim_simdblend.SetValue( bOldSIMDBlend );
+	anim_posecache.SetValue( bOldPoseCache );
+	Studio_ResetPoseCache();
+}
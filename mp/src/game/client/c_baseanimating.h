@@ -43,6 +43,7 @@ class CIKState;
 class ConVar;
 class C_RopeKeyframe;
 class CBoneBitList;
+class CHitboxBVH;
 class CBoneList;
 class KeyValues;
 class CJiggleBones;
@@ -599,6 +600,7 @@ private:
 	
 	CUtlVector< matrix3x4_t >		m_CachedBoneData; // never access this directly. Use m_BoneAccessor.
 	memhandle_t						m_hitboxBoneCacheHandle;
+	CHitboxBVH						*m_pHitboxBVH;		// Made by the first hitbox trace
 	float							m_flLastBoneSetupTime;
 	CJiggleBones					*m_pJiggleBones;
 
@@ -21,6 +21,7 @@
 #include "env_detail_controller.h"
 #include "tier0/icommandline.h"
 #include "c_world.h"
+#include "tier0/fasttimer.h"
 
 #include "tier0/valve_minmax_off.h"
 #include <algorithm>
@@ -338,10 +339,29 @@ class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 	int m_nNumPendingSprites;
 	int m_nStartSpriteIndex;
 
+	// state for the cached per-leaf buildout. The quads and sort order live in
+	// CDetailObjectSystem's leaf cache arrays at the same offset as m_pSprites.
+	Vector m_vecSortCenter;									// used to pick the distance bucket
+	Vector m_vecCachedViewOrigin;
+	Vector m_vecCachedViewForward;
+	float m_flCachedMaxSqDist;
+	float m_flCachedFadeSqDist;
+	int m_nCachedSortCount;
+	int m_nDistanceBucket;
+	int m_nCacheSerial;
+
 	CFastDetailLeafSpriteList( void )
 	{
 		m_nNumPendingSprites = 0;
 		m_nStartSpriteIndex = 0;
+		m_vecSortCenter.Init();
+		m_vecCachedViewOrigin.Init();
+		m_vecCachedViewForward.Init();
+		m_flCachedMaxSqDist = 0.0f;
+		m_flCachedFadeSqDist = 0.0f;
+		m_nCachedSortCount = 0;
+		m_nDistanceBucket = -1;
+		m_nCacheSerial = -1;
 	}
 
 };
@@ -407,6 +427,10 @@ public:
 	// Method of ISpatialLeafEnumerator
 	bool EnumerateLeaf( int leaf, int context );
 
+	// Camera path recording + replay for measuring the fast sprite buildout
+	void ToggleBenchmarkRecording();
+	void RunBenchmark();
+
 	DetailPropLightstylesLump_t& DetailLighting( int i ) { return m_DetailLighting[i]; }
 	DetailPropSpriteDict_t& DetailSpriteDict( int i ) { return m_DetailSpriteDict[i]; }
 
@@ -428,11 +452,30 @@ private:
 		float m_flDistance;
 	};
 
+	struct BenchmarkFrame_t
+	{
+		Vector m_vecOrigin;
+		Vector m_vecForward;
+	};
+
+	struct SortStats_t
+	{
+		int m_nCachedLeaves;								// reused last buildout + order as-is
+		int m_nIncrementalLeaves;							// rebuilt quads, insertion sorted from last order
+		int m_nFullSortLeaves;								// rebuilt quads, full sort
+	};
+
 	int BuildOutSortedSprites( CFastDetailLeafSpriteList *pData,
 							   Vector const &viewOrigin,
 							   Vector const &viewForward,
 							   Vector const &viewRight,
 							   Vector const &viewUp );
+	int BuildOutCachedSortedSprites( CFastDetailLeafSpriteList *pData,
+									 Vector const &viewOrigin,
+									 Vector const &viewForward );
+	bool ShouldUseLeafCache() const;
+	void ComputeLeafSortCenter( CFastDetailLeafSpriteList *pData ) const;
+	void ComputeFadeDistances();
 
 	void RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList );
 
@@ -461,6 +504,7 @@ private:
 
 	// Sorts sprites in back-to-front order
 	static bool SortLessFunc( const SortInfo_t &left, const SortInfo_t &right );
+	static void InsertionSortSprites( SortInfo_t *pSortInfo, int nCount );
 	int SortSpritesBackToFront( int nLeaf, const Vector &viewOrigin, const Vector &viewForward, SortInfo_t *pSortInfo );
 
 	// For fast detail object insertion
@@ -486,6 +530,23 @@ private:
 	SortInfo_t *m_pFastSortInfo;
 	FastSpriteQuadBuildoutBufferX4_t *m_pBuildoutBuffer;
 
+	// Output of the last BuildOutSortedSprites call; either the scratch buffers
+	// above or the leaf's slice of the leaf cache below
+	SortInfo_t *m_pCurFastSortInfo;
+	FastSpriteQuadBuildoutBufferX4_t *m_pCurBuildoutBuffer;
+
+	// Per-leaf cache, parallel to m_pFastSpriteData
+	SortInfo_t *m_pFastSortCache;
+	FastSpriteQuadBuildoutBufferX4_t *m_pFastQuadCache;
+	float *m_pFastDistScratch;
+	uint8 *m_pFastPlacedScratch;
+	int m_nFastCacheSerial;
+	SortStats_t m_SortStats;
+
+	bool m_bRecordingBenchmark;
+	bool m_bBenchmarkNoCache;
+	CUtlVector<BenchmarkFrame_t> m_BenchmarkPath;
+
 	float m_flDefaultFadeStart;
 	float m_flDefaultFadeEnd;
 
@@ -1402,6 +1463,16 @@ CDetailObjectSystem::CDetailObjectSystem() : m_DetailSpriteDict( 0, 32 ), m_Deta
 	m_pSortInfo = NULL;
 	m_pFastSortInfo = NULL;
 	m_pBuildoutBuffer = NULL;
+	m_pCurFastSortInfo = NULL;
+	m_pCurBuildoutBuffer = NULL;
+	m_pFastSortCache = NULL;
+	m_pFastQuadCache = NULL;
+	m_pFastDistScratch = NULL;
+	m_pFastPlacedScratch = NULL;
+	m_nFastCacheSerial = 0;
+	memset( &m_SortStats, 0, sizeof( m_SortStats ) );
+	m_bRecordingBenchmark = false;
+	m_bBenchmarkNoCache = false;
 }
 
 void CDetailObjectSystem::FreeSortBuffers( void )
@@ -1421,6 +1492,29 @@ void CDetailObjectSystem::FreeSortBuffers( void )
 		MemAlloc_FreeAligned(  m_pBuildoutBuffer );
 		m_pBuildoutBuffer = NULL;
 	}
+	if ( m_pFastSortCache )
+	{
+		MemAlloc_FreeAligned( m_pFastSortCache );
+		m_pFastSortCache = NULL;
+	}
+	if ( m_pFastQuadCache )
+	{
+		MemAlloc_FreeAligned( m_pFastQuadCache );
+		m_pFastQuadCache = NULL;
+	}
+	if ( m_pFastDistScratch )
+	{
+		MemAlloc_FreeAligned( m_pFastDistScratch );
+		m_pFastDistScratch = NULL;
+	}
+	if ( m_pFastPlacedScratch )
+	{
+		MemAlloc_FreeAligned( m_pFastPlacedScratch );
+		m_pFastPlacedScratch = NULL;
+	}
+	m_pCurFastSortInfo = NULL;
+	m_pCurBuildoutBuffer = NULL;
+	++m_nFastCacheSerial;
 }
 
 CDetailObjectSystem::~CDetailObjectSystem()
@@ -1541,6 +1635,8 @@ void CDetailObjectSystem::LevelShutdownPreEntity()
 	m_DetailSpriteDictFlipped.Purge();
 	m_DetailLighting.Purge();
 	m_DetailSpriteMaterial.Shutdown();
+	m_BenchmarkPath.Purge();
+	m_bRecordingBenchmark = false;
 	if ( m_pFastSpriteData )
 	{
 		MemAlloc_FreeAligned( m_pFastSpriteData );
@@ -1639,6 +1735,9 @@ ConVar cl_detail_multiplier( "cl_detail_multiplier", "1", FCVAR_CHEAT, "extra de
 #define SPRITE_MULTIPLIER  ( cl_detail_multiplier.GetInt() )
 
 ConVar cl_fastdetailsprites( "cl_fastdetailsprites", "1", FCVAR_CHEAT, "whether to use new detail sprite system");
+ConVar cl_detail_leafcache( "cl_detail_leafcache", "1", FCVAR_CHEAT, "Cache fast detail sprite buildout + sort order per leaf and re-sort incrementally" );
+ConVar cl_detail_leafcache_tolerance( "cl_detail_leafcache_tolerance", "0", FCVAR_CHEAT, "Distance the view may move before a leaf's cached detail sprite quads are rebuilt" );
+ConVar cl_detail_sort_bucket( "cl_detail_sort_bucket", "64", FCVAR_CHEAT, "Size of the view distance buckets; leaves that change bucket get a full re-sort instead of an incremental one" );
 
 static bool DetailObjectIsFastSprite( DetailObjectLump_t const & lump )
 {
@@ -1747,6 +1846,11 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 			MemAlloc_AllocAligned( 
 				( 1 + nMaxFastInLeaf / 4 ) * sizeof( FastSpriteQuadBuildoutBufferX4_t ),
 				sizeof( fltx4 ) ) );
+
+		m_pFastDistScratch = reinterpret_cast<float *> (
+			MemAlloc_AllocAligned( ( 4 + nMaxFastInLeaf ) * sizeof( float ), sizeof( fltx4 ) ) );
+		m_pFastPlacedScratch = reinterpret_cast<uint8 *> (
+			MemAlloc_AllocAligned( 4 + nMaxFastInLeaf, sizeof( fltx4 ) ) );
 	}
 
 	if ( nNumFastSpritesToAllocate )
@@ -1757,6 +1861,14 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 			MemAlloc_AllocAligned( 
 				( nNumFastSpritesToAllocate >> 2 ) * sizeof( FastSpriteX4_t ),
 				sizeof( fltx4 ) ) );
+
+		// leaf cache - one buildout quad per sprite group, and a sort slot per sprite
+		m_pFastQuadCache = reinterpret_cast<FastSpriteQuadBuildoutBufferX4_t *> (
+			MemAlloc_AllocAligned( 
+				( nNumFastSpritesToAllocate >> 2 ) * sizeof( FastSpriteQuadBuildoutBufferX4_t ),
+				sizeof( fltx4 ) ) );
+		m_pFastSortCache = reinterpret_cast<SortInfo_t *> (
+			MemAlloc_AllocAligned( nNumFastSpritesToAllocate * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
 	}
 
 	m_DetailObjects.EnsureCapacity( nNumOldStyleObjects  );
@@ -1787,6 +1899,7 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 					pNew->m_nNumSIMDSprites = ( 3 + nNumFastObjectsInCurLeaf ) >> 2;
 					pNew->m_pSprites = pCurFastSpriteOut;
 					pCurFastSpriteOut += pNew->m_nNumSIMDSprites;
+					ComputeLeafSortCenter( pNew );
 					ClientLeafSystem()->SetSubSystemDataInLeaf( 
 						detailObjectLeaf, CLSUBSYSTEM_DETAILOBJECTS, pNew );
 					// round to see boundary
@@ -1872,6 +1985,7 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 			pNew->m_nNumSIMDSprites = ( 3 + nNumFastObjectsInCurLeaf ) >> 2;
 			pNew->m_pSprites = pCurFastSpriteOut;
 			pCurFastSpriteOut += pNew->m_nNumSIMDSprites;
+			ComputeLeafSortCenter( pNew );
 			ClientLeafSystem()->SetSubSystemDataInLeaf( 
 				detailObjectLeaf, CLSUBSYSTEM_DETAILOBJECTS, pNew );
 		}
@@ -2134,6 +2248,12 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 												Vector const &viewRight,
 												Vector const &viewUp )
 {
+	if ( ShouldUseLeafCache() )
+		return BuildOutCachedSortedSprites( pData, viewOrigin, viewForward );
+
+	m_pCurFastSortInfo = m_pFastSortInfo;
+	m_pCurBuildoutBuffer = m_pBuildoutBuffer;
+
 	// part 1 - do all vertex math, fading, etc into a buffer, using as much simd as we can
 	int nSIMDSprites = pData->m_nNumSIMDSprites;
 	FastSpriteX4_t const *pSprites = pData->m_pSprites;
@@ -2232,6 +2352,212 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 }
 
 
+
+//-----------------------------------------------------------------------------
+// Leaf cache for fast sprites
+//-----------------------------------------------------------------------------
+bool CDetailObjectSystem::ShouldUseLeafCache() const
+{
+	return cl_detail_leafcache.GetBool() && ( m_pFastSortCache != NULL ) && !m_bBenchmarkNoCache;
+}
+
+void CDetailObjectSystem::ComputeLeafSortCenter( CFastDetailLeafSpriteList *pData ) const
+{
+	Vector vecSum( 0, 0, 0 );
+	for ( int i = 0; i < pData->m_nNumSprites; ++i )
+	{
+		FastSpriteX4_t const &sprite = pData->m_pSprites[i >> 2];
+		vecSum.x += sprite.m_Pos.X( i & 3 );
+		vecSum.y += sprite.m_Pos.Y( i & 3 );
+		vecSum.z += sprite.m_Pos.Z( i & 3 );
+	}
+	pData->m_vecSortCenter = vecSum / MAX( 1, pData->m_nNumSprites );
+}
+
+// Sprites come out of the previous frame's order nearly sorted, so this is close to linear
+void CDetailObjectSystem::InsertionSortSprites( SortInfo_t *pSortInfo, int nCount )
+{
+	for ( int i = 1; i < nCount; ++i )
+	{
+		SortInfo_t tmp = pSortInfo[i];
+		int j = i;
+		while ( ( j > 0 ) && SortLessFunc( tmp, pSortInfo[j - 1] ) )
+		{
+			pSortInfo[j] = pSortInfo[j - 1];
+			--j;
+		}
+		pSortInfo[j] = tmp;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Same output as BuildOutSortedSprites, but the quads and sort order are kept
+// per leaf. If the view hasn't moved the last result is returned as-is; if it
+// has, the quads are rebuilt and last frame's order is insertion sorted unless
+// the leaf has moved to a different distance bucket.
+//-----------------------------------------------------------------------------
+int CDetailObjectSystem::BuildOutCachedSortedSprites( CFastDetailLeafSpriteList *pData,
+													  Vector const &viewOrigin,
+													  Vector const &viewForward )
+{
+	int nSIMDOffset = pData->m_pSprites - m_pFastSpriteData;
+	SortInfo_t *pCachedSortInfo = m_pFastSortCache + 4 * nSIMDOffset;
+	FastSpriteQuadBuildoutBufferX4_t *pCachedQuads = m_pFastQuadCache + nSIMDOffset;
+	m_pCurFastSortInfo = pCachedSortInfo;
+	m_pCurBuildoutBuffer = pCachedQuads;
+
+	bool bCacheValid = ( pData->m_nCacheSerial == m_nFastCacheSerial ) &&
+		( pData->m_flCachedMaxSqDist == m_flCurMaxSqDist ) &&
+		( pData->m_flCachedFadeSqDist == m_flCurFadeSqDist );
+
+	// the cull depends on the view direction, so reusing the quads requires the same forward vector
+	float flTolerance = cl_detail_leafcache_tolerance.GetFloat();
+	if ( bCacheValid && ( viewForward == pData->m_vecCachedViewForward ) &&
+		 ( viewOrigin.DistToSqr( pData->m_vecCachedViewOrigin ) <= flTolerance * flTolerance ) )
+	{
+		++m_SortStats.m_nCachedLeaves;
+		return pData->m_nCachedSortCount;
+	}
+
+	// part 1 - vertex math into the leaf's cached quads. Groups are not compacted, so
+	// the sort index of a sprite is its index in the leaf.
+	int nSIMDSprites = pData->m_nNumSIMDSprites;
+	FastSpriteX4_t const *pSprites = pData->m_pSprites;
+	FastSpriteQuadBuildoutBufferX4_t *pQuadBufferOut = pCachedQuads;
+	float *pDistances = m_pFastDistScratch;
+	uint8 *pPlaced = m_pFastPlacedScratch;
+
+	FourVectors vecViewPos;
+	vecViewPos.DuplicateVector( viewOrigin );
+	fltx4 maxsqdist = ReplicateX4( m_flCurMaxSqDist );
+
+	fltx4 falloffFactor = ReplicateX4( 1.0/ ( m_flCurMaxSqDist - m_flCurFadeSqDist ) );
+	fltx4 startFade = ReplicateX4( m_flCurFadeSqDist );
+
+	FourVectors vecUp;
+	vecUp.DuplicateVector(Vector(0,0,1) );
+	FourVectors vecFwd;
+	vecFwd.DuplicateVector( viewForward );
+
+	for ( int i = 0; i < nSIMDSprites; ++i, ++pSprites, ++pQuadBufferOut )
+	{
+		FourVectors ofs = pSprites->m_Pos;
+		ofs -= vecViewPos;
+		fltx4 ofsDotFwd = ofs * vecFwd;
+		fltx4 distanceSquared = ofs * ofs;
+		int nBfMask = TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );		//  cull
+
+		// 0 = culled, 1 = visible, 2 = visible and already placed by the incremental seed
+		uint8 nVisible = ( nBfMask != 0xf ) ? 1 : 0;
+		pPlaced[4 * i + 0] = pPlaced[4 * i + 1] = pPlaced[4 * i + 2] = pPlaced[4 * i + 3] = nVisible;
+		if ( !nVisible )
+			continue;
+
+		FourVectors dx1;
+		dx1.x = fnegate( ofs.y );
+		dx1.y = ( ofs.x );
+		dx1.z = Four_Zeros;
+		dx1.VectorNormalizeFast();
+
+		FourVectors vecDx = dx1;
+		FourVectors vecDy = vecUp;
+
+		FourVectors vecPos0 = pSprites->m_Pos;
+
+		vecDx *= pSprites->m_HalfWidth;
+		vecDy *= pSprites->m_Height;
+		fltx4 alpha = MulSIMD( falloffFactor, SubSIMD( distanceSquared, startFade ) );
+		alpha = SubSIMD( Four_Ones, MinSIMD( MaxSIMD( alpha, Four_Zeros), Four_Ones ) );
+
+		pQuadBufferOut->m_Alpha = AddSIMD( Four_MagicNumbers, 
+										   MulSIMD( Four_255s,alpha ) );
+
+		vecPos0 += vecDx;
+		pQuadBufferOut->m_Coords[0] = vecPos0;
+		vecPos0 -= vecDy;
+		pQuadBufferOut->m_Coords[1] = vecPos0;
+		vecPos0 -= vecDx;
+		vecPos0 -= vecDx;
+		pQuadBufferOut->m_Coords[2] = vecPos0;
+		vecPos0 += vecDy;
+		pQuadBufferOut->m_Coords[3] = vecPos0;
+
+		fltx4 fetch4 = *( ( fltx4 *) ( &pSprites->m_pSpriteDefs[0] ) );
+		*( (fltx4 *) ( & ( pQuadBufferOut->m_pSpriteDefs[0] ) ) ) = fetch4;
+
+		fetch4 = *( ( fltx4 *) ( &pSprites->m_RGBColor[0][0] ) );
+		*( (fltx4 *) ( & ( pQuadBufferOut->m_RGBColor[0][0] ) ) ) = fetch4;
+
+		StoreAlignedSIMD( pDistances + 4 * i, distanceSquared );
+	}
+
+	// part 2 - sort. Seed with last frame's order when the leaf is in the same distance bucket.
+	float flBucketSize = MAX( 1.0f, cl_detail_sort_bucket.GetFloat() );
+	int nBucket = (int)( FastSqrt( viewOrigin.DistToSqr( pData->m_vecSortCenter ) ) / flBucketSize );
+	bool bIncremental = bCacheValid && ( nBucket == pData->m_nDistanceBucket );
+
+	SortInfo_t *pOut = m_pFastSortInfo;
+	int nNumSprites = pData->m_nNumSprites;
+	int nCount = 0;
+	if ( bIncremental )
+	{
+		for ( int i = 0; i < pData->m_nCachedSortCount; ++i )
+		{
+			int nIndex = pCachedSortInfo[i].m_nIndex;
+			if ( pPlaced[nIndex] != 1 )
+				continue;
+			pPlaced[nIndex] = 2;
+			pOut[nCount].m_nIndex = nIndex;
+			pOut[nCount].m_flDistance = pDistances[nIndex];
+			++nCount;
+		}
+	}
+
+	// anything that just became visible goes on the end and gets sorted into place
+	for ( int i = 0; i < nNumSprites; ++i )
+	{
+		if ( pPlaced[i] != 1 )
+			continue;
+		pOut[nCount].m_nIndex = i;
+		pOut[nCount].m_flDistance = pDistances[i];
+		++nCount;
+	}
+
+	if ( nCount )
+	{
+		VPROF( "CDetailObjectSystem::SortSpritesBackToFront -- Sort" );
+		if ( bIncremental )
+		{
+			InsertionSortSprites( pOut, nCount );
+		}
+		else
+		{
+			std::make_heap( pOut, pOut + nCount, SortLessFunc ); 
+			std::sort_heap( pOut, pOut + nCount, SortLessFunc ); 
+		}
+		memcpy( pCachedSortInfo, pOut, nCount * sizeof( SortInfo_t ) );
+	}
+
+	if ( bIncremental )
+	{
+		++m_SortStats.m_nIncrementalLeaves;
+	}
+	else
+	{
+		++m_SortStats.m_nFullSortLeaves;
+	}
+
+	pData->m_vecCachedViewOrigin = viewOrigin;
+	pData->m_vecCachedViewForward = viewForward;
+	pData->m_flCachedMaxSqDist = m_flCurMaxSqDist;
+	pData->m_flCachedFadeSqDist = m_flCurFadeSqDist;
+	pData->m_nCachedSortCount = nCount;
+	pData->m_nDistanceBucket = nBucket;
+	pData->m_nCacheSerial = m_nFastCacheSerial;
+	return nCount;
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2294,9 +2620,9 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 			int nCount = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
 
 			// part 3 - stuff the sorted sprites into the vb
-			SortInfo_t const *pDraw = m_pFastSortInfo;
+			SortInfo_t const *pDraw = m_pCurFastSortInfo;
 			FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
-				( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
+				( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pCurBuildoutBuffer;
 
 			COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
 								 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
@@ -2375,6 +2701,13 @@ void CDetailObjectSystem::RenderTranslucentDetailObjects( const Vector &viewOrig
 	// We better not have any partially drawn leaf of detail sprites!
 	Assert( m_nSpriteCount == m_nFirstSprite );
 
+	if ( m_bRecordingBenchmark )
+	{
+		int i = m_BenchmarkPath.AddToTail();
+		m_BenchmarkPath[i].m_vecOrigin = viewOrigin;
+		m_BenchmarkPath[i].m_vecForward = viewForward;
+	}
+
 	// Here, we must draw all detail objects back-to-front
 	RenderFastSprites( viewOrigin, viewForward, viewRight, viewUp, nLeafCount, pLeafList );
 
@@ -2489,7 +2822,7 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		flMinDistance = vecDelta.LengthSqr();
 	}
 		
-	if ( m_pFastSortInfo[pData->m_nStartSpriteIndex].m_flDistance < flMinDistance )
+	if ( m_pCurFastSortInfo[pData->m_nStartSpriteIndex].m_flDistance < flMinDistance )
 		return;
 
 	int nCount = pData->m_nNumPendingSprites;
@@ -2528,10 +2861,10 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		
 	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
 
-	SortInfo_t const *pDraw = m_pFastSortInfo + pData->m_nStartSpriteIndex;
+	SortInfo_t const *pDraw = m_pCurFastSortInfo + pData->m_nStartSpriteIndex;
 
 	FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
-		( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
+		( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pCurBuildoutBuffer;
 	
 	while( nCount && ( pDraw->m_flDistance >= flMinDistance ) )
 	{
@@ -2588,7 +2921,7 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		}
 	}
 	pData->m_nNumPendingSprites = nCount;
-	pData->m_nStartSpriteIndex = pDraw - m_pFastSortInfo;
+	pData->m_nStartSpriteIndex = pDraw - m_pCurFastSortInfo;
 
 	meshBuilder.End();
 	pMesh->Draw();
@@ -2778,6 +3111,19 @@ void CDetailObjectSystem::BuildDetailObjectRenderLists( const Vector &vViewOrigi
 		}
 	}
 
+	ComputeFadeDistances();
+
+	ISpatialQuery* pQuery = engine->GetBSPTreeQuery();
+	pQuery->EnumerateLeavesInSphere( CurrentViewOrigin(), 
+									 cl_detaildist.GetFloat(), this, (int)&ctx );
+}
+
+
+//-----------------------------------------------------------------------------
+// Compute factors to optimize rendering of the detail models
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::ComputeFadeDistances()
+{
 	float factor = 1.0f;
 	C_BasePlayer *local = C_BasePlayer::GetLocalPlayer();
 	if ( local )
@@ -2785,7 +3131,6 @@ void CDetailObjectSystem::BuildDetailObjectRenderLists( const Vector &vViewOrigi
 		factor = local->GetFOVDistanceAdjustFactor();
 	}
 
-	// Compute factors to optimize rendering of the detail models
 	m_flCurMaxSqDist = cl_detaildist.GetFloat() * cl_detaildist.GetFloat();
 	m_flCurFadeSqDist = cl_detaildist.GetFloat() - cl_detailfade.GetFloat();
 
@@ -2802,10 +3147,110 @@ void CDetailObjectSystem::BuildDetailObjectRenderLists( const Vector &vViewOrigi
 	}
 	m_flCurFadeSqDist = MIN( m_flCurFadeSqDist, m_flCurMaxSqDist -1  );
 	m_flCurFalloffFactor = 255.0f / ( m_flCurMaxSqDist - m_flCurFadeSqDist );
+}
 
 
+//-----------------------------------------------------------------------------
+// Benchmark: record a camera path while playing, then replay it over the fast
+// sprites with and without the leaf cache. Only the buildout + sort is timed.
+//-----------------------------------------------------------------------------
+class CDetailBenchmarkLeafEnumerator : public ISpatialLeafEnumerator
+{
+public:
+	bool EnumerateLeaf( int leaf, int context )
+	{
+		m_Leaves.AddToTail( leaf );
+		return true;
+	}
+
+	CUtlVector<int> m_Leaves;
+};
+
+void CDetailObjectSystem::ToggleBenchmarkRecording()
+{
+	if ( m_bRecordingBenchmark )
+	{
+		m_bRecordingBenchmark = false;
+		Msg( "Recorded %d detail benchmark frames\n", m_BenchmarkPath.Count() );
+		return;
+	}
+
+	m_BenchmarkPath.RemoveAll();
+	m_bRecordingBenchmark = true;
+	Msg( "Recording detail benchmark camera path; run cl_detail_bench_record again to stop\n" );
+}
+
+void CDetailObjectSystem::RunBenchmark()
+{
+	int nFrames = m_BenchmarkPath.Count();
+	if ( !nFrames || !m_pFastSpriteData )
+	{
+		Msg( "Nothing to replay; record a camera path with cl_detail_bench_record on a map with detail sprites\n" );
+		return;
+	}
+
+	m_bRecordingBenchmark = false;
+	ComputeFadeDistances();
+
+	// Leaf enumeration isn't part of what we're measuring; gather it up front
+	CUtlVector<int> leafStart;
+	CDetailBenchmarkLeafEnumerator leafEnum;
 	ISpatialQuery* pQuery = engine->GetBSPTreeQuery();
-	pQuery->EnumerateLeavesInSphere( CurrentViewOrigin(), 
-									 cl_detaildist.GetFloat(), this, (int)&ctx );
+	for ( int i = 0; i < nFrames; ++i )
+	{
+		leafStart.AddToTail( leafEnum.m_Leaves.Count() );
+		pQuery->EnumerateLeavesInSphere( m_BenchmarkPath[i].m_vecOrigin, cl_detaildist.GetFloat(), &leafEnum, 0 );
+	}
+	leafStart.AddToTail( leafEnum.m_Leaves.Count() );
+
+	for ( int nPass = 0; nPass < 2; ++nPass )
+	{
+		m_bBenchmarkNoCache = ( nPass == 0 );
+		++m_nFastCacheSerial;
+		memset( &m_SortStats, 0, sizeof( m_SortStats ) );
+
+		int nSprites = 0;
+		CFastTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nFrames; ++i )
+		{
+			Vector vecRight, vecUp;
+			VectorVectors( m_BenchmarkPath[i].m_vecForward, vecRight, vecUp );
+			for ( int j = leafStart[i]; j < leafStart[i + 1]; ++j )
+			{
+				CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
+					ClientLeafSystem()->GetSubSystemDataInLeaf( leafEnum.m_Leaves[j], CLSUBSYSTEM_DETAILOBJECTS ) );
+				if ( pData )
+				{
+					nSprites += BuildOutSortedSprites( pData, m_BenchmarkPath[i].m_vecOrigin, 
+						m_BenchmarkPath[i].m_vecForward, vecRight, vecUp );
+				}
+			}
+		}
+		timer.End();
+
+		float flMS = timer.GetDuration().GetMillisecondsF();
+		Msg( "%s: %d frames, %.3f ms/frame, %d sprites/frame", m_bBenchmarkNoCache ? "uncached" : "leaf cache",
+			nFrames, flMS / nFrames, nSprites / nFrames );
+		if ( !m_bBenchmarkNoCache )
+		{
+			Msg( " (leaves: %d cached, %d incremental, %d full sort)", m_SortStats.m_nCachedLeaves,
+				m_SortStats.m_nIncrementalLeaves, m_SortStats.m_nFullSortLeaves );
+		}
+		Msg( "\n" );
+	}
+
+	m_bBenchmarkNoCache = false;
+	++m_nFastCacheSerial;
+	m_nSortedFastLeaf = -1;
 }
 
+CON_COMMAND_F( cl_detail_bench_record, "Start/stop recording the camera path replayed by cl_detail_bench", FCVAR_CHEAT )
+{
+	s_DetailObjectSystem.ToggleBenchmarkRecording();
+}
+
+CON_COMMAND_F( cl_detail_bench, "Replay the recorded camera path over the detail sprites and report ms per frame", FCVAR_CHEAT )
+{
+	s_DetailObjectSystem.RunBenchmark();
+}
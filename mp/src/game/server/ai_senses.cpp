@@ -35,6 +35,9 @@ const float AI_EFFICIENT_NPC_SEARCH_TIME = .35;
 const float AI_HIGH_PRIORITY_SEARCH_TIME = 0.15;
 const float AI_MISC_SEARCH_TIME  = 0.45;
 
+ConVar ai_sound_grid( "ai_sound_grid", "1", 0, "Use the sound grid to find the sounds near an NPC instead of walking the whole active sound list" );
+ConVar ai_sound_grid_verify( "ai_sound_grid_verify", "0", FCVAR_CHEAT, "Check that the sound grid finds every sound in range of a listening NPC" );
+
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
@@ -118,7 +121,33 @@ void CAI_Senses::Listen( void )
 
 	int iSoundMask = GetOuter()->GetSoundInterests();
 	
-	if ( iSoundMask != SOUND_NONE && !(GetOuter()->HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) )
+	if ( iSoundMask != SOUND_NONE && !(GetOuter()->HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) && ai_sound_grid.GetBool() )
+	{
+		// The grid returns a superset of the sounds in range, in active list
+		// order, so CanHearSound() sees the same sounds in the same order as
+		// the walk below and the audible list comes out identical.
+		int sounds[ MAX_WORLD_SOUNDS_MP ];
+		Vector vecEar = GetOuter()->EarPosition();
+		float flSensitivity = GetOuter()->HearingSensitivity();
+		int nSounds = CSoundEnt::GetAudibleSounds( vecEar, flSensitivity, iSoundMask, sounds, ARRAYSIZE( sounds ) );
+
+		if ( ai_sound_grid_verify.GetBool() )
+		{
+			VerifyAudibleSounds( vecEar, flSensitivity, iSoundMask, sounds, nSounds );
+		}
+
+		for ( int i = 0; i < nSounds; i++ )
+		{
+			CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( sounds[i] );
+
+			if ( pCurrentSound && CanHearSound( pCurrentSound ) )
+			{
+				pCurrentSound->m_iNextAudible = m_iAudibleList;
+				m_iAudibleList = sounds[i];
+			}
+		}
+	}
+	else if ( iSoundMask != SOUND_NONE && !(GetOuter()->HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) )
 	{
 		int	iSound = CSoundEnt::ActiveList();
 		
@@ -140,6 +169,96 @@ void CAI_Senses::Listen( void )
 	GetOuter()->OnListened();
 }
 
+//-----------------------------------------------------------------------------
+// Walks the active list the slow way and reports any sound in range that the
+// sound grid didn't return
+
+void CAI_Senses::VerifyAudibleSounds( const Vector &vecEar, float flSensitivity, int iSoundMask, const int *pSounds, int nSounds )
+{
+	int	iSound = CSoundEnt::ActiveList();
+
+	while ( iSound != SOUNDLIST_EMPTY )
+	{
+		CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
+		if ( !pCurrentSound )
+			break;
+
+		float flHearDistanceSq = pCurrentSound->Volume() * flSensitivity;
+		flHearDistanceSq *= flHearDistanceSq;
+		if ( (iSoundMask & pCurrentSound->SoundType()) && pCurrentSound->GetSoundOrigin().DistToSqr( vecEar ) <= flHearDistanceSq )
+		{
+			int i;
+			for ( i = 0; i < nSounds && pSounds[i] != iSound; i++ )
+				;
+
+			if ( i == nSounds )
+			{
+				Warning( "Sound grid missed sound %d (type %x, volume %d) for %s\n", iSound, pCurrentSound->SoundType(), pCurrentSound->Volume(), GetOuter()->GetDebugName() );
+			}
+		}
+
+		iSound = pCurrentSound->NextSound();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND_F( ai_sound_grid_bench, "Times finding the sounds near each NPC with and without the sound grid. Arguments: [iterations]", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 1000;
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	int nAIs = g_AI_Manager.NumAIs();
+	if ( !nAIs )
+	{
+		Msg( "No NPCs\n" );
+		return;
+	}
+
+	int nWalkFound = 0;
+	double flStart = Plat_FloatTime();
+	for ( int n = 0; n < nIterations; n++ )
+	{
+		for ( int i = 0; i < nAIs; i++ )
+		{
+			int iSoundMask = ppAIs[i]->GetSoundInterests();
+			Vector vecEar = ppAIs[i]->EarPosition();
+			float flSensitivity = ppAIs[i]->HearingSensitivity();
+
+			for ( int iSound = CSoundEnt::ActiveList(); iSound != SOUNDLIST_EMPTY; )
+			{
+				CSound *pSound = CSoundEnt::SoundPointerForIndex( iSound );
+				float flHearDistanceSq = pSound->Volume() * flSensitivity;
+				flHearDistanceSq *= flHearDistanceSq;
+				if ( (iSoundMask & pSound->SoundType()) && pSound->GetSoundOrigin().DistToSqr( vecEar ) <= flHearDistanceSq )
+				{
+					nWalkFound++;
+				}
+				iSound = pSound->NextSound();
+			}
+		}
+	}
+	double flWalk = Plat_FloatTime() - flStart;
+
+	int nGridFound = 0;
+	int sounds[ MAX_WORLD_SOUNDS_MP ];
+	flStart = Plat_FloatTime();
+	for ( int n = 0; n < nIterations; n++ )
+	{
+		for ( int i = 0; i < nAIs; i++ )
+		{
+			nGridFound += CSoundEnt::GetAudibleSounds( ppAIs[i]->EarPosition(), ppAIs[i]->HearingSensitivity(), ppAIs[i]->GetSoundInterests(), sounds, ARRAYSIZE( sounds ) );
+		}
+	}
+	double flGrid = Plat_FloatTime() - flStart;
+
+	int nQueries = nIterations * nAIs;
+	Msg( "%d NPCs, %d iterations\n", nAIs, nIterations );
+	Msg( "  active list walk: %.3f us per NPC, %.2f sounds in range\n", flWalk * 1e6 / nQueries, (float)nWalkFound / nQueries );
+	Msg( "  sound grid:       %.3f us per NPC, %.2f candidates\n", flGrid * 1e6 / nQueries, (float)nGridFound / nQueries );
+	CSoundEnt::ReportSoundGridStats();
+}
+
 //-----------------------------------------------------------------------------
 
 bool CAI_Senses::ShouldSeeEntity( CBaseEntity *pSightEnt )
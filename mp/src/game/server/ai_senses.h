@@ -120,6 +120,8 @@ private:
 	int 			LookForObjects( int iDistance );
 	
 	bool			SeeEntity( CBaseEntity *pEntity );
+
+	void			VerifyAudibleSounds( const Vector &vecEar, float flSensitivity, int iSoundMask, const int *pSounds, int nSounds );
 	
 	float			m_LookDist;				// distance npc sees (Default 2048)
 	float			m_LastLookDist;
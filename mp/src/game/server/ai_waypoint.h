@@ -13,6 +13,7 @@
 #endif
 
 #include <mempool.h>
+#include "tier1/smallobjectallocator.h"
 
 // ----------------------------------------------------------------------------
 // Forward declarations
@@ -144,7 +145,7 @@ private:
 	AI_Waypoint_t *pNext;
 	AI_Waypoint_t *pPrev;
 
-	DECLARE_FIXEDSIZE_ALLOCATOR(AI_Waypoint_t);
+	DECLARE_SMALLOBJECT_ALLOCATOR(AI_Waypoint_t);
 
 public:
 	DECLARE_SIMPLE_DATADESC();
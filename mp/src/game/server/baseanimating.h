@@ -21,6 +21,7 @@ struct animevent_t;
 struct matrix3x4_t;
 class CIKContext;
 class KeyValues;
+class CHitboxBVH;
 FORWARD_DECLARE_HANDLE( memhandle_t );
 
 #define	BCF_NO_ANIMATION_SKIP	( 1 << 0 )	// Do not allow PVS animation skipping (mostly for attachments being critical to an entity)
@@ -407,6 +408,7 @@ private:
 
 	memhandle_t		m_boneCacheHandle;
 	unsigned short	m_fBoneCacheFlags;		// Used for bone cache state on model
+	CHitboxBVH		*m_pHitboxBVH;			// Made by the first hitbox trace
 
 protected:
 	CNetworkVar( float, m_fadeMinDist );	// Point at which fading is absolute
@@ -62,6 +62,7 @@
 #include "env_debughistory.h"
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
+#include "player_parallelmove.h"
 
 #if defined( TF_DLL )
 #include "tf_gamerules.h"
@@ -3434,6 +3435,22 @@ void CBaseEntity::SetMoveType( MoveType_t val, MoveCollide_t moveCollide )
 	m_MoveType = val;
 	m_MoveCollide = moveCollide;
 
+	// Player movement running on a worker thread; the rest touches shared state
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->ApplyMoveType( this );
+		return;
+	}
+
+	ApplyMoveType();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Updates collision rules and simulation flags for the current move type
+//-----------------------------------------------------------------------------
+void CBaseEntity::ApplyMoveType( void )
+{
 	CollisionRulesChanged();
 
 	switch( m_MoveType )
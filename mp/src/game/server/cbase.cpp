@@ -184,28 +184,7 @@ CEventAction::CEventAction( const char *ActionData )
 }
 
 
-// this memory pool stores blocks around the size of CEventAction/inputitem_t structs
-// can be used for other blocks; will error if to big a block is tried to be allocated
-CUtlMemoryPool g_EntityListPool( MAX(sizeof(CEventAction),sizeof(CMultiInputVar::inputitem_t)), 512, CUtlMemoryPool::GROW_FAST, "g_EntityListPool" );
-
-#include "tier0/memdbgoff.h"
-
-void *CEventAction::operator new( size_t stAllocateBlock )
-{
-	return g_EntityListPool.Alloc( stAllocateBlock );
-}
-
-void *CEventAction::operator new( size_t stAllocateBlock, int nBlockUse, const char *pFileName, int nLine )
-{
-	return g_EntityListPool.Alloc( stAllocateBlock );
-}
-
-void CEventAction::operator delete( void *pMem )
-{
-	g_EntityListPool.Free( pMem );
-}
-
-#include "tier0/memdbgon.h"
+DEFINE_SMALLOBJECT_ALLOCATOR( CEventAction );
 
 //-----------------------------------------------------------------------------
 // Purpose: Returns the highest-valued delay in our list of event actions.
@@ -599,30 +578,7 @@ void CMultiInputVar::AddValue( variant_t newVal, int outputID )
 }
 
 
-#include "tier0/memdbgoff.h"
-
-//-----------------------------------------------------------------------------
-// Purpose: allocates memory from the entitylist pool
-//-----------------------------------------------------------------------------
-void *CMultiInputVar::inputitem_t::operator new( size_t stAllocateBlock )
-{
-	return g_EntityListPool.Alloc( stAllocateBlock );
-}
-
-void *CMultiInputVar::inputitem_t::operator new( size_t stAllocateBlock, int nBlockUse, const char *pFileName, int nLine )
-{
-	return g_EntityListPool.Alloc( stAllocateBlock );
-}
-
-//-----------------------------------------------------------------------------
-// Purpose: frees memory from the entitylist pool
-//-----------------------------------------------------------------------------
-void CMultiInputVar::inputitem_t::operator delete( void *pMem )
-{
-	g_EntityListPool.Free( pMem );
-}
-
-#include "tier0/memdbgon.h"
+DEFINE_SMALLOBJECT_ALLOCATOR( CMultiInputVar::inputitem_t );
 
 
 //-----------------------------------------------------------------------------
@@ -630,7 +586,7 @@ void CMultiInputVar::inputitem_t::operator delete( void *pMem )
 //
 // Purpose: holds and executes a global prioritized queue of entity actions
 //-----------------------------------------------------------------------------
-DEFINE_FIXEDSIZE_ALLOCATOR( EventQueuePrioritizedEvent_t, 128, CUtlMemoryPool::GROW_SLOW );
+DEFINE_SMALLOBJECT_ALLOCATOR( EventQueuePrioritizedEvent_t );
 
 CEventQueue g_EventQueue;
 
@@ -133,6 +133,39 @@ struct simthinkentry_t
 	unsigned short	unused0;
 	int				nextThinkTick;
 };
+
+// Entries are also kept in a two level timing wheel keyed by nextThinkTick, so
+// each tick only visits the entries that came due instead of the whole list.
+// Level 0 has a bucket per tick for the next 256 ticks, level 1 a bucket per
+// 256 ticks for the next 16384, and anything later waits in the far list.
+// Entries that are due (including everything that simulates, which has a
+// nextThinkTick of 0) stay in the due list until they are rescheduled.
+#define SIMTHINK_WHEEL_BITS			8
+#define SIMTHINK_WHEEL_SIZE			(1 << SIMTHINK_WHEEL_BITS)
+#define SIMTHINK_WHEEL_LEVEL1_BITS	6
+#define SIMTHINK_WHEEL_LEVEL1_SIZE	(1 << SIMTHINK_WHEEL_LEVEL1_BITS)
+#define SIMTHINK_WHEEL_SPAN			(SIMTHINK_WHEEL_SIZE * SIMTHINK_WHEEL_LEVEL1_SIZE)
+
+enum
+{
+	SIMTHINK_LIST_LEVEL1 = SIMTHINK_WHEEL_SIZE,
+	SIMTHINK_LIST_FAR = SIMTHINK_LIST_LEVEL1 + SIMTHINK_WHEEL_LEVEL1_SIZE,
+	SIMTHINK_LIST_DUE,
+	SIMTHINK_LIST_COUNT,
+
+	SIMTHINK_LIST_NONE = -1,
+};
+
+struct simthinkwheelnode_t
+{
+	unsigned short	next;
+	unsigned short	prev;
+	short			list;
+};
+
+ConVar sv_thinkwheel( "sv_thinkwheel", "1", 0, "Find the entities due to think with a timing wheel instead of scanning the whole sim/think list" );
+ConVar sv_thinkwheel_verify( "sv_thinkwheel_verify", "0", FCVAR_CHEAT, "Checks the timing wheel against a full scan of the sim/think list every tick" );
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -146,7 +179,14 @@ public:
 		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_wheelNodes[i].list = SIMTHINK_LIST_NONE;
 		}
+		for ( int i = 0; i < SIMTHINK_LIST_COUNT; i++ )
+		{
+			m_wheelHeads[i] = 0xFFFF;
+		}
+		m_wheelTick = 0;
+		ClearStats();
 	}
 	void LevelInitPreEntity()
 	{
@@ -177,6 +217,7 @@ public:
 			Assert(m_simThinkList[listHandle].entEntry == index);
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
+			WheelUnlink( index );
 			
 			// fast remove shifted someone, update that someone
 			if ( listHandle < m_simThinkList.Count() )
@@ -191,6 +232,28 @@ public:
 	}
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
+	{
+		if ( !sv_thinkwheel.GetBool() )
+			return ListCopyScan( pList, listMax );
+
+		int out = ListCopyWheel( pList, listMax );
+
+		if ( sv_thinkwheel_verify.GetBool() )
+		{
+			CBaseEntity **pScan = (CBaseEntity **)stackalloc( sizeof(CBaseEntity *) * MAX( listMax, 1 ) );
+			int scanCount = ListCopyScan( pScan, listMax );
+			if ( scanCount != out || V_memcmp( pScan, pList, out * sizeof(CBaseEntity *) ) )
+			{
+				Warning( "sv_thinkwheel_verify: tick %d, wheel found %d entities, scan found %d\n", gpGlobals->tickcount, out, scanCount );
+			}
+			stackfree( pScan );
+		}
+
+		return out;
+	}
+
+	// The original scan over the whole list
+	int ListCopyScan( CBaseEntity *pList[], int listMax )
 	{
 		int count = MIN(listMax, ListCount());
 		int out = 0;
@@ -212,6 +275,49 @@ public:
 		return out;
 	}
 
+	int ListCopyWheel( CBaseEntity *pList[], int listMax )
+	{
+		bool bNewTick = ( gpGlobals->tickcount != m_wheelTick );
+		int visited = WheelAdvance( gpGlobals->tickcount );
+
+		// Copy out in list order, the same order a scan of the list would use
+		m_dueSort.RemoveAll();
+		for ( unsigned short index = m_wheelHeads[SIMTHINK_LIST_DUE]; index != 0xFFFF; index = m_wheelNodes[index].next )
+		{
+			if ( m_entinfoIndex[index] < listMax )
+			{
+				m_dueSort.AddToTail( m_entinfoIndex[index] );
+			}
+		}
+		visited += m_dueSort.Count();
+
+		if ( m_dueSort.Count() > 1 )
+		{
+			qsort( m_dueSort.Base(), m_dueSort.Count(), sizeof(unsigned short), CompareListHandles );
+		}
+
+		int out = 0;
+		for ( int i = 0; i < m_dueSort.Count(); i++ )
+		{
+			const simthinkentry_t &entry = m_simThinkList[m_dueSort[i]];
+			Assert( entry.nextThinkTick <= gpGlobals->tickcount );
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert( gEntList.IsEntityPtr( pList[out] ) );
+			out++;
+		}
+
+		if ( bNewTick )
+		{
+			m_statTicks++;
+			m_statListed += ListCount();
+			m_statDue += out;
+			m_statVisited += visited;
+		}
+
+		return out;
+	}
+
 	void EntityChanged( CBaseEntity *pEntity )
 	{
 		// might change after deletion, don't put back into the list
@@ -255,12 +361,164 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			WheelUnlink( index );
+			WheelInsert( index, m_wheelTick + 1 );
+		}
+	}
+
+	void ReportStats()
+	{
+		if ( !m_statTicks )
+		{
+			Msg( "No ticks since the last report\n" );
+			return;
 		}
+
+		float flTicks = (float)m_statTicks;
+		Msg( "Sim/think list over %d ticks, per tick:\n", m_statTicks );
+		Msg( "  %.1f entities in the list (visited by a full scan)\n", m_statListed / flTicks );
+		Msg( "  %.1f entities due\n", m_statDue / flTicks );
+		Msg( "  %.1f entries visited by the timing wheel\n", m_statVisited / flTicks );
+		ClearStats();
 	}
 
 private:
+	static int __cdecl CompareListHandles( const void *a, const void *b )
+	{
+		return (int)*(const unsigned short *)a - (int)*(const unsigned short *)b;
+	}
+
+	void WheelLink( int index, int list )
+	{
+		simthinkwheelnode_t &node = m_wheelNodes[index];
+		node.list = list;
+		node.prev = 0xFFFF;
+		node.next = m_wheelHeads[list];
+		if ( node.next != 0xFFFF )
+		{
+			m_wheelNodes[node.next].prev = index;
+		}
+		m_wheelHeads[list] = index;
+	}
+
+	void WheelUnlink( int index )
+	{
+		simthinkwheelnode_t &node = m_wheelNodes[index];
+		if ( node.list == SIMTHINK_LIST_NONE )
+			return;
+
+		if ( node.prev != 0xFFFF )
+		{
+			m_wheelNodes[node.prev].next = node.next;
+		}
+		else
+		{
+			m_wheelHeads[node.list] = node.next;
+		}
+		if ( node.next != 0xFFFF )
+		{
+			m_wheelNodes[node.next].prev = node.prev;
+		}
+		node.list = SIMTHINK_LIST_NONE;
+	}
+
+	// Files an entry relative to baseTick, the next tick the wheel will visit
+	void WheelInsert( int index, int baseTick )
+	{
+		int tick = m_simThinkList[m_entinfoIndex[index]].nextThinkTick;
+		int delta = tick - baseTick;
+		if ( delta < 0 )
+		{
+			WheelLink( index, SIMTHINK_LIST_DUE );
+		}
+		else if ( delta < SIMTHINK_WHEEL_SIZE )
+		{
+			WheelLink( index, tick & ( SIMTHINK_WHEEL_SIZE - 1 ) );
+		}
+		else if ( delta < SIMTHINK_WHEEL_SPAN )
+		{
+			WheelLink( index, SIMTHINK_LIST_LEVEL1 + ( ( tick >> SIMTHINK_WHEEL_BITS ) & ( SIMTHINK_WHEEL_LEVEL1_SIZE - 1 ) ) );
+		}
+		else
+		{
+			WheelLink( index, SIMTHINK_LIST_FAR );
+		}
+	}
+
+	// Refiles every entry of a list; returns how many there were
+	int WheelRefile( int list, int baseTick )
+	{
+		int count = 0;
+		unsigned short index = m_wheelHeads[list];
+		m_wheelHeads[list] = 0xFFFF;
+		while ( index != 0xFFFF )
+		{
+			unsigned short next = m_wheelNodes[index].next;
+			WheelInsert( index, baseTick );
+			index = next;
+			count++;
+		}
+		return count;
+	}
+
+	// Moves the wheel forward to tick, moving entries that come due to the
+	// due list; returns how many entries it touched
+	int WheelAdvance( int tick )
+	{
+		if ( tick == m_wheelTick )
+			return 0;
+
+		int visited = 0;
+		if ( tick < m_wheelTick || tick - m_wheelTick > SIMTHINK_WHEEL_SPAN )
+		{
+			// Time went backwards (a restore) or jumped; refile everything
+			m_wheelTick = tick;
+			for ( int list = 0; list < SIMTHINK_LIST_COUNT; list++ )
+			{
+				visited += WheelRefile( list, tick + 1 );
+			}
+			return visited;
+		}
+
+		while ( m_wheelTick < tick )
+		{
+			int t = ++m_wheelTick;
+			if ( !( t & ( SIMTHINK_WHEEL_SIZE - 1 ) ) )
+			{
+				if ( !( t & ( SIMTHINK_WHEEL_SPAN - 1 ) ) )
+				{
+					visited += WheelRefile( SIMTHINK_LIST_FAR, t );
+				}
+				visited += WheelRefile( SIMTHINK_LIST_LEVEL1 + ( ( t >> SIMTHINK_WHEEL_BITS ) & ( SIMTHINK_WHEEL_LEVEL1_SIZE - 1 ) ), t );
+			}
+
+			// Everything in this tick's bucket is due now
+			visited += WheelRefile( t & ( SIMTHINK_WHEEL_SIZE - 1 ), t + 1 );
+		}
+		return visited;
+	}
+
+	void ClearStats()
+	{
+		m_statTicks = 0;
+		m_statListed = 0;
+		m_statDue = 0;
+		m_statVisited = 0;
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	simthinkwheelnode_t m_wheelNodes[NUM_ENT_ENTRIES];
+	unsigned short m_wheelHeads[SIMTHINK_LIST_COUNT];
+	int m_wheelTick;						// Last tick the wheel visited
+	CUtlVector<unsigned short> m_dueSort;
+
+	int m_statTicks;
+	int m_statListed;
+	int m_statDue;
+	int m_statVisited;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -1634,3 +1892,11 @@ CON_COMMAND(report_simthinklist, "Lists all simulating/thinking entities")
 	list.ReportEntityList();
 }
 
+CON_COMMAND(report_simthinkstats, "Reports how many simulating/thinking entities were due per tick versus how many were in the list")
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_SimThinkManager.ReportStats();
+}
+
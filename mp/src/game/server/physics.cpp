@@ -45,6 +45,7 @@
 #include "positionwatcher.h"
 #include "tier1/callqueue.h"
 #include "vphysics/constraints.h"
+#include "physics_lod.h"
 
 #ifdef PORTAL
 #include "portal_physics_collisionevent.h"
@@ -282,6 +283,7 @@ void CPhysicsHook::LevelShutdownPostEntity()
 	g_pPhysSaveRestoreManager->ForgetAllModels();
 
 	g_Collisions.LevelShutdown();
+	PhysicsLOD()->LevelShutdown();
 
 	physics->DestroyEnvironment( physenv );
 	physenv = NULL;
@@ -444,11 +446,15 @@ static bool WheelCollidesWith( IPhysicsObject *pObj, CBaseEntity *pEntity )
 	return false;
 }
 
+static ConVar phys_collision_event_dedupe( "phys_collision_event_dedupe", "1", 0, "Drop repeated touch events and merge repeated damage events between the same objects within a frame." );
+
 CCollisionEvent::CCollisionEvent()
 {
 	m_inCallback = 0;
 	m_bBufferTouchEvents = false;
 	m_lastTickFrictionError = 0;
+	m_iDamageEventDispatch = -1;
+	ResetEventStats();
 }
 
 int CCollisionEvent::ShouldCollide( IPhysicsObject *pObj0, IPhysicsObject *pObj1, void *pGameData0, void *pGameData1 )
@@ -998,6 +1004,7 @@ int CCollisionEvent::ShouldSolvePenetration( IPhysicsObject *pObj0, IPhysicsObje
 			return false;
 		}
 	}
+	m_eventCounts[COLLISION_EVENT_PENETRATE]++;
 	penetrateevent_t &event = FindOrAddPenetrateEvent( pEntity0, pEntity1 );
 	float eventTime = gpGlobals->curtime - event.startTime;
 	 
@@ -1709,7 +1716,9 @@ void PhysFrame( float deltaTime )
 	g_Collisions.BufferTouchEvents( true );
 #endif
 
+	float flSimStart = engine->Time();
 	physenv->Simulate( deltaTime );
+	float flSimTime = engine->Time() - flSimStart;
 
 	int activeCount = physenv->GetActiveObjectCount();
 	IPhysicsObject **pActiveList = NULL;
@@ -1730,6 +1739,8 @@ void PhysFrame( float deltaTime )
 				pEntity->VPhysicsUpdate( pActiveList[i] );
 			}
 		}
+
+		PhysicsLOD()->Update( pActiveList, activeCount, flSimTime );
 		stackfree( pActiveList );
 	}
 
@@ -1859,6 +1870,7 @@ void CCollisionEvent::PreCollision( vcollisionevent_t *pEvent )
 void CCollisionEvent::PostCollision( vcollisionevent_t *pEvent )
 {
 	CallbackContext check(this);
+	m_eventCounts[COLLISION_EVENT_COLLISION]++;
 	bool isShadow[2] = {false,false};
 	int i;
 
@@ -1938,6 +1950,8 @@ void PhysForceEntityToSleep( CBaseEntity *pEntity, IPhysicsObject *pObject )
 void CCollisionEvent::Friction( IPhysicsObject *pObject, float energy, int surfaceProps, int surfacePropsHit, IPhysicsCollisionData *pData )
 {
 	CallbackContext check(this);
+	m_eventCounts[COLLISION_EVENT_FRICTION]++;
+
 	//Get our friction information
 	Vector vecPos, vecVel;
 	pData->GetContactPoint( vecPos );
@@ -2030,6 +2044,8 @@ void CCollisionEvent::FlushQueuedOperations()
 
 void CCollisionEvent::FrameUpdate( void )
 {
+	m_eventFrames++;
+
 	UpdateFrictionSounds();
 	UpdateTouchEvents();
 	UpdatePenetrateEvents();
@@ -2042,6 +2058,49 @@ void CCollisionEvent::FrameUpdate( void )
 	FlushQueuedOperations();
 }
 
+void CCollisionEvent::ReportEventStats()
+{
+	static const char *s_pEventNames[COLLISION_EVENT_TYPE_COUNT] =
+	{
+		"collision",
+		"friction",
+		"touch start",
+		"touch end",
+		"trigger",
+		"damage",
+		"penetrate",
+		"remove",
+	};
+
+	Msg( "Physics collision events over %d frames (dedupe %s):\n", m_eventFrames, phys_collision_event_dedupe.GetBool() ? "on" : "off" );
+	Msg( "  %-12s %10s %10s %10s\n", "event", "count", "merged", "per frame" );
+	for ( int i = 0; i < COLLISION_EVENT_TYPE_COUNT; i++ )
+	{
+		Msg( "  %-12s %10d %10d %10.2f\n", s_pEventNames[i], m_eventCounts[i], m_mergedEventCounts[i],
+			m_eventFrames ? (float)m_eventCounts[i] / m_eventFrames : 0.0f );
+	}
+}
+
+void CCollisionEvent::ResetEventStats()
+{
+	memset( m_eventCounts, 0, sizeof(m_eventCounts) );
+	memset( m_mergedEventCounts, 0, sizeof(m_mergedEventCounts) );
+	m_eventFrames = 0;
+}
+
+CON_COMMAND( phys_collision_event_stats, "Print how many of each kind of physics collision event were handled. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_Collisions.ReportEventStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_Collisions.ResetEventStats();
+	}
+}
+
 // the delete list is getting flushed, clean up ours
 void PhysOnCleanupDeleteList()
 {
@@ -2121,6 +2180,9 @@ void CCollisionEvent::UpdateTouchEvents( void )
 	// Turn on buffering in case new touch events occur during processing
 	bool bOldTouchEvents = m_bBufferTouchEvents;
 	m_bBufferTouchEvents = true;
+
+	// Events queued while dispatching these are only checked against each other
+	m_touchEventPairs.RemoveAll();
 	for ( i = 0; i < m_touchEvents.Count(); i++ )
 	{
 		const touchevent_t &event = m_touchEvents[i];
@@ -2135,6 +2197,7 @@ void CCollisionEvent::UpdateTouchEvents( void )
 		}
 	}
 	m_touchEvents.RemoveAll();
+	m_touchEventPairs.RemoveAll();
 
 	for ( i = 0; i < m_triggerEvents.Count(); i++ )
 	{
@@ -2157,6 +2220,8 @@ void CCollisionEvent::UpdateDamageEvents( void )
 {
 	for ( int i = 0; i < m_damageEvents.Count(); i++ )
 	{
+		// Damage queued by this event's callbacks must not merge into it
+		m_iDamageEventDispatch = i;
 		damageevent_t &event = m_damageEvents[i];
 
 		// Track changes in the entity's life state
@@ -2192,8 +2257,11 @@ void CCollisionEvent::UpdateDamageEvents( void )
 			RestoreDamageInflictorState( event.pInflictorPhysics );
 		}
 	}
+	m_iDamageEventDispatch = -1;
 	m_damageEvents.RemoveAll();
+	m_damageEventPairs.RemoveAll();
 	m_damageInflictors.RemoveAll();
+	m_damageInflictorIndex.RemoveAll();
 }
 
 void CCollisionEvent::RestoreDamageInflictorState( int inflictorStateIndex, float velocityBlend )
@@ -2277,7 +2345,35 @@ void CCollisionEvent::AddTouchEvent( CBaseEntity *pEntity0, CBaseEntity *pEntity
 	if ( !pEntity0 || !pEntity1 )
 		return;
 
+	UtlHashHandle_t hPair = m_touchEventPairs.InvalidHandle();
+	if ( phys_collision_event_dedupe.GetBool() )
+	{
+		// Touches link both entities, so the pair is unordered
+		collisioneventpair_t pair;
+		pair.pObject0 = MIN( pEntity0, pEntity1 );
+		pair.pObject1 = MAX( pEntity0, pEntity1 );
+
+		// Another start after a start (or end after an end) has nothing left to do
+		// but run the touch functions again
+		hPair = m_touchEventPairs.Find( pair );
+		if ( hPair != m_touchEventPairs.InvalidHandle() && m_touchEvents[ m_touchEventPairs[hPair] ].touchType == touchType )
+		{
+			m_mergedEventCounts[ touchType == TOUCH_START ? COLLISION_EVENT_TOUCH_START : COLLISION_EVENT_TOUCH_END ]++;
+			return;
+		}
+
+		if ( hPair == m_touchEventPairs.InvalidHandle() )
+		{
+			hPair = m_touchEventPairs.Insert( pair, 0 );
+		}
+	}
+
 	int index = m_touchEvents.AddToTail();
+	if ( hPair != m_touchEventPairs.InvalidHandle() )
+	{
+		m_touchEventPairs[hPair] = index;
+	}
+
 	touchevent_t &event = m_touchEvents[index];
 	event.pEntity0 = pEntity0;
 	event.pEntity1 = pEntity1;
@@ -2286,27 +2382,74 @@ void CCollisionEvent::AddTouchEvent( CBaseEntity *pEntity0, CBaseEntity *pEntity
 	event.normal = normal;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Folds damage into an event still waiting to be delivered for the
+//			same entity and inflictor. The damage adds up and the harder hit
+//			supplies the force and position.
+// Output : False if there was no such event and a new one is needed
+//-----------------------------------------------------------------------------
+bool CCollisionEvent::MergeDamageEvent( CBaseEntity *pEntity, const CTakeDamageInfo &info, IPhysicsObject *pInflictorPhysics, bool bRestoreVelocity )
+{
+	if ( !pInflictorPhysics || !phys_collision_event_dedupe.GetBool() )
+		return false;
+
+	collisioneventpair_t pair;
+	pair.pObject0 = pEntity;
+	pair.pObject1 = pInflictorPhysics;
+	UtlHashHandle_t hPair = m_damageEventPairs.Find( pair );
+	if ( hPair == m_damageEventPairs.InvalidHandle() )
+	{
+		m_damageEventPairs.Insert( pair, m_damageEvents.Count() );
+		return false;
+	}
+
+	int iEvent = m_damageEventPairs[hPair];
+	damageevent_t &event = m_damageEvents[iEvent];
+	if ( iEvent <= m_iDamageEventDispatch || event.info.GetDamageType() != info.GetDamageType() || event.bRestoreVelocity != bRestoreVelocity )
+	{
+		// Already delivered or not the same kind of hit, later ones merge into the new event
+		m_damageEventPairs[hPair] = m_damageEvents.Count();
+		return false;
+	}
+
+	event.info.AddDamage( info.GetDamage() );
+	if ( info.GetDamageForce().LengthSqr() > event.info.GetDamageForce().LengthSqr() )
+	{
+		event.info.SetDamageForce( info.GetDamageForce() );
+		event.info.SetDamagePosition( info.GetDamagePosition() );
+	}
+	m_mergedEventCounts[COLLISION_EVENT_DAMAGE]++;
+	return true;
+}
+
 void CCollisionEvent::AddDamageEvent( CBaseEntity *pEntity, const CTakeDamageInfo &info, IPhysicsObject *pInflictorPhysics, bool bRestoreVelocity, const Vector &savedVel, const AngularImpulse &savedAngVel )
 {
 	if ( pEntity->IsMarkedForDeletion() )
 		return;
 
+	m_eventCounts[COLLISION_EVENT_DAMAGE]++;
+
 	int iTimeBasedDamage = g_pGameRules->Damage_GetTimeBased();
 	if ( !( info.GetDamageType() & (DMG_BURN | DMG_DROWN | iTimeBasedDamage | DMG_PREVENT_PHYSICS_FORCE) ) )
 	{
 		Assert( info.GetDamageForce() != vec3_origin && info.GetDamagePosition() != vec3_origin );
 	}
 
+	if ( !pInflictorPhysics || !pInflictorPhysics->IsMoveable() )
+	{
+		bRestoreVelocity = false;
+	}
+
+	// The inflictor's saved state was recorded with the first event
+	if ( MergeDamageEvent( pEntity, info, pInflictorPhysics, bRestoreVelocity ) )
+		return;
+
 	int index = m_damageEvents.AddToTail();
 	damageevent_t &event = m_damageEvents[index];
 	event.pEntity = pEntity;
 	event.info = info;
 	event.pInflictorPhysics = pInflictorPhysics;
 	event.bRestoreVelocity = bRestoreVelocity;
-	if ( !pInflictorPhysics || !pInflictorPhysics->IsMoveable() )
-	{
-		event.bRestoreVelocity = false;
-	}
 
 	if ( event.bRestoreVelocity )
 	{
@@ -2348,18 +2491,16 @@ void CCollisionEvent::AddRemoveObject(IServerNetworkable *pRemove)
 {
 	if ( pRemove && m_removeObjects.Find(pRemove) == -1 )
 	{
+		m_eventCounts[COLLISION_EVENT_REMOVE]++;
 		m_removeObjects.AddToTail(pRemove);
 	}
 }
 int CCollisionEvent::FindDamageInflictor( IPhysicsObject *pInflictorPhysics )
 {
-	// UNDONE: Linear search?  Probably ok with a low count here
-	for ( int i = m_damageInflictors.Count()-1; i >= 0; --i )
-	{
-		const inflictorstate_t &state = m_damageInflictors[i];
-		if ( state.pInflictorPhysics == pInflictorPhysics )
-			return i;
-	}
+	// Big pileups can queue thousands of these a frame, so they're indexed
+	UtlHashHandle_t hIndex = m_damageInflictorIndex.Find( pInflictorPhysics );
+	if ( hIndex != m_damageInflictorIndex.InvalidHandle() )
+		return m_damageInflictorIndex[hIndex];
 
 	return -1;
 }
@@ -2383,6 +2524,10 @@ int CCollisionEvent::AddDamageInflictor( IPhysicsObject *pInflictorPhysics, floa
 		state.nextIndex = -1;
 	}
 
+	// Later states for the same object win, as they did with the old backwards search
+	UtlHashHandle_t hIndex = m_damageInflictorIndex.Insert( pInflictorPhysics, addIndex );
+	m_damageInflictorIndex[hIndex] = addIndex;
+
 	if ( addList )
 	{
 		CBaseEntity *pEntity = static_cast<CBaseEntity *>(pInflictorPhysics->GetGameData());
@@ -2421,6 +2566,18 @@ void CCollisionEvent::LevelShutdown( void )
 			ShutdownFriction( m_current[i] );
 		}
 	}
+
+	// The queues keep their memory from frame to frame; don't carry one map's
+	// worst frame into the next
+	if ( !m_touchEvents.Count() && !m_damageEvents.Count() )
+	{
+		m_touchEvents.Purge();
+		m_damageEvents.Purge();
+		m_damageInflictors.Purge();
+		m_touchEventPairs.Purge();
+		m_damageEventPairs.Purge();
+		m_damageInflictorIndex.Purge();
+	}
 }
 
 
@@ -2433,6 +2590,8 @@ void CCollisionEvent::StartTouch( IPhysicsObject *pObject1, IPhysicsObject *pObj
 	if ( !pEntity1 || !pEntity2 )
 		return;
 
+	m_eventCounts[COLLISION_EVENT_TOUCH_START]++;
+
 	Vector endPoint, normal;
 	pTouchData->GetContactPoint( endPoint );
 	pTouchData->GetSurfaceNormal( normal );
@@ -2488,6 +2647,8 @@ void CCollisionEvent::EndTouch( IPhysicsObject *pObject1, IPhysicsObject *pObjec
 	// should have exactly one contact point (the one getting deleted here)
 	//Assert( contactCount == 1 );
 
+	m_eventCounts[COLLISION_EVENT_TOUCH_END]++;
+
 	Vector endPoint, normal;
 	pTouchData->GetContactPoint( endPoint );
 	pTouchData->GetSurfaceNormal( normal );
@@ -2509,6 +2670,8 @@ void CCollisionEvent::ObjectEnterTrigger( IPhysicsObject *pTrigger, IPhysicsObje
 	CBaseEntity *pEntity = static_cast<CBaseEntity *>(pObject->GetGameData());
 	if ( pTriggerEntity && pEntity )
 	{
+		m_eventCounts[COLLISION_EVENT_TRIGGER]++;
+
 		// UNDONE: Don't buffer these until we can solve generating touches at object creation time
 		if ( 0 && m_bBufferTouchEvents )
 		{
@@ -2531,6 +2694,8 @@ void CCollisionEvent::ObjectLeaveTrigger( IPhysicsObject *pTrigger, IPhysicsObje
 	CBaseEntity *pEntity = static_cast<CBaseEntity *>(pObject->GetGameData());
 	if ( pTriggerEntity && pEntity )
 	{
+		m_eventCounts[COLLISION_EVENT_TRIGGER]++;
+
 		// UNDONE: Don't buffer these until we can solve generating touches at object creation time
 		if ( 0 && m_bBufferTouchEvents )
 		{
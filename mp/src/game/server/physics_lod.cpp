@@ -0,0 +1,365 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Early sleeping for physics objects out of every player's sight.
+//
+//			After each step, the awake props and ragdolls are checked
+//			against the union of the players' PVSs and their distance to
+//			the nearest player. Hidden ones that have stayed at rest for
+//			phys_lod_rest_time are forced to sleep, farthest and most
+//			expensive first, a few per step. vphysics wakes them again as
+//			soon as anything touches them.
+//
+//			vphysics steps the whole environment at one rate, so objects
+//			can't be stepped less often; putting them to sleep is the
+//			reduced rate. When the step takes longer than phys_lod_budget_ms
+//			the rest thresholds are scaled up, letting slow movers drop out
+//			of the step too.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "physics_lod.h"
+#include "physics.h"
+#include "collisionutils.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar phys_lod( "phys_lod", "0", FCVAR_NONE, "Put physics props and ragdolls no player can see to sleep as soon as they come to rest." );
+ConVar phys_lod_distance( "phys_lod_distance", "1024", FCVAR_NONE, "Objects closer than this to a player are never put to sleep early, even outside the PVS." );
+ConVar phys_lod_rest_time( "phys_lod_rest_time", "0.5", FCVAR_NONE, "Seconds a hidden object must stay at rest before it's put to sleep." );
+ConVar phys_lod_rest_speed( "phys_lod_rest_speed", "4", FCVAR_NONE, "Speed (units/sec) below which an object counts as at rest." );
+ConVar phys_lod_rest_angspeed( "phys_lod_rest_angspeed", "10", FCVAR_NONE, "Angular speed (degrees/sec) below which an object counts as at rest." );
+ConVar phys_lod_budget_ms( "phys_lod_budget_ms", "4", FCVAR_NONE, "Average physics step time over which hidden objects are put to sleep more eagerly. 0 disables the budget." );
+ConVar phys_lod_max_sleeps( "phys_lod_max_sleeps", "8", FCVAR_NONE, "Most entities put to sleep after one step." );
+
+// Largest factor the rest thresholds are scaled by when over budget
+#define PHYSLOD_MAX_BUDGET_SCALE	4.0f
+
+// States not touched for this many steps are dropped
+#define PHYSLOD_STATE_LIFETIME		64
+
+#define PHYSLOD_NO_CLUSTER			-2
+
+
+static CPhysicsLOD g_PhysicsLOD;
+
+CPhysicsLOD *PhysicsLOD()
+{
+	return &g_PhysicsLOD;
+}
+
+CPhysicsLOD::CPhysicsLOD()
+{
+	m_nPVSBytes = 0;
+	for ( int i = 0; i < ARRAYSIZE( m_PlayerClusters ); i++ )
+	{
+		m_PlayerClusters[i] = PHYSLOD_NO_CLUSTER;
+	}
+	m_flAverageSimTime = 0.0f;
+	m_nFrame = 0;
+
+	ResetStats();
+}
+
+bool CPhysicsLOD::IsEnabled()
+{
+	return phys_lod.GetBool();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Props and ragdolls that nothing else is steering
+//-----------------------------------------------------------------------------
+bool CPhysicsLOD::ShouldLOD( CBaseEntity *pEntity, IPhysicsObject *pObject )
+{
+	if ( pEntity->IsPlayer() || pEntity->MyNPCPointer() || pEntity->GetServerVehicle() )
+		return false;
+
+	if ( pEntity->GetMoveType() != MOVETYPE_VPHYSICS || pEntity->GetMoveParent() )
+		return false;
+
+	if ( !pObject->IsMoveable() || pObject->GetShadowController() )
+		return false;
+
+	if ( pObject->GetGameFlags() & FVPHYSICS_PLAYER_HELD )
+		return false;
+
+	// Other constraint systems may be driven by motors
+	if ( !( pObject->GetGameFlags() & FVPHYSICS_PART_OF_RAGDOLL ) && pObject->IsAttachedToConstraint( false ) )
+		return false;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the PVS union if a player moved to another cluster
+//-----------------------------------------------------------------------------
+void CPhysicsLOD::UpdateVisibility()
+{
+	m_PlayerOrigins.RemoveAll();
+
+	bool bChanged = false;
+	for ( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		int cluster = PHYSLOD_NO_CLUSTER;
+		if ( pPlayer && pPlayer->IsConnected() )
+		{
+			Vector vecEye = pPlayer->EyePosition();
+			m_PlayerOrigins.AddToTail( vecEye );
+			cluster = engine->GetClusterForOrigin( vecEye );
+		}
+
+		if ( cluster != m_PlayerClusters[i] )
+		{
+			m_PlayerClusters[i] = cluster;
+			bChanged = true;
+		}
+	}
+
+	if ( !bChanged )
+		return;
+
+	memset( m_PVS, 0, sizeof( m_PVS ) );
+	m_nPVSBytes = 0;
+
+	byte pvs[ MAX_MAP_CLUSTERS / 8 ];
+	for ( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		// Outside the world, only the distance check applies
+		if ( m_PlayerClusters[i] < 0 )
+			continue;
+
+		int nBytes = engine->GetPVSForCluster( m_PlayerClusters[i], sizeof( pvs ), pvs );
+		nBytes = MIN( nBytes, (int)sizeof( pvs ) );
+		for ( int j = 0; j < nBytes; j++ )
+		{
+			m_PVS[j] |= pvs[j];
+		}
+		m_nPVSBytes = MAX( m_nPVSBytes, nBytes );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Out of every player's PVS and far from all of them
+//-----------------------------------------------------------------------------
+bool CPhysicsLOD::IsHidden( CBaseEntity *pEntity, float *pDistance ) const
+{
+	Vector vecMins, vecMaxs;
+	pEntity->CollisionProp()->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+	if ( m_nPVSBytes && engine->CheckBoxInPVS( vecMins, vecMaxs, m_PVS, m_nPVSBytes ) )
+		return false;
+
+	float flMinDistSqr = FLT_MAX;
+	for ( int i = 0; i < m_PlayerOrigins.Count(); i++ )
+	{
+		flMinDistSqr = MIN( flMinDistSqr, CalcSqrDistanceToAABB( vecMins, vecMaxs, m_PlayerOrigins[i] ) );
+	}
+
+	float flDistance = phys_lod_distance.GetFloat();
+	if ( flMinDistSqr < flDistance * flDistance )
+		return false;
+
+	*pDistance = FastSqrt( flMinDistSqr );
+	return true;
+}
+
+bool CPhysicsLOD::IsAtRest( CBaseEntity *pEntity, float flScale, int *pObjectCount ) const
+{
+	float flSpeed = phys_lod_rest_speed.GetFloat() * flScale;
+	float flAngSpeed = phys_lod_rest_angspeed.GetFloat() * flScale;
+
+	IPhysicsObject *pList[VPHYSICS_MAX_OBJECT_LIST_COUNT];
+	int count = pEntity->VPhysicsGetObjectList( pList, ARRAYSIZE( pList ) );
+	*pObjectCount = count;
+	for ( int i = 0; i < count; i++ )
+	{
+		Vector vecVelocity;
+		AngularImpulse angVelocity;
+		pList[i]->GetVelocity( &vecVelocity, &angVelocity );
+		if ( vecVelocity.LengthSqr() > flSpeed * flSpeed || angVelocity.LengthSqr() > flAngSpeed * flAngSpeed )
+			return false;
+	}
+
+	return true;
+}
+
+CPhysicsLOD::EntityState_t &CPhysicsLOD::FindOrAddState( CBaseEntity *pEntity )
+{
+	UtlHashHandle_t h = m_States.Find( pEntity );
+	if ( h != m_States.InvalidHandle() && m_States[h].m_hEntity.Get() == pEntity )
+		return m_States[h];
+
+	// New, or a stale state left by an entity that used the same memory
+	if ( h == m_States.InvalidHandle() )
+	{
+		h = m_States.Insert( pEntity );
+	}
+
+	EntityState_t &state = m_States[h];
+	state.m_hEntity = pEntity;
+	state.m_flRestStart = -1.0f;
+	state.m_nLastFrame = -1;
+	return state;
+}
+
+void CPhysicsLOD::PruneStates()
+{
+	UtlHashHandle_t h = m_States.FirstHandle();
+	while ( h != m_States.InvalidHandle() )
+	{
+		const EntityState_t &state = m_States[h];
+		if ( state.m_nLastFrame < m_nFrame - PHYSLOD_STATE_LIFETIME || !state.m_hEntity.Get() )
+		{
+			h = m_States.RemoveAndAdvance( h );
+		}
+		else
+		{
+			h = m_States.NextHandle( h );
+		}
+	}
+}
+
+int __cdecl CPhysicsLOD::CandidateCompare( const Candidate_t *pCandidate0, const Candidate_t *pCandidate1 )
+{
+	if ( pCandidate0->m_flPriority > pCandidate1->m_flPriority )
+		return -1;
+	return ( pCandidate0->m_flPriority < pCandidate1->m_flPriority ) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts hidden objects that have come to rest to sleep
+//-----------------------------------------------------------------------------
+void CPhysicsLOD::Update( IPhysicsObject **pActiveList, int activeCount, float flSimTime )
+{
+	VPROF_BUDGET( "CPhysicsLOD::Update", VPROF_BUDGETGROUP_PHYSICS );
+
+	m_flAverageSimTime = m_flAverageSimTime * 0.8f + flSimTime * 0.2f;
+
+	if ( !IsEnabled() )
+		return;
+
+	m_nSteps++;
+	m_nFrame++;
+
+	UpdateVisibility();
+	if ( !m_PlayerOrigins.Count() )
+		return;
+
+	// Over budget, let slower movers and shorter rests count
+	float flScale = 1.0f;
+	float flBudget = phys_lod_budget_ms.GetFloat() * 0.001f;
+	if ( flBudget > 0.0f && m_flAverageSimTime > flBudget )
+	{
+		flScale = MIN( m_flAverageSimTime / flBudget, PHYSLOD_MAX_BUDGET_SCALE );
+		m_nBudgetSteps++;
+	}
+	float flRestTime = phys_lod_rest_time.GetFloat() / flScale;
+
+	m_Candidates.RemoveAll();
+	for ( int i = 0; i < activeCount; i++ )
+	{
+		CBaseEntity *pEntity = reinterpret_cast<CBaseEntity *>(pActiveList[i]->GetGameData());
+		if ( !pEntity || !ShouldLOD( pEntity, pActiveList[i] ) )
+			continue;
+
+		// Ragdolls show up once per awake element
+		EntityState_t &state = FindOrAddState( pEntity );
+		if ( state.m_nLastFrame == m_nFrame )
+			continue;
+		state.m_nLastFrame = m_nFrame;
+		m_nObjectsSeen++;
+
+		float flDistance;
+		if ( !IsHidden( pEntity, &flDistance ) )
+		{
+			state.m_flRestStart = -1.0f;
+			continue;
+		}
+		m_nHidden++;
+
+		int nObjects;
+		if ( !IsAtRest( pEntity, flScale, &nObjects ) )
+		{
+			state.m_flRestStart = -1.0f;
+			continue;
+		}
+
+		if ( state.m_flRestStart < 0.0f )
+		{
+			state.m_flRestStart = gpGlobals->curtime;
+		}
+		if ( gpGlobals->curtime - state.m_flRestStart < flRestTime )
+			continue;
+
+		// Farther and more elements (ragdolls) go first
+		int index = m_Candidates.AddToTail();
+		m_Candidates[index].m_pEntity = pEntity;
+		m_Candidates[index].m_flPriority = flDistance * nObjects;
+	}
+
+	if ( m_Candidates.Count() > 1 )
+	{
+		m_Candidates.Sort( CandidateCompare );
+	}
+
+	int nSleeps = MIN( m_Candidates.Count(), phys_lod_max_sleeps.GetInt() );
+	for ( int i = 0; i < nSleeps; i++ )
+	{
+		CBaseEntity *pEntity = m_Candidates[i].m_pEntity;
+		PhysForceEntityToSleep( pEntity, pEntity->VPhysicsGetObject() );
+		FindOrAddState( pEntity ).m_flRestStart = -1.0f;
+	}
+	m_nSleeps += nSleeps;
+	VPROF_INCREMENT_COUNTER( "physics LOD sleeps", nSleeps );
+
+	if ( ( m_nFrame % PHYSLOD_STATE_LIFETIME ) == 0 )
+	{
+		PruneStates();
+	}
+}
+
+void CPhysicsLOD::LevelShutdown()
+{
+	m_States.Purge();
+	m_Candidates.Purge();
+	m_PlayerOrigins.Purge();
+	m_nPVSBytes = 0;
+	for ( int i = 0; i < ARRAYSIZE( m_PlayerClusters ); i++ )
+	{
+		m_PlayerClusters[i] = PHYSLOD_NO_CLUSTER;
+	}
+	m_flAverageSimTime = 0.0f;
+}
+
+void CPhysicsLOD::ResetStats()
+{
+	m_nSteps = 0;
+	m_nObjectsSeen = 0;
+	m_nHidden = 0;
+	m_nSleeps = 0;
+	m_nBudgetSteps = 0;
+}
+
+void CPhysicsLOD::ReportStats()
+{
+	Msg( "Physics LOD (%s): %d steps, %d over budget, average step %.2fms\n",
+		IsEnabled() ? "on" : "off", m_nSteps, m_nBudgetSteps, m_flAverageSimTime * 1000.0f );
+	Msg( "  %d entities checked, %d hidden, %d put to sleep, %d tracked\n",
+		m_nObjectsSeen, m_nHidden, m_nSleeps, m_States.Count() );
+}
+
+CON_COMMAND( phys_lod_stats, "Print how many physics objects phys_lod has put to sleep. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CPhysicsLOD *pLOD = PhysicsLOD();
+	pLOD->ReportStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		pLOD->ResetStats();
+	}
+}
@@ -0,0 +1,84 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Puts physics props and ragdolls that no player can see to sleep
+//			as soon as they come to rest, instead of waiting for vphysics'
+//			own sleep timers. When the simulation goes over its time budget
+//			the rest thresholds loosen, so more of the hidden objects drop
+//			out of the step. Anything a player can see, or is near, is left
+//			alone.
+//
+//=============================================================================//
+
+#ifndef PHYSICS_LOD_H
+#define PHYSICS_LOD_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "bspfile.h"
+#include "tier1/utlhashtable.h"
+
+class IPhysicsObject;
+class CBaseEntity;
+
+class CPhysicsLOD
+{
+public:
+	CPhysicsLOD();
+
+	static bool		IsEnabled();
+
+	// Called after each simulation step with the objects that were awake for
+	// it and how long the step took
+	void			Update( IPhysicsObject **pActiveList, int activeCount, float flSimTime );
+
+	void			LevelShutdown();
+	void			ReportStats();
+	void			ResetStats();
+
+private:
+	struct EntityState_t
+	{
+		EHANDLE		m_hEntity;
+		float		m_flRestStart;		// -1 while moving
+		int			m_nLastFrame;
+	};
+
+	struct Candidate_t
+	{
+		CBaseEntity	*m_pEntity;
+		float		m_flPriority;		// Higher goes to sleep first
+	};
+
+	void			UpdateVisibility();
+	bool			IsHidden( CBaseEntity *pEntity, float *pDistance ) const;
+	bool			IsAtRest( CBaseEntity *pEntity, float flScale, int *pObjectCount ) const;
+	EntityState_t	&FindOrAddState( CBaseEntity *pEntity );
+	void			PruneStates();
+
+	static bool		ShouldLOD( CBaseEntity *pEntity, IPhysicsObject *pObject );
+	static int __cdecl CandidateCompare( const Candidate_t *pCandidate0, const Candidate_t *pCandidate1 );
+
+	CUtlHashtable< CBaseEntity *, EntityState_t, PointerHashFunctor, PointerEqualFunctor > m_States;
+	CUtlVector<Candidate_t>	m_Candidates;
+
+	// Union of every player's PVS, rebuilt when one of them changes cluster
+	byte			m_PVS[ MAX_MAP_CLUSTERS / 8 ];
+	int				m_nPVSBytes;
+	int				m_PlayerClusters[ MAX_PLAYERS + 1 ];
+	CUtlVector<Vector>	m_PlayerOrigins;
+
+	float			m_flAverageSimTime;
+	int				m_nFrame;
+
+	// Stats for phys_lod_stats
+	int				m_nSteps;
+	int				m_nObjectsSeen;
+	int				m_nHidden;
+	int				m_nSleeps;
+	int				m_nBudgetSteps;
+};
+
+CPhysicsLOD *PhysicsLOD();
+
+#endif // PHYSICS_LOD_H
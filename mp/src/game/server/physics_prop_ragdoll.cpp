@@ -275,6 +275,7 @@ CRagdollProp::CRagdollProp( void )
 	m_allAsleep = false;
 	m_flFadeScale = 1;
 	m_flDefaultFadeScale = 1;
+	m_ragSentMask = 0;
 }
 
 CRagdollProp::~CRagdollProp( void )
@@ -975,21 +976,40 @@ void CRagdollProp::VPhysicsUpdate( IPhysicsObject *pPhysics )
 	QAngle angles;
 	Vector surroundingMins, surroundingMaxs;
 
+	// Read each element's transform out of vphysics once, for both the network state and the bounds
+	matrix3x4_t physMatrices[RAGDOLL_MAX_ELEMENTS];
 	int i;
 	for ( i = 0; i < m_ragdoll.listCount; i++ )
 	{
-		CBoneAccessor boneaccessor( boneToWorld );
-		if ( RagdollGetBoneMatrix( m_ragdoll, boneaccessor, i ) )
+		if ( m_ragdoll.list[i].pObject )
 		{
-			Vector vNewPos;
-			MatrixAngles( boneToWorld[m_ragdoll.boneIndex[i]], angles, vNewPos );
-			m_ragPos.Set( i, vNewPos );
-			m_ragAngles.Set( i, angles );
+			m_ragdoll.list[i].pObject->GetPositionMatrix( &physMatrices[i] );
 		}
-		else
+	}
+
+	fltx4 tolerance;
+	if ( PhysPoseSyncTolerance( tolerance ) )
+	{
+		UpdateNetworkPoseBatched( physMatrices, tolerance );
+	}
+	else
+	{
+		m_ragSentMask = 0;
+		for ( i = 0; i < m_ragdoll.listCount; i++ )
 		{
-			m_ragPos.GetForModify(i).Init();
-			m_ragAngles.GetForModify(i).Init();
+			CBoneAccessor boneaccessor( boneToWorld );
+			if ( RagdollGetBoneMatrix( m_ragdoll, boneaccessor, i ) )
+			{
+				Vector vNewPos;
+				MatrixAngles( boneToWorld[m_ragdoll.boneIndex[i]], angles, vNewPos );
+				m_ragPos.Set( i, vNewPos );
+				m_ragAngles.Set( i, angles );
+			}
+			else
+			{
+				m_ragPos.GetForModify(i).Init();
+				m_ragAngles.GetForModify(i).Init();
+			}
 		}
 	}
 
@@ -1023,15 +1043,13 @@ void CRagdollProp::VPhysicsUpdate( IPhysicsObject *pPhysics )
 	for ( i = 0; i < m_ragdoll.listCount; i++ )
 	{
 		Vector mins, maxs;
-		matrix3x4_t update;
 		if ( !m_ragdoll.list[i].pObject )
 		{
 			m_ragdollMins[i].Init();
 			m_ragdollMaxs[i].Init();
 			continue;
 		}
-		m_ragdoll.list[i].pObject->GetPositionMatrix( &update );
-		TransformAABB( update, m_ragdollMins[i], m_ragdollMaxs[i], mins, maxs );
+		TransformAABB( physMatrices[i], m_ragdollMins[i], m_ragdollMaxs[i], mins, maxs );
 		for ( int j = 0; j < 3; j++ )
 		{
 			if ( mins[j] < vecFullMins[j] )
@@ -1056,6 +1074,92 @@ void CRagdollProp::VPhysicsUpdate( IPhysicsObject *pPhysics )
 	PhysicsTouchTriggers();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Same as the RagdollGetBoneMatrix() loop in VPhysicsUpdate(), but
+//			only elements that moved past the tolerance since they were last
+//			sent get converted to angles, four at a time, and networked.
+//-----------------------------------------------------------------------------
+void CRagdollProp::UpdateNetworkPoseBatched( const matrix3x4_t *pPhysMatrices, const fltx4 &tolerance )
+{
+	VPROF( "CRagdollProp::UpdateNetworkPoseBatched" );
+
+	// Rigid attachment needs the fixed up bones of the parents, which always come first in the list
+	matrix3x4_t bones[RAGDOLL_MAX_ELEMENTS];
+
+	int moved[4];
+	const matrix3x4_t *pMoved[4];
+	int nMoved = 0;
+	int nSkipped = 0;
+	for ( int i = 0; i < m_ragdoll.listCount; i++ )
+	{
+		const ragdollelement_t &element = m_ragdoll.list[i];
+		if ( m_ragdoll.boneIndex[i] < 0 || !element.pObject )
+		{
+			m_ragPos.GetForModify(i).Init();
+			m_ragAngles.GetForModify(i).Init();
+			m_ragSentMask &= ~( 1 << i );
+			continue;
+		}
+
+		MatrixCopy( pPhysMatrices[i], bones[i] );
+		if ( element.parentIndex >= 0 && !m_ragdoll.allowStretch )
+		{
+			// overwrite the position from physics to force rigid attachment
+			Vector out;
+			VectorTransform( element.originParentSpace, bones[element.parentIndex], out );
+			MatrixSetColumn( out, 3, bones[i] );
+		}
+
+		if ( ( m_ragSentMask & ( 1 << i ) ) && !MatricesDifferSIMD( bones[i], m_ragSentBones[i], tolerance ) )
+		{
+			nSkipped++;
+			continue;
+		}
+
+		MatrixCopy( bones[i], m_ragSentBones[i] );
+		m_ragSentMask |= ( 1 << i );
+
+		moved[nMoved] = i;
+		pMoved[nMoved] = &m_ragSentBones[i];
+		if ( ++nMoved == 4 )
+		{
+			SendNetworkPose( moved, pMoved, nMoved );
+			nMoved = 0;
+		}
+	}
+
+	if ( nMoved )
+	{
+		SendNetworkPose( moved, pMoved, nMoved );
+	}
+
+	VPROF_INCREMENT_COUNTER( "Ragdoll elements skipped", nSkipped );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Networks up to four elements
+//-----------------------------------------------------------------------------
+void CRagdollProp::SendNetworkPose( const int *pElements, const matrix3x4_t **ppBones, int count )
+{
+	Assert( count > 0 && count <= 4 );
+
+	// Pad out a short batch, the extra lanes are ignored
+	for ( int i = count; i < 4; i++ )
+	{
+		ppBones[i] = ppBones[0];
+	}
+
+	FourVectors angles, positions;
+	FourMatricesAnglesSIMD( ppBones, angles, positions );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		Vector vecAngles = angles.Vec( i );
+		m_ragPos.Set( pElements[i], positions.Vec( i ) );
+		m_ragAngles.Set( pElements[i], QAngle( vecAngles.x, vecAngles.y, vecAngles.z ) );
+	}
+}
+
 int CRagdollProp::VPhysicsGetObjectList( IPhysicsObject **pList, int listMax )
 {
 	for ( int i = 0; i < m_ragdoll.listCount; i++ )
@@ -1078,6 +1182,7 @@ void CRagdollProp::UpdateNetworkDataFromVPhysics( IPhysicsObject *pPhysics, int
 	m_ragdoll.list[index].pObject->GetPosition( &vPos, &angles );
 	m_ragPos.Set( index, vPos );
 	m_ragAngles.Set( index, angles );
+	m_ragSentMask &= ~( 1 << index );
 
 	// move/relink if root moved
 	if ( index == 0 )
@@ -315,6 +315,9 @@ public:
 	// Forces processing of usercmds (e.g., even if game is paused, etc.)
 	void					ForceSimulation();
 
+	// Can the next usercmd run alongside other players' (see player_parallelmove.cpp)?
+	virtual bool			CanRunUserCmdInParallel( void );
+
 	virtual unsigned int	PhysicsSolidMaskForEntity( void ) const;
 
 	virtual void			PreThink( void );
@@ -817,6 +820,8 @@ private:
 
 	int					DetermineSimulationTicks( void );
 	void				AdjustPlayerTimeBase( int simulation_ticks );
+	int					GetUserCmdsToRun( CUtlVector< CUserCmd > &vecAvailCommands );
+	void				RecordSimulationInfo( int commandsToRun );
 
 public:
 	
@@ -1126,6 +1131,8 @@ private:
 
 	friend class CPlayerMove;
 	friend class CPlayerClass;
+	friend class CParallelPlayerMove;
+	friend class CDeferredPlayerMove;
 
 	// Player name
 	char					m_szNetname[MAX_PLAYER_NAME_LENGTH];
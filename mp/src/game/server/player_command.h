@@ -17,6 +17,21 @@
 class IMoveHelper;
 class CMoveData;
 class CBasePlayer;
+class CPlayerMove;
+class IGameMovement;
+class IServerVehicle;
+
+//-----------------------------------------------------------------------------
+// A usercmd stopped before its movement, so that the movement of several
+// players can run in parallel (see player_parallelmove.cpp)
+//-----------------------------------------------------------------------------
+struct PlayerMoveStage_t
+{
+	CPlayerMove		*m_pPlayerMove;		// Runs the stages, and keeps any state between SetupMove and FinishMove
+	CMoveData		*m_pMoveData;
+	IServerVehicle	*m_pVehicle;		// Vehicle the player was in when the command started
+	bool			m_bStarted;			// False if the command was dropped
+};
 
 //-----------------------------------------------------------------------------
 // Purpose: Server side player movement
@@ -34,7 +49,17 @@ public:
 	// Run a movement command from the player
 	void			RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper );
 
+	// While a stage is set, RunCommand stops before the movement and leaves
+	// the command on the stage; RunCommandMove and RunCommandPostMove
+	// (on the stage's CPlayerMove) finish it.
+	void			SetStage( PlayerMoveStage_t *pStage ) { m_pStage = pStage; }
+	void			RunCommandMove( CBasePlayer *player, IGameMovement *pMovement, IServerVehicle *pVehicle, CMoveData *move );
+	void			RunCommandPostMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper, CMoveData *move );
+
 protected:
+	// Everything up to SetupMove; returns false if the command was dropped
+	bool			RunCommandPreMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper, CMoveData *move, IServerVehicle **ppVehicle );
+
 	// Prepare for running movement
 	virtual void	SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *pHelper, CMoveData *move );
 
@@ -52,6 +77,9 @@ protected:
 	void			RunPreThink( CBasePlayer *player );
 	void			RunThink (CBasePlayer *ent, double frametime );
 	void			RunPostThink( CBasePlayer *player );
+
+private:
+	PlayerMoveStage_t	*m_pStage;
 };
 
 
@@ -60,5 +88,10 @@ protected:
 //-----------------------------------------------------------------------------
 CPlayerMove *PlayerMove();
 
+// Creates another instance of the game's CPlayerMove and CMoveData, for
+// players whose movement runs in parallel
+CPlayerMove *CreatePlayerMove();
+CMoveData *CreatePlayerMoveData();
+
 
 #endif // PLAYER_COMMAND_H
@@ -0,0 +1,161 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the usercmd movement of players that can't reach each other
+//			on worker threads. Anything the movement does outside the moving
+//			player is recorded by CDeferredPlayerMove and applied on the main
+//			thread afterwards, in player index order.
+//
+//=============================================================================//
+
+#ifndef PLAYER_PARALLELMOVE_H
+#define PLAYER_PARALLELMOVE_H
+#pragma once
+
+#include "tier0/threadtools.h"
+#include "utlvector.h"
+
+class CBasePlayer;
+class CBaseEntity;
+class IMoveHelper;
+class IGameMovement;
+struct surfacedata_t;
+
+//-----------------------------------------------------------------------------
+// Side effects of one player's movement, recorded while it runs on a worker.
+// The hooks check GetActive(), which is only non-NULL on a thread that is
+// moving a player in parallel.
+//-----------------------------------------------------------------------------
+class CDeferredPlayerMove
+{
+public:
+	CDeferredPlayerMove();
+
+	static CDeferredPlayerMove *GetActive();
+	static void		SetActive( CDeferredPlayerMove *pDeferred );
+
+	// Set by the main thread around the parallel part of a round
+	static void		EnableHooks( bool bEnable ) { s_bAnyActive = bEnable; }
+
+	void			Reset( CBasePlayer *pPlayer );
+
+	// IMoveHelper
+	void			ResetTouchList();
+	bool			AddToTouched( const trace_t &tr, const Vector &impactvelocity );
+	void			StartSound( const Vector &origin, const char *soundname );
+	void			StartSound( const Vector &origin, int channel, const char *sample, float volume, soundlevel_t soundlevel, int fFlags, int pitch );
+	bool			PlayerFallingDamage();
+	void			PlayerSetAnimation( PLAYER_ANIM eAnim );
+
+	// Player and entity calls made by the movement code
+	void			UpdateStepSound( surfacedata_t *psurface, const Vector &vecOrigin, const Vector &vecVelocity );
+	void			PlayStepSound( const Vector &vecOrigin, surfacedata_t *psurface, float fvol, bool force );
+	void			Splash();
+	void			RumbleEffect( unsigned char index, unsigned char rumbleData, unsigned char rumbleFlags );
+	void			SetPlayerSurface( char gameMaterial );
+	void			UpdateGroundLinks( CBaseEntity *pEntity, CBaseEntity *pOldGround, CBaseEntity *pGround );
+	void			ApplyMoveType( CBaseEntity *pEntity );
+
+	// Applies everything, in the order it was recorded. The move helper's
+	// host must be the player.
+	void			Replay( IMoveHelper *pMoveHelper );
+
+private:
+	enum DeferredEvent_t
+	{
+		DEFERRED_START_SOUND = 0,
+		DEFERRED_START_SOUND_EX,
+		DEFERRED_FALLING_DAMAGE,
+		DEFERRED_SET_ANIMATION,
+		DEFERRED_UPDATE_STEP_SOUND,
+		DEFERRED_PLAY_STEP_SOUND,
+		DEFERRED_SPLASH,
+		DEFERRED_RUMBLE,
+		DEFERRED_PLAYER_SURFACE,
+		DEFERRED_GROUND_LINKS,
+		DEFERRED_MOVE_TYPE,
+	};
+
+	struct Event_t
+	{
+		int				m_nType;
+		Vector			m_vecOrigin;
+		Vector			m_vecVelocity;
+		EHANDLE			m_hEntity;
+		EHANDLE			m_hOther[2];
+		surfacedata_t	*m_pSurface;
+		float			m_flValue[2];
+		int				m_nValue[4];
+		int				m_nString;			// Offset in m_Strings, or -1
+	};
+
+	struct Touch_t
+	{
+		Vector			m_vecVelocity;
+		trace_t			m_Trace;
+	};
+
+	Event_t			&AddEvent( int nType );
+	int				AddString( const char *pString );
+
+	CBasePlayer			*m_pPlayer;
+	CUtlVector<Event_t>	m_Events;
+	CUtlVector<Touch_t>	m_Touches;
+	CUtlVector<char>	m_Strings;
+
+	static CThreadLocalPtr<CDeferredPlayerMove>	s_pActive;
+	static bool			s_bAnyActive;
+};
+
+inline CDeferredPlayerMove *CDeferredPlayerMove::GetActive()
+{
+	// Cheap test first, since the hooks sit on paths every entity uses
+	return s_bAnyActive ? (CDeferredPlayerMove *)s_pActive : NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Runs the usercmds of every player that can run in parallel this tick.
+// Those players are marked as simulated, so Physics_SimulateEntity skips
+// them; everyone else is left for the usual serial path.
+//-----------------------------------------------------------------------------
+class CParallelPlayerMove
+{
+public:
+	CParallelPlayerMove();
+
+	void			SimulatePlayers();
+	void			ReportStats();
+
+private:
+	struct PlayerSlot_t;
+
+	PlayerSlot_t	*GetSlot( CBasePlayer *pPlayer );
+	bool			BeginPlayer( PlayerSlot_t *pSlot );
+	void			RunRound( int nRound );
+	void			RunSerialCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd );
+	void			StartStagedCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd );
+	void			FinishStagedCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd, bool bRunMove );
+	void			ProcessMove( PlayerSlot_t *&pSlot );
+	void			UpdateVPhysics( PlayerSlot_t *pSlot );
+
+	static void		ComputeMoveBounds( CBasePlayer *pPlayer, Vector *pMins, Vector *pMaxs );
+	static bool		AnyOverlap( PlayerSlot_t **ppSlots, int nSlots, int iSlot );
+	static void		CacheAbsState( PlayerSlot_t **ppSlots, int nSlots );
+
+	PlayerSlot_t	*m_pSlots[MAX_PLAYERS];
+	CUtlVector<PlayerSlot_t *>	m_Active;
+	float			m_flServerTime;
+	float			m_flServerFrameTime;
+
+	// Stats for sv_parallel_usercmds_stats
+	int				m_nTicks;
+	int				m_nParallelMoves;
+	int				m_nSerialMoves;
+};
+
+CParallelPlayerMove *ParallelPlayerMove();
+
+// Another instance of the game's movement class
+IGameMovement *CreateGameMovement();
+
+#endif // PLAYER_PARALLELMOVE_H
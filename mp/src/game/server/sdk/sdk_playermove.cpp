@@ -44,6 +44,16 @@ CPlayerMove *PlayerMove()
 	return &g_PlayerMove;
 }
 
+CPlayerMove *CreatePlayerMove()
+{
+	return new CSDKPlayerMove;
+}
+
+CMoveData *CreatePlayerMoveData()
+{
+	return new CMoveData;
+}
+
 //-----------------------------------------------------------------------------
 // Main setup, finish
 //-----------------------------------------------------------------------------
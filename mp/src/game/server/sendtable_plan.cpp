@@ -0,0 +1,988 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Precompiled SendTable walk plans and the change detector that
+//			uses them.
+//
+//			The engine re-encodes every entity whose edict is flagged as
+//			changed, but entities routinely flag themselves for writes that
+//			leave their networked state untouched (a value set to what it
+//			already was, a think that moves and moves back, ...). Before the
+//			engine packs entities we compare the flagged ones against a
+//			shadow copy of what was last packed and clear the flag when
+//			nothing networked actually differs.
+//
+//			Props whose proxies are plain copies (the standard int, float,
+//			vector and angle proxies) are compared straight out of entity
+//			memory, sixteen bytes at a time, without calling the proxy.
+//			Everything else goes through its proxy and is compared on the
+//			proxy's output.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "sendtable_plan.h"
+#include "dt_send.h"
+#include "server_class.h"
+#include "igamesystem.h"
+#include "tier0/fasttimer.h"
+#include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_sendplan_changedetect( "sv_sendplan_changedetect", "0", 0, "Compare entities flagged as changed against their last sent state and skip re-encoding the ones whose networked props did not change." );
+
+// Matches the limit the engine puts on nested datatable proxies.
+#define SENDPLAN_MAX_DEPTH	MAX_DATATABLE_PROXIES
+
+// Shadow payload of a SENDPLAN_DATATABLE op: the pointer the proxy returned
+// followed by the recipients it selected.
+#define SENDPLAN_DATATABLE_BYTES	( sizeof( void* ) + sizeof( CSendProxyRecipients ) )
+
+
+//-----------------------------------------------------------------------------
+// Returns the number of bytes read by a proxy that copies its input
+// verbatim (or is a pure function of it), or 0 if the proxy has to be called.
+//-----------------------------------------------------------------------------
+static int SendPlan_TrivialBytes( const SendProp *pProp )
+{
+	const CStandardSendProxies &proxies = g_StandardSendProxies;
+	SendVarProxyFn fn = pProp->GetProxyFn();
+
+	switch ( pProp->GetType() )
+	{
+	case DPT_Int:
+		if ( fn == proxies.m_Int8ToInt32 || fn == proxies.m_UInt8ToInt32 )
+			return 1;
+		if ( fn == proxies.m_Int16ToInt32 || fn == proxies.m_UInt16ToInt32 )
+			return 2;
+		if ( fn == proxies.m_Int32ToInt32 || fn == proxies.m_UInt32ToInt32 )
+			return 4;
+		break;
+
+	case DPT_Float:
+		if ( fn == proxies.m_FloatToFloat || fn == SendProxy_AngleToFloat )
+			return 4;
+		break;
+
+	case DPT_Vector:
+		if ( fn == proxies.m_VectorToVector || fn == SendProxy_QAngles )
+			return 12;
+		break;
+
+	case DPT_VectorXY:
+		if ( fn == SendProxy_VectorXYToVectorXY )
+			return 8;
+		break;
+
+#ifdef SUPPORTS_INT64
+	case DPT_Int64:
+		if ( fn == proxies.m_Int64ToInt64 || fn == proxies.m_UInt64ToInt64 )
+			return 8;
+		break;
+#endif
+	}
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Size of the part of a DVariant a prop of this type actually uses
+//-----------------------------------------------------------------------------
+static int SendPlan_VariantBytes( const SendProp *pProp )
+{
+	switch ( pProp->GetType() )
+	{
+	case DPT_Int:
+	case DPT_Float:
+		return 4;
+	case DPT_Vector:
+		return 12;
+	case DPT_VectorXY:
+		return 8;
+	case DPT_String:
+		return DT_MAX_STRING_BUFFERSIZE;
+#ifdef SUPPORTS_INT64
+	case DPT_Int64:
+		return 8;
+#endif
+	}
+
+	return sizeof( DVariant );
+}
+
+static void SendPlan_StoreVariant( const SendProp *pProp, const DVariant &var, unsigned char *pOut, int nBytes )
+{
+	if ( pProp->GetType() == DPT_String )
+	{
+		Q_strncpy( (char*)pOut, var.m_pString ? var.m_pString : "", DT_MAX_STRING_BUFFERSIZE );
+	}
+	else
+	{
+		memcpy( pOut, &var.m_Int, nBytes );
+	}
+}
+
+static bool SendPlan_VariantDiffers( const SendProp *pProp, const DVariant &var, const unsigned char *pShadow, int nBytes )
+{
+	if ( pProp->GetType() == DPT_String )
+	{
+		return Q_strncmp( (const char*)pShadow, var.m_pString ? var.m_pString : "", DT_MAX_STRING_BUFFERSIZE - 1 ) != 0;
+	}
+
+	return memcmp( pShadow, &var.m_Int, nBytes ) != 0;
+}
+
+//-----------------------------------------------------------------------------
+// Bitwise comparison. Floats are deliberately not compared as floats:
+// -0 and 0 encode differently, and NaNs never compare equal.
+//-----------------------------------------------------------------------------
+static inline bool SendPlan_BytesDiffer( const unsigned char *pA, const unsigned char *pB, int nBytes )
+{
+	if ( nBytes < 16 )
+		return memcmp( pA, pB, nBytes ) != 0;
+
+	fltx4 diff = XorSIMD( LoadUnalignedSIMD( pA ), LoadUnalignedSIMD( pB ) );
+	for ( int i = 16; i < nBytes - 16; i += 16 )
+	{
+		diff = OrSIMD( diff, XorSIMD( LoadUnalignedSIMD( pA + i ), LoadUnalignedSIMD( pB + i ) ) );
+	}
+
+	// The last block overlaps the previous one rather than falling back to memcmp for the tail
+	diff = OrSIMD( diff, XorSIMD( LoadUnalignedSIMD( pA + nBytes - 16 ), LoadUnalignedSIMD( pB + nBytes - 16 ) ) );
+
+	ALIGN16 uint32 lanes[4] ALIGN16_POST;
+	StoreAlignedSIMD( (float*)lanes, diff );
+	return ( lanes[0] | lanes[1] | lanes[2] | lanes[3] ) != 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Flattens a SendTable tree into plan ops
+//-----------------------------------------------------------------------------
+class CSendTablePlanCompiler
+{
+public:
+	CSendTablePlanCompiler( CSendTablePlan *pPlan ) : m_pPlan( pPlan ), m_nDepth( 0 ), m_nMaxDepth( 0 ) {}
+
+	void Compile( SendTable *pTable )
+	{
+		GatherExcludes( pTable );
+
+		Scope_t root;
+		CompileTable( pTable, 0, root );
+		FinishScope( root, m_pPlan->m_Ops );
+
+		int nShadowBytes = 0;
+		for ( int i = 0; i < m_pPlan->m_Ops.Count(); i++ )
+		{
+			SendPlanOp_t &op = m_pPlan->m_Ops[i];
+			op.m_ShadowOffset = nShadowBytes;
+			nShadowBytes += op.m_nBytes;
+
+			if ( op.m_Type == SENDPLAN_RANGE )
+			{
+				m_pPlan->m_nRangeBytes += op.m_nBytes;
+			}
+			else
+			{
+				m_pPlan->m_nProxyBytes += op.m_nBytes;
+			}
+		}
+
+		m_pPlan->m_nShadowBytes = nShadowBytes;
+		m_pPlan->m_bValid = ( m_nMaxDepth <= SENDPLAN_MAX_DEPTH );
+	}
+
+private:
+	struct Range_t
+	{
+		int m_Offset;
+		int m_nBytes;
+	};
+
+	// Ranges and ops of one base pointer. Ranges are sorted and merged when
+	// the scope closes, so props declared out of order still coalesce.
+	struct Scope_t
+	{
+		CUtlVector<Range_t>			m_Ranges;
+		CUtlVector<SendPlanOp_t>	m_Ops;
+	};
+
+	static int RangeLessFunc( const Range_t *pLeft, const Range_t *pRight )
+	{
+		return pLeft->m_Offset - pRight->m_Offset;
+	}
+
+	static SendPlanOp_t MakeOp( int type, const SendProp *pProp, int structOffset, int offset, int nBytes )
+	{
+		SendPlanOp_t op;
+		op.m_Type = type;
+		op.m_iElement = 0;
+		op.m_nSkip = 0;
+		op.m_StructOffset = structOffset;
+		op.m_Offset = offset;
+		op.m_nBytes = nBytes;
+		op.m_ShadowOffset = 0;
+		op.m_pProp = pProp;
+		return op;
+	}
+
+	void GatherExcludes( SendTable *pTable )
+	{
+		for ( int i = 0; i < pTable->GetNumProps(); i++ )
+		{
+			SendProp *pProp = pTable->GetProp( i );
+			if ( pProp->IsExcludeProp() )
+			{
+				m_pPlan->m_Excludes.AddToTail( pProp );
+			}
+			else if ( pProp->GetType() == DPT_DataTable && pProp->GetDataTable() )
+			{
+				GatherExcludes( pProp->GetDataTable() );
+			}
+		}
+	}
+
+	bool IsExcluded( const SendTable *pTable, const SendProp *pProp )
+	{
+		for ( int i = 0; i < m_pPlan->m_Excludes.Count(); i++ )
+		{
+			const SendProp *pExclude = m_pPlan->m_Excludes[i];
+			if ( !Q_stricmp( pExclude->GetExcludeDTName(), pTable->GetName() ) &&
+				 !Q_stricmp( pExclude->GetName(), pProp->GetName() ) )
+			{
+				m_pPlan->m_ExcludedProps.AddToTail( pProp );
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void AddLeaf( const SendProp *pProp, int structOffset, int offset, int iElement, Scope_t &scope )
+	{
+		m_pPlan->m_nProps++;
+		m_pPlan->m_nMaxEncodeBytes += SendPlan_VariantBytes( pProp );
+
+		int nTrivialBytes = SendPlan_TrivialBytes( pProp );
+		if ( nTrivialBytes )
+		{
+			Range_t range = { offset, nTrivialBytes };
+			scope.m_Ranges.AddToTail( range );
+			return;
+		}
+
+		SendPlanOp_t op = MakeOp( SENDPLAN_PROXY, pProp, structOffset, offset, SendPlan_VariantBytes( pProp ) );
+		op.m_iElement = iElement;
+		scope.m_Ops.AddToTail( op );
+	}
+
+	void CompileTable( SendTable *pTable, int baseOffset, Scope_t &scope )
+	{
+		for ( int i = 0; i < pTable->GetNumProps(); i++ )
+		{
+			SendProp *pProp = pTable->GetProp( i );
+			if ( pProp->IsExcludeProp() || pProp->IsInsideArray() || IsExcluded( pTable, pProp ) )
+				continue;
+
+			switch ( pProp->GetType() )
+			{
+			case DPT_DataTable:
+				{
+					SendTable *pChild = pProp->GetDataTable();
+					if ( !pChild )
+						break;
+
+					// The default proxy only offsets the base, so its props fold into this scope
+					if ( pProp->GetDataTableProxyFn() == SendProxy_DataTableToDataTable )
+					{
+						CompileTable( pChild, baseOffset + pProp->GetOffset(), scope );
+						break;
+					}
+
+					int iOp = scope.m_Ops.AddToTail( MakeOp( SENDPLAN_DATATABLE, pProp, baseOffset, baseOffset + pProp->GetOffset(), SENDPLAN_DATATABLE_BYTES ) );
+
+					m_nMaxDepth = MAX( m_nMaxDepth, ++m_nDepth );
+					Scope_t child;
+					CompileTable( pChild, 0, child );
+					FinishScope( child, scope.m_Ops );
+					--m_nDepth;
+
+					scope.m_Ops.AddToTail( MakeOp( SENDPLAN_POP, pProp, 0, 0, 0 ) );
+					scope.m_Ops[iOp].m_nSkip = scope.m_Ops.Count() - iOp - 1;
+				}
+				break;
+
+			case DPT_Array:
+				{
+					// The element prop always precedes the array in its table
+					const SendProp *pElement = pProp->GetArrayProp();
+					if ( !pElement && i > 0 )
+					{
+						pElement = pTable->GetProp( i - 1 );
+					}
+
+					if ( !pElement )
+						break;
+
+					if ( pProp->GetArrayLengthProxy() )
+					{
+						scope.m_Ops.AddToTail( MakeOp( SENDPLAN_ARRAYLENGTH, pProp, baseOffset, 0, sizeof( int ) ) );
+					}
+
+					for ( int iElement = 0; iElement < pProp->GetNumElements(); iElement++ )
+					{
+						int offset = baseOffset + pElement->GetOffset() + iElement * pProp->GetElementStride();
+						AddLeaf( pElement, baseOffset, offset, iElement, scope );
+					}
+				}
+				break;
+
+			default:
+				AddLeaf( pProp, baseOffset, baseOffset + pProp->GetOffset(), 0, scope );
+				break;
+			}
+		}
+	}
+
+	void FinishScope( Scope_t &scope, CUtlVector<SendPlanOp_t> &out )
+	{
+		scope.m_Ranges.Sort( RangeLessFunc );
+
+		int iFirstRange = out.Count();
+		for ( int i = 0; i < scope.m_Ranges.Count(); i++ )
+		{
+			const Range_t &range = scope.m_Ranges[i];
+
+			// Merge with the previous range if it touches or overlaps this one
+			if ( out.Count() > iFirstRange )
+			{
+				SendPlanOp_t &prev = out.Tail();
+				if ( range.m_Offset <= prev.m_Offset + prev.m_nBytes )
+				{
+					prev.m_nBytes = MAX( prev.m_nBytes, range.m_Offset + range.m_nBytes - prev.m_Offset );
+					continue;
+				}
+			}
+
+			out.AddToTail( MakeOp( SENDPLAN_RANGE, NULL, 0, range.m_Offset, range.m_nBytes ) );
+		}
+
+		out.AddVectorToTail( scope.m_Ops );
+	}
+
+	CSendTablePlan	*m_pPlan;
+	int				m_nDepth;
+	int				m_nMaxDepth;
+};
+
+
+//-----------------------------------------------------------------------------
+// CSendTablePlan
+//-----------------------------------------------------------------------------
+CSendTablePlan::CSendTablePlan()
+{
+	m_pClass = NULL;
+	m_bValid = false;
+	m_nProps = 0;
+	m_nMaxEncodeBytes = 0;
+	m_nShadowBytes = 0;
+	m_nRangeBytes = 0;
+	m_nProxyBytes = 0;
+}
+
+void CSendTablePlan::Compile( ServerClass *pClass )
+{
+	m_pClass = pClass;
+
+	CSendTablePlanCompiler compiler( this );
+	compiler.Compile( pClass->m_pTable );
+}
+
+//-----------------------------------------------------------------------------
+// Runs the plan against an entity. In store mode the shadow is rewritten; in
+// compare mode this stops and returns true at the first difference.
+//-----------------------------------------------------------------------------
+bool CSendTablePlan::Walk( const void *pEntity, int objectID, unsigned char *pShadow, bool bStore, bool bProxies ) const
+{
+	const unsigned char *pBaseStack[SENDPLAN_MAX_DEPTH];
+	const unsigned char *pBase = (const unsigned char*)pEntity;
+	int nDepth = 0;
+
+	const SendPlanOp_t *pOps = m_Ops.Base();
+	int nOps = m_Ops.Count();
+	for ( int i = 0; i < nOps; i++ )
+	{
+		const SendPlanOp_t &op = pOps[i];
+		unsigned char *pSlot = pShadow + op.m_ShadowOffset;
+
+		switch ( op.m_Type )
+		{
+		case SENDPLAN_RANGE:
+			if ( bStore )
+			{
+				memcpy( pSlot, pBase + op.m_Offset, op.m_nBytes );
+			}
+			else if ( SendPlan_BytesDiffer( pBase + op.m_Offset, pSlot, op.m_nBytes ) )
+			{
+				return true;
+			}
+			break;
+
+		case SENDPLAN_PROXY:
+			if ( bProxies )
+			{
+				DVariant var;
+				op.m_pProp->GetProxyFn()( op.m_pProp, pBase + op.m_StructOffset, pBase + op.m_Offset, &var, op.m_iElement, objectID );
+
+				if ( bStore )
+				{
+					SendPlan_StoreVariant( op.m_pProp, var, pSlot, op.m_nBytes );
+				}
+				else if ( SendPlan_VariantDiffers( op.m_pProp, var, pSlot, op.m_nBytes ) )
+				{
+					return true;
+				}
+			}
+			break;
+
+		case SENDPLAN_ARRAYLENGTH:
+			if ( bProxies )
+			{
+				int nElements = op.m_pProp->GetArrayLengthProxy()( pBase + op.m_StructOffset, objectID );
+				if ( bStore )
+				{
+					memcpy( pSlot, &nElements, sizeof( nElements ) );
+				}
+				else if ( memcmp( pSlot, &nElements, sizeof( nElements ) ) )
+				{
+					return true;
+				}
+			}
+			break;
+
+		case SENDPLAN_DATATABLE:
+			{
+				CSendProxyRecipients recipients;
+				recipients.SetAllRecipients();
+
+				const void *pNewBase = op.m_pProp->GetDataTableProxyFn()( op.m_pProp, pBase + op.m_StructOffset, pBase + op.m_Offset, &recipients, objectID );
+
+				if ( bStore )
+				{
+					memcpy( pSlot, &pNewBase, sizeof( pNewBase ) );
+					memcpy( pSlot + sizeof( pNewBase ), &recipients, sizeof( recipients ) );
+				}
+				else if ( memcmp( pSlot, &pNewBase, sizeof( pNewBase ) ) ||
+						  memcmp( pSlot + sizeof( pNewBase ), &recipients, sizeof( recipients ) ) )
+				{
+					return true;
+				}
+
+				if ( !pNewBase )
+				{
+					// Nothing below this table gets sent; skip through the matching pop
+					i += op.m_nSkip;
+					break;
+				}
+
+				pBaseStack[nDepth++] = pBase;
+				pBase = (const unsigned char*)pNewBase;
+			}
+			break;
+
+		case SENDPLAN_POP:
+			pBase = pBaseStack[--nDepth];
+			break;
+		}
+	}
+
+	return false;
+}
+
+void CSendTablePlan::Store( const void *pEntity, int objectID, unsigned char *pShadow, bool bProxies ) const
+{
+	Walk( pEntity, objectID, pShadow, true, bProxies );
+}
+
+bool CSendTablePlan::Differs( const void *pEntity, int objectID, const unsigned char *pShadow, bool bProxies ) const
+{
+	return Walk( pEntity, objectID, const_cast<unsigned char*>( pShadow ), false, bProxies );
+}
+
+//-----------------------------------------------------------------------------
+// Walks the SendTable tree the way the engine's encoder does: every
+// datatable and every prop goes through its proxy.
+//-----------------------------------------------------------------------------
+int CSendTablePlan::EncodeTable( const SendTable *pTable, const void *pBase, int objectID, unsigned char *pOut ) const
+{
+	int nWritten = 0;
+
+	for ( int i = 0; i < pTable->m_nProps; i++ )
+	{
+		const SendProp *pProp = &pTable->m_pProps[i];
+		if ( pProp->IsExcludeProp() || pProp->IsInsideArray() || m_ExcludedProps.Find( pProp ) != -1 )
+			continue;
+
+		const unsigned char *pData = (const unsigned char*)pBase + pProp->GetOffset();
+
+		switch ( pProp->GetType() )
+		{
+		case DPT_DataTable:
+			{
+				if ( !pProp->GetDataTable() )
+					break;
+
+				CSendProxyRecipients recipients;
+				recipients.SetAllRecipients();
+
+				const void *pNewBase = pProp->GetDataTableProxyFn()( pProp, pBase, pData, &recipients, objectID );
+				if ( pNewBase )
+				{
+					nWritten += EncodeTable( pProp->GetDataTable(), pNewBase, objectID, pOut + nWritten );
+				}
+			}
+			break;
+
+		case DPT_Array:
+			{
+				const SendProp *pElement = pProp->GetArrayProp();
+				if ( !pElement && i > 0 )
+				{
+					pElement = &pTable->m_pProps[i - 1];
+				}
+
+				if ( !pElement )
+					break;
+
+				int nElements = pProp->GetNumElements();
+				if ( pProp->GetArrayLengthProxy() )
+				{
+					nElements = MIN( nElements, pProp->GetArrayLengthProxy()( pBase, objectID ) );
+				}
+
+				int nBytes = SendPlan_VariantBytes( pElement );
+				const unsigned char *pElementData = (const unsigned char*)pBase + pElement->GetOffset();
+				for ( int iElement = 0; iElement < nElements; iElement++ )
+				{
+					DVariant var;
+					pElement->GetProxyFn()( pElement, pBase, pElementData, &var, iElement, objectID );
+					SendPlan_StoreVariant( pElement, var, pOut + nWritten, nBytes );
+					nWritten += nBytes;
+					pElementData += pProp->GetElementStride();
+				}
+			}
+			break;
+
+		default:
+			{
+				DVariant var;
+				int nBytes = SendPlan_VariantBytes( pProp );
+				pProp->GetProxyFn()( pProp, pBase, pData, &var, 0, objectID );
+				SendPlan_StoreVariant( pProp, var, pOut + nWritten, nBytes );
+				nWritten += nBytes;
+			}
+			break;
+		}
+	}
+
+	return nWritten;
+}
+
+void CSendTablePlan::EncodeWithProxies( const void *pEntity, int objectID, unsigned char *pOut ) const
+{
+	EncodeTable( m_pClass->m_pTable, pEntity, objectID, pOut );
+}
+
+
+//-----------------------------------------------------------------------------
+// Per-edict shadows of the last packed state, and the plan cache
+//-----------------------------------------------------------------------------
+struct SendPlanShadow_t
+{
+	CBaseHandle		m_hEntity;
+	ServerClass		*m_pClass;
+	unsigned char	*m_pData;
+	int				m_nBytes;
+	bool			m_bValid;			// m_pData holds what the engine last packed
+	bool			m_bProxiesValid;	// Proxy outputs in m_pData are current, not just the ranges
+	bool			m_bPendingPack;		// Refreshed at the last client update; valid once the engine clears the flag
+};
+
+class CSendTablePlanSystem : public CAutoGameSystemPerFrame
+{
+public:
+	CSendTablePlanSystem() : CAutoGameSystemPerFrame( "CSendTablePlanSystem" )
+	{
+		memset( m_Shadows, 0, sizeof( m_Shadows ) );
+		m_bHaveShadows = false;
+		ResetStats();
+	}
+
+	virtual void Shutdown()
+	{
+		FreeShadows();
+		m_Plans.PurgeAndDeleteElements();
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		FreeShadows();
+	}
+
+	virtual void FrameUpdatePreEntityThink();
+
+	void PreClientUpdate();
+	CSendTablePlan *GetPlan( ServerClass *pClass );
+	void PrintStats();
+	void ResetStats() { m_nChecked = m_nSuppressed = m_nRefreshed = 0; }
+
+private:
+	void FreeShadows();
+	SendPlanShadow_t &GetShadow( int iEdict, const CBaseHandle &hEntity, ServerClass *pClass, const CSendTablePlan *pPlan );
+
+	SendPlanShadow_t				m_Shadows[MAX_EDICTS];
+	CUtlVector<unsigned short>		m_PendingPack;
+	CUtlVector<CSendTablePlan*>		m_Plans;	// Indexed by ServerClass::m_ClassID
+	bool							m_bHaveShadows;
+
+	int								m_nChecked;
+	int								m_nSuppressed;
+	int								m_nRefreshed;
+};
+
+static CSendTablePlanSystem g_SendTablePlanSystem;
+
+
+CSendTablePlan *CSendTablePlanSystem::GetPlan( ServerClass *pClass )
+{
+	int iClass = pClass->m_ClassID;
+	if ( iClass < 0 )
+		return NULL;
+
+	if ( iClass >= m_Plans.Count() )
+	{
+		int nOld = m_Plans.Count();
+		m_Plans.SetCount( iClass + 1 );
+		for ( int i = nOld; i < m_Plans.Count(); i++ )
+		{
+			m_Plans[i] = NULL;
+		}
+	}
+
+	CSendTablePlan *pPlan = m_Plans[iClass];
+	if ( !pPlan || pPlan->GetServerClass() != pClass )
+	{
+		delete pPlan;
+		pPlan = new CSendTablePlan;
+		pPlan->Compile( pClass );
+		m_Plans[iClass] = pPlan;
+	}
+
+	return pPlan;
+}
+
+void CSendTablePlanSystem::FreeShadows()
+{
+	if ( !m_bHaveShadows )
+		return;
+
+	for ( int i = 0; i < MAX_EDICTS; i++ )
+	{
+		delete [] m_Shadows[i].m_pData;
+	}
+
+	memset( m_Shadows, 0, sizeof( m_Shadows ) );
+	m_PendingPack.RemoveAll();
+	m_bHaveShadows = false;
+}
+
+SendPlanShadow_t &CSendTablePlanSystem::GetShadow( int iEdict, const CBaseHandle &hEntity, ServerClass *pClass, const CSendTablePlan *pPlan )
+{
+	SendPlanShadow_t &shadow = m_Shadows[iEdict];
+	if ( shadow.m_pData && shadow.m_hEntity == hEntity && shadow.m_pClass == pClass )
+		return shadow;
+
+	// New entity in this slot; nothing we hold describes what the engine packed for it
+	if ( shadow.m_nBytes < pPlan->GetShadowBytes() )
+	{
+		delete [] shadow.m_pData;
+		shadow.m_pData = new unsigned char[pPlan->GetShadowBytes()];
+		shadow.m_nBytes = pPlan->GetShadowBytes();
+	}
+
+	shadow.m_hEntity = hEntity;
+	shadow.m_pClass = pClass;
+	shadow.m_bValid = false;
+	shadow.m_bProxiesValid = false;
+	shadow.m_bPendingPack = false;
+	m_bHaveShadows = true;
+	return shadow;
+}
+
+//-----------------------------------------------------------------------------
+// The engine clears the changed flag when it packs an entity, so a shadow
+// refreshed at the last client update is known to match the packed state
+// only if the flag is clear when the next frame starts.
+//-----------------------------------------------------------------------------
+void CSendTablePlanSystem::FrameUpdatePreEntityThink()
+{
+	if ( !m_PendingPack.Count() )
+		return;
+
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+	for ( int i = 0; i < m_PendingPack.Count(); i++ )
+	{
+		int iEdict = m_PendingPack[i];
+		SendPlanShadow_t &shadow = m_Shadows[iEdict];
+		if ( !shadow.m_bPendingPack )
+			continue;
+
+		edict_t *pEdict = pBaseEdict + iEdict;
+		shadow.m_bValid = !pEdict->IsFree() && !pEdict->HasStateChanged();
+		shadow.m_bPendingPack = false;
+	}
+
+	m_PendingPack.RemoveAll();
+}
+
+void CSendTablePlanSystem::PreClientUpdate()
+{
+	if ( !sv_sendplan_changedetect.GetBool() )
+	{
+		// Shadows stop tracking packed state as soon as we stop looking at them
+		FreeShadows();
+		return;
+	}
+
+	VPROF_BUDGET( "SendTablePlan_PreClientUpdate", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+	int nEdicts = MIN( gpGlobals->maxEntities, MAX_EDICTS );
+	for ( int iEdict = 1; iEdict < nEdicts; iEdict++ )
+	{
+		edict_t *pEdict = pBaseEdict + iEdict;
+		if ( pEdict->IsFree() || !pEdict->HasStateChanged() )
+			continue;
+
+		IServerUnknown *pUnknown = pEdict->GetUnknown();
+		IServerNetworkable *pNetworkable = pEdict->GetNetworkable();
+		if ( !pUnknown || !pNetworkable )
+			continue;
+
+		ServerClass *pClass = pNetworkable->GetServerClass();
+		CSendTablePlan *pPlan = pClass ? GetPlan( pClass ) : NULL;
+		if ( !pPlan || !pPlan->IsValid() )
+			continue;
+
+		SendPlanShadow_t &shadow = GetShadow( iEdict, pUnknown->GetRefEHandle(), pClass, pPlan );
+		++m_nChecked;
+
+		if ( shadow.m_bValid && shadow.m_bProxiesValid )
+		{
+			if ( !pPlan->Differs( pUnknown, iEdict, shadow.m_pData, true ) )
+			{
+				// Same bytes the engine already has; don't make it encode them again
+				pEdict->ClearStateChanged();
+				++m_nSuppressed;
+				continue;
+			}
+
+			// Changed. Entities that change every frame only pay for the ranges.
+			pPlan->Store( pUnknown, iEdict, shadow.m_pData, false );
+			shadow.m_bProxiesValid = false;
+		}
+		else if ( shadow.m_bValid && !pPlan->Differs( pUnknown, iEdict, shadow.m_pData, false ) )
+		{
+			// Ranges settled; pick up the proxy outputs so the next update can be skipped
+			pPlan->Store( pUnknown, iEdict, shadow.m_pData, true );
+			shadow.m_bProxiesValid = true;
+		}
+		else
+		{
+			pPlan->Store( pUnknown, iEdict, shadow.m_pData, !shadow.m_bValid );
+			shadow.m_bProxiesValid = !shadow.m_bValid;
+		}
+
+		++m_nRefreshed;
+		shadow.m_bValid = false;
+		if ( !shadow.m_bPendingPack )
+		{
+			shadow.m_bPendingPack = true;
+			m_PendingPack.AddToTail( iEdict );
+		}
+	}
+}
+
+void CSendTablePlanSystem::PrintStats()
+{
+	int nPlans = 0, nOps = 0, nProps = 0, nShadowBytes = 0, nRangeBytes = 0;
+	for ( int i = 0; i < m_Plans.Count(); i++ )
+	{
+		const CSendTablePlan *pPlan = m_Plans[i];
+		if ( !pPlan )
+			continue;
+
+		++nPlans;
+		nOps += pPlan->GetNumOps();
+		nProps += pPlan->GetNumProps();
+		nShadowBytes += pPlan->GetShadowBytes();
+		nRangeBytes += pPlan->GetNumRangeBytes();
+	}
+
+	Msg( "SendTable plans: %d compiled, %d props in %d ops, %d shadow bytes (%d raw)\n", nPlans, nProps, nOps, nShadowBytes, nRangeBytes );
+	Msg( "Change detection: %d checked, %d suppressed (%.1f%%), %d refreshed\n",
+		m_nChecked, m_nSuppressed, m_nChecked ? 100.0f * m_nSuppressed / m_nChecked : 0.0f, m_nRefreshed );
+}
+
+
+CSendTablePlan *SendTablePlan_Get( ServerClass *pClass )
+{
+	return g_SendTablePlanSystem.GetPlan( pClass );
+}
+
+void SendTablePlan_PreClientUpdate()
+{
+	g_SendTablePlanSystem.PreClientUpdate();
+}
+
+
+CON_COMMAND( sv_sendplan_stats, "Print SendTable plan and change detection statistics. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_SendTablePlanSystem.PrintStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_SendTablePlanSystem.ResetStats();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Records the current set of networked entities and runs it through the
+// per-prop proxy walk, the plan encoder and the plan compare.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( sv_sendplan_bench, "Benchmark SendTable plans against per-prop proxy encoding. Usage: sv_sendplan_bench [iterations]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 100;
+
+	struct BenchEntity_t
+	{
+		const void			*m_pEntity;
+		int					m_iEdict;
+		const CSendTablePlan *m_pPlan;
+		unsigned char		*m_pShadow;
+		unsigned char		*m_pEncoded;
+	};
+
+	CUtlVector<BenchEntity_t> entities;
+	int64 nStateBytes = 0;
+
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+	int nEdicts = MIN( gpGlobals->maxEntities, MAX_EDICTS );
+	for ( int iEdict = 1; iEdict < nEdicts; iEdict++ )
+	{
+		edict_t *pEdict = pBaseEdict + iEdict;
+		if ( pEdict->IsFree() || !pEdict->GetUnknown() || !pEdict->GetNetworkable() )
+			continue;
+
+		ServerClass *pClass = pEdict->GetNetworkable()->GetServerClass();
+		const CSendTablePlan *pPlan = pClass ? SendTablePlan_Get( pClass ) : NULL;
+		if ( !pPlan || !pPlan->IsValid() )
+			continue;
+
+		BenchEntity_t entity;
+		entity.m_pEntity = pEdict->GetUnknown();
+		entity.m_iEdict = iEdict;
+		entity.m_pPlan = pPlan;
+		entity.m_pShadow = new unsigned char[pPlan->GetShadowBytes()];
+		entity.m_pEncoded = new unsigned char[pPlan->GetMaxEncodeBytes()];
+		entities.AddToTail( entity );
+
+		nStateBytes += pPlan->GetShadowBytes();
+	}
+
+	if ( !entities.Count() )
+	{
+		Msg( "sv_sendplan_bench: no networked entities\n" );
+		return;
+	}
+
+	CFastTimer timer;
+
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < entities.Count(); i++ )
+		{
+			const BenchEntity_t &entity = entities[i];
+			entity.m_pPlan->EncodeWithProxies( entity.m_pEntity, entity.m_iEdict, entity.m_pEncoded );
+		}
+	}
+	timer.End();
+	double flProxySeconds = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < entities.Count(); i++ )
+		{
+			const BenchEntity_t &entity = entities[i];
+			entity.m_pPlan->Store( entity.m_pEntity, entity.m_iEdict, entity.m_pShadow, true );
+		}
+	}
+	timer.End();
+	double flStoreSeconds = timer.GetDuration().GetSeconds();
+
+	// Every entity matches its shadow here, so each compare walks the whole plan
+	int nDiffers = 0;
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < entities.Count(); i++ )
+		{
+			const BenchEntity_t &entity = entities[i];
+			nDiffers += entity.m_pPlan->Differs( entity.m_pEntity, entity.m_iEdict, entity.m_pShadow, true ) ? 1 : 0;
+		}
+	}
+	timer.End();
+	double flCompareSeconds = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < entities.Count(); i++ )
+		{
+			const BenchEntity_t &entity = entities[i];
+			entity.m_pPlan->Differs( entity.m_pEntity, entity.m_iEdict, entity.m_pShadow, false );
+		}
+	}
+	timer.End();
+	double flRangeSeconds = timer.GetDuration().GetSeconds();
+
+	for ( int i = 0; i < entities.Count(); i++ )
+	{
+		delete [] entities[i].m_pShadow;
+		delete [] entities[i].m_pEncoded;
+	}
+
+	double flMB = (double)nStateBytes * nIterations / ( 1024.0 * 1024.0 );
+	Msg( "sv_sendplan_bench: %d entities, %lld bytes of state, %d iterations\n", entities.Count(), nStateBytes, nIterations );
+	Msg( "  proxy encode   %8.2f ms  %8.1f MB/s\n", flProxySeconds * 1000.0, flMB / MAX( flProxySeconds, 1e-9 ) );
+	Msg( "  plan encode    %8.2f ms  %8.1f MB/s\n", flStoreSeconds * 1000.0, flMB / MAX( flStoreSeconds, 1e-9 ) );
+	Msg( "  plan compare   %8.2f ms  %8.1f MB/s\n", flCompareSeconds * 1000.0, flMB / MAX( flCompareSeconds, 1e-9 ) );
+	Msg( "  range compare  %8.2f ms  %8.1f MB/s\n", flRangeSeconds * 1000.0, flMB / MAX( flRangeSeconds, 1e-9 ) );
+
+	if ( nDiffers )
+	{
+		// Proxies that aren't pure functions of entity state (random, time based, ...) show up here
+		Warning( "sv_sendplan_bench: %d compares saw state change between identical walks\n", nDiffers );
+	}
+}
@@ -0,0 +1,108 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Precompiled SendTable walk plans. Each ServerClass's SendTable is
+//			flattened once into a list of raw memory ranges (props whose
+//			proxies are plain copies) and proxy calls, which lets the game
+//			snapshot an entity's networked state and compare it against
+//			the last snapshot without walking the SendTable tree.
+//
+//=============================================================================//
+
+#ifndef SENDTABLE_PLAN_H
+#define SENDTABLE_PLAN_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+
+class ServerClass;
+class SendTable;
+class SendProp;
+
+
+//-----------------------------------------------------------------------------
+// A single step of a compiled plan
+//-----------------------------------------------------------------------------
+enum SendPlanOpType_t
+{
+	SENDPLAN_RANGE = 0,		// Raw bytes, compared/copied directly
+	SENDPLAN_PROXY,			// Non-trivial proxy, compared on its DVariant output
+	SENDPLAN_ARRAYLENGTH,	// Array length proxy output
+	SENDPLAN_DATATABLE,		// Custom datatable proxy; pushes a new base pointer
+	SENDPLAN_POP,			// Restores the base pointer of the enclosing datatable
+};
+
+struct SendPlanOp_t
+{
+	unsigned short	m_Type;			// SendPlanOpType_t
+	unsigned short	m_iElement;		// Element index passed to array element proxies
+	int				m_nSkip;		// SENDPLAN_DATATABLE: ops to skip when the proxy returns NULL
+	int				m_StructOffset;	// Offset of the struct base handed to proxies
+	int				m_Offset;		// Offset of the data from the current base pointer
+	int				m_nBytes;		// Bytes of shadow state this op owns
+	int				m_ShadowOffset;
+	const SendProp	*m_pProp;
+};
+
+
+//-----------------------------------------------------------------------------
+// Compiled plan for one ServerClass
+//-----------------------------------------------------------------------------
+class CSendTablePlan
+{
+public:
+	CSendTablePlan();
+
+	void Compile( ServerClass *pClass );
+
+	// Writes the current networked state of pEntity into pShadow. When bProxies
+	// is false only the raw ranges and datatable pointers are written.
+	void Store( const void *pEntity, int objectID, unsigned char *pShadow, bool bProxies ) const;
+
+	// Returns true if the entity's networked state differs from pShadow.
+	bool Differs( const void *pEntity, int objectID, const unsigned char *pShadow, bool bProxies ) const;
+
+	// Evaluates every prop through its own proxy, the same way the engine's
+	// encoder does. Only used to benchmark against the plan.
+	void EncodeWithProxies( const void *pEntity, int objectID, unsigned char *pOut ) const;
+
+	ServerClass *GetServerClass() const { return m_pClass; }
+	bool IsValid() const { return m_bValid; }
+	int GetShadowBytes() const { return m_nShadowBytes; }
+	int GetNumOps() const { return m_Ops.Count(); }
+	int GetNumRangeBytes() const { return m_nRangeBytes; }
+	int GetNumProps() const { return m_nProps; }
+	int GetMaxEncodeBytes() const { return m_nMaxEncodeBytes; }
+
+private:
+	bool Walk( const void *pEntity, int objectID, unsigned char *pShadow, bool bStore, bool bProxies ) const;
+	int EncodeTable( const SendTable *pTable, const void *pBase, int objectID, unsigned char *pOut ) const;
+	bool IsExcluded( const SendTable *pTable, const SendProp *pProp ) const;
+
+	ServerClass					*m_pClass;
+	CUtlVector<SendPlanOp_t>	m_Ops;
+	CUtlVector<const SendProp*>	m_Excludes;			// SPROP_EXCLUDE entries found in the tree
+	CUtlVector<const SendProp*>	m_ExcludedProps;	// Props those entries resolved to
+	bool						m_bValid;
+	int							m_nProps;
+	int							m_nMaxEncodeBytes;
+	int							m_nShadowBytes;
+	int							m_nRangeBytes;
+	int							m_nProxyBytes;
+
+	friend class CSendTablePlanCompiler;
+};
+
+
+//-----------------------------------------------------------------------------
+// Returns the plan for a server class, compiling it on first use.
+//-----------------------------------------------------------------------------
+CSendTablePlan *SendTablePlan_Get( ServerClass *pClass );
+
+// Called after the game systems' PreClientUpdate. Clears the state-changed
+// flag on entities whose networked state matches what was last sent.
+void SendTablePlan_PreClientUpdate();
+
+
+#endif // SENDTABLE_PLAN_H
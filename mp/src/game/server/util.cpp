@@ -36,6 +36,7 @@
 #include "datacache/imdlcache.h"
 #include "util.h"
 #include "cdll_int.h"
+#include "tier1/smallobjectallocator.h"
 
 #ifdef PORTAL
 #include "PortalSimulation.h"
@@ -122,6 +123,14 @@ CON_COMMAND( dump_entity_sizes, "Print sizeof(entclass)" )
 	((CEntityFactoryDictionary*)EntityFactoryDictionary())->ReportEntitySizes();
 }
 
+CON_COMMAND( sv_smallobject_stats, "Prints the server's small object allocator size classes and the live counts of the classes that use it." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	SmallObjectAllocator().ReportStats();
+}
+
 
 //-----------------------------------------------------------------------------
 // Constructor
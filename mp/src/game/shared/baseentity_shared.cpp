@@ -19,6 +19,8 @@
 #include "debugoverlay_shared.h"
 #include "coordsize.h"
 #include "vphysics/performance.h"
+#include "movetracecache.h"
+#include "bone_setup.h"
 
 #ifdef CLIENT_DLL
 	#include "c_te_effect_dispatch.h"
@@ -1690,6 +1692,31 @@ void CBaseEntity::FireBullets( const FireBulletsInfo_t &info )
 	//-----------------------------------------------------
 	CShotManipulator Manipulator( info.m_vecDirShooting );
 
+	// A player's pellet spread only depends on its seed, so the ray pellets can be worked out up front
+	// and traced against hitboxes as one batch. The hull pellets are left out.
+	CHitboxRayBatch pelletBatch;
+	if ( IsPlayer() && info.m_iShots > 1 && CHitboxBVH::IsEnabled() )
+	{
+		for ( int iShot = 0; iShot < info.m_iShots; iShot += 2 )
+		{
+			RandomSeed( iSeed + iShot );
+
+			if ( iShot == 0 && (info.m_nFlags & FIRE_BULLETS_FIRST_SHOT_ACCURATE) )
+			{
+				vecDir = Manipulator.GetShotDirection();
+			}
+			else
+			{
+				vecDir = Manipulator.ApplySpread( info.m_vecSpread );
+			}
+
+			if ( !pelletBatch.AddRay( info.m_vecSrc, info.m_vecSrc + vecDir * info.m_flDistance ) )
+				break;
+		}
+
+		pelletBatch.Activate();
+	}
+
 	bool bDoImpacts = false;
 	bool bDoTracers = false;
 	
@@ -2486,6 +2513,8 @@ void CBaseEntity::SetCollisionGroup( int collisionGroup )
 
 void CBaseEntity::CollisionRulesChanged()
 {
+	MoveTraceCache_EntityChanged( this );
+
 	// ivp maintains state based on recent return values from the collision filter, so anything
 	// that can change the state that a collision filter will return (like m_Solid) needs to call RecheckCollisionFilter.
 	if ( VPhysicsGetObject() )
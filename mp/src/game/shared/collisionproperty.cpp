@@ -11,6 +11,7 @@
 #include "utlvector.h"
 #include "tier0/threadtools.h"
 #include "tier0/tslist.h"
+#include "movetracecache.h"
 
 #ifdef CLIENT_DLL
 
@@ -566,6 +567,8 @@ void CCollisionProperty::SetSolid( SolidType_t val )
 
 	m_nSolidType = val;
 
+	MoveTraceCache_EntityChanged( m_pOuter );
+
 #ifndef CLIENT_DLL
 	m_pOuter->CollisionRulesChanged();
 
@@ -1290,6 +1293,7 @@ void CCollisionProperty::CreatePartitionHandle()
 	// Put the entity into the spatial partition.
 	Assert( m_Partition == PARTITION_INVALID_HANDLE );
 	m_Partition = partition->CreateHandle( GetEntityHandle() );
+	MoveTraceCache_WorldChanged();
 }
 
 void CCollisionProperty::DestroyPartitionHandle()
@@ -1298,6 +1302,7 @@ void CCollisionProperty::DestroyPartitionHandle()
 	{
 		partition->DestroyHandle( m_Partition );
 		m_Partition = PARTITION_INVALID_HANDLE;
+		MoveTraceCache_WorldChanged();
 	}
 }
 
@@ -1359,6 +1364,12 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 	// don't bother with the world
 	if ( m_pOuter->entindex() == 0 )
 		return;
+
+	// Cached movement traces may have hit or missed this
+	if ( IsSolid() )
+	{
+		MoveTraceCache_EntityChanged( m_pOuter );
+	}
 	
 	if ( !m_pOuter->IsEFlagSet( EFL_DIRTY_SPATIAL_PARTITION ) )
 	{
@@ -32,6 +32,7 @@ extern IFileSystem *filesystem;
 
 #ifndef CLIENT_DLL
 	#include "env_player_surface_trigger.h"
+	#include "player_parallelmove.h"
 	static ConVar dispcoll_drawplane( "dispcoll_drawplane", "0" );
 #endif
 
@@ -1138,7 +1139,12 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 
 	//!!HACK HACK: Adrian - slow down all player movement by this factor.
 	//!!Blame Yahn for this one.
-	gpGlobals->frametime *= pPlayer->GetLaggedMovementValue();
+	// Only write gpGlobals when needed; players moving in parallel share it.
+	bool bLagged = ( pPlayer->GetLaggedMovementValue() != 1.0f );
+	if ( bLagged )
+	{
+		gpGlobals->frametime *= pPlayer->GetLaggedMovementValue();
+	}
 
 	ResetGetPointContentsCache();
 
@@ -1168,7 +1174,10 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 	// CheckV( player->CurrentCommandNumber(), "EndPos", mv->GetAbsOrigin() );
 
 	//This is probably not needed, but just in case.
-	gpGlobals->frametime = flStoreFrametime;
+	if ( bLagged )
+	{
+		gpGlobals->frametime = flStoreFrametime;
+	}
 
 // 	player = NULL;
 }
@@ -2135,7 +2144,15 @@ void CGameMovement::FullWalkMove( )
 	{
 		PlaySwimSound();
 #if !defined( CLIENT_DLL )
-		player->Splash();
+		CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+		if ( pDeferred )
+		{
+			pDeferred->Splash();
+		}
+		else
+		{
+			player->Splash();
+		}
 #endif
 	}
 }
@@ -2419,7 +2436,17 @@ bool CGameMovement::CheckJumpButton( void )
 	// In the air now.
     SetGroundEntity( NULL );
 	
-	player->PlayStepSound( (Vector &)mv->GetAbsOrigin(), player->m_pSurfaceData, 1.0, true );
+#ifndef CLIENT_DLL
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->PlayStepSound( mv->GetAbsOrigin(), player->m_pSurfaceData, 1.0, true );
+	}
+	else
+#endif
+	{
+		player->PlayStepSound( (Vector &)mv->GetAbsOrigin(), player->m_pSurfaceData, 1.0, true );
+	}
 	
 	MoveHelper()->PlayerSetAnimation( PLAYER_JUMP );
 
@@ -3883,7 +3910,15 @@ void CGameMovement::CategorizePosition( void )
 			// Changed?
 			if ( player->m_chPreviousTextureType != cCurrGameMaterial )
 			{
-				CEnvPlayerSurfaceTrigger::SetPlayerSurface( player, cCurrGameMaterial );
+				CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+				if ( pDeferred )
+				{
+					pDeferred->SetPlayerSurface( cCurrGameMaterial );
+				}
+				else
+				{
+					CEnvPlayerSurfaceTrigger::SetPlayerSurface( player, cCurrGameMaterial );
+				}
 			}
 
 			player->m_chPreviousTextureType = cCurrGameMaterial;
@@ -3973,7 +4008,17 @@ void CGameMovement::PlayerRoughLandingEffects( float fvol )
 		player->m_flStepSoundTime = 400;
 
 		// Play step sound for current texture.
-		player->PlayStepSound( (Vector &)mv->GetAbsOrigin(), player->m_pSurfaceData, fvol, true );
+#ifndef CLIENT_DLL
+		CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+		if ( pDeferred )
+		{
+			pDeferred->PlayStepSound( mv->GetAbsOrigin(), player->m_pSurfaceData, fvol, true );
+		}
+		else
+#endif
+		{
+			player->PlayStepSound( (Vector &)mv->GetAbsOrigin(), player->m_pSurfaceData, fvol, true );
+		}
 
 		//
 		// Knock the screen around a little bit, temporary effect.
@@ -3986,7 +4031,14 @@ void CGameMovement::PlayerRoughLandingEffects( float fvol )
 		}
 
 #if !defined( CLIENT_DLL )
-		player->RumbleEffect( ( fvol > 0.85f ) ? ( RUMBLE_FALL_LONG ) : ( RUMBLE_FALL_SHORT ), 0, RUMBLE_FLAGS_NONE );
+		if ( pDeferred )
+		{
+			pDeferred->RumbleEffect( ( fvol > 0.85f ) ? ( RUMBLE_FALL_LONG ) : ( RUMBLE_FALL_SHORT ), 0, RUMBLE_FLAGS_NONE );
+		}
+		else
+		{
+			player->RumbleEffect( ( fvol > 0.85f ) ? ( RUMBLE_FALL_LONG ) : ( RUMBLE_FALL_SHORT ), 0, RUMBLE_FLAGS_NONE );
+		}
 #endif
 	}
 }
@@ -4605,7 +4657,18 @@ void CGameMovement::PlayerMove( void )
 
 	m_nOnLadder = 0;
 
-	player->UpdateStepSound( player->m_pSurfaceData, mv->GetAbsOrigin(), mv->m_vecVelocity );
+#ifndef CLIENT_DLL
+	// Step sounds look at other entities; run them on the main thread
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->UpdateStepSound( player->m_pSurfaceData, mv->GetAbsOrigin(), mv->m_vecVelocity );
+	}
+	else
+#endif
+	{
+		player->UpdateStepSound( player->m_pSurfaceData, mv->GetAbsOrigin(), mv->m_vecVelocity );
+	}
 
 	UpdateDuckJumpEyeOffset();
 	Duck();
@@ -4907,6 +4970,12 @@ void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, uns
 {
 	VPROF( "CGameMovement::TracePlayerBBox" );
 
+	if ( CMoveTraceCache::IsEnabled() )
+	{
+		TraceHullCached( start, end, GetPlayerMins(), GetPlayerMaxs(), fMask, collisionGroup, pm );
+		return;
+	}
+
 	Ray_t ray;
 	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
 	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
@@ -4915,6 +4984,22 @@ void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, uns
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Identical traces repeat within a command, and across commands when
+//			prediction reruns them or a server tick runs several
+//-----------------------------------------------------------------------------
+void CGameMovement::TraceHullCached( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm )
+{
+	if ( m_TraceCache.Lookup( player, start, end, mins, maxs, fMask, collisionGroup, pm ) )
+		return;
+
+	Ray_t ray;
+	ray.Init( start, end, mins, maxs );
+	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
+
+	m_TraceCache.Store( player, start, end, mins, maxs, fMask, collisionGroup, pm );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: overridded by game classes to limit results (to standable objects for example)
 //-----------------------------------------------------------------------------
@@ -4922,6 +5007,12 @@ void  CGameMovement::TryTouchGround( const Vector& start, const Vector& end, con
 {
 	VPROF( "CGameMovement::TryTouchGround" );
 
+	if ( CMoveTraceCache::IsEnabled() )
+	{
+		TraceHullCached( start, end, mins, maxs, fMask, collisionGroup, pm );
+		return;
+	}
+
 	Ray_t ray;
 	ray.Init( start, end, mins, maxs );
 	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
@@ -23,6 +23,10 @@
 	#include "portal_util_shared.h"
 #endif
 
+#ifdef GAME_DLL
+	#include "player_parallelmove.h"
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -2127,6 +2131,39 @@ void CBaseEntity::SetGroundEntity( CBaseEntity *ground )
 	if ( m_hGroundEntity.Get() == ground )
 		return;
 
+	CBaseEntity *oldGround = m_hGroundEntity;
+	m_hGroundEntity = ground;
+
+#ifdef GAME_DLL
+	// Player movement running on a worker thread can't touch other entities' ground lists
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->UpdateGroundLinks( this, oldGround, ground );
+	}
+	else
+#endif
+	{
+		UpdateGroundLinks( oldGround, ground );
+	}
+
+	// HACK/PARANOID:  This is redundant with the code above, but in case we get out of sync groundlist entries ever, 
+	//  this will force the appropriate flags
+	if ( ground )
+	{
+		AddFlag( FL_ONGROUND );
+	}
+	else
+	{
+		RemoveFlag( FL_ONGROUND );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves this entity from the old ground entity's ground list to the new one's
+//-----------------------------------------------------------------------------
+void CBaseEntity::UpdateGroundLinks( CBaseEntity *oldGround, CBaseEntity *ground )
+{
 #ifdef GAME_DLL
 	// this can happen in-between updates to the held object controller (physcannon, +USE)
 	// so trap it here and release held objects when they become player ground
@@ -2144,9 +2181,6 @@ void CBaseEntity::SetGroundEntity( CBaseEntity *ground )
 	}
 #endif
 
-	CBaseEntity *oldGround = m_hGroundEntity;
-	m_hGroundEntity = ground;
-
 	// Just starting to touch
 	if ( !oldGround && ground )
 	{
@@ -2158,22 +2192,11 @@ void CBaseEntity::SetGroundEntity( CBaseEntity *ground )
 		PhysicsNotifyOtherOfGroundRemoval( this, oldGround );
 	}
 	// Changing out to new ground entity
-	else
+	else if ( oldGround && ground )
 	{
 		PhysicsNotifyOtherOfGroundRemoval( this, oldGround );
 		ground->AddEntityToGroundList( this );
 	}
-
-	// HACK/PARANOID:  This is redundant with the code above, but in case we get out of sync groundlist entries ever, 
-	//  this will force the appropriate flags
-	if ( ground )
-	{
-		AddFlag( FL_ONGROUND );
-	}
-	else
-	{
-		RemoveFlag( FL_ONGROUND );
-	}
 }
 
 CBaseEntity *CBaseEntity::GetGroundEntity( void )
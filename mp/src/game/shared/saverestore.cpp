@@ -29,6 +29,8 @@
 
 #include "globalstate.h"
 #include "entitylist.h"
+#include "utlhashtable.h"
+#include "tier0/fasttimer.h"
 
 #else
 
@@ -110,6 +112,69 @@ static void Matrix3x4Offset( matrix3x4_t& dest, const matrix3x4_t& matrixIn, con
 	MatrixSetColumn( out, 3, dest );
 }
 
+//-----------------------------------------------------------------------------
+// Values in a saved block that depend on the save they were written into
+// rather than on the object alone. The incremental save cache rewrites these
+// when it reuses a block.
+//-----------------------------------------------------------------------------
+enum SaveFixupType_t
+{
+	SAVEFIXUP_SYMBOL = 0,	// Symbol index in a record header
+	SAVEFIXUP_TIME,			// FIELD_TIME, relative to the save's base time
+	SAVEFIXUP_TICK,			// FIELD_TICK, relative to the save's base tick
+	SAVEFIXUP_CLASSPTR,		// Entity table indices
+	SAVEFIXUP_EDICT,
+	SAVEFIXUP_EHANDLE,
+};
+
+struct SaveFixup_t
+{
+	int			m_Type;
+	int			m_nPos;			// Offset of the value from the start of the block
+	int			m_nOffset;		// Offset of the source field in the object
+	const char	*m_pszSymbol;	// SAVEFIXUP_SYMBOL only
+};
+
+struct SaveBlockRecord_t
+{
+	const void				*m_pObject;
+	int						m_nStart;
+
+	// The outermost WriteAll() made while recording
+	const void				*m_pLeafObject;
+	datamap_t				*m_pLeafMap;
+	int						m_nLeafStart;
+	int						m_nLeafEnd;
+	int						m_nLeafCount;
+
+	CUtlVector<SaveFixup_t>	m_Fixups;
+};
+
+static inline float EncodeSaveTime( float flTime, float flBaseTime )
+{
+	// Always encode time as a delta from the current time so it can be re-based if loaded in a new level
+	// Times of 0 are never written to the file, so they will be restored as 0, not a relative time
+	if ( flTime == 0.0 )
+		return ZERO_TIME;
+
+	if ( flTime == INVALID_TIME || flTime == FLT_MAX )
+		return flTime;
+
+	float tmp = flTime - flBaseTime;
+	if ( fabsf( tmp ) < 0.001 ) // never allow a time to become zero due to rebasing
+		tmp = 0.001;
+	return tmp;
+}
+
+static inline int EncodeSaveTick( int nTick, int nBaseTick )
+{
+	if ( nTick == TICK_NEVER_THINK )
+		return TICK_NEVER_THINK_ENCODE;
+
+	// Rebase it...
+	return nTick - nBaseTick;
+}
+
 // This does the necessary casting / extract to grab a pointer to a member function as a void *
 // UNDONE: Cast to BASEPTR or something else here?
 #define EXTRACT_INPUTFUNC_FUNCTIONPTR(x)		(*(inputfunc_t **)(&(x)))
@@ -191,7 +256,9 @@ inputfunc_t *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 CSave::CSave( CSaveRestoreData *pdata )
  :	m_pData(pdata),
 	m_pGameInfo( pdata ),
-	m_bAsync( pdata->bAsync )
+	m_bAsync( pdata->bAsync ),
+	m_pRecord( NULL ),
+	m_nWriteAllDepth( 0 )
 {
 	m_BlockStartStack.EnsureCapacity( 32 );
 
@@ -864,15 +931,35 @@ int CSave::WriteFields( const char *pname, const void *pBaseData, datamap_t *pRo
 
 int CSave::DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap )
 {
+	bool bRecordLeaf = ( m_pRecord && m_nWriteAllDepth == 0 );
+	if ( bRecordLeaf )
+	{
+		m_pRecord->m_pLeafObject = pLeafObject;
+		m_pRecord->m_pLeafMap = pLeafMap;
+		m_pRecord->m_nLeafStart = GetWritePos();
+		m_pRecord->m_nLeafCount++;
+	}
+
 	// save base classes first
+	int status = 1;
+	m_nWriteAllDepth++;
 	if ( pCurMap->baseMap )
 	{
-		int status = DoWriteAll( pLeafObject, pLeafMap, pCurMap->baseMap );
-		if ( !status )
-			return status;
+		status = DoWriteAll( pLeafObject, pLeafMap, pCurMap->baseMap );
 	}
 
-	return WriteFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
+	if ( status )
+	{
+		status = WriteFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
+	}
+	m_nWriteAllDepth--;
+
+	if ( bRecordLeaf )
+	{
+		m_pRecord->m_nLeafEnd = GetWritePos();
+	}
+
+	return status;
 }
 	
 //-------------------------------------
@@ -937,6 +1024,15 @@ void CSave::WriteHeader( const char *pname, int size )
 		Assert(0);
 	}
 
+	if ( m_pRecord )
+	{
+		SaveFixup_t &fixup = m_pRecord->m_Fixups[ m_pRecord->m_Fixups.AddToTail() ];
+		fixup.m_Type = SAVEFIXUP_SYMBOL;
+		fixup.m_nPos = GetWritePos() + sizeof(short) - m_pRecord->m_nStart;
+		fixup.m_nOffset = 0;
+		fixup.m_pszSymbol = pname;
+	}
+
 	BufferData( (const char *)&shortSize, sizeof(short) );
 	BufferData( (const char *)&hashvalue, sizeof(short) );
 }
@@ -993,6 +1089,25 @@ int	CSave::EntityFlagsSet( int entityIndex, int flags )
 	return m_pGameInfo->GetEntityInfo( entityIndex )->flags;
 }
 
+//-------------------------------------
+// Purpose: Notes values about to be written at nPos that the incremental
+//			save cache has to recompute when it reuses the block
+
+void CSave::RecordFixups( int type, int nPos, const void *pData, int nStride, int count )
+{
+	if ( !m_pRecord )
+		return;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		SaveFixup_t &fixup = m_pRecord->m_Fixups[ m_pRecord->m_Fixups.AddToTail() ];
+		fixup.m_Type = type;
+		fixup.m_nPos = nPos + i * nStride - m_pRecord->m_nStart;
+		fixup.m_nOffset = (const char *)pData + i * nStride - (const char *)m_pRecord->m_pObject;
+		fixup.m_pszSymbol = NULL;
+	}
+}
+
 //-------------------------------------
 
 void CSave::WriteTime( const char *pname, const float *data, int count )
@@ -1001,27 +1116,12 @@ void CSave::WriteTime( const char *pname, const float *data, int count )
 	float tmp;
 
 	WriteHeader( pname, sizeof(float) * count );
+	RecordFixups( SAVEFIXUP_TIME, GetWritePos(), data, sizeof(float), count );
 	for ( i = 0; i < count; i++ )
 	{
-		// Always encode time as a delta from the current time so it can be re-based if loaded in a new level
-		// Times of 0 are never written to the file, so they will be restored as 0, not a relative time
 		Assert( data[i] != ZERO_TIME );
 
-		if ( data[i] == 0.0 )
-		{
-			tmp = ZERO_TIME;
-		}
-		else if ( data[i] == INVALID_TIME || data[i] == FLT_MAX )
-		{
-			tmp = data[i];
-		}
-		else
-		{			
-			tmp = data[i] - m_pGameInfo->GetBaseTime();
-			if ( fabsf( tmp ) < 0.001 ) // never allow a time to become zero due to rebasing
-				tmp = 0.001;
-		}
-
+		tmp = EncodeSaveTime( data[i], m_pGameInfo->GetBaseTime() );
 		WriteData( (const char *)&tmp, sizeof(float) );
 	}
 }
@@ -1033,25 +1133,10 @@ void CSave::WriteTime( const float *data, int count )
 	int i;
 	float tmp;
 
+	RecordFixups( SAVEFIXUP_TIME, GetWritePos(), data, sizeof(float), count );
 	for ( i = 0; i < count; i++ )
 	{
-		// Always encode time as a delta from the current time so it can be re-based if loaded in a new level
-		// Times of 0 are never written to the file, so they will be restored as 0, not a relative time
-		if ( data[i] == 0.0 )
-		{
-			tmp = ZERO_TIME;
-		}
-		else if ( data[i] == INVALID_TIME || data[i] == FLT_MAX )
-		{
-			tmp = data[i];
-		}
-		else
-		{			
-			tmp = data[i] - m_pGameInfo->GetBaseTime();
-			if ( fabsf( tmp ) < 0.001 ) // never allow a time to become zero due to rebasing
-				tmp = 0.001;
-		}
-
+		tmp = EncodeSaveTime( data[i], m_pGameInfo->GetBaseTime() );
 		WriteData( (const char *)&tmp, sizeof(float) );
 	}
 }
@@ -1071,20 +1156,12 @@ void CSave::WriteTick( const int *data, int count )
 
 	int baseTick = TIME_TO_TICKS( m_pGameInfo->GetBaseTime() );
 
+	RecordFixups( SAVEFIXUP_TICK, GetWritePos(), data, sizeof(int), count );
 	for ( i = 0; i < count; i++ )
 	{
 		// Always encode time as a delta from the current time so it can be re-based if loaded in a new level
 		// Times of 0 are never written to the file, so they will be restored as 0, not a relative time
-		tmp = data[ i ];
-		if ( data[ i ] == TICK_NEVER_THINK )
-		{
-			tmp = TICK_NEVER_THINK_ENCODE;
-		}
-		else
-		{
-			// Rebase it...
-			tmp -= baseTick;
-		}
+		tmp = EncodeSaveTick( data[ i ], baseTick );
 		WriteData( (const char *)&tmp, sizeof(int) );
 	}
 }
@@ -1163,6 +1240,7 @@ void CSave::WriteEntityPtr( const char *pname, CBaseEntity **ppEntity, int count
 	{
 		entityArray[i] = EntityIndex( ppEntity[i] );
 	}
+	RecordFixups( SAVEFIXUP_CLASSPTR, GetWritePos() + sizeof(SaveRestoreRecordHeader_t), ppEntity, sizeof(ppEntity[0]), count );
 	WriteInt( pname, entityArray, count );
 }
 
@@ -1176,6 +1254,7 @@ void CSave::WriteEntityPtr( CBaseEntity **ppEntity, int count )
 	{
 		entityArray[i] = EntityIndex( ppEntity[i] );
 	}
+	RecordFixups( SAVEFIXUP_CLASSPTR, GetWritePos(), ppEntity, sizeof(ppEntity[0]), count );
 	WriteInt( entityArray, count );
 }
 
@@ -1189,6 +1268,7 @@ void CSave::WriteEdictPtr( const char *pname, edict_t **ppEdict, int count )
 	{
 		entityArray[i] = EntityIndex( ppEdict[i] );
 	}
+	RecordFixups( SAVEFIXUP_EDICT, GetWritePos() + sizeof(SaveRestoreRecordHeader_t), ppEdict, sizeof(ppEdict[0]), count );
 	WriteInt( pname, entityArray, count );
 }
 
@@ -1202,6 +1282,7 @@ void CSave::WriteEdictPtr( edict_t **ppEdict, int count )
 	{
 		entityArray[i] = EntityIndex( ppEdict[i] );
 	}
+	RecordFixups( SAVEFIXUP_EDICT, GetWritePos(), ppEdict, sizeof(ppEdict[0]), count );
 	WriteInt( entityArray, count );
 }
 
@@ -1215,6 +1296,7 @@ void CSave::WriteEHandle( const char *pname, const EHANDLE *pEHandle, int count
 	{
 		entityArray[i] = EntityIndex( (CBaseEntity *)(const_cast<EHANDLE *>(pEHandle)[i]) );
 	}
+	RecordFixups( SAVEFIXUP_EHANDLE, GetWritePos() + sizeof(SaveRestoreRecordHeader_t), pEHandle, sizeof(pEHandle[0]), count );
 	WriteInt( pname, entityArray, count );
 }
 
@@ -1228,6 +1310,7 @@ void CSave::WriteEHandle( const EHANDLE *pEHandle, int count )
 	{
 		entityArray[i] = EntityIndex( (CBaseEntity *)(const_cast<EHANDLE *>(pEHandle)[i]) );
 	}
+	RecordFixups( SAVEFIXUP_EHANDLE, GetWritePos(), pEHandle, sizeof(pEHandle[0]), count );
 	WriteInt( entityArray, count );
 }
 
@@ -2336,6 +2419,438 @@ void CEntitySaveUtils::AddLevelTransitionSaveDependency( CBaseEntity *pEntity1,
 }
 
 
+#if !defined( CLIENT_DLL )
+
+//-----------------------------------------------------------------------------
+// Incremental entity saves. Most entities don't change between autosaves, so
+// the block each one wrote last time is kept along with a copy of the fields
+// it was written from. If those fields still match, the block is copied into
+// the new save and only the values that depend on the save itself (symbol
+// indices, relative times, entity table indices) are rewritten.
+//
+// Only entities whose Save() is a plain datadesc WriteAll() are cached, and
+// only while their custom and embedded pointer fields are empty, so every
+// byte of the block is a function of the compared fields.
+//-----------------------------------------------------------------------------
+ConVar save_incremental( "save_incremental", "1", 0, "Reuse the saved data of entities that haven't changed since the last save." );
+ConVar save_incremental_verify( "save_incremental_verify", "0", FCVAR_CHEAT, "Rewrite entities save_incremental reused and report any whose data differs." );
+ConVar save_incremental_spew( "save_incremental_spew", "0", 0, "Report how many entities each save reused." );
+
+// Saved fields of one datamap, flattened into the object's memory ranges
+struct SaveCachePlan_t
+{
+	struct Range_t
+	{
+		int m_nOffset;
+		int m_nBytes;
+	};
+
+	// Custom and embedded pointer fields; a block is only cached while these are empty
+	struct ComplexField_t
+	{
+		int					m_nOffset;
+		typedescription_t	*m_pField;
+	};
+
+	CUtlVector<Range_t>			m_Ranges;
+	CUtlVector<ComplexField_t>	m_ComplexFields;
+	int							m_nShadowBytes;
+};
+
+struct SaveCacheEntry_t
+{
+	int							m_nSerial;
+	datamap_t					*m_pMap;
+	CUtlVector<unsigned char>	m_Block;
+	CUtlVector<unsigned char>	m_Shadow;
+	CUtlVector<SaveFixup_t>		m_Fixups;
+};
+
+class CSaveBlockCache : public CAutoGameSystem
+{
+public:
+	CSaveBlockCache() : CAutoGameSystem( "CSaveBlockCache" ), m_Plans( DefLessFunc( datamap_t * ) )
+	{
+		memset( m_pEntries, 0, sizeof(m_pEntries) );
+		m_bActive = false;
+	}
+
+	virtual void Shutdown()
+	{
+		Purge();
+		m_Plans.PurgeAndDeleteElements();
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Purge();
+	}
+
+	void Purge();
+
+	void BeginSave( CSave *pSave );
+	void SaveEntity( CSave *pSave, CBaseEntity *pEntity );
+	void EndSave();
+
+private:
+	SaveCachePlan_t *GetPlan( datamap_t *pMap );
+	void CompileMap( SaveCachePlan_t *pPlan, datamap_t *pMap, int nBaseOffset );
+	bool AreComplexFieldsEmpty( const SaveCachePlan_t *pPlan, const void *pObject ) const;
+	bool IsUnchanged( const SaveCachePlan_t *pPlan, const void *pObject, const SaveCacheEntry_t *pEntry ) const;
+
+	bool Replay( CSave *pSave, CBaseEntity *pEntity, const SaveCacheEntry_t *pEntry );
+	void Store( CSave *pSave, CBaseEntity *pEntity, const SaveCachePlan_t *pPlan, SaveBlockRecord_t &record );
+	unsigned short FindCreateSymbol( CSave *pSave, const char *pszSymbol );
+
+	CUtlMap<datamap_t *, SaveCachePlan_t *>	m_Plans;
+	SaveCacheEntry_t	*m_pEntries[NUM_ENT_ENTRIES];
+
+	// Symbols resolved in the current save, by name pointer
+	CUtlHashtable<const void *, unsigned short>	m_Symbols;
+
+	bool				m_bActive;
+	int					m_nReused;
+	int					m_nWritten;
+	int					m_nUncached;
+	CFastTimer			m_Timer;
+};
+
+static CSaveBlockCache g_SaveBlockCache;
+
+//-------------------------------------
+
+void CSaveBlockCache::Purge()
+{
+	for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+	{
+		delete m_pEntries[i];
+		m_pEntries[i] = NULL;
+	}
+	m_Symbols.Purge();
+}
+
+//-------------------------------------
+
+void CSaveBlockCache::CompileMap( SaveCachePlan_t *pPlan, datamap_t *pMap, int nBaseOffset )
+{
+	// Same walk as CSave::DoWriteAll()
+	if ( pMap->baseMap )
+	{
+		CompileMap( pPlan, pMap->baseMap, nBaseOffset );
+	}
+
+	for ( int i = 0; i < pMap->dataNumFields; i++ )
+	{
+		typedescription_t *pField = &pMap->dataDesc[i];
+		if ( !(pField->flags & FTYPEDESC_SAVE) || pField->fieldType == FIELD_VOID )
+			continue;
+
+		int nOffset = nBaseOffset + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+		if ( pField->fieldType == FIELD_CUSTOM || ( pField->fieldType == FIELD_EMBEDDED && ( pField->flags & FTYPEDESC_PTR ) ) )
+		{
+			SaveCachePlan_t::ComplexField_t &complex = pPlan->m_ComplexFields[ pPlan->m_ComplexFields.AddToTail() ];
+			complex.m_nOffset = nOffset;
+			complex.m_pField = pField;
+			continue;
+		}
+
+		if ( pField->fieldType == FIELD_EMBEDDED )
+		{
+			if ( pField->td )
+			{
+				for ( int j = 0; j < pField->fieldSize; j++ )
+				{
+					CompileMap( pPlan, pField->td, nOffset + j * pField->fieldSizeInBytes );
+				}
+			}
+			continue;
+		}
+
+		// Merge with the previous range where the fields are adjacent
+		int nRanges = pPlan->m_Ranges.Count();
+		if ( nRanges && pPlan->m_Ranges[nRanges - 1].m_nOffset + pPlan->m_Ranges[nRanges - 1].m_nBytes == nOffset )
+		{
+			pPlan->m_Ranges[nRanges - 1].m_nBytes += pField->fieldSizeInBytes;
+		}
+		else
+		{
+			SaveCachePlan_t::Range_t &range = pPlan->m_Ranges[ pPlan->m_Ranges.AddToTail() ];
+			range.m_nOffset = nOffset;
+			range.m_nBytes = pField->fieldSizeInBytes;
+		}
+		pPlan->m_nShadowBytes += pField->fieldSizeInBytes;
+	}
+}
+
+//-------------------------------------
+
+SaveCachePlan_t *CSaveBlockCache::GetPlan( datamap_t *pMap )
+{
+	unsigned short i = m_Plans.Find( pMap );
+	if ( i != m_Plans.InvalidIndex() )
+		return m_Plans[i];
+
+	SaveCachePlan_t *pPlan = new SaveCachePlan_t;
+	pPlan->m_nShadowBytes = 0;
+	CompileMap( pPlan, pMap, 0 );
+	m_Plans.Insert( pMap, pPlan );
+	return pPlan;
+}
+
+//-------------------------------------
+
+bool CSaveBlockCache::AreComplexFieldsEmpty( const SaveCachePlan_t *pPlan, const void *pObject ) const
+{
+	for ( int i = 0; i < pPlan->m_ComplexFields.Count(); i++ )
+	{
+		const SaveCachePlan_t::ComplexField_t &complex = pPlan->m_ComplexFields[i];
+		char *pData = (char *)pObject + complex.m_nOffset;
+		if ( complex.m_pField->fieldType == FIELD_EMBEDDED )
+		{
+			if ( *(void **)pData )
+				return false;
+			continue;
+		}
+
+		SaveRestoreFieldInfo_t fieldInfo =
+		{
+			pData,
+			pData - complex.m_pField->fieldOffset[ TD_OFFSET_NORMAL ],
+			complex.m_pField
+		};
+		if ( !complex.m_pField->pSaveRestoreOps->IsEmpty( fieldInfo ) )
+			return false;
+	}
+	return true;
+}
+
+//-------------------------------------
+
+bool CSaveBlockCache::IsUnchanged( const SaveCachePlan_t *pPlan, const void *pObject, const SaveCacheEntry_t *pEntry ) const
+{
+	if ( !AreComplexFieldsEmpty( pPlan, pObject ) )
+		return false;
+
+	const unsigned char *pShadow = pEntry->m_Shadow.Base();
+	for ( int i = 0; i < pPlan->m_Ranges.Count(); i++ )
+	{
+		const SaveCachePlan_t::Range_t &range = pPlan->m_Ranges[i];
+		if ( memcmp( (const char *)pObject + range.m_nOffset, pShadow, range.m_nBytes ) )
+			return false;
+		pShadow += range.m_nBytes;
+	}
+	return true;
+}
+
+//-------------------------------------
+
+unsigned short CSaveBlockCache::FindCreateSymbol( CSave *pSave, const char *pszSymbol )
+{
+	// Symbols are never removed from a save's table, so the index a name
+	// resolved to stays valid until the next save
+	UtlHashHandle_t h = m_Symbols.Find( pszSymbol );
+	if ( h != m_Symbols.InvalidHandle() )
+		return m_Symbols[h];
+
+	unsigned short nSymbol = pSave->m_pData->FindCreateSymbol( pszSymbol );
+	m_Symbols.Insert( pszSymbol, nSymbol );
+	return nSymbol;
+}
+
+//-------------------------------------
+
+bool CSaveBlockCache::Replay( CSave *pSave, CBaseEntity *pEntity, const SaveCacheEntry_t *pEntry )
+{
+	CSaveRestoreSegment *pData = pSave->m_pData;
+	if ( pData->BytesAvailable() < pEntry->m_Block.Count() )
+		return false;
+
+	char *pBlock = pData->AccessCurPos();
+	pData->Write( pEntry->m_Block.Base(), pEntry->m_Block.Count() );
+
+	const char *pObject = (const char *)pEntity;
+	float flBaseTime = pSave->m_pGameInfo->GetBaseTime();
+	int nBaseTick = TIME_TO_TICKS( flBaseTime );
+	for ( int i = 0; i < pEntry->m_Fixups.Count(); i++ )
+	{
+		const SaveFixup_t &fixup = pEntry->m_Fixups[i];
+		char *pDest = pBlock + fixup.m_nPos;
+		const char *pSrc = pObject + fixup.m_nOffset;
+		switch ( fixup.m_Type )
+		{
+		case SAVEFIXUP_SYMBOL:
+			{
+				short nSymbol = FindCreateSymbol( pSave, fixup.m_pszSymbol );
+				memcpy( pDest, &nSymbol, sizeof(short) );
+			}
+			break;
+
+		case SAVEFIXUP_TIME:
+			{
+				float flTime = EncodeSaveTime( *(const float *)pSrc, flBaseTime );
+				memcpy( pDest, &flTime, sizeof(float) );
+			}
+			break;
+
+		case SAVEFIXUP_TICK:
+			{
+				int nTick = EncodeSaveTick( *(const int *)pSrc, nBaseTick );
+				memcpy( pDest, &nTick, sizeof(int) );
+			}
+			break;
+
+		case SAVEFIXUP_CLASSPTR:
+			{
+				int nIndex = pSave->EntityIndex( *(CBaseEntity * const *)pSrc );
+				memcpy( pDest, &nIndex, sizeof(int) );
+			}
+			break;
+
+		case SAVEFIXUP_EDICT:
+			{
+				int nIndex = pSave->EntityIndex( *(edict_t * const *)pSrc );
+				memcpy( pDest, &nIndex, sizeof(int) );
+			}
+			break;
+
+		case SAVEFIXUP_EHANDLE:
+			{
+				int nIndex = pSave->EntityIndex( ((const EHANDLE *)pSrc)->Get() );
+				memcpy( pDest, &nIndex, sizeof(int) );
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+//-------------------------------------
+
+void CSaveBlockCache::Store( CSave *pSave, CBaseEntity *pEntity, const SaveCachePlan_t *pPlan, SaveBlockRecord_t &record )
+{
+	int iEntry = pEntity->GetRefEHandle().GetEntryIndex();
+	int nEnd = pSave->GetWritePos();
+
+	// Only cache blocks that are exactly one WriteAll() of the entity's datamap
+	bool bCacheable = ( record.m_nLeafCount == 1 && record.m_pLeafObject == pEntity &&
+						record.m_pLeafMap == pEntity->GetDataDescMap() && record.m_nLeafStart == record.m_nStart &&
+						record.m_nLeafEnd == nEnd && pSave->m_pData->BytesAvailable() > 0 &&
+						AreComplexFieldsEmpty( pPlan, pEntity ) );
+	if ( !bCacheable )
+	{
+		delete m_pEntries[iEntry];
+		m_pEntries[iEntry] = NULL;
+		m_nUncached++;
+		return;
+	}
+
+	SaveCacheEntry_t *pEntry = m_pEntries[iEntry];
+	if ( !pEntry )
+	{
+		pEntry = m_pEntries[iEntry] = new SaveCacheEntry_t;
+	}
+
+	pEntry->m_nSerial = pEntity->GetRefEHandle().GetSerialNumber();
+	pEntry->m_pMap = record.m_pLeafMap;
+	pEntry->m_Block.CopyArray( (const unsigned char *)pSave->m_pData->GetBuffer() + record.m_nStart, nEnd - record.m_nStart );
+	pEntry->m_Fixups.Swap( record.m_Fixups );
+
+	pEntry->m_Shadow.SetCount( pPlan->m_nShadowBytes );
+	unsigned char *pShadow = pEntry->m_Shadow.Base();
+	for ( int i = 0; i < pPlan->m_Ranges.Count(); i++ )
+	{
+		const SaveCachePlan_t::Range_t &range = pPlan->m_Ranges[i];
+		memcpy( pShadow, (const char *)pEntity + range.m_nOffset, range.m_nBytes );
+		pShadow += range.m_nBytes;
+	}
+	m_nWritten++;
+}
+
+//-------------------------------------
+
+void CSaveBlockCache::BeginSave( CSave *pSave )
+{
+	// Positions are saved relative to the landmark in level transitions;
+	// blocks don't record them, so those saves are always written in full
+	m_bActive = save_incremental.GetBool() && !pSave->m_pGameInfo->levelInfo.fUseLandmark;
+	if ( !m_bActive )
+	{
+		Purge();
+	}
+
+	m_Symbols.RemoveAll();
+	m_nReused = m_nWritten = m_nUncached = 0;
+	m_Timer.Start();
+}
+
+//-------------------------------------
+
+void CSaveBlockCache::SaveEntity( CSave *pSave, CBaseEntity *pEntity )
+{
+	if ( !m_bActive )
+	{
+		pEntity->Save( *pSave );
+		return;
+	}
+
+	datamap_t *pMap = pEntity->GetDataDescMap();
+	SaveCachePlan_t *pPlan = GetPlan( pMap );
+	SaveCacheEntry_t *pEntry = m_pEntries[ pEntity->GetRefEHandle().GetEntryIndex() ];
+	int nStart = pSave->GetWritePos();
+
+	CUtlVector<unsigned char> replayed;
+	if ( pEntry && pEntry->m_nSerial == pEntity->GetRefEHandle().GetSerialNumber() && pEntry->m_pMap == pMap &&
+		 IsUnchanged( pPlan, pEntity, pEntry ) && Replay( pSave, pEntity, pEntry ) )
+	{
+		m_nReused++;
+		if ( !save_incremental_verify.GetBool() )
+			return;
+
+		// Write it again the normal way and compare
+		replayed.CopyArray( (const unsigned char *)pSave->m_pData->GetBuffer() + nStart, pSave->GetWritePos() - nStart );
+		pSave->SetWritePos( nStart );
+	}
+
+	SaveBlockRecord_t record;
+	record.m_pObject = pEntity;
+	record.m_nStart = nStart;
+	record.m_pLeafObject = NULL;
+	record.m_pLeafMap = NULL;
+	record.m_nLeafStart = record.m_nLeafEnd = -1;
+	record.m_nLeafCount = 0;
+
+	pSave->m_pRecord = &record;
+	pEntity->Save( *pSave );
+	pSave->m_pRecord = NULL;
+
+	if ( replayed.Count() )
+	{
+		int nSize = pSave->GetWritePos() - nStart;
+		if ( nSize != replayed.Count() || memcmp( replayed.Base(), pSave->m_pData->GetBuffer() + nStart, nSize ) )
+		{
+			Warning( "save_incremental: reused data for %s (%d) differs from a full write\n", pEntity->GetClassname(), pEntity->entindex() );
+		}
+	}
+
+	Store( pSave, pEntity, pPlan, record );
+}
+
+//-------------------------------------
+
+void CSaveBlockCache::EndSave()
+{
+	m_Timer.End();
+	if ( save_incremental_spew.GetBool() && m_bActive )
+	{
+		Msg( "save_incremental: %d entities reused, %d written, %d uncacheable, %.2f ms\n",
+			m_nReused, m_nWritten, m_nUncached, m_Timer.GetDuration().GetMillisecondsF() );
+	}
+}
+
+#endif // !CLIENT_DLL
+
+
 //-----------------------------------------------------------------------------
 // Block handler for save/restore of entities
 //-----------------------------------------------------------------------------
@@ -2456,6 +2971,10 @@ void CEntitySaveRestoreBlockHandler::PreSave( CSaveRestoreData *pSaveData )
 void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 {
 	CGameSaveRestoreInfo *pSaveData = pSave->GetGameSaveRestoreInfo();
+
+#if !defined( CLIENT_DLL )
+	g_SaveBlockCache.BeginSave( static_cast<CSave *>( pSave ) );
+#endif
 	
 	// write entity list that was previously built by SaveInitEntities()
 	for ( int i = 0; i < pSaveData->NumEntities(); i++ )
@@ -2476,7 +2995,11 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 #endif
 
 			pSaveData->SetCurrentEntityContext( pEnt );
+#if !defined( CLIENT_DLL )
+			g_SaveBlockCache.SaveEntity( static_cast<CSave *>( pSave ), pEnt );
+#else
 			pEnt->Save( *pSave );
+#endif
 			pSaveData->SetCurrentEntityContext( NULL );
 
 			pEntInfo->size = pSave->GetWritePos() - pEntInfo->location;	// Size of entity block is data size written to block
@@ -2495,6 +3018,10 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 #endif
 		}
 	}
+
+#if !defined( CLIENT_DLL )
+	g_SaveBlockCache.EndSave();
+#endif
 }
 
 //---------------------------------
@@ -2521,6 +3048,9 @@ void CEntitySaveRestoreBlockHandler::PostSave()
 
 void CEntitySaveRestoreBlockHandler::PreRestore()
 {
+#if !defined( CLIENT_DLL )
+	g_SaveBlockCache.Purge();
+#endif
 }
 
 //---------------------------------
@@ -16,7 +16,7 @@
 #include "gamestringpool.h"
 #include "igamesystem.h"
 #include "utlpriorityqueue.h"
-#include "mempool.h"
+#include "tier1/smallobjectallocator.h"
 #include "SoundEmitterSystem/isoundemittersystembase.h"
 #include "tier0/vprof.h"
 #include "gamerules.h"
@@ -301,7 +301,7 @@ private:
 	string_t		m_iszClassName;
 #endif
 
-	DECLARE_FIXEDSIZE_ALLOCATOR(CSoundPatch);
+	DECLARE_SMALLOBJECT_ALLOCATOR(CSoundPatch);
 };
 #include "tier0/memdbgon.h"
 
@@ -316,7 +316,7 @@ CON_COMMAND( report_soundpatch, "reports sound patch count" )
 
 	Msg("Current sound patches: %d\n", CSoundPatch::g_SoundPatchCount );
 }
-DEFINE_FIXEDSIZE_ALLOCATOR( CSoundPatch, 64, CUtlMemoryPool::GROW_FAST );
+DEFINE_SMALLOBJECT_ALLOCATOR( CSoundPatch );
 
 BEGIN_SIMPLE_DATADESC( CSoundPatch )
 
@@ -664,11 +664,11 @@ struct SoundCommand_t
 	SoundCommand_t	*m_pNext;
 
 	DECLARE_SIMPLE_DATADESC();
-	DECLARE_FIXEDSIZE_ALLOCATOR(SoundCommand_t);
+	DECLARE_SMALLOBJECT_ALLOCATOR(SoundCommand_t);
 };
 #include "tier0/memdbgon.h"
 
-DEFINE_FIXEDSIZE_ALLOCATOR( SoundCommand_t, 32, CUtlMemoryPool::GROW_FAST );
+DEFINE_SMALLOBJECT_ALLOCATOR( SoundCommand_t );
 
 
 BEGIN_SIMPLE_DATADESC( SoundCommand_t )
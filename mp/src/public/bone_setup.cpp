@@ -20,6 +20,7 @@
 #include "datamanager.h"
 #include "convar.h"
 #include "tier0/tslist.h"
+#include "tier1/checksum_crc.h"
 #include "vphysics_interface.h"
 #ifdef CLIENT_DLL
 	#include "posedebugger.h"
@@ -78,6 +79,11 @@ CBoneSetupMemoryPool<Quaternion> g_QaternionPool;
 CBoneSetupMemoryPool<Vector> g_VectorPool;
 CBoneSetupMemoryPool<matrix3x4_t> g_MatrixPool;
 
+// Bumped whenever a decode falls back to zero frame data or applies a local
+// hierarchy, so the pose cache never keeps a half-streamed pose or one that
+// depends on the caller's unweighted bones.
+static CThreadLocalInt<> g_nUncacheablePoses;
+
 // -----------------------------------------------------------------
 CBoneCache *CBoneCache::CreateResource( const bonecacheparams_t &params )
 {
@@ -144,6 +150,8 @@ void CBoneCache::Init( const bonecacheparams_t &params, unsigned int size, short
 	UpdateBones( params.pBoneToWorld, params.pStudioHdr->numbones(), params.curtime );
 }
 
+static long volatile s_nBoneCacheSerial = 0;
+
 void CBoneCache::UpdateBones( const matrix3x4_t *pBoneToWorld, int numbones, float curtime )
 {
 	matrix3x4_t *pBones = BoneArray();
@@ -155,6 +163,7 @@ void CBoneCache::UpdateBones( const matrix3x4_t *pBoneToWorld, int numbones, flo
 		MatrixCopy( pBoneToWorld[index], pBones[i] );
 	}
 	m_timeValid = curtime;
+	m_nSerial = ThreadInterlockedIncrement( &s_nBoneCacheSerial );
 }
 
 matrix3x4_t *CBoneCache::GetCachedBone( int studioIndex )
@@ -961,6 +970,7 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 	// if the animation isn't available, look for the zero frame cache
 	if (!panim)
 	{
+		++g_nUncacheablePoses;
 		CalcZeroframeData( ((CStudioHdr *)pStudioHdr), pAnimStudioHdr, pAnimGroup, pAnimbone, animdesc, fFrame, pos, q, boneMask, 1.0 );
 		return;
 	}
@@ -988,12 +998,15 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
+		++g_nUncacheablePoses;
 		CalcZeroframeData( pStudioHdr, pAnimStudioHdr, pAnimGroup, pAnimbone, animdesc, fFrame, pos, q, boneMask, flStall );
 	}
 
 	// calculate a local hierarchy override
 	if (animdesc.numlocalhierarchy)
 	{
+		++g_nUncacheablePoses;
+
 		matrix3x4_t *boneToWorld = g_MatrixPool.Alloc();
 		CBoneBitList boneComputed;
 
@@ -1072,6 +1085,8 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 	// if the animation isn't available, look for the zero frame cache
 	if (!panim)
 	{
+		++g_nUncacheablePoses;
+
 		// Msg("zeroframe %s\n", animdesc.pszName() );
 		// pre initialize
 		for (i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++)
@@ -1133,11 +1148,14 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
+		++g_nUncacheablePoses;
 		CalcZeroframeData( pStudioHdr, pStudioHdr->GetRenderHdr(), NULL, pStudioHdr->pBone( 0 ), animdesc, fFrame, pos, q, boneMask, flStall );
 	}
 
 	if (animdesc.numlocalhierarchy)
 	{
+		++g_nUncacheablePoses;
+
 		matrix3x4_t *boneToWorld = g_MatrixPool.Alloc();
 		CBoneBitList boneComputed;
 
@@ -1372,6 +1390,311 @@ void WorldSpaceSlerp(
 
 
 
+#ifndef _X360
+//-----------------------------------------------------------------------------
+// Four bone wide blend kernels for SlerpBones and BlendBones.  Each lane of a
+// fltx4 holds one bone; bones are gathered through an index list so masked
+// and unweighted bones never enter a batch.  The math follows QuaternionAlign,
+// QuaternionBlendNoAlign, QuaternionSlerpNoAlign and the position lerp step
+// for step, so SSE builds produce the same poses as the scalar loops.
+//-----------------------------------------------------------------------------
+static ConVar anim_simdblend( "anim_simdblend", "1", FCVAR_REPLICATED, "Blend bone quaternions and positions four bones at a time." );
+
+struct FourBoneQuaternions_t
+{
+	fltx4 x, y, z, w;
+
+	FORCEINLINE void Load( const Quaternion *q, const int *pBones )
+	{
+		x = LoadUnalignedSIMD( q[ pBones[0] ].Base() );
+		y = LoadUnalignedSIMD( q[ pBones[1] ].Base() );
+		z = LoadUnalignedSIMD( q[ pBones[2] ].Base() );
+		w = LoadUnalignedSIMD( q[ pBones[3] ].Base() );
+		TransposeSIMD( x, y, z, w );
+	}
+
+	FORCEINLINE void Store( Quaternion *q, const int *pBones ) const
+	{
+		fltx4 q0 = x, q1 = y, q2 = z, q3 = w;
+		TransposeSIMD( q0, q1, q2, q3 );
+		StoreUnalignedSIMD( q[ pBones[0] ].Base(), q0 );
+		StoreUnalignedSIMD( q[ pBones[1] ].Base(), q1 );
+		StoreUnalignedSIMD( q[ pBones[2] ].Base(), q2 );
+		StoreUnalignedSIMD( q[ pBones[3] ].Base(), q3 );
+	}
+
+	FORCEINLINE fltx4 Dot( const FourBoneQuaternions_t &q ) const
+	{
+		return AddSIMD( AddSIMD( AddSIMD( MulSIMD( x, q.x ), MulSIMD( y, q.y ) ), MulSIMD( z, q.z ) ), MulSIMD( w, q.w ) );
+	}
+
+	// reverse any lane that is more than 180 degrees from p
+	FORCEINLINE void Align( const FourBoneQuaternions_t &p )
+	{
+		FourBoneQuaternions_t diff, sum;
+		diff.x = SubSIMD( p.x, x ); diff.y = SubSIMD( p.y, y ); diff.z = SubSIMD( p.z, z ); diff.w = SubSIMD( p.w, w );
+		sum.x = AddSIMD( p.x, x ); sum.y = AddSIMD( p.y, y ); sum.z = AddSIMD( p.z, z ); sum.w = AddSIMD( p.w, w );
+
+		fltx4 flip = CmpGtSIMD( diff.Dot( diff ), sum.Dot( sum ) );
+		x = MaskedAssign( flip, fnegate( x ), x );
+		y = MaskedAssign( flip, fnegate( y ), y );
+		z = MaskedAssign( flip, fnegate( z ), z );
+		w = MaskedAssign( flip, fnegate( w ), w );
+	}
+
+	// this = sclp * p + sclq * this
+	FORCEINLINE void Lerp( const FourBoneQuaternions_t &p, const fltx4 &sclp, const fltx4 &sclq )
+	{
+		x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( sclq, x ) );
+		y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( sclq, y ) );
+		z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( sclq, z ) );
+		w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( sclq, w ) );
+	}
+
+	FORCEINLINE void Normalize()
+	{
+		fltx4 radius = Dot( *this );
+		fltx4 iradius = DivSIMD( Four_Ones, SqrtSIMD( radius ) );
+		fltx4 zero = CmpEqSIMD( radius, Four_Zeros );
+		x = MaskedAssign( zero, x, MulSIMD( x, iradius ) );
+		y = MaskedAssign( zero, y, MulSIMD( y, iradius ) );
+		z = MaskedAssign( zero, z, MulSIMD( z, iradius ) );
+		w = MaskedAssign( zero, w, MulSIMD( w, iradius ) );
+	}
+};
+
+struct FourBonePositions_t
+{
+	fltx4 x, y, z;
+
+	// Vectors are 12 bytes, so a 16 byte load of the last bone could run off
+	// the end of the array; gather and scatter a lane at a time instead.
+	FORCEINLINE void Load( const Vector *pos, const int *pBones )
+	{
+		for ( int k = 0; k < 4; k++ )
+		{
+			const Vector &v = pos[ pBones[k] ];
+			SubFloat( x, k ) = v.x;
+			SubFloat( y, k ) = v.y;
+			SubFloat( z, k ) = v.z;
+		}
+	}
+
+	FORCEINLINE void Store( Vector *pos, const int *pBones ) const
+	{
+		for ( int k = 0; k < 4; k++ )
+		{
+			pos[ pBones[k] ].Init( SubFloat( x, k ), SubFloat( y, k ), SubFloat( z, k ) );
+		}
+	}
+
+	// this = this * s1 + p * s2
+	FORCEINLINE void Lerp( const fltx4 &s1, const FourBonePositions_t &p, const fltx4 &s2 )
+	{
+		x = AddSIMD( MulSIMD( x, s1 ), MulSIMD( p.x, s2 ) );
+		y = AddSIMD( MulSIMD( y, s1 ), MulSIMD( p.y, s2 ) );
+		z = AddSIMD( MulSIMD( z, s1 ), MulSIMD( p.z, s2 ) );
+	}
+};
+
+static FORCEINLINE void SlerpBone( const CStudioHdr *pStudioHdr, Quaternion q1[], Vector pos1[], const QuaternionAligned q2[], const Vector pos2[], int i, float s2 )
+{
+	QuaternionAligned q3;
+	float s1 = 1.0 - s2;
+
+	if ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT )
+	{
+		QuaternionSlerpNoAlign( q2[i], q1[i], s1, q3 );
+	}
+	else
+	{
+		QuaternionSlerp( q2[i], q1[i], s1, q3 );
+	}
+
+	q1[i] = q3;
+	pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+	pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+	pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: non-delta SlerpBones, four bones at a time.  pS2 is the per bone
+//			weight list SlerpBones builds.
+//-----------------------------------------------------------------------------
+static void SlerpBonesSIMD(
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES],
+	Vector pos1[MAXSTUDIOBONES],
+	const QuaternionAligned q2[MAXSTUDIOBONES],
+	const Vector pos2[MAXSTUDIOBONES],
+	const float *pS2 )
+{
+	int nBoneCount = pStudioHdr->numbones();
+	int *pBones = (int *)stackalloc( nBoneCount * sizeof(int) );
+	int nBones = 0;
+
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pS2[i] <= 0.0f )
+			continue;
+
+		// fixed alignment bones are rare, leave them to the scalar slerp
+		if ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT )
+		{
+			SlerpBone( pStudioHdr, q1, pos1, q2, pos2, i, pS2[i] );
+			continue;
+		}
+
+		pBones[nBones++] = i;
+	}
+
+	int n = 0;
+	for ( ; n + 4 <= nBones; n += 4 )
+	{
+		const int *pBatch = pBones + n;
+
+		FourBoneQuaternions_t p, q;
+		p.Load( q2, pBatch );
+		q.Load( q1, pBatch );
+		q.Align( p );
+		fltx4 cosom = p.Dot( q );
+
+		fltx4 s1, s2, sclp, sclq;
+		bool bOpposed = false;
+		for ( int k = 0; k < 4; k++ )
+		{
+			float t = 1.0 - pS2[ pBatch[k] ];
+			float c = SubFloat( cosom, k );
+			SubFloat( s2, k ) = pS2[ pBatch[k] ];
+			SubFloat( s1, k ) = t;
+
+			if ( ( 1.0f + c ) <= 0.000001f )
+			{
+				// opposing quaternions take a different path through QuaternionSlerpNoAlign
+				bOpposed = true;
+				break;
+			}
+
+			if ( ( 1.0f - c ) > 0.000001f )
+			{
+				float omega = acos( c );
+				float sinom = sin( omega );
+				SubFloat( sclp, k ) = sin( (1.0f - t)*omega) / sinom;
+				SubFloat( sclq, k ) = sin( t*omega ) / sinom;
+			}
+			else
+			{
+				SubFloat( sclp, k ) = 1.0f - t;
+				SubFloat( sclq, k ) = t;
+			}
+		}
+
+		if ( bOpposed )
+		{
+			for ( int k = 0; k < 4; k++ )
+			{
+				SlerpBone( pStudioHdr, q1, pos1, q2, pos2, pBatch[k], pS2[ pBatch[k] ] );
+			}
+			continue;
+		}
+
+		q.Lerp( p, sclp, sclq );
+		q.Store( q1, pBatch );
+
+		FourBonePositions_t a, b;
+		a.Load( pos1, pBatch );
+		b.Load( pos2, pBatch );
+		a.Lerp( s1, b, s2 );
+		a.Store( pos1, pBatch );
+	}
+
+	for ( ; n < nBones; n++ )
+	{
+		SlerpBone( pStudioHdr, q1, pos1, q2, pos2, pBones[n], pS2[ pBones[n] ] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: BlendBones for 0 < s < 1, four bones at a time
+//-----------------------------------------------------------------------------
+static void BlendBonesSIMD(
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES],
+	Vector pos1[MAXSTUDIOBONES],
+	mstudioseqdesc_t &seqdesc,
+	const virtualgroup_t *pSeqGroup,
+	const Quaternion q2[MAXSTUDIOBONES],
+	const Vector pos2[MAXSTUDIOBONES],
+	float s1,
+	float s2,
+	int boneMask )
+{
+	int nBoneCount = pStudioHdr->numbones();
+	int *pBones = (int *)stackalloc( nBoneCount * sizeof(int) );
+	int nBones = 0;
+	Quaternion q3;
+
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		// skip unused bones
+		if ( !(pStudioHdr->boneFlags(i) & boneMask) )
+			continue;
+
+		int j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+		if ( j < 0 || seqdesc.weight( j ) <= 0.0 )
+			continue;
+
+		if ( !(pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT) )
+		{
+			pBones[nBones++] = i;
+			continue;
+		}
+
+		QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
+		q1[i] = q3;
+		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+	}
+
+	fltx4 sclp = ReplicateX4( 1.0f - s1 );
+	fltx4 sclq = ReplicateX4( s1 );
+	fltx4 fl4S1 = ReplicateX4( s1 );
+	fltx4 fl4S2 = ReplicateX4( s2 );
+
+	int n = 0;
+	for ( ; n + 4 <= nBones; n += 4 )
+	{
+		const int *pBatch = pBones + n;
+
+		FourBoneQuaternions_t p, q;
+		p.Load( q2, pBatch );
+		q.Load( q1, pBatch );
+		q.Align( p );
+		q.Lerp( p, sclp, sclq );
+		q.Normalize();
+		q.Store( q1, pBatch );
+
+		FourBonePositions_t a, b;
+		a.Load( pos1, pBatch );
+		b.Load( pos2, pBatch );
+		a.Lerp( fl4S1, b, fl4S2 );
+		a.Store( pos1, pBatch );
+	}
+
+	for ( ; n < nBones; n++ )
+	{
+		int i = pBones[n];
+		QuaternionBlend( q2[i], q1[i], s1, q3 );
+		q1[i] = q3;
+		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+	}
+}
+#endif // !_X360
+
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -1481,6 +1804,14 @@ void SlerpBones(
 		return;
 	}
 
+#ifndef _X360
+	if ( anim_simdblend.GetBool() )
+	{
+		SlerpBonesSIMD( pStudioHdr, q1, pos1, q2, pos2, pS2 );
+		return;
+	}
+#endif
+
 	QuaternionAligned q3;
 	for (i = 0; i < nBoneCount; i++)
 	{
@@ -1592,6 +1923,14 @@ void BlendBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+#ifndef _X360
+	if ( anim_simdblend.GetBool() )
+	{
+		BlendBonesSIMD( pStudioHdr, q1, pos1, seqdesc, pSeqGroup, q2, pos2, s1, s2, boneMask );
+		return;
+	}
+#endif
+
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
 		// skip unused bones
@@ -1917,18 +2256,21 @@ void Calc3WayBlendIndices( int i0, int i1, float s0, float s1, const mstudioseqd
 
 
 //-----------------------------------------------------------------------------
-// Purpose: calculate a pose for a single sequence
+// Purpose: decode and blend the animations of a single sequence once its cycle
+//			and local pose parameters are known
 //-----------------------------------------------------------------------------
-bool CalcPoseSingle(
+static bool CalcPoseSingleBlend(
 	const CStudioHdr *pStudioHdr,
-	Vector pos[], 
-	Quaternion q[], 
+	Vector pos[],
+	Quaternion q[],
 	mstudioseqdesc_t &seqdesc,
-	int sequence, 
+	int sequence,
 	float cycle,
-	const float poseParameter[],
-	int boneMask,
-	float flTime
+	int i0,
+	float s0,
+	int i1,
+	float s1,
+	int boneMask
 	)
 {
 	bool bResult = true;
@@ -1938,55 +2280,6 @@ bool CalcPoseSingle(
 	Vector		*pos3= g_VectorPool.Alloc();
 	Quaternion	*q3 = g_QaternionPool.Alloc();
 
-	if (sequence >= pStudioHdr->GetNumSeq()) 
-	{
-		sequence = 0;
-		seqdesc = ((CStudioHdr *)pStudioHdr)->pSeqdesc( sequence );
-	}
-
-
-	int i0 = 0, i1 = 0;
-	float s0 = 0, s1 = 0;
-
-	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, sequence, 0, s0, i0 );
-	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, sequence, 1, s1, i1 );
-
-
-	if (seqdesc.flags & STUDIO_REALTIME)
-	{
-		float cps = Studio_CPS( pStudioHdr, seqdesc, sequence, poseParameter );
-		cycle = flTime * cps;
-		cycle = cycle - (int)cycle;
-	}
-	else if (seqdesc.flags & STUDIO_CYCLEPOSE)
-	{
-		int iPose = pStudioHdr->GetSharedPoseParameter( sequence, seqdesc.cycleposeindex );
-		if (iPose != -1)
-		{
-			/*
-			const mstudioposeparamdesc_t &Pose = ((CStudioHdr *)pStudioHdr)->pPoseParameter( iPose );
-			cycle = poseParameter[ iPose ] * (Pose.end - Pose.start) + Pose.start;
-			*/
-			cycle = poseParameter[ iPose ];
-		}
-		else
-		{
-			cycle = 0.0f;
-		}
-	}
-	else if (cycle < 0 || cycle >= 1)
-	{
-		if (seqdesc.flags & STUDIO_LOOPING)
-		{
-			cycle = cycle - (int)cycle;
-			if (cycle < 0) cycle += 1;
-		}
-		else
-		{
-			cycle = clamp( cycle, 0.0f, 1.0f );
-		}
-	}
-
 	if (s0 < 0.001)
 	{
 		if (s1 < 0.001)
@@ -2117,6 +2410,296 @@ bool CalcPoseSingle(
 
 
 
+//-----------------------------------------------------------------------------
+// Pose cache.  Crowds playing the same sequence decode the same local pose over
+// and over.  With anim_posecache on, CalcPoseSingle snaps the cycle and the
+// sequence's pose parameter weights to a grid and keeps the decoded bones,
+// keyed on everything that feeds the decode.  It is opt-in because snapping
+// changes the result, and replicated so server hitboxes match client poses.
+//-----------------------------------------------------------------------------
+static ConVar anim_posecache( "anim_posecache", "0", FCVAR_REPLICATED, "Cache decoded single sequence poses, snapping cycle and pose parameters to a grid." );
+static ConVar anim_posecache_steps( "anim_posecache_steps", "1024", FCVAR_REPLICATED, "Grid steps per unit of cycle and pose parameter weight used by anim_posecache." );
+
+#define POSECACHE_SETS	256		// must be a power of two
+#define POSECACHE_WAYS	2
+
+struct PoseCacheKey_t
+{
+	const studiohdr_t		*m_pStudioHdr;
+	const virtualmodel_t	*m_pVModel;
+	int		m_nChecksum;
+	int		m_nSequence;
+	int		m_nBoneMask;
+	int		m_nCycle;
+	int		m_nAnim[2];
+	int		m_nWeight[2];
+	int		m_n3WayBlend;
+};
+
+struct PoseCacheEntry_t
+{
+	PoseCacheKey_t	m_Key;
+	unsigned int	m_nLastUse;
+	bool			m_bValid;
+	bool			m_bResult;
+	int				m_nBones;
+	int				m_nMaxBones;
+	Vector			*m_pPos;
+	Quaternion		*m_pQ;
+};
+
+struct PoseCacheSet_t
+{
+	CThreadFastMutex	m_Mutex;
+	unsigned int		m_nClock;
+	PoseCacheEntry_t	m_Entries[POSECACHE_WAYS];
+};
+
+static PoseCacheSet_t g_PoseCache[POSECACHE_SETS];
+static CInterlockedInt g_nPoseCacheHits;
+static CInterlockedInt g_nPoseCacheMisses;
+static CInterlockedInt g_nPoseCacheUncacheable;
+
+//-----------------------------------------------------------------------------
+// Purpose: the bones CalcAnimation writes for a sequence, which are the only
+//			ones a cache entry needs to hold
+//-----------------------------------------------------------------------------
+static int PoseCacheBoneList( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, int sequence, int boneMask, int *pBones )
+{
+	virtualmodel_t *pVModel = pStudioHdr->GetVirtualModel();
+	const virtualgroup_t *pSeqGroup = pVModel ? pVModel->pSeqGroup( sequence ) : NULL;
+
+	int nBones = 0;
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		if ( !(pStudioHdr->boneFlags(i) & boneMask) )
+			continue;
+
+		int j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+		if ( j >= 0 && seqdesc.weight( j ) > 0.0f )
+		{
+			pBones[nBones++] = i;
+		}
+	}
+	return nBones;
+}
+
+static bool CalcPoseSingleCached(
+	const CStudioHdr *pStudioHdr,
+	Vector pos[],
+	Quaternion q[],
+	mstudioseqdesc_t &seqdesc,
+	int sequence,
+	float cycle,
+	int i0,
+	float s0,
+	int i1,
+	float s1,
+	int boneMask
+	)
+{
+	float flSteps = (float)clamp( anim_posecache_steps.GetInt(), 16, 65536 );
+
+	PoseCacheKey_t key;
+	memset( &key, 0, sizeof( key ) );
+	key.m_pStudioHdr = pStudioHdr->GetRenderHdr();
+	key.m_pVModel = pStudioHdr->GetVirtualModel();
+	key.m_nChecksum = key.m_pStudioHdr->checksum;
+	key.m_nSequence = sequence;
+	key.m_nBoneMask = boneMask;
+	key.m_nCycle = (int)floor( cycle * flSteps + 0.5f );
+	key.m_nAnim[0] = i0;
+	key.m_nAnim[1] = i1;
+	key.m_nWeight[0] = (int)floor( s0 * flSteps + 0.5f );
+	key.m_nWeight[1] = (int)floor( s1 * flSteps + 0.5f );
+	key.m_n3WayBlend = anim_3wayblend.GetBool();
+
+	// misses decode the snapped values too, so a pose doesn't depend on whether it was cached
+	cycle = key.m_nCycle / flSteps;
+	s0 = key.m_nWeight[0] / flSteps;
+	s1 = key.m_nWeight[1] / flSteps;
+
+	int *pBones = (int *)stackalloc( pStudioHdr->numbones() * sizeof(int) );
+	int nBones = PoseCacheBoneList( pStudioHdr, seqdesc, sequence, boneMask, pBones );
+
+	PoseCacheSet_t &set = g_PoseCache[ CRC32_ProcessSingleBuffer( &key, sizeof( key ) ) & ( POSECACHE_SETS - 1 ) ];
+	{
+		AUTO_LOCK( set.m_Mutex );
+		for ( int w = 0; w < POSECACHE_WAYS; w++ )
+		{
+			PoseCacheEntry_t &entry = set.m_Entries[w];
+			if ( !entry.m_bValid || entry.m_nBones != nBones || memcmp( &entry.m_Key, &key, sizeof( key ) ) )
+				continue;
+
+			entry.m_nLastUse = ++set.m_nClock;
+			if ( entry.m_bResult )
+			{
+				for ( int k = 0; k < nBones; k++ )
+				{
+					pos[ pBones[k] ] = entry.m_pPos[k];
+					q[ pBones[k] ] = entry.m_pQ[k];
+				}
+			}
+			++g_nPoseCacheHits;
+			return entry.m_bResult;
+		}
+	}
+
+	++g_nPoseCacheMisses;
+
+	int nUncacheable = g_nUncacheablePoses;
+	bool bResult = CalcPoseSingleBlend( pStudioHdr, pos, q, seqdesc, sequence, cycle, i0, s0, i1, s1, boneMask );
+	if ( g_nUncacheablePoses != nUncacheable )
+	{
+		++g_nPoseCacheUncacheable;
+		return bResult;
+	}
+
+	AUTO_LOCK( set.m_Mutex );
+
+	// another thread may have filled the same key while we decoded; otherwise replace the least recently used way
+	PoseCacheEntry_t *pEntry = NULL;
+	for ( int w = 0; w < POSECACHE_WAYS; w++ )
+	{
+		PoseCacheEntry_t &entry = set.m_Entries[w];
+		if ( entry.m_bValid && !memcmp( &entry.m_Key, &key, sizeof( key ) ) )
+		{
+			pEntry = &entry;
+			break;
+		}
+		if ( !pEntry || !entry.m_bValid || ( pEntry->m_bValid && entry.m_nLastUse < pEntry->m_nLastUse ) )
+		{
+			pEntry = &entry;
+		}
+	}
+
+	if ( pEntry->m_nMaxBones < nBones )
+	{
+		delete[] pEntry->m_pPos;
+		delete[] pEntry->m_pQ;
+		pEntry->m_nMaxBones = nBones;
+		pEntry->m_pPos = new Vector[ nBones ];
+		pEntry->m_pQ = new Quaternion[ nBones ];
+	}
+
+	pEntry->m_Key = key;
+	pEntry->m_nLastUse = ++set.m_nClock;
+	pEntry->m_bValid = true;
+	pEntry->m_bResult = bResult;
+	pEntry->m_nBones = nBones;
+	if ( bResult )
+	{
+		for ( int k = 0; k < nBones; k++ )
+		{
+			pEntry->m_pPos[k] = pos[ pBones[k] ];
+			pEntry->m_pQ[k] = q[ pBones[k] ];
+		}
+	}
+
+	return bResult;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: pose cache counters, and a reset so benchmarks start cold
+//-----------------------------------------------------------------------------
+void Studio_GetPoseCacheStats( int &nHits, int &nMisses, int &nUncacheable )
+{
+	nHits = g_nPoseCacheHits;
+	nMisses = g_nPoseCacheMisses;
+	nUncacheable = g_nPoseCacheUncacheable;
+}
+
+void Studio_ResetPoseCache()
+{
+	for ( int i = 0; i < POSECACHE_SETS; i++ )
+	{
+		AUTO_LOCK( g_PoseCache[i].m_Mutex );
+		for ( int w = 0; w < POSECACHE_WAYS; w++ )
+		{
+			g_PoseCache[i].m_Entries[w].m_bValid = false;
+		}
+	}
+
+	g_nPoseCacheHits = 0;
+	g_nPoseCacheMisses = 0;
+	g_nPoseCacheUncacheable = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: calculate a pose for a single sequence
+//-----------------------------------------------------------------------------
+bool CalcPoseSingle(
+	const CStudioHdr *pStudioHdr,
+	Vector pos[], 
+	Quaternion q[], 
+	mstudioseqdesc_t &seqdesc,
+	int sequence, 
+	float cycle,
+	const float poseParameter[],
+	int boneMask,
+	float flTime
+	)
+{
+	if (sequence >= pStudioHdr->GetNumSeq()) 
+	{
+		sequence = 0;
+		seqdesc = ((CStudioHdr *)pStudioHdr)->pSeqdesc( sequence );
+	}
+
+
+	int i0 = 0, i1 = 0;
+	float s0 = 0, s1 = 0;
+
+	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, sequence, 0, s0, i0 );
+	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, sequence, 1, s1, i1 );
+
+
+	if (seqdesc.flags & STUDIO_REALTIME)
+	{
+		float cps = Studio_CPS( pStudioHdr, seqdesc, sequence, poseParameter );
+		cycle = flTime * cps;
+		cycle = cycle - (int)cycle;
+	}
+	else if (seqdesc.flags & STUDIO_CYCLEPOSE)
+	{
+		int iPose = pStudioHdr->GetSharedPoseParameter( sequence, seqdesc.cycleposeindex );
+		if (iPose != -1)
+		{
+			/*
+			const mstudioposeparamdesc_t &Pose = ((CStudioHdr *)pStudioHdr)->pPoseParameter( iPose );
+			cycle = poseParameter[ iPose ] * (Pose.end - Pose.start) + Pose.start;
+			*/
+			cycle = poseParameter[ iPose ];
+		}
+		else
+		{
+			cycle = 0.0f;
+		}
+	}
+	else if (cycle < 0 || cycle >= 1)
+	{
+		if (seqdesc.flags & STUDIO_LOOPING)
+		{
+			cycle = cycle - (int)cycle;
+			if (cycle < 0) cycle += 1;
+		}
+		else
+		{
+			cycle = clamp( cycle, 0.0f, 1.0f );
+		}
+	}
+
+	if ( anim_posecache.GetBool() )
+	{
+		return CalcPoseSingleCached( pStudioHdr, pos, q, seqdesc, sequence, cycle, i0, s0, i1, s1, boneMask );
+	}
+
+	return CalcPoseSingleBlend( pStudioHdr, pos, q, seqdesc, sequence, cycle, i0, s0, i1, s1, boneMask );
+}
+
+
+
 
 //-----------------------------------------------------------------------------
 // Purpose: calculate a pose for a single sequence
@@ -5260,44 +5843,102 @@ static int ClipRayToHitbox( const Ray_t &ray, mstudiobbox_t *pbox, matrix3x4_t&
 #pragma warning (default : 4701)
 
 
+static ConVar hitbox_trace_batch( "hitbox_trace_batch", "1", FCVAR_REPLICATED, "Cull hitboxes four at a time before the exact ray tests." );
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers up to four hitboxes that pass the contents filter, starting
+//          at iNext. Returns how many it found; unused lanes repeat the last.
+//-----------------------------------------------------------------------------
+static int GatherFourHitboxes( CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, 
+							   int fContentsMask, const uint64 *pCandidates, int &iNext, int *pHitboxes, FourOBBs_t &obbs )
+{
+	int nHitboxes = 0;
+	while ( iNext < set->numhitboxes && nHitboxes < 4 )
+	{
+		int i = iNext++;
+
+		// Skip what the hitbox tree already ruled out
+		if ( pCandidates && !( *pCandidates & ( (uint64)1 << i ) ) )
+			continue;
+
+		mstudiobbox_t *pbox = set->pHitbox(i);
+
+		// Filter based on contents mask
+		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
+		if ( ( fBoneContents & fContentsMask ) == 0 )
+			continue;
+
+		obbs.Set( nHitboxes, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax );
+		pHitboxes[nHitboxes++] = i;
+	}
+
+	for ( int j = nHitboxes; j < 4 && nHitboxes > 0; j++ )
+	{
+		mstudiobbox_t *pbox = set->pHitbox( pHitboxes[nHitboxes - 1] );
+		obbs.Set( j, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax );
+	}
+
+	return nHitboxes;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
 bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
-				   matrix3x4_t **hitboxbones, int fContentsMask, trace_t &tr )
+				   matrix3x4_t **hitboxbones, int fContentsMask, trace_t &tr, CHitboxBVH *pBVH )
 {
 	tr.fraction = 1.0;
 	tr.startsolid = false;
 
+	uint64 candidates = 0;
+	const uint64 *pCandidates = NULL;
+	if ( pBVH && pBVH->IsValid() )
+	{
+		candidates = pBVH->FindCandidates( ray, HITBOX_CULL_TOLERANCE );
+		pCandidates = &candidates;
+	}
+
 	// OPTIMIZE: Partition these?
 	Ray_t clippedRay = ray;
 	int hitbox = -1;
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	bool bBatch = hitbox_trace_batch.GetBool();
+	FourOBBs_t obbs;
+	int iHitboxes[4];
+	int iNext = 0;
+	int nHitboxes;
+	while ( ( nHitboxes = GatherFourHitboxes( pStudioHdr, set, hitboxbones, fContentsMask, pCandidates, iNext, iHitboxes, obbs ) ) > 0 )
 	{
-		mstudiobbox_t *pbox = set->pHitbox(i);
+		int mask = bBatch ? IsFourOBBsIntersectingRay( obbs, clippedRay, HITBOX_CULL_TOLERANCE ) : 0xf;
+		for ( int j = 0; j < nHitboxes; j++ )
+		{
+			if ( !( mask & ( 1 << j ) ) )
+				continue;
 
-		// Filter based on contents mask
-		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
-		if ( ( fBoneContents & fContentsMask ) == 0 )
-			continue;
-		
-		//FIXME: Won't work with scaling!
-		trace_t obbTrace;
-		if ( IntersectRayWithOBB( clippedRay, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace ) )
-		{
-			tr.startpos = obbTrace.startpos;
-			tr.endpos = obbTrace.endpos;
-			tr.plane = obbTrace.plane;
-			tr.startsolid = obbTrace.startsolid;
-			tr.allsolid = obbTrace.allsolid;
-
-			// This logic here is to shorten the ray each time to get more early outs
-			tr.fraction *= obbTrace.fraction;
-			clippedRay.m_Delta *= obbTrace.fraction;
-			hitbox = i;
-			if (tr.startsolid)
-				break;
+			int i = iHitboxes[j];
+			mstudiobbox_t *pbox = set->pHitbox(i);
+
+			//FIXME: Won't work with scaling!
+			trace_t obbTrace;
+			if ( IntersectRayWithOBB( clippedRay, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace ) )
+			{
+				tr.startpos = obbTrace.startpos;
+				tr.endpos = obbTrace.endpos;
+				tr.plane = obbTrace.plane;
+				tr.startsolid = obbTrace.startsolid;
+				tr.allsolid = obbTrace.allsolid;
+
+				// This logic here is to shorten the ray each time to get more early outs
+				tr.fraction *= obbTrace.fraction;
+				clippedRay.m_Delta *= obbTrace.fraction;
+				hitbox = i;
+				if (tr.startsolid)
+					break;
+			}
 		}
+
+		if ( hitbox >= 0 && tr.startsolid )
+			break;
 	}
 
 	if ( hitbox >= 0 )
@@ -5322,80 +5963,104 @@ bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHd
 // Purpose:
 //-----------------------------------------------------------------------------
 bool TraceToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
-				   matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr )
+				   matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr, CHitboxBVH *pBVH )
 {
 	if ( !ray.m_IsRay )
 	{
-		return SweepBoxToStudio( pProps, ray, pStudioHdr, set, hitboxbones, fContentsMask, tr );
+		return SweepBoxToStudio( pProps, ray, pStudioHdr, set, hitboxbones, fContentsMask, tr, pBVH );
 	}
 
 	tr.fraction = 1.0;
 	tr.startsolid = false;
 
+	uint64 candidates = 0;
+	const uint64 *pCandidates = NULL;
+	if ( pBVH && pBVH->IsValid() )
+	{
+		candidates = pBVH->FindCandidates( ray, HITBOX_CULL_TOLERANCE );
+		pCandidates = &candidates;
+	}
+
 	// no hit yet
 	int hitbox = -1;
 	int hitside = -1;
 
 	// OPTIMIZE: Partition these?
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	bool bBatch = hitbox_trace_batch.GetBool();
+	FourOBBs_t obbs;
+	int iHitboxes[4];
+	int iNext = 0;
+	int nHitboxes;
+	while ( ( nHitboxes = GatherFourHitboxes( pStudioHdr, set, hitboxbones, fContentsMask, pCandidates, iNext, iHitboxes, obbs ) ) > 0 )
 	{
-		mstudiobbox_t *pbox = set->pHitbox(i);
+		// Cull against what's left of the ray; the exact tests shorten it too
+		int mask = 0xf;
+		if ( bBatch )
+		{
+			Ray_t cullRay;
+			cullRay.Init( ray.m_Start, ray.m_Start + ray.m_Delta * tr.fraction );
+			mask = IsFourOBBsIntersectingRay( obbs, cullRay, HITBOX_CULL_TOLERANCE );
+		}
 
-		// Filter based on contents mask
-		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
-		if ( ( fBoneContents & fContentsMask ) == 0 )
-			continue;
-		
-		// columns are axes of the bones in world space, translation is in world space
-		matrix3x4_t& matrix = *hitboxbones[pbox->bone];
+		for ( int j = 0; j < nHitboxes; j++ )
+		{
+			if ( !( mask & ( 1 << j ) ) )
+				continue;
+
+			int i = iHitboxes[j];
+			mstudiobbox_t *pbox = set->pHitbox(i);
+
+			// columns are axes of the bones in world space, translation is in world space
+			matrix3x4_t& matrix = *hitboxbones[pbox->bone];
 		
-		// Because we're sending in a matrix with scale data, and because the matrix inversion in the hitbox
-		// code does not handle that case, we pre-scale the bones and ray down here and do our collision checks
-		// in unscaled space.  We can then rescale the results afterwards.
+			// Because we're sending in a matrix with scale data, and because the matrix inversion in the hitbox
+			// code does not handle that case, we pre-scale the bones and ray down here and do our collision checks
+			// in unscaled space.  We can then rescale the results afterwards.
 
-		int side = -1;
-		if ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON )
-		{
-			matrix3x4_t matScaled;
-			MatrixCopy( matrix, matScaled );
+			int side = -1;
+			if ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON )
+			{
+				matrix3x4_t matScaled;
+				MatrixCopy( matrix, matScaled );
 			
-			float invScale = 1.0f / flScale;
+				float invScale = 1.0f / flScale;
 
-			Vector vecBoneOrigin;
-			MatrixGetColumn( matScaled, 3, vecBoneOrigin );
+				Vector vecBoneOrigin;
+				MatrixGetColumn( matScaled, 3, vecBoneOrigin );
 			
-			// Pre-scale the origin down
-			Vector vecNewOrigin = vecBoneOrigin - vecOrigin;
-			vecNewOrigin *= invScale;
-			vecNewOrigin += vecOrigin;
-			MatrixSetColumn( vecNewOrigin, 3, matScaled );
-
-			// Scale it uniformly
-			VectorScale( matScaled[0], invScale, matScaled[0] );
-			VectorScale( matScaled[1], invScale, matScaled[1] );
-			VectorScale( matScaled[2], invScale, matScaled[2] );
+				// Pre-scale the origin down
+				Vector vecNewOrigin = vecBoneOrigin - vecOrigin;
+				vecNewOrigin *= invScale;
+				vecNewOrigin += vecOrigin;
+				MatrixSetColumn( vecNewOrigin, 3, matScaled );
+
+				// Scale it uniformly
+				VectorScale( matScaled[0], invScale, matScaled[0] );
+				VectorScale( matScaled[1], invScale, matScaled[1] );
+				VectorScale( matScaled[2], invScale, matScaled[2] );
 			
-			// Pre-scale our ray as well
-			Vector vecRayStart = ray.m_Start - vecOrigin;
-			vecRayStart *= invScale;
-			vecRayStart += vecOrigin;
+				// Pre-scale our ray as well
+				Vector vecRayStart = ray.m_Start - vecOrigin;
+				vecRayStart *= invScale;
+				vecRayStart += vecOrigin;
 			
-			Vector vecRayDelta = ray.m_Delta * invScale;
+				Vector vecRayDelta = ray.m_Delta * invScale;
 
-			Ray_t newRay;
-			newRay.Init( vecRayStart, vecRayStart + vecRayDelta );  
+				Ray_t newRay;
+				newRay.Init( vecRayStart, vecRayStart + vecRayDelta );  
 			
-			side = ClipRayToHitbox( newRay, pbox, matScaled, tr );
-		}
-		else
-		{
-			side = ClipRayToHitbox( ray, pbox, matrix, tr );
-		}
+				side = ClipRayToHitbox( newRay, pbox, matScaled, tr );
+			}
+			else
+			{
+				side = ClipRayToHitbox( ray, pbox, matrix, tr );
+			}
 
-		if ( side >= 0 )
-		{
-			hitbox = i;
-			hitside = side;
+			if ( side >= 0 )
+			{
+				hitbox = i;
+				hitside = side;
+			}
 		}
 	}
 
@@ -15,6 +15,8 @@
 #include "studio.h"
 #include "cmodel.h"
 #include "bitvec.h"
+#include "mathlib/ssemath.h"
+#include "hitbox_bvh.h"
 
 
 class CBoneToWorld;
@@ -418,6 +420,7 @@ public:
 public:
 	float			m_timeValid;
 	int				m_boneMask;
+	int				m_nSerial;		// New, unique value every time the bones are updated
 
 private:
 	matrix3x4_t		*BoneArray();
@@ -437,13 +440,19 @@ void Studio_DestroyBoneCache( memhandle_t cacheHandle );
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
-bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
+// pBVH, if given, must have been updated for these bones; it's used to skip hitboxes the ray can't reach
+bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace, CHitboxBVH *pBVH = NULL );
+
 
 void QuaternionSM( float s, const Quaternion &p, const Quaternion &q, Quaternion &qt );
 void QuaternionMA( const Quaternion &p, float s, const Quaternion &q, Quaternion &qt );
 
 bool Studio_PrefetchSequence( const CStudioHdr *pStudioHdr, int iSequence );
 
+// anim_posecache hit/miss counters since the last reset
+void Studio_GetPoseCacheStats( int &nHits, int &nMisses, int &nUncacheable );
+void Studio_ResetPoseCache();
+
 void Studio_RunBoneFlexDrivers( float *pFlexController, const CStudioHdr *pStudioHdr, const Vector *pPositions, const matrix3x4_t *pBoneToWorld, const matrix3x4_t &mRootToWorld );
 
 #endif // BONE_SETUP_H
@@ -3259,4 +3259,208 @@ bool RayHasFullyContainedIntersectionWithQuad( const Ray_t &ray,
 	return true; //there were lines crossing the quad plane, and every line crossing that plane had its intersection with the plane within the quad's boundaries
 }
 
+
+//-----------------------------------------------------------------------------
+// Clips rays against one slab of four boxes. lo and hi are the slab planes
+// relative to the ray starts. Updates the [enter, leave] interval of rays
+// that cross a plane, and flags rays that start and end outside the same one.
+//-----------------------------------------------------------------------------
+static FORCEINLINE void ClipRaysToFourSlabs( const fltx4 &lo, const fltx4 &hi, const fltx4 &delta, const fltx4 &invDelta,
+											fltx4 &enter, fltx4 &leave, fltx4 &miss )
+{
+	fltx4 startOutMins = CmpLtSIMD( Four_Zeros, lo );
+	fltx4 endOutMins = CmpLtSIMD( delta, lo );
+	fltx4 startOutMaxs = CmpGtSIMD( Four_Zeros, hi );
+	fltx4 endOutMaxs = CmpGtSIMD( delta, hi );
+	miss = OrSIMD( miss, OrSIMD( AndSIMD( startOutMins, endOutMins ), AndSIMD( startOutMaxs, endOutMaxs ) ) );
+
+	// only consider rays that cross a plane
+	fltx4 crossPlane = OrSIMD( XorSIMD( startOutMins, endOutMins ), XorSIMD( startOutMaxs, endOutMaxs ) );
+	fltx4 t0 = MulSIMD( lo, invDelta );
+	fltx4 t1 = MulSIMD( hi, invDelta );
+	enter = MaskedAssign( crossPlane, MaxSIMD( enter, MinSIMD( t0, t1 ) ), enter );
+	leave = MaskedAssign( crossPlane, MinSIMD( leave, MaxSIMD( t0, t1 ) ), leave );
+}
+
+static FORCEINLINE int FinishFourRayClips( const fltx4 &enter, const fltx4 &leave, const fltx4 &miss, fltx4 *pEnterFractions )
+{
+	if ( pEnterFractions )
+	{
+		*pEnterFractions = enter;
+	}
+
+	return ~TestSignSIMD( OrSIMD( miss, CmpGtSIMD( enter, leave ) ) ) & 0xf;
+}
+
+
+//-----------------------------------------------------------------------------
+// One ray against four AABBs
+//-----------------------------------------------------------------------------
+int FASTCALL IsFourBoxesIntersectingRay( const FourVectors& boxMin, const FourVectors& boxMax, 
+										const Ray_t& ray, float flTolerance, fltx4 *pEnterFractions )
+{
+	fltx4 enter = Four_Zeros;
+	fltx4 leave = Four_Ones;
+	fltx4 miss = Four_Zeros;
+
+	// Expand the boxes by the ray extents, relative to the ray start
+	for ( int i = 0; i < 3; ++i )
+	{
+		fltx4 lo = SubSIMD( boxMin[i], ReplicateX4( ray.m_Start[i] + ray.m_Extents[i] + flTolerance ) );
+		fltx4 hi = AddSIMD( boxMax[i], ReplicateX4( ray.m_Extents[i] + flTolerance - ray.m_Start[i] ) );
+		fltx4 delta = ReplicateX4( ray.m_Delta[i] );
+		ClipRaysToFourSlabs( lo, hi, delta, ReciprocalSaturateSIMD( delta ), enter, leave, miss );
+	}
+
+	return FinishFourRayClips( enter, leave, miss, pEnterFractions );
+}
+
+
+//-----------------------------------------------------------------------------
+// Four rays against one AABB
+//-----------------------------------------------------------------------------
+int FASTCALL IsBoxIntersectingFourRays( const Vector& boxMin, const Vector& boxMax, 
+									   const FourVectors& origin, const FourVectors& delta, float flTolerance, fltx4 *pEnterFractions )
+{
+	fltx4 enter = Four_Zeros;
+	fltx4 leave = Four_Ones;
+	fltx4 miss = Four_Zeros;
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		fltx4 lo = SubSIMD( ReplicateX4( boxMin[i] - flTolerance ), origin[i] );
+		fltx4 hi = SubSIMD( ReplicateX4( boxMax[i] + flTolerance ), origin[i] );
+		ClipRaysToFourSlabs( lo, hi, delta[i], ReciprocalSaturateSIMD( delta[i] ), enter, leave, miss );
+	}
+
+	return FinishFourRayClips( enter, leave, miss, pEnterFractions );
+}
+
+
+//-----------------------------------------------------------------------------
+// Four rays against one OBB, tested in the space of the box
+//-----------------------------------------------------------------------------
+int FASTCALL IsOBBIntersectingFourRays( const matrix3x4_t &matOBBToWorld, const Vector &vecOBBMins, const Vector &vecOBBMaxs, 
+									   const FourVectors& origin, const FourVectors& delta, float flTolerance, fltx4 *pEnterFractions )
+{
+	Vector vecOBBOrigin, vecAxis[3];
+	MatrixGetColumn( matOBBToWorld, 3, vecOBBOrigin );
+	MatrixGetColumn( matOBBToWorld, 0, vecAxis[0] );
+	MatrixGetColumn( matOBBToWorld, 1, vecAxis[1] );
+	MatrixGetColumn( matOBBToWorld, 2, vecAxis[2] );
+
+	FourVectors offset = origin;
+	FourVectors vecOBBOrigin4;
+	vecOBBOrigin4.DuplicateVector( vecOBBOrigin );
+	offset -= vecOBBOrigin4;
+
+	FourVectors localOrigin, localDelta;
+	for ( int i = 0; i < 3; ++i )
+	{
+		localOrigin[i] = offset * vecAxis[i];
+		localDelta[i] = delta * vecAxis[i];
+	}
+
+	return IsBoxIntersectingFourRays( vecOBBMins, vecOBBMaxs, localOrigin, localDelta, flTolerance, pEnterFractions );
+}
+
+
+//-----------------------------------------------------------------------------
+// Four OBBs
+//-----------------------------------------------------------------------------
+void FourOBBs_t::Set( int i, const matrix3x4_t &matOBBToWorld, const Vector &vecOBBMins, const Vector &vecOBBMaxs )
+{
+	Vector vecLocalCenter, vecCenter;
+	VectorAdd( vecOBBMins, vecOBBMaxs, vecLocalCenter );
+	vecLocalCenter *= 0.5f;
+	VectorTransform( vecLocalCenter, matOBBToWorld, vecCenter );
+	m_vecCenter.X( i ) = vecCenter.x;
+	m_vecCenter.Y( i ) = vecCenter.y;
+	m_vecCenter.Z( i ) = vecCenter.z;
+
+	// Fold any scale into the extents so the axes are unit length
+	for ( int j = 0; j < 3; ++j )
+	{
+		Vector vecAxis;
+		MatrixGetColumn( matOBBToWorld, j, vecAxis );
+		float flScale = VectorNormalize( vecAxis );
+		m_vecAxis[j].X( i ) = vecAxis.x;
+		m_vecAxis[j].Y( i ) = vecAxis.y;
+		m_vecAxis[j].Z( i ) = vecAxis.z;
+		SubFloat( m_vecExtents[j], i ) = ( vecOBBMaxs[j] - vecLocalCenter[j] ) * flScale;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Flags the boxes that are separated from the swept ray along one axis per
+// box. The ray is centered on the middle of its sweep.
+//-----------------------------------------------------------------------------
+static FORCEINLINE fltx4 IsSeparatingAxisForFourOBBs( const FourVectors &axis, const FourVectors &centerDelta, const FourOBBs_t &obbs,
+													 const FourVectors &obbExtents, const Ray_t &ray )
+{
+	fltx4 flDist = fabs( axis * centerDelta );
+
+	fltx4 flRadius = MulSIMD( fabs( axis * obbs.m_vecAxis[0] ), obbExtents.x );
+	flRadius = MaddSIMD( fabs( axis * obbs.m_vecAxis[1] ), obbExtents.y, flRadius );
+	flRadius = MaddSIMD( fabs( axis * obbs.m_vecAxis[2] ), obbExtents.z, flRadius );
+	flRadius = MaddSIMD( fabs( axis * ray.m_Delta ), Four_PointFives, flRadius );
+	if ( !ray.m_IsRay )
+	{
+		flRadius = MaddSIMD( fabs( axis.x ), ReplicateX4( ray.m_Extents.x ), flRadius );
+		flRadius = MaddSIMD( fabs( axis.y ), ReplicateX4( ray.m_Extents.y ), flRadius );
+		flRadius = MaddSIMD( fabs( axis.z ), ReplicateX4( ray.m_Extents.z ), flRadius );
+	}
+
+	return CmpGtSIMD( flDist, flRadius );
+}
+
+int FASTCALL IsFourOBBsIntersectingRay( const FourOBBs_t &obbs, const Ray_t& ray, float flTolerance )
+{
+	Vector vecRayCenter;
+	VectorMA( ray.m_Start, 0.5f, ray.m_Delta, vecRayCenter );
+	FourVectors rayCenter;
+	rayCenter.DuplicateVector( vecRayCenter );
+	FourVectors centerDelta = obbs.m_vecCenter;
+	centerDelta -= rayCenter;
+
+	fltx4 tolerance = ReplicateX4( flTolerance );
+	FourVectors obbExtents;
+	obbExtents.x = AddSIMD( obbs.m_vecExtents.x, tolerance );
+	obbExtents.y = AddSIMD( obbs.m_vecExtents.y, tolerance );
+	obbExtents.z = AddSIMD( obbs.m_vecExtents.z, tolerance );
+
+	FourVectors rayDelta;
+	rayDelta.DuplicateVector( ray.m_Delta );
+
+	fltx4 separated = Four_Zeros;
+	for ( int i = 0; i < 3; ++i )
+	{
+		// The box faces
+		separated = OrSIMD( separated, IsSeparatingAxisForFourOBBs( obbs.m_vecAxis[i], centerDelta, obbs, obbExtents, ray ) );
+
+		// The box edges vs. the sweep
+		FourVectors axis = obbs.m_vecAxis[i] ^ rayDelta;
+		separated = OrSIMD( separated, IsSeparatingAxisForFourOBBs( axis, centerDelta, obbs, obbExtents, ray ) );
+	}
+
+	if ( !ray.m_IsRay )
+	{
+		// The faces of the swept box, and their edges vs. the sweep
+		for ( int i = 0; i < 3; ++i )
+		{
+			Vector vecAxis( 0.0f, 0.0f, 0.0f );
+			vecAxis[i] = 1.0f;
+			FourVectors axis;
+			axis.DuplicateVector( vecAxis );
+			separated = OrSIMD( separated, IsSeparatingAxisForFourOBBs( axis, centerDelta, obbs, obbExtents, ray ) );
+
+			axis = axis ^ rayDelta;
+			separated = OrSIMD( separated, IsSeparatingAxisForFourOBBs( axis, centerDelta, obbs, obbExtents, ray ) );
+		}
+	}
+
+	return ~TestSignSIMD( separated ) & 0xf;
+}
+
 #endif // !_STATIC_LINKED || _SHARED_LIB
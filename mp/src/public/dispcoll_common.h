@@ -12,6 +12,7 @@
 #include "trace.h"
 #include "builddisp.h"
 #include "bitvec.h"
+#include "mathlib/vector4d.h"
 #ifdef ENGINE_DLL
 #include "../engine/zone.h"
 #endif
@@ -40,6 +41,10 @@ FORWARD_DECLARE_HANDLE( memhandle_t );
 extern double g_flDispCollSweepTimer;
 extern double g_flDispCollIntersectTimer;
 extern double g_flDispCollInCallTimer;
+// Reject triangles four at a time by their planes before the exact tests. Of
+// the projects in this tree only vrad builds this file; game traces against
+// displacements run in the engine's own copy, which doesn't have the culls.
+extern bool g_bDispCollCullFourTris;
 
 struct RayDispOutput_t
 {
@@ -323,6 +328,7 @@ protected:
 protected:
 	CDispVector<Vector>				m_aVerts;								// Displacement verts.
 	CDispVector<CDispCollTri>		m_aTris;								// Displacement triangles.
+	CDispVector<Vector4D>			m_aTriPlanes;							// Triangle planes (normal, dist), packed for the four-wide culls.
 	CDispVector<CDispCollNode>		m_nodes;					// Nodes.
 	CDispVector<CDispCollLeaf>		m_leaves;								// Leaves.
 	// Cache
@@ -182,6 +182,187 @@ class CCallQueue : public CCallQueueT<>
 {
 };
 
+//-----------------------------------------------------
+// Call queue that builds small functors directly in the cells of a lock
+// free ring (CTSRingQueue) instead of allocating each one. Functors too big
+// for a cell are allocated as usual and queued by pointer. When the ring is
+// full, calls go to an allocating CTSQueue until CallQueued() drains it, so
+// each thread's calls still run in the order they were queued.
+//-----------------------------------------------------
+
+#define INLINE_CALLQUEUE_STORAGE 96
+
+class CInlineCallQueue : private CCustomizedFunctorFactory<CInlineCallQueue>
+{
+public:
+	CInlineCallQueue( int nCapacity = 1024 )
+		: m_Ring( nCapacity ),
+		  m_bNoQueue( false )
+	{
+		SetAllocator( this );
+	}
+
+	~CInlineCallQueue()
+	{
+		Flush();
+	}
+
+	void DisableQueue( bool bDisable )
+	{
+		if ( m_bNoQueue == bDisable )
+		{
+			return;
+		}
+		if ( !m_bNoQueue )
+			CallQueued();
+
+		m_bNoQueue = bDisable;
+	}
+
+	bool IsDisabled() const
+	{
+		return m_bNoQueue;
+	}
+
+	int Count()
+	{
+		return m_Ring.Count() + m_nOverflow;
+	}
+
+	void CallQueued()
+	{
+		Drain( true );
+	}
+
+	void QueueFunctor( CFunctor *pFunctor )
+	{
+		Assert( pFunctor );
+		QueueAllocated( RetAddRef( pFunctor ) );
+	}
+
+	void Flush()
+	{
+		Drain( false );
+	}
+
+	FUNC_GENERATE_QUEUE_METHODS();
+
+private:
+	friend class CCustomizedFunctorFactory<CInlineCallQueue>;
+
+	enum
+	{
+		QUEUEDCALL_INLINE,			// Built in the cell; destroyed in place
+		QUEUEDCALL_REFCOUNTED,		// Allocated; released after the call
+	};
+
+	struct QueuedCall_t
+	{
+		CFunctor	*m_pFunctor;
+		int			m_Type;
+		ALIGN16 char m_Storage[INLINE_CALLQUEUE_STORAGE] ALIGN16_POST;
+	};
+
+	// Called by the functor factory, just before it constructs a functor
+	void *Alloc( size_t nBytes )
+	{
+		if ( nBytes <= INLINE_CALLQUEUE_STORAGE && !m_bNoQueue && !m_nOverflow )
+		{
+			QueuedCall_t *pCall = m_Ring.BeginPush();
+			if ( pCall )
+				return pCall->m_Storage;
+		}
+		return ::operator new( nBytes );
+	}
+
+	void QueueFunctorInternal( CFunctor *pFunctor )
+	{
+		QueuedCall_t *pCall = m_Ring.FindElement( pFunctor );
+		if ( pCall )
+		{
+			pCall->m_pFunctor = pFunctor;
+			pCall->m_Type = QUEUEDCALL_INLINE;
+			m_Ring.EndPush( pCall );
+			return;
+		}
+
+		QueueAllocated( pFunctor );
+	}
+
+	void QueueAllocated( CFunctor *pFunctor )
+	{
+		if ( m_bNoQueue )
+		{
+			(*pFunctor)();
+			pFunctor->Release();
+			return;
+		}
+
+		if ( !m_nOverflow )
+		{
+			QueuedCall_t *pCall = m_Ring.BeginPush();
+			if ( pCall )
+			{
+				pCall->m_pFunctor = pFunctor;
+				pCall->m_Type = QUEUEDCALL_REFCOUNTED;
+				m_Ring.EndPush( pCall );
+				return;
+			}
+		}
+
+		m_nOverflow++;
+		m_Overflow.PushItem( pFunctor );
+	}
+
+	void Drain( bool bCall )
+	{
+		// Only take the calls that were queued before we started
+		int nCalls = m_Ring.Count();
+		QueuedCall_t *pCall;
+		while ( nCalls-- > 0 && ( pCall = m_Ring.BeginPop() ) != NULL )
+		{
+			CFunctor *pFunctor = pCall->m_pFunctor;
+			if ( bCall )
+			{
+				(*pFunctor)();
+			}
+
+			if ( pCall->m_Type == QUEUEDCALL_INLINE )
+			{
+				pFunctor->~CFunctor();
+			}
+			else
+			{
+				pFunctor->Release();
+			}
+			m_Ring.EndPop( pCall );
+		}
+
+		if ( !m_nOverflow )
+		{
+			return;
+		}
+
+		m_Overflow.PushItem( NULL );
+
+		CFunctor *pFunctor;
+		while ( m_Overflow.PopItem( &pFunctor ) && pFunctor != NULL )
+		{
+			if ( bCall )
+			{
+				(*pFunctor)();
+			}
+			pFunctor->Release();
+			m_nOverflow--;
+		}
+	}
+
+	CTSRingQueue<QueuedCall_t> m_Ring;
+	CTSQueue<CFunctor *> m_Overflow;
+	CInterlockedInt m_nOverflow;
+	bool m_bNoQueue;
+};
+
 //-----------------------------------------------------
 // Optional interface that can be bound to concrete CCallQueue
 //-----------------------------------------------------
@@ -0,0 +1,148 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Size classed small object allocator with per-thread caches.
+//			Each thread allocates from and frees to its own free lists
+//			without locking; when a list runs dry or grows too long, a whole
+//			batch of blocks moves to or from the central pool for that size
+//			class, so the shared lock is taken once per batch instead of
+//			once per allocation.
+//
+//			A thread's cache is only returned by FlushThreadCache(). A thread
+//			that exits without calling it strands its cache, and the blocks
+//			cached in it, until the module unloads. Threads that live as long
+//			as the module, like the main thread and the job thread pool's,
+//			never need to flush; any thread that's created and destroyed
+//			while the game runs must flush before it returns.
+//
+//=============================================================================//
+
+#ifndef SMALLOBJECTALLOCATOR_H
+#define SMALLOBJECTALLOCATOR_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier0/memalloc.h"
+
+// Larger requests go straight to the heap
+#define SMALLOBJECT_MAX_SIZE		1024
+
+// Sizes are rounded up to 16 bytes up to 256, then to 64 bytes
+#define SMALLOBJECT_NUM_SIZECLASSES	28
+
+// Classes beyond this still allocate through the size classes, but don't get
+// their own statistics
+#define SMALLOBJECT_MAX_TRACKED		128
+
+class CSmallObjectThreadCache;
+
+//-----------------------------------------------------------------------------
+// Statistics for one class that allocates through
+// DECLARE_SMALLOBJECT_ALLOCATOR. Live counts are kept per thread and summed
+// when read; the peak is sampled whenever a thread refills from the central
+// pool, so it is accurate to about one batch per thread.
+//-----------------------------------------------------------------------------
+class CSmallObjectAllocStats
+{
+public:
+	CSmallObjectAllocStats( const char *pszName, int nSize );
+
+	int GetLiveCount() const;
+	int GetPeakCount() const	{ return m_nPeak; }
+	const char *GetName() const	{ return m_pszName; }
+	int GetSize() const			{ return m_nSize; }
+
+private:
+	const char				*m_pszName;
+	int						m_nSize;
+	int						m_nIndex;		// Slot in the per-thread counters, -1 if untracked
+	int						m_nPeak;
+	CSmallObjectAllocStats	*m_pNext;
+
+	friend class CSmallObjectAllocator;
+};
+
+
+//-----------------------------------------------------------------------------
+// The allocator. There is one per module; use SmallObjectAllocator().
+//-----------------------------------------------------------------------------
+class CSmallObjectAllocator
+{
+public:
+	CSmallObjectAllocator();
+
+	void*		Alloc( size_t nBytes, CSmallObjectAllocStats *pStats = NULL );
+	void		Free( void *pMem, size_t nBytes, CSmallObjectAllocStats *pStats = NULL );
+
+	// Returns this thread's cached blocks to the central pools and releases
+	// its cache for reuse by the next thread that allocates. Must be called
+	// before a short-lived thread exits; nothing calls it on thread exit.
+	void		FlushThreadCache();
+
+	// Prints the size classes and the registered classes through Msg. tier1
+	// is linked into several modules, so each one that wants this exposes it
+	// with its own command (sv_smallobject_stats, cl_smallobject_stats).
+	void		ReportStats();
+
+	static int	GetSizeClass( size_t nBytes );
+	static int	GetSizeClassBytes( int nSizeClass );
+
+private:
+	struct CentralPool_t
+	{
+		CThreadFastMutex	m_Mutex;
+		void				*m_pBatches;		// Full batches, linked through their first block
+		int					m_nBatches;
+		void				*m_pLoose;			// Partial batches from flushed thread caches
+		int					m_nLoose;
+		char				*m_pCarve;			// Unused tail of the newest slab
+		int					m_nCarveBlocks;
+		int					m_nSlabs;
+		int					m_nBlocks;			// Blocks carved from all slabs
+	};
+
+	CSmallObjectThreadCache *GetThreadCache();
+	CSmallObjectThreadCache *CreateThreadCache();
+	void		Refill( CSmallObjectThreadCache *pCache, int nSizeClass, CSmallObjectAllocStats *pStats );
+	void		Release( CSmallObjectThreadCache *pCache, int nSizeClass, int nBlocks );
+	void		RegisterStats( CSmallObjectAllocStats *pStats );
+	int			SumLiveCount( int nIndex );
+
+	CThreadLocalPtr<CSmallObjectThreadCache>	m_pThreadCache;
+	CentralPool_t			m_Central[SMALLOBJECT_NUM_SIZECLASSES];
+
+	CThreadFastMutex		m_CacheMutex;		// Guards the lists below
+	CSmallObjectThreadCache	*m_pCaches;
+	CSmallObjectAllocStats	*m_pStats;
+	int						m_nTracked;
+
+	friend class CSmallObjectAllocStats;
+};
+
+CSmallObjectAllocator &SmallObjectAllocator();
+
+
+//-----------------------------------------------------------------------------
+// Macros that make a class allocate through the small object allocator.
+// Unlike DECLARE_FIXEDSIZE_ALLOCATOR_MT there is no lock on the common path,
+// and no pool size to pick. Derived classes may be larger than the class
+// that declares the allocator.
+// Put DECLARE_SMALLOBJECT_ALLOCATOR in the private section of a class,
+// Put DEFINE_SMALLOBJECT_ALLOCATOR in the CPP file
+//-----------------------------------------------------------------------------
+#define DECLARE_SMALLOBJECT_ALLOCATOR( _class )									\
+	public:																		\
+		inline void* operator new( size_t size ) { MEM_ALLOC_CREDIT_(#_class " pool"); return SmallObjectAllocator().Alloc( size, &s_AllocStats ); }   \
+		inline void* operator new( size_t size, int nBlockUse, const char *pFileName, int nLine ) { MEM_ALLOC_CREDIT_(#_class " pool"); return SmallObjectAllocator().Alloc( size, &s_AllocStats ); }   \
+		inline void  operator delete( void* p, size_t size ) { SmallObjectAllocator().Free( p, size, &s_AllocStats ); }		\
+		inline void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine ) { SmallObjectAllocator().Free( p, sizeof(_class), &s_AllocStats ); }   \
+	private:																		\
+		static   CSmallObjectAllocStats   s_AllocStats
+
+#define DEFINE_SMALLOBJECT_ALLOCATOR( _class )									\
+	CSmallObjectAllocStats   _class::s_AllocStats( #_class, sizeof(_class) )
+
+#endif // SMALLOBJECTALLOCATOR_H
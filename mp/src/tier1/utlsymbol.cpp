@@ -44,7 +44,7 @@
 // globals
 //-----------------------------------------------------------------------------
 
-CUtlSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0; 
+CUtlHashedSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0; 
 bool CUtlSymbol::s_bAllowStaticSymbolTable = true;
 
 
@@ -63,7 +63,7 @@ void CUtlSymbol::Initialize()
 	static bool symbolsInitialized = false;
 	if (!symbolsInitialized)
 	{
-		s_pSymbolTable = new CUtlSymbolTableMT;
+		s_pSymbolTable = new CUtlHashedSymbolTableMT;
 		symbolsInitialized = true;
 	}
 }
@@ -83,7 +83,7 @@ public:
 
 static CCleanupUtlSymbolTable g_CleanupSymbolTable;
 
-CUtlSymbolTableMT* CUtlSymbol::CurrTable()
+CUtlHashedSymbolTableMT* CUtlSymbol::CurrTable()
 {
 	Initialize();
 	return s_pSymbolTable; 
@@ -289,6 +289,242 @@ void CUtlSymbolTable::RemoveAll()
 
 
 
+//-----------------------------------------------------------------------------
+// Hashed symbol table
+//-----------------------------------------------------------------------------
+CUtlHashedSymbolTable::CUtlHashedSymbolTable( int growSize, int initSize, bool caseInsensitive ) :
+	m_pTable( NULL ), m_nSymbols( 0 ), m_nInitSize( initSize ), m_bInsensitive( caseInsensitive ),
+	m_StringPools( 8 ), m_pPoolNext( NULL ), m_nPoolSpaceLeft( 0 )
+{
+	memset( m_pBlocks, 0, sizeof( m_pBlocks ) );
+}
+
+CUtlHashedSymbolTable::~CUtlHashedSymbolTable()
+{
+	RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// FNV-1a; case insensitive tables fold A-Z so equal strings hash the same
+//-----------------------------------------------------------------------------
+unsigned int CUtlHashedSymbolTable::HashString( const char *pString ) const
+{
+	const unsigned char *p = (const unsigned char *)pString;
+	unsigned int nHash = 2166136261u;
+	if ( m_bInsensitive )
+	{
+		for ( ; *p; ++p )
+		{
+			unsigned char c = *p;
+			if ( (unsigned char)( c - 'A' ) <= ( 'Z' - 'A' ) )
+			{
+				c |= 0x20;
+			}
+			nHash = ( nHash ^ c ) * 16777619u;
+		}
+	}
+	else
+	{
+		for ( ; *p; ++p )
+		{
+			nHash = ( nHash ^ *p ) * 16777619u;
+		}
+	}
+	return nHash;
+}
+
+
+UtlSymId_t CUtlHashedSymbolTable::FindHashed( const char *pString, unsigned int nHash ) const
+{
+	const HashTable_t *pTable = m_pTable;
+	if ( !pTable )
+		return UTL_INVAL_SYMBOL;
+
+	uint32 nTag = nHash & 0xFFFF0000;
+	for ( unsigned int i = nHash & pTable->m_nMask; ; i = ( i + 1 ) & pTable->m_nMask )
+	{
+		uint32 nSlot = pTable->m_Slots[i];
+		if ( nSlot == EMPTY_SLOT )
+			return UTL_INVAL_SYMBOL;
+
+		if ( ( nSlot & 0xFFFF0000 ) != nTag )
+			continue;
+
+		UtlSymId_t id = (UtlSymId_t)( nSlot & 0xFFFF );
+		const Symbol_t &symbol = m_pBlocks[id >> SYMBOL_BLOCK_SHIFT][id & ( SYMBOL_BLOCK_SIZE - 1 )];
+		if ( symbol.m_nHash != nHash )
+			continue;
+
+		if ( m_bInsensitive ? !V_stricmp( symbol.m_pString, pString ) : !V_strcmp( symbol.m_pString, pString ) )
+			return id;
+	}
+}
+
+
+CUtlSymbol CUtlHashedSymbolTable::Find( const char* pString ) const
+{
+	if ( !pString )
+		return CUtlSymbol();
+
+	return CUtlSymbol( FindHashed( pString, HashString( pString ) ) );
+}
+
+
+CUtlHashedSymbolTable::HashTable_t *CUtlHashedSymbolTable::AllocTable( int nSlots )
+{
+	HashTable_t *pTable = (HashTable_t *)malloc( sizeof( HashTable_t ) + ( nSlots - 1 ) * sizeof( uint32 ) );
+	pTable->m_pRetired = NULL;
+	pTable->m_nMask = nSlots - 1;
+	for ( int i = 0; i < nSlots; i++ )
+	{
+		pTable->m_Slots[i] = EMPTY_SLOT;
+	}
+	return pTable;
+}
+
+
+void CUtlHashedSymbolTable::InsertSlot( HashTable_t *pTable, UtlSymId_t id, unsigned int nHash )
+{
+	unsigned int i = nHash & pTable->m_nMask;
+	while ( pTable->m_Slots[i] != EMPTY_SLOT )
+	{
+		i = ( i + 1 ) & pTable->m_nMask;
+	}
+	pTable->m_Slots[i] = ( nHash & 0xFFFF0000 ) | id;
+}
+
+
+const char *CUtlHashedSymbolTable::CopyString( const char *pString, int nLen )
+{
+	if ( nLen > m_nPoolSpaceLeft )
+	{
+		int nPoolSize = max( nLen, MIN_STRING_POOL_SIZE );
+		m_pPoolNext = (char *)malloc( nPoolSize );
+		m_nPoolSpaceLeft = nPoolSize;
+		m_StringPools.AddToTail( m_pPoolNext );
+	}
+
+	char *pCopy = m_pPoolNext;
+	memcpy( pCopy, pString, nLen );
+	m_pPoolNext += nLen;
+	m_nPoolSpaceLeft -= nLen;
+	return pCopy;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string
+//-----------------------------------------------------------------------------
+CUtlSymbol CUtlHashedSymbolTable::AddString( const char* pString )
+{
+	if ( !pString )
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned int nHash = HashString( pString );
+	UtlSymId_t id = FindHashed( pString, nHash );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	if ( m_nSymbols >= UTL_INVAL_SYMBOL )
+	{
+		AssertMsg( 0, "CUtlHashedSymbolTable: too many symbols" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
+
+	// Keep the table at most half full; the old table stays readable
+	HashTable_t *pTable = m_pTable;
+	if ( !pTable || ( m_nSymbols + 1 ) * 2 > (int)( pTable->m_nMask + 1 ) )
+	{
+		int nSlots = 32;
+		if ( pTable )
+		{
+			nSlots = ( pTable->m_nMask + 1 ) * 2;
+		}
+		else
+		{
+			while ( nSlots < m_nInitSize * 2 )
+			{
+				nSlots <<= 1;
+			}
+		}
+
+		HashTable_t *pNewTable = AllocTable( nSlots );
+		for ( int i = 0; i < m_nSymbols; i++ )
+		{
+			InsertSlot( pNewTable, i, m_pBlocks[i >> SYMBOL_BLOCK_SHIFT][i & ( SYMBOL_BLOCK_SIZE - 1 )].m_nHash );
+		}
+		pNewTable->m_pRetired = pTable;
+
+		ThreadMemoryBarrier();
+		m_pTable = pTable = pNewTable;
+	}
+
+	id = (UtlSymId_t)m_nSymbols;
+	Symbol_t *&pBlock = m_pBlocks[id >> SYMBOL_BLOCK_SHIFT];
+	if ( !pBlock )
+	{
+		pBlock = (Symbol_t *)malloc( SYMBOL_BLOCK_SIZE * sizeof( Symbol_t ) );
+	}
+
+	Symbol_t &symbol = pBlock[id & ( SYMBOL_BLOCK_SIZE - 1 )];
+	symbol.m_pString = CopyString( pString, V_strlen( pString ) + 1 );
+	symbol.m_nHash = nHash;
+	++m_nSymbols;
+
+	// Publish the slot only once the symbol it points at is complete
+	ThreadMemoryBarrier();
+	InsertSlot( pTable, id, nHash );
+	return CUtlSymbol( id );
+}
+
+
+//-----------------------------------------------------------------------------
+// Look up the string associated with a particular symbol
+//-----------------------------------------------------------------------------
+const char* CUtlHashedSymbolTable::String( CUtlSymbol id ) const
+{
+	if ( !id.IsValid() )
+		return "";
+
+	UtlSymId_t i = id;
+	Assert( m_pBlocks[i >> SYMBOL_BLOCK_SHIFT] );
+	return m_pBlocks[i >> SYMBOL_BLOCK_SHIFT][i & ( SYMBOL_BLOCK_SIZE - 1 )].m_pString;
+}
+
+
+//-----------------------------------------------------------------------------
+// Remove all symbols in the table.
+//-----------------------------------------------------------------------------
+void CUtlHashedSymbolTable::RemoveAll()
+{
+	HashTable_t *pTable = m_pTable;
+	m_pTable = NULL;
+	while ( pTable )
+	{
+		HashTable_t *pRetired = pTable->m_pRetired;
+		free( pTable );
+		pTable = pRetired;
+	}
+
+	for ( int i = 0; i < SYMBOL_BLOCK_COUNT; i++ )
+	{
+		free( m_pBlocks[i] );
+		m_pBlocks[i] = NULL;
+	}
+	m_nSymbols = 0;
+
+	for ( int i = 0; i < m_StringPools.Count(); i++ )
+	{
+		free( m_StringPools[i] );
+	}
+	m_StringPools.RemoveAll();
+	m_pPoolNext = NULL;
+	m_nPoolSpaceLeft = 0;
+}
+
+
+
 class CUtlFilenameSymbolTable::HashTable : public CUtlStableHashtable<CUtlConstString>
 {
 };
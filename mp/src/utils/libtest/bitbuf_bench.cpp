@@ -0,0 +1,288 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: bf_write / bf_read benchmarks
+//
+//=============================================================================//
+
+#include "tier0/fasttimer.h"
+#include "tier1/bitbuf.h"
+#include "tier1/utlvector.h"
+#include "tier1/utlstring.h"
+#include "vstdlib/random.h"
+#include "mathlib/vector.h"
+#include "coordsize.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// The batched and bulk paths are timed against the equivalent one value at a
+// time calls, and the two outputs are checked for bit-identical results.
+//-----------------------------------------------------------------------------
+#define BITBUF_BENCH_BYTES		( 512 * 1024 )
+#define BITBUF_BENCH_VECTORS	4096
+#define BITBUF_BENCH_STRINGS	2048
+#define BITBUF_BENCH_VARINTS	16384
+
+static void BitBufBench_Report( const char *pName, int nItems, int nBits, double flSeconds )
+{
+	flSeconds = MAX( flSeconds, 1e-9 );
+	Msg( "  %-28s %8.2f ns/item  %8.1f MB/s\n", pName, flSeconds * 1e9 / MAX( nItems, 1 ), nBits / 8.0 / ( 1024.0 * 1024.0 ) / flSeconds );
+}
+
+static bool BitBufBench_Same( const char *pName, bf_write &a, bf_write &b )
+{
+	if ( a.GetNumBitsWritten() == b.GetNumBitsWritten() && !a.IsOverflowed() && !b.IsOverflowed() &&
+		 !memcmp( a.GetData(), b.GetData(), a.GetNumBytesWritten() ) )
+		return true;
+
+	Warning( "  %s: output differs from the reference path!\n", pName );
+	return false;
+}
+
+DEFINE_LIBBENCH( bitbuf_bench, "[iterations]" )
+{
+	int nIterations = ( argc > 1 ) ? MAX( 1, atoi( argv[1] ) ) : 20;
+
+	unsigned int *pDataA = new unsigned int[BITBUF_BENCH_BYTES / 4];
+	unsigned int *pDataB = new unsigned int[BITBUF_BENCH_BYTES / 4];
+	memset( pDataA, 0, BITBUF_BENCH_BYTES );
+	memset( pDataB, 0, BITBUF_BENCH_BYTES );
+
+	bf_write bufA( "bitbuf_bench A", pDataA, BITBUF_BENCH_BYTES );
+	bf_write bufB( "bitbuf_bench B", pDataB, BITBUF_BENCH_BYTES );
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	CUtlVector<Vector> coords, normals;
+	coords.SetCount( BITBUF_BENCH_VECTORS );
+	normals.SetCount( BITBUF_BENCH_VECTORS );
+	for ( int i = 0; i < BITBUF_BENCH_VECTORS; i++ )
+	{
+		coords[i].Init( random.RandomFloat( -MAX_COORD_FLOAT, MAX_COORD_FLOAT ), random.RandomFloat( -4096, 4096 ), ( i & 3 ) ? random.RandomFloat( -64, 64 ) : 0.0f );
+		normals[i].Init( random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ) );
+		VectorNormalize( normals[i] );
+	}
+
+	CUtlVector<uint32> varints;
+	varints.SetCount( BITBUF_BENCH_VARINTS );
+	for ( int i = 0; i < BITBUF_BENCH_VARINTS; i++ )
+	{
+		varints[i] = (uint32)random.RandomInt( 0, INT_MAX ) >> random.RandomInt( 0, 30 );
+	}
+
+	CUtlVector<CUtlString> strings;
+	strings.SetCount( BITBUF_BENCH_STRINGS );
+	for ( int i = 0; i < BITBUF_BENCH_STRINGS; i++ )
+	{
+		char szString[128];
+		int nLength = random.RandomInt( 4, sizeof( szString ) - 1 );
+		for ( int j = 0; j < nLength; j++ )
+		{
+			szString[j] = (char)random.RandomInt( 'a', 'z' );
+		}
+		szString[nLength] = 0;
+		strings[i] = szString;
+	}
+
+	Msg( "bitbuf_bench: %d iterations\n", nIterations );
+
+	int nFailures = 0;
+
+	CFastTimer timer;
+	Vector vecRead;
+	char szRead[256];
+
+	// Each case starts one bit in, so nothing lands on a dword boundary by accident
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		bool bBatched = ( nPass == 1 );
+		bf_write &buf = bBatched ? bufB : bufA;
+
+		Msg( bBatched ? " batched:\n" : " one at a time:\n" );
+
+		// Coords
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			buf.SeekToBit( 1 );
+			if ( bBatched )
+			{
+				buf.WriteBitVec3CoordArray( coords.Base(), coords.Count() );
+			}
+			else
+			{
+				for ( int i = 0; i < coords.Count(); i++ )
+				{
+					buf.WriteBitVec3Coord( coords[i] );
+				}
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "WriteBitVec3Coord", coords.Count() * nIterations, ( buf.GetNumBitsWritten() - 1 ) * nIterations, timer.GetDuration().GetSeconds() );
+		if ( bBatched )
+		{
+			nFailures += BitBufBench_Same( "WriteBitVec3CoordArray", bufA, bufB ) ? 0 : 1;
+		}
+
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			bf_read read( buf.GetData(), buf.GetNumBytesWritten() );
+			read.Seek( 1 );
+			for ( int i = 0; i < coords.Count(); i++ )
+			{
+				read.ReadBitVec3Coord( vecRead );
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "ReadBitVec3Coord", coords.Count() * nIterations, ( buf.GetNumBitsWritten() - 1 ) * nIterations, timer.GetDuration().GetSeconds() );
+
+		// Normals
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			buf.SeekToBit( 1 );
+			if ( bBatched )
+			{
+				buf.WriteBitVec3NormalArray( normals.Base(), normals.Count() );
+			}
+			else
+			{
+				for ( int i = 0; i < normals.Count(); i++ )
+				{
+					buf.WriteBitVec3Normal( normals[i] );
+				}
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "WriteBitVec3Normal", normals.Count() * nIterations, ( buf.GetNumBitsWritten() - 1 ) * nIterations, timer.GetDuration().GetSeconds() );
+		if ( bBatched )
+		{
+			nFailures += BitBufBench_Same( "WriteBitVec3NormalArray", bufA, bufB ) ? 0 : 1;
+		}
+
+		// Strings; the reference writes a char at a time the way WriteString used to
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			buf.SeekToBit( 0 );
+			for ( int i = 0; i < strings.Count(); i++ )
+			{
+				const char *pString = strings[i].Get();
+				if ( bBatched )
+				{
+					buf.WriteString( pString );
+				}
+				else
+				{
+					do
+					{
+						buf.WriteChar( *pString );
+					} while ( *pString++ );
+				}
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "WriteString", strings.Count() * nIterations, buf.GetNumBitsWritten() * nIterations, timer.GetDuration().GetSeconds() );
+		if ( bBatched )
+		{
+			nFailures += BitBufBench_Same( "WriteString", bufA, bufB ) ? 0 : 1;
+		}
+
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			bf_read read( buf.GetData(), buf.GetNumBytesWritten() );
+			for ( int i = 0; i < strings.Count(); i++ )
+			{
+				read.ReadString( szRead, sizeof( szRead ) );
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "ReadString", strings.Count() * nIterations, buf.GetNumBitsWritten() * nIterations, timer.GetDuration().GetSeconds() );
+
+		// Varints, byte aligned (fast path) and not
+		for ( int nStartBit = 0; nStartBit < 2; nStartBit++ )
+		{
+			timer.Start();
+			for ( int iter = 0; iter < nIterations; iter++ )
+			{
+				buf.SeekToBit( nStartBit );
+				for ( int i = 0; i < varints.Count(); i++ )
+				{
+					if ( nStartBit )
+					{
+						buf.WriteOneBit( 0 );
+					}
+					buf.WriteVarInt32( varints[i] );
+				}
+			}
+			timer.End();
+			BitBufBench_Report( nStartBit ? "WriteVarInt32 (unaligned)" : "WriteVarInt32", varints.Count() * nIterations, buf.GetNumBitsWritten() * nIterations, timer.GetDuration().GetSeconds() );
+
+			uint32 nCheck = 0;
+			timer.Start();
+			for ( int iter = 0; iter < nIterations; iter++ )
+			{
+				bf_read read( buf.GetData(), buf.GetNumBytesWritten() );
+				read.Seek( nStartBit );
+				for ( int i = 0; i < varints.Count(); i++ )
+				{
+					if ( nStartBit )
+					{
+						read.ReadOneBit();
+					}
+					nCheck |= read.ReadVarInt32() ^ varints[i];
+				}
+			}
+			timer.End();
+			BitBufBench_Report( nStartBit ? "ReadVarInt32 (unaligned)" : "ReadVarInt32", varints.Count() * nIterations, buf.GetNumBitsWritten() * nIterations, timer.GetDuration().GetSeconds() );
+
+			if ( nCheck )
+			{
+				Warning( "  ReadVarInt32: values don't round trip!\n" );
+				nFailures++;
+			}
+		}
+
+		// Bulk copy between unaligned positions; the reference moves 32 bits at a time
+		int nCopyBits = ( BITBUF_BENCH_BYTES / 2 ) * 8;
+		bf_write &source = bBatched ? bufA : bufB;
+		source.SeekToBit( 0 );
+		for ( int i = 0; i < nCopyBits / 32; i++ )
+		{
+			source.WriteUBitLong( random.RandomInt( 0, INT_MAX ) * 2 + 1, 32 );
+		}
+
+		timer.Start();
+		for ( int iter = 0; iter < nIterations; iter++ )
+		{
+			bf_read read( source.GetData(), source.GetNumBytesWritten() );
+			read.Seek( 3 );
+			buf.SeekToBit( 5 );
+
+			int nBits = nCopyBits - 3;
+			if ( bBatched )
+			{
+				buf.WriteBitsFromBuffer( &read, nBits );
+			}
+			else
+			{
+				for ( ; nBits > 32; nBits -= 32 )
+				{
+					buf.WriteUBitLong( read.ReadUBitLong( 32 ), 32 );
+				}
+				buf.WriteUBitLong( read.ReadUBitLong( nBits ), nBits );
+			}
+		}
+		timer.End();
+		BitBufBench_Report( "WriteBitsFromBuffer", nIterations, ( nCopyBits - 3 ) * nIterations, timer.GetDuration().GetSeconds() );
+	}
+
+	delete [] pDataA;
+	delete [] pDataB;
+	return nFailures;
+}
@@ -0,0 +1,203 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks that hitbox trees never cull a hitbox a trace could hit
+//
+//=============================================================================//
+
+#include "tier1/strtools.h"
+#include "vstdlib/random.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "studio.h"
+#include "cmodel.h"
+#include "collisionutils.h"
+#include "hitbox_bvh.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define HITBOX_BVH_TEST_SIZE		100.0f
+#define HITBOX_BVH_TEST_SEED		1138
+#define HITBOX_BVH_TEST_MODELS		2000
+#define HITBOX_BVH_TEST_RAYS		HITBOX_RAY_BATCH_MAX
+
+enum
+{
+	HITBOX_BVH_TEST_RAY = 0,
+	HITBOX_BVH_TEST_SWEPT_BOX,
+	HITBOX_BVH_TEST_BATCHED_RAY,
+
+	HITBOX_BVH_TEST_COUNT
+};
+
+// A hitbox set laid out the way it is in a model, one bone per hitbox
+struct HitboxBVHTestModel_t
+{
+	mstudiohitboxset_t	m_Set;
+	mstudiobbox_t		m_Hitboxes[HITBOX_BVH_MAX_HITBOXES];
+	matrix3x4_t			m_HitboxToWorld[HITBOX_BVH_MAX_HITBOXES];
+	matrix3x4_t			*m_pHitboxBones[HITBOX_BVH_MAX_HITBOXES];
+};
+
+static Vector RandomHitboxBVHVector( IUniformRandomStream &random, float flSize )
+{
+	return Vector( random.RandomFloat( -flSize, flSize ), random.RandomFloat( -flSize, flSize ), random.RandomFloat( -flSize, flSize ) );
+}
+
+static void RandomHitboxBVHModel( IUniformRandomStream &random, HitboxBVHTestModel_t &model )
+{
+	memset( &model.m_Set, 0, sizeof( model.m_Set ) );
+	model.m_Set.numhitboxes = random.RandomInt( 1, HITBOX_BVH_MAX_HITBOXES );
+	model.m_Set.hitboxindex = (byte *)model.m_Hitboxes - (byte *)&model.m_Set;
+
+	for ( int i = 0; i < model.m_Set.numhitboxes; i++ )
+	{
+		QAngle angles( random.RandomFloat( -180.0f, 180.0f ), random.RandomFloat( -180.0f, 180.0f ), random.RandomFloat( -180.0f, 180.0f ) );
+		AngleMatrix( angles, RandomHitboxBVHVector( random, HITBOX_BVH_TEST_SIZE ), model.m_HitboxToWorld[i] );
+		model.m_pHitboxBones[i] = &model.m_HitboxToWorld[i];
+
+		mstudiobbox_t *pbox = model.m_Set.pHitbox( i );
+		memset( pbox, 0, sizeof( *pbox ) );
+		pbox->bone = i;
+		Vector vecCenter = RandomHitboxBVHVector( random, 16.0f );
+		Vector vecExtents( random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ) );
+		pbox->bbmin = vecCenter - vecExtents;
+		pbox->bbmax = vecCenter + vecExtents;
+	}
+}
+
+// Rays across the model, every eighth one starting inside a hitbox
+static void RandomHitboxBVHRay( IUniformRandomStream &random, const HitboxBVHTestModel_t &model, int iRay, Vector &vecStart, Vector &vecEnd )
+{
+	vecStart = RandomHitboxBVHVector( random, 2.0f * HITBOX_BVH_TEST_SIZE );
+	vecEnd = RandomHitboxBVHVector( random, 2.0f * HITBOX_BVH_TEST_SIZE );
+	if ( ( iRay & 7 ) == 7 )
+	{
+		int iHitbox = random.RandomInt( 0, model.m_Set.numhitboxes - 1 );
+		const mstudiobbox_t *pbox = model.m_Set.pHitbox( iHitbox );
+		VectorTransform( ( pbox->bbmin + pbox->bbmax ) * 0.5f, model.m_HitboxToWorld[iHitbox], vecStart );
+	}
+}
+
+// Bits of the hitboxes the exact OBB test says the ray touches
+static uint64 HitboxBVHBruteForce( const HitboxBVHTestModel_t &model, const Ray_t &ray )
+{
+	uint64 hits = 0;
+	for ( int i = 0; i < model.m_Set.numhitboxes; i++ )
+	{
+		const mstudiobbox_t *pbox = model.m_Set.pHitbox( i );
+		bool bHit;
+		if ( ray.m_IsRay )
+		{
+			BoxTraceInfo_t obbTrace;
+			bHit = IntersectRayWithOBB( ray.m_Start, ray.m_Delta, model.m_HitboxToWorld[i], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace );
+		}
+		else
+		{
+			CBaseTrace obbTrace;
+			bHit = IntersectRayWithOBB( ray, model.m_HitboxToWorld[i], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace );
+		}
+
+		if ( bHit )
+		{
+			hits |= (uint64)1 << i;
+		}
+	}
+	return hits;
+}
+
+//-----------------------------------------------------------------------------
+// Builds a tree for each random model and checks the candidates it finds for
+// single rays, swept boxes and a batch of rays against every hitbox the exact
+// test hits. Extra candidates are fine, missing ones are failures.
+//-----------------------------------------------------------------------------
+DEFINE_LIBTEST( hitbox_bvh, "" )
+{
+	static const char *s_pTestNames[HITBOX_BVH_TEST_COUNT] = { "ray", "swept box", "batched ray" };
+	int nMisses[HITBOX_BVH_TEST_COUNT] = { 0, 0, 0 };
+	int nFailures = 0;
+
+	CUniformRandomStream random;
+	random.SetSeed( HITBOX_BVH_TEST_SEED );
+
+	HitboxBVHTestModel_t model;
+	for ( int iModel = 0; iModel < HITBOX_BVH_TEST_MODELS; iModel++ )
+	{
+		RandomHitboxBVHModel( random, model );
+
+		CHitboxBVH bvh;
+		bvh.Update( NULL, &model.m_Set, model.m_pHitboxBones, iModel + 1 );
+		if ( !bvh.IsValid() )
+		{
+			Warning( "%s: no tree for %d hitboxes\n", argv[0], model.m_Set.numhitboxes );
+			nFailures++;
+			continue;
+		}
+
+		// Rays and swept boxes one at a time, with no batch active
+		Vector vecStarts[HITBOX_BVH_TEST_RAYS], vecEnds[HITBOX_BVH_TEST_RAYS];
+		for ( int iRay = 0; iRay < HITBOX_BVH_TEST_RAYS; iRay++ )
+		{
+			RandomHitboxBVHRay( random, model, iRay, vecStarts[iRay], vecEnds[iRay] );
+
+			Ray_t ray;
+			ray.Init( vecStarts[iRay], vecEnds[iRay] );
+			if ( HitboxBVHBruteForce( model, ray ) & ~bvh.FindCandidates( ray, HITBOX_CULL_TOLERANCE ) )
+			{
+				nMisses[HITBOX_BVH_TEST_RAY]++;
+			}
+
+			Vector vecExtents = RandomHitboxBVHVector( random, 16.0f );
+			vecExtents.x = fabs( vecExtents.x ); vecExtents.y = fabs( vecExtents.y ); vecExtents.z = fabs( vecExtents.z );
+			Ray_t sweptBox;
+			sweptBox.Init( vecStarts[iRay], vecEnds[iRay], -vecExtents, vecExtents );
+			if ( HitboxBVHBruteForce( model, sweptBox ) & ~bvh.FindCandidates( sweptBox, HITBOX_CULL_TOLERANCE ) )
+			{
+				nMisses[HITBOX_BVH_TEST_SWEPT_BOX]++;
+			}
+		}
+
+		// The same rays again through a batch, which may be any size up to full
+		int nBatchRays = random.RandomInt( 1, HITBOX_BVH_TEST_RAYS );
+		CHitboxRayBatch batch;
+		for ( int iRay = 0; iRay < nBatchRays; iRay++ )
+		{
+			batch.AddRay( vecStarts[iRay], vecEnds[iRay] );
+		}
+		batch.Activate();
+		if ( CHitboxRayBatch::GetActive() != &batch )
+		{
+			Warning( "%s: ray batch didn't activate\n", argv[0] );
+			nFailures++;
+			continue;
+		}
+
+		for ( int iRay = 0; iRay < nBatchRays; iRay++ )
+		{
+			Ray_t ray;
+			ray.Init( vecStarts[iRay], vecEnds[iRay] );
+			if ( batch.FindRay( ray ) != iRay )
+			{
+				Warning( "%s: ray %d isn't in the batch\n", argv[0], iRay );
+				nFailures++;
+				continue;
+			}
+
+			if ( HitboxBVHBruteForce( model, ray ) & ~bvh.FindCandidates( ray, HITBOX_CULL_TOLERANCE ) )
+			{
+				nMisses[HITBOX_BVH_TEST_BATCHED_RAY]++;
+			}
+		}
+	}
+
+	for ( int i = 0; i < HITBOX_BVH_TEST_COUNT; i++ )
+	{
+		if ( nMisses[i] )
+		{
+			Warning( "%s: the tree dropped a hitbox the exact test hits for %d %ss\n", argv[0], nMisses[i], s_pTestNames[i] );
+			nFailures += nMisses[i];
+		}
+	}
+	return nFailures;
+}
@@ -0,0 +1,104 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the library checks and benchmarks.
+//
+//			libtest					runs every check
+//			libtest <name> [args]	runs one check or benchmark
+//			libtest -list			lists them
+//
+//			The exit code is non-zero if anything failed.
+//
+//=============================================================================//
+
+#include "tier0/dbg.h"
+#include "tier1/strtools.h"
+#include "mathlib/mathlib.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CLibTestCase *CLibTestCase::s_pFirst = NULL;
+
+CLibTestCase::CLibTestCase( const char *pName, const char *pUsage, LibTestFunc_t pFunc, bool bBenchmark )
+{
+	m_pName = pName;
+	m_pUsage = pUsage;
+	m_pFunc = pFunc;
+	m_bBenchmark = bBenchmark;
+	m_pNext = s_pFirst;
+	s_pFirst = this;
+}
+
+CLibTestCase *CLibTestCase::Find( const char *pName )
+{
+	for ( CLibTestCase *pCase = s_pFirst; pCase; pCase = pCase->m_pNext )
+	{
+		if ( !Q_stricmp( pCase->m_pName, pName ) )
+			return pCase;
+	}
+	return NULL;
+}
+
+static void PrintCases()
+{
+	Msg( "Usage: libtest [-list | <name> [args]]\n" );
+	for ( int nBenchmarks = 0; nBenchmarks < 2; nBenchmarks++ )
+	{
+		Msg( nBenchmarks ? "Benchmarks:\n" : "Checks (run by default):\n" );
+		for ( CLibTestCase *pCase = CLibTestCase::First(); pCase; pCase = pCase->m_pNext )
+		{
+			if ( pCase->m_bBenchmark == ( nBenchmarks != 0 ) )
+			{
+				Msg( "  %-20s %s\n", pCase->m_pName, pCase->m_pUsage );
+			}
+		}
+	}
+}
+
+static int RunCase( CLibTestCase *pCase, int argc, const char **argv )
+{
+	int nFailures = pCase->m_pFunc( argc, argv );
+	Msg( "%s: %s\n", pCase->m_pName, nFailures ? "FAILED" : "ok" );
+	return nFailures;
+}
+
+int main( int argc, char **argv )
+{
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+	if ( argc > 1 && ( !Q_stricmp( argv[1], "-list" ) || !Q_stricmp( argv[1], "-help" ) ) )
+	{
+		PrintCases();
+		return 0;
+	}
+
+	if ( argc > 1 )
+	{
+		CLibTestCase *pCase = CLibTestCase::Find( argv[1] );
+		if ( !pCase )
+		{
+			Warning( "libtest: unknown check or benchmark '%s'\n", argv[1] );
+			PrintCases();
+			return -1;
+		}
+		return RunCase( pCase, argc - 1, (const char **)argv + 1 ) ? 1 : 0;
+	}
+
+	int nFailed = 0;
+	for ( CLibTestCase *pCase = CLibTestCase::First(); pCase; pCase = pCase->m_pNext )
+	{
+		if ( !pCase->m_bBenchmark )
+		{
+			const char *pArgs[1] = { pCase->m_pName };
+			nFailed += RunCase( pCase, 1, pArgs ) ? 1 : 0;
+		}
+	}
+
+	if ( nFailed )
+	{
+		Warning( "libtest: %d check(s) failed\n", nFailed );
+		return 1;
+	}
+	return 0;
+}
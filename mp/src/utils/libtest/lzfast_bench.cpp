@@ -0,0 +1,156 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: LZFast benchmark, with snappy for comparison
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/lzfast.h"
+#include "tier1/snappy.h"
+#include "vstdlib/random.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Stand-in for a map's entity lump, for when no file is given
+//-----------------------------------------------------------------------------
+static void LZFastBench_BuildEntities( CUtlBuffer &buf, int nEntities )
+{
+	static const char *s_pClassNames[] = { "prop_physics", "info_player_start", "light", "func_door", "npc_combine_s", "env_sprite" };
+	static const char *s_pModels[] = { "models/props_c17/oildrum001.mdl", "models/props_junk/wood_crate001a.mdl", "models/combine_soldier.mdl" };
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	buf.SetBufferType( true, false );
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		buf.Printf( "{\n\"classname\" \"%s\"\n", s_pClassNames[random.RandomInt( 0, ARRAYSIZE( s_pClassNames ) - 1 )] );
+		buf.Printf( "\"origin\" \"%d %d %d\"\n", random.RandomInt( -8192, 8192 ), random.RandomInt( -8192, 8192 ), random.RandomInt( -512, 2048 ) );
+		buf.Printf( "\"angles\" \"0 %d 0\"\n", random.RandomInt( 0, 359 ) );
+		if ( random.RandomInt( 0, 1 ) )
+		{
+			buf.Printf( "\"model\" \"%s\"\n\"skin\" \"%d\"\n", s_pModels[random.RandomInt( 0, ARRAYSIZE( s_pModels ) - 1 )], random.RandomInt( 0, 3 ) );
+		}
+		buf.Printf( "\"targetname\" \"ent_%d\"\n}\n", i );
+	}
+}
+
+static bool LZFastBench_ReadFile( const char *pFileName, CUtlBuffer &buf )
+{
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	int nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	buf.EnsureCapacity( nSize );
+	int nRead = fread( buf.Base(), 1, nSize, fp );
+	fclose( fp );
+
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, nRead );
+	return ( nRead == nSize );
+}
+
+//-----------------------------------------------------------------------------
+// Times LZFast at both levels against snappy on a file, or on generated
+// entity lump text if no file is given
+//-----------------------------------------------------------------------------
+DEFINE_LIBBENCH( lzfast_bench, "[file] [iterations]" )
+{
+	CUtlBuffer file;
+	const char *pSource = "generated entities";
+	if ( argc > 1 )
+	{
+		pSource = argv[1];
+		if ( !LZFastBench_ReadFile( pSource, file ) )
+		{
+			Warning( "lzfast_bench: couldn't read %s\n", pSource );
+			return 1;
+		}
+	}
+	else
+	{
+		LZFastBench_BuildEntities( file, 4096 );
+	}
+
+	int nIterations = ( argc > 2 ) ? MAX( 1, atoi( argv[2] ) ) : 10;
+	int nSize = file.TellPut();
+	if ( !nSize )
+		return 0;
+
+	const unsigned char *pInput = (const unsigned char *)file.Base();
+	unsigned char *pCompressed = new unsigned char[MAX( CLZFast::GetMaxCompressedSize( nSize ), (unsigned int)snappy::MaxCompressedLength( nSize ) )];
+	unsigned char *pOutput = new unsigned char[nSize];
+
+	Msg( "lzfast_bench: %s, %d bytes, %d iterations\n", pSource, nSize, nIterations );
+
+	int nFailures = 0;
+	CFastTimer timer;
+	for ( int nCodec = 0; nCodec < 4; nCodec++ )
+	{
+		static const char *s_pNames[] = { "snappy", "lzfast", "lzfast high", "lzfast 1 thread" };
+
+		CLZFast lz( ( nCodec == 2 ) ? LZFAST_LEVEL_HIGH : LZFAST_LEVEL_FAST );
+		if ( nCodec == 3 )
+		{
+			lz.SetMaxThreads( 1 );
+		}
+
+		unsigned int nCompressed = 0;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			if ( nCodec == 0 )
+			{
+				size_t nSnappy = 0;
+				snappy::RawCompress( (const char *)pInput, nSize, (char *)pCompressed, &nSnappy );
+				nCompressed = (unsigned int)nSnappy;
+			}
+			else if ( !lz.CompressNoAlloc( pInput, nSize, pCompressed, &nCompressed ) )
+			{
+				nCompressed = 0;
+			}
+		}
+		timer.End();
+		double flCompress = timer.GetDuration().GetSeconds();
+
+		if ( !nCompressed )
+		{
+			Msg( "  %-16s incompressible\n", s_pNames[nCodec] );
+			continue;
+		}
+
+		bool bOk = true;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			if ( nCodec == 0 )
+			{
+				bOk &= snappy::RawUncompress( (const char *)pCompressed, nCompressed, (char *)pOutput );
+			}
+			else
+			{
+				bOk &= ( lz.SafeUncompress( pCompressed, pOutput, nSize ) == (unsigned int)nSize );
+			}
+		}
+		timer.End();
+		double flUncompress = timer.GetDuration().GetSeconds();
+
+		bOk = bOk && !memcmp( pInput, pOutput, nSize );
+		nFailures += bOk ? 0 : 1;
+		double flMB = (double)nSize * nIterations / ( 1024.0 * 1024.0 );
+		Msg( "  %-16s %5.1f%%  compress %8.1f MB/s  uncompress %8.1f MB/s%s\n", s_pNames[nCodec], 100.0 * nCompressed / nSize,
+			flMB / MAX( flCompress, 1e-9 ), flMB / MAX( flUncompress, 1e-9 ), bOk ? "" : "  MISMATCH" );
+	}
+
+	delete [] pCompressed;
+	delete [] pOutput;
+	return nFailures;
+}
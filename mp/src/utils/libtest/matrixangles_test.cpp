@@ -0,0 +1,115 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks FourMatricesAnglesSIMD against MatrixAngles
+//
+//=============================================================================//
+
+#include "tier1/strtools.h"
+#include "vstdlib/random.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// ArcTan2SIMD is double atan2 per lane on PC where MatrixAngles uses atan2f,
+// so the two are only expected to agree this closely
+#define MATRIXANGLES_TOLERANCE		0.001f
+#define MATRIXANGLES_SEED			1138
+#define MATRIXANGLES_TESTS			20000
+
+static float AngleDifference( float a, float b )
+{
+	// atan2 may land on either side of +-180
+	float flDelta = fmodf( fabs( a - b ), 360.0f );
+	return MIN( flDelta, 360.0f - flDelta );
+}
+
+//-----------------------------------------------------------------------------
+// Random orientations, with every fourth one pitched straight up or down, or
+// just short of it, so forward is Z and MatrixAngles takes its gimbal lock branch
+//-----------------------------------------------------------------------------
+static void RandomMatrixAnglesMatrix( IUniformRandomStream &random, int iTest, matrix3x4_t &mat )
+{
+	QAngle angles( random.RandomFloat( -90.0f, 90.0f ), random.RandomFloat( -180.0f, 180.0f ), random.RandomFloat( -180.0f, 180.0f ) );
+	if ( ( iTest & 3 ) == 3 )
+	{
+		static const float s_pLockedPitches[4] = { 90.0f, -90.0f, 89.99f, -89.99f };
+		angles.x = s_pLockedPitches[ ( iTest >> 2 ) & 3 ];
+	}
+
+	Vector vecOrigin( random.RandomFloat( -4096.0f, 4096.0f ), random.RandomFloat( -4096.0f, 4096.0f ), random.RandomFloat( -4096.0f, 4096.0f ) );
+	AngleMatrix( angles, vecOrigin, mat );
+}
+
+DEFINE_LIBTEST( fourmatricesangles, "" )
+{
+	CUniformRandomStream random;
+	random.SetSeed( MATRIXANGLES_SEED );
+
+	int nFailures = 0;
+	int nLocked = 0;
+	float flMaxError = 0.0f;
+
+	for ( int iTest = 0; iTest < MATRIXANGLES_TESTS; iTest += 4 )
+	{
+		matrix3x4_t matrices[4];
+		const matrix3x4_t *ppMatrices[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			RandomMatrixAnglesMatrix( random, iTest + i, matrices[i] );
+			ppMatrices[i] = &matrices[i];
+		}
+
+		FourVectors angles, positions;
+		FourMatricesAnglesSIMD( ppMatrices, angles, positions );
+
+		for ( int i = 0; i < 4; i++ )
+		{
+			QAngle scalarAngles;
+			Vector scalarPosition;
+			MatrixAngles( matrices[i], scalarAngles, scalarPosition );
+
+			Vector vecForward;
+			MatrixGetColumn( matrices[i], 0, vecForward );
+			if ( vecForward.AsVector2D().Length() <= 0.001f )
+			{
+				nLocked++;
+			}
+
+			QAngle batchAngles( angles.X( i ), angles.Y( i ), angles.Z( i ) );
+			float flError = 0.0f;
+			for ( int j = 0; j < 3; j++ )
+			{
+				flError = MAX( flError, AngleDifference( scalarAngles[j], batchAngles[j] ) );
+			}
+			flMaxError = MAX( flMaxError, flError );
+
+			Vector batchPosition = positions.Vec( i );
+			if ( flError > MATRIXANGLES_TOLERANCE || batchPosition != scalarPosition )
+			{
+				if ( nFailures < 10 )
+				{
+					Warning( "%s: (%f %f %f) at (%f %f %f), MatrixAngles gives (%f %f %f) at (%f %f %f)\n", argv[0],
+						batchAngles.x, batchAngles.y, batchAngles.z, batchPosition.x, batchPosition.y, batchPosition.z,
+						scalarAngles.x, scalarAngles.y, scalarAngles.z, scalarPosition.x, scalarPosition.y, scalarPosition.z );
+				}
+				nFailures++;
+			}
+		}
+	}
+
+	// Make sure the gimbal lock branch was actually reached
+	if ( !nLocked )
+	{
+		Warning( "%s: no matrix had forward along Z\n", argv[0] );
+		nFailures++;
+	}
+
+	if ( nFailures )
+	{
+		Warning( "%s: %d of %d matrices differ by more than %g degrees (largest %g)\n", argv[0], nFailures, MATRIXANGLES_TESTS, MATRIXANGLES_TOLERANCE, flMaxError );
+	}
+	return nFailures;
+}
@@ -0,0 +1,120 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Small object allocator spawn/destroy churn benchmark
+//
+//=============================================================================//
+
+#include "tier0/fasttimer.h"
+#include "tier0/threadtools.h"
+#include "tier1/mempool.h"
+#include "tier1/smallobjectallocator.h"
+#include "tier1/utlvector.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Object sizes typical of waypoints, events and entity helpers
+static const int s_SmallObjectBenchSizes[] = { 48, 96, 176, 320, 640 };
+#define SMALLOBJECT_BENCH_SLOTS 2048
+
+struct SmallObjectBench_t
+{
+	int				m_nType;
+	int				m_nOps;
+	CMemoryPoolMT	*m_pPools[ARRAYSIZE(s_SmallObjectBenchSizes)];
+};
+
+// Each thread keeps a set of live objects and randomly destroys or spawns
+// one per step, so the heap sees a steady spawn/destroy churn
+static unsigned SmallObjectBenchThread( void *pParam )
+{
+	SmallObjectBench_t *pBench = (SmallObjectBench_t *)pParam;
+	void *pSlots[SMALLOBJECT_BENCH_SLOTS];
+	unsigned char nSizes[SMALLOBJECT_BENCH_SLOTS];
+	memset( pSlots, 0, sizeof(pSlots) );
+
+	unsigned nSeed = ThreadGetCurrentId() | 1;
+	for ( int i = 0; i < pBench->m_nOps + SMALLOBJECT_BENCH_SLOTS; i++ )
+	{
+		nSeed = nSeed * 1664525 + 1013904223;
+		int iSlot = ( i < pBench->m_nOps ) ? ( nSeed >> 8 ) % SMALLOBJECT_BENCH_SLOTS : i - pBench->m_nOps;
+		if ( pSlots[iSlot] )
+		{
+			int nSize = s_SmallObjectBenchSizes[nSizes[iSlot]];
+			switch ( pBench->m_nType )
+			{
+			case 0:		MemAlloc_Free( pSlots[iSlot] ); break;
+			case 1:		pBench->m_pPools[nSizes[iSlot]]->Free( pSlots[iSlot] ); break;
+			default:	SmallObjectAllocator().Free( pSlots[iSlot], nSize ); break;
+			}
+			pSlots[iSlot] = NULL;
+		}
+		else if ( i < pBench->m_nOps )
+		{
+			nSizes[iSlot] = ( nSeed >> 24 ) % ARRAYSIZE(s_SmallObjectBenchSizes);
+			int nSize = s_SmallObjectBenchSizes[nSizes[iSlot]];
+			switch ( pBench->m_nType )
+			{
+			case 0:		pSlots[iSlot] = MemAlloc_Alloc( nSize ); break;
+			case 1:		pSlots[iSlot] = pBench->m_pPools[nSizes[iSlot]]->Alloc(); break;
+			default:	pSlots[iSlot] = SmallObjectAllocator().Alloc( nSize ); break;
+			}
+			*(int *)pSlots[iSlot] = i;
+		}
+	}
+
+	SmallObjectAllocator().FlushThreadCache();
+	return 0;
+}
+
+DEFINE_LIBBENCH( smallobject_bench, "[steps] [max threads]" )
+{
+	int nOps = ( argc > 1 ) ? MAX( 1, atoi( argv[1] ) ) : 1000000;
+	int nMaxThreads = ( argc > 2 ) ? clamp( atoi( argv[2] ), 1, 32 ) : 8;
+
+	Msg( "smallobject_bench: %d spawn/destroy steps per thread, millions per second\n", nOps );
+	Msg( "  threads      heap  CMemoryPoolMT  small object\n" );
+
+	for ( int nThreads = 1; nThreads <= nMaxThreads; nThreads *= 2 )
+	{
+		double flRate[3];
+		for ( int nType = 0; nType < 3; nType++ )
+		{
+			SmallObjectBench_t bench;
+			bench.m_nType = nType;
+			bench.m_nOps = nOps;
+			for ( int i = 0; i < ARRAYSIZE(s_SmallObjectBenchSizes); i++ )
+			{
+				bench.m_pPools[i] = new CMemoryPoolMT( s_SmallObjectBenchSizes[i], 256, UTLMEMORYPOOL_GROW_FAST, "smallobject_bench" );
+			}
+
+			CFastTimer timer;
+			timer.Start();
+
+			CUtlVector<ThreadHandle_t> threads;
+			for ( int i = 0; i < nThreads; i++ )
+			{
+				threads.AddToTail( CreateSimpleThread( SmallObjectBenchThread, &bench ) );
+			}
+			for ( int i = 0; i < nThreads; i++ )
+			{
+				ThreadJoin( threads[i] );
+				ReleaseThreadHandle( threads[i] );
+			}
+
+			timer.End();
+			flRate[nType] = (double)nOps * nThreads / MAX( timer.GetDuration().GetSeconds(), 1e-9 ) / 1e6;
+
+			for ( int i = 0; i < ARRAYSIZE(s_SmallObjectBenchSizes); i++ )
+			{
+				delete bench.m_pPools[i];
+			}
+		}
+
+		Msg( "  %7d  %8.2f  %13.2f  %12.2f\n", nThreads, flRate[0], flRate[1], flRate[2] );
+	}
+
+	SmallObjectAllocator().ReportStats();
+	return 0;
+}
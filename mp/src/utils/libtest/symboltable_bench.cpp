@@ -0,0 +1,118 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Symbol table benchmarks
+//
+//=============================================================================//
+
+#include "tier0/fasttimer.h"
+#include "tier1/strtools.h"
+#include "tier1/utlsymbol.h"
+#include "tier1/utlvector.h"
+#include "tier1/utlstring.h"
+#include "vstdlib/random.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Compares the RB tree and hashed symbol tables on the same set of strings
+//-----------------------------------------------------------------------------
+template< class TABLE >
+static void SymbolTableBench_Run( const char *pName, TABLE &table, const CUtlVector<CUtlString> &strings,
+	const CUtlVector<CUtlString> &lookups, const CUtlVector<CUtlString> &misses, int nIterations, CUtlVector<UtlSymId_t> &ids )
+{
+	CFastTimer timer;
+
+	timer.Start();
+	for ( int i = 0; i < strings.Count(); i++ )
+	{
+		ids.AddToTail( table.AddString( strings[i].Get() ) );
+	}
+	timer.End();
+	double flInsert = timer.GetDuration().GetSeconds();
+
+	int nFound = 0;
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < lookups.Count(); i++ )
+		{
+			nFound += table.Find( lookups[i].Get() ).IsValid();
+		}
+	}
+	timer.End();
+	double flHit = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	for ( int iter = 0; iter < nIterations; iter++ )
+	{
+		for ( int i = 0; i < misses.Count(); i++ )
+		{
+			nFound += table.Find( misses[i].Get() ).IsValid();
+		}
+	}
+	timer.End();
+	double flMiss = timer.GetDuration().GetSeconds();
+
+	int nLookups = MAX( lookups.Count() * nIterations, 1 );
+	Msg( "  %-26s insert %7.1f ns  hit %7.1f ns  miss %7.1f ns  (%d found)\n", pName,
+		flInsert * 1e9 / MAX( strings.Count(), 1 ), flHit * 1e9 / nLookups, flMiss * 1e9 / nLookups, nFound );
+}
+
+DEFINE_LIBBENCH( symboltable_bench, "[strings] [lookup passes]" )
+{
+	int nStrings = ( argc > 1 ) ? clamp( atoi( argv[1] ), 1, 60000 ) : 8192;
+	int nIterations = ( argc > 2 ) ? MAX( 1, atoi( argv[2] ) ) : 10;
+
+	static const char *s_pPrefixes[] = { "models/props_c17/", "sound/weapons/", "ACT_", "materials/effects/", "scripts/", "player/" };
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	CUtlVector<CUtlString> strings, upper, misses;
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		char szString[128];
+		Q_snprintf( szString, sizeof( szString ), "%sname_%d_%x.mdl", s_pPrefixes[random.RandomInt( 0, ARRAYSIZE( s_pPrefixes ) - 1 )], i, random.RandomInt( 0, 0xFFFF ) );
+		strings.AddToTail( szString );
+
+		Q_strupr( szString );
+		upper.AddToTail( szString );
+
+		szString[0] = '#';
+		misses.AddToTail( szString );
+	}
+
+	Msg( "symboltable_bench: %d strings, %d lookup passes\n", nStrings, nIterations );
+
+	int nFailures = 0;
+
+	for ( int nInsensitive = 0; nInsensitive < 2; nInsensitive++ )
+	{
+		const CUtlVector<CUtlString> &lookups = nInsensitive ? upper : strings;
+		Msg( nInsensitive ? " case insensitive:\n" : " case sensitive:\n" );
+
+		CUtlVector<UtlSymId_t> treeIds, hashIds, hashMTIds;
+		CUtlSymbolTable tree( 0, 32, nInsensitive != 0 );
+		CUtlHashedSymbolTable hashed( 0, 32, nInsensitive != 0 );
+		CUtlHashedSymbolTableMT hashedMT( 0, 32, nInsensitive != 0 );
+		SymbolTableBench_Run( "CUtlSymbolTable", tree, strings, lookups, misses, nIterations, treeIds );
+		SymbolTableBench_Run( "CUtlHashedSymbolTable", hashed, strings, lookups, misses, nIterations, hashIds );
+		SymbolTableBench_Run( "CUtlHashedSymbolTableMT", hashedMT, strings, lookups, misses, nIterations, hashMTIds );
+
+		for ( int i = 0; i < strings.Count(); i++ )
+		{
+			if ( treeIds[i] != hashIds[i] || treeIds[i] != hashMTIds[i] ||
+				 Q_strcmp( tree.String( treeIds[i] ), hashed.String( hashIds[i] ) ) ||
+				 hashed.Find( lookups[i].Get() ) != tree.Find( lookups[i].Get() ) )
+			{
+				Warning( "  symbol %d (%s) differs between the tables!\n", i, strings[i].Get() );
+				nFailures++;
+				break;
+			}
+		}
+	}
+
+	return nFailures;
+}
@@ -0,0 +1,285 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Lock free queue and call queue checks and benchmarks
+//
+//=============================================================================//
+
+#include "tier0/fasttimer.h"
+#include "tier0/threadtools.h"
+#include "tier0/tslist.h"
+#include "tier1/callqueue.h"
+#include "tier1/utlvector.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Contention benchmark for the lock free queues. Each thread alternates
+// pushes and pops on one shared queue; then producer threads feed the call
+// queues while this thread drains them. Every item pushed must be popped
+// exactly once and every call queued must run exactly once.
+//-----------------------------------------------------------------------------
+#define TSQUEUE_BENCH_BATCH 16
+
+struct TSQueueBench_t
+{
+	int					m_nType;
+	int					m_nOps;			// per thread, a multiple of TSQUEUE_BENCH_BATCH
+	CTSQueue<int>		*m_pQueue;
+	CTSRingQueue<int>	*m_pRing;
+	int					m_nThreads;
+	int					*m_pPopCounts;	// times each item was popped
+	CInterlockedInt		m_nStrayItems;	// popped items that were never pushed
+	CInterlockedInt		m_nStarted;
+};
+
+static void TSQueueBench_Popped( TSQueueBench_t *pBench, int item )
+{
+	if ( item >= 0 && item < pBench->m_nOps * pBench->m_nThreads )
+	{
+		ThreadInterlockedIncrement( &pBench->m_pPopCounts[item] );
+	}
+	else
+	{
+		++pBench->m_nStrayItems;
+	}
+}
+
+static unsigned TSQueueBenchThread( void *pParam )
+{
+	TSQueueBench_t *pBench = (TSQueueBench_t *)pParam;
+	int nFirstItem = ( ++pBench->m_nStarted - 1 ) * pBench->m_nOps;
+	int item;
+	int batch[TSQUEUE_BENCH_BATCH] = { 0 };
+
+	for ( int i = 0; i < pBench->m_nOps; i++ )
+	{
+		switch ( pBench->m_nType )
+		{
+		case 0:
+			pBench->m_pQueue->PushItem( nFirstItem + i );
+			while ( !pBench->m_pQueue->PopItem( &item ) )
+			{
+				ThreadPause();
+			}
+			TSQueueBench_Popped( pBench, item );
+			break;
+
+		case 1:
+			while ( !pBench->m_pRing->PushItem( nFirstItem + i ) )
+			{
+				ThreadPause();
+			}
+			while ( !pBench->m_pRing->PopItem( &item ) )
+			{
+				ThreadPause();
+			}
+			TSQueueBench_Popped( pBench, item );
+			break;
+
+		default:
+			{
+				for ( int j = 0; j < TSQUEUE_BENCH_BATCH; j++ )
+				{
+					batch[j] = nFirstItem + i + j;
+				}
+
+				int nPushed = 0;
+				while ( nPushed < TSQUEUE_BENCH_BATCH )
+				{
+					nPushed += pBench->m_pRing->PushItems( batch + nPushed, TSQUEUE_BENCH_BATCH - nPushed );
+				}
+
+				int nPopped = 0;
+				while ( nPopped < TSQUEUE_BENCH_BATCH )
+				{
+					nPopped += pBench->m_pRing->PopItems( batch + nPopped, TSQUEUE_BENCH_BATCH - nPopped );
+				}
+				for ( int j = 0; j < TSQUEUE_BENCH_BATCH; j++ )
+				{
+					TSQueueBench_Popped( pBench, batch[j] );
+				}
+				i += TSQUEUE_BENCH_BATCH - 1;
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+// Returns the number of items that weren't popped exactly once
+static int TSQueueBench_Check( TSQueueBench_t &bench )
+{
+	int item;
+	int nFailures = bench.m_nStrayItems;
+	while ( ( bench.m_nType == 0 ) ? bench.m_pQueue->PopItem( &item ) : bench.m_pRing->PopItem( &item ) )
+	{
+		// Left over in the queue
+		nFailures++;
+	}
+
+	for ( int i = 0; i < bench.m_nOps * bench.m_nThreads; i++ )
+	{
+		if ( bench.m_pPopCounts[i] != 1 )
+		{
+			nFailures++;
+		}
+	}
+	return nFailures;
+}
+
+static void CallQueueBench_Call( int *pCount )
+{
+	(*pCount)++;
+}
+
+template <class QUEUE_TYPE>
+struct CallQueueBench_t
+{
+	QUEUE_TYPE		*m_pQueue;
+	int				m_nCalls;
+	int				*m_pCount;
+	CInterlockedInt	m_nFinished;
+};
+
+template <class QUEUE_TYPE>
+static unsigned CallQueueBenchThread( void *pParam )
+{
+	CallQueueBench_t<QUEUE_TYPE> *pBench = (CallQueueBench_t<QUEUE_TYPE> *)pParam;
+	for ( int i = 0; i < pBench->m_nCalls; i++ )
+	{
+		pBench->m_pQueue->QueueCall( CallQueueBench_Call, pBench->m_pCount );
+	}
+	++pBench->m_nFinished;
+	return 0;
+}
+
+// Returns millions of calls per second; counts a failure if the number of
+// calls run doesn't match the number queued
+template <class QUEUE_TYPE>
+static double CallQueueBench_Run( int nThreads, int nCalls, int &nFailures )
+{
+	QUEUE_TYPE queue;
+	int nCount = 0;
+	CallQueueBench_t<QUEUE_TYPE> bench;
+	bench.m_pQueue = &queue;
+	bench.m_nCalls = nCalls / nThreads;
+	bench.m_pCount = &nCount;
+	bench.m_nFinished = 0;
+	int nTotal = bench.m_nCalls * nThreads;
+
+	CFastTimer timer;
+	timer.Start();
+
+	CUtlVector<ThreadHandle_t> threads;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		threads.AddToTail( CreateSimpleThread( CallQueueBenchThread<QUEUE_TYPE>, &bench ) );
+	}
+
+	while ( bench.m_nFinished < nThreads )
+	{
+		queue.CallQueued();
+		ThreadPause();
+	}
+
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		ThreadJoin( threads[i] );
+		ReleaseThreadHandle( threads[i] );
+	}
+	queue.CallQueued();
+
+	timer.End();
+
+	if ( nCount != nTotal )
+	{
+		Warning( "tsqueue: %d threads queued %d calls but %d ran\n", nThreads, nTotal, nCount );
+		nFailures++;
+	}
+	return nTotal / MAX( timer.GetDuration().GetSeconds(), 1e-9 ) / 1e6;
+}
+
+// Runs each queue type with 1, 2, 4... up to nMaxThreads threads and returns
+// the number of lost, duplicated or stray items and calls
+static int TSQueueBench_Run( int nOps, int nMaxThreads, bool bReport )
+{
+	static const char *s_pTypeNames[3] = { "CTSQueue", "ring", "ring batch" };
+	int nFailures = 0;
+
+	for ( int nThreads = 1; nThreads <= nMaxThreads; nThreads *= 2 )
+	{
+		int nOpsPerThread = MAX( TSQUEUE_BENCH_BATCH, ( nOps / nThreads ) & ~( TSQUEUE_BENCH_BATCH - 1 ) );
+		CUtlVector<int> popCounts;
+		popCounts.SetCount( nOpsPerThread * nThreads );
+
+		double flRate[3];
+		for ( int nType = 0; nType < 3; nType++ )
+		{
+			CTSQueue<int> queue;
+			CTSRingQueue<int> ring( 1024 );
+			memset( popCounts.Base(), 0, popCounts.Count() * sizeof(int) );
+
+			TSQueueBench_t bench;
+			bench.m_nType = nType;
+			bench.m_nOps = nOpsPerThread;
+			bench.m_pQueue = &queue;
+			bench.m_pRing = &ring;
+			bench.m_nThreads = nThreads;
+			bench.m_pPopCounts = popCounts.Base();
+			bench.m_nStrayItems = 0;
+			bench.m_nStarted = 0;
+
+			CFastTimer timer;
+			timer.Start();
+
+			CUtlVector<ThreadHandle_t> threads;
+			for ( int i = 0; i < nThreads; i++ )
+			{
+				threads.AddToTail( CreateSimpleThread( TSQueueBenchThread, &bench ) );
+			}
+			for ( int i = 0; i < nThreads; i++ )
+			{
+				ThreadJoin( threads[i] );
+				ReleaseThreadHandle( threads[i] );
+			}
+
+			timer.End();
+			flRate[nType] = (double)bench.m_nOps * nThreads / MAX( timer.GetDuration().GetSeconds(), 1e-9 ) / 1e6;
+
+			int nBad = TSQueueBench_Check( bench );
+			if ( nBad )
+			{
+				Warning( "tsqueue: %s with %d threads lost or duplicated %d items\n", s_pTypeNames[nType], nThreads, nBad );
+				nFailures += nBad;
+			}
+		}
+
+		double flCallQueue = CallQueueBench_Run<CCallQueue>( nThreads, nOps, nFailures );
+		double flInlineCallQueue = CallQueueBench_Run<CInlineCallQueue>( nThreads, nOps, nFailures );
+
+		if ( bReport )
+		{
+			Msg( "  %7d  %8.2f  %8.2f  %8.2f  %10.2f  %16.2f\n", nThreads, flRate[0], flRate[1], flRate[2], flCallQueue, flInlineCallQueue );
+		}
+	}
+
+	return nFailures;
+}
+
+DEFINE_LIBTEST( tsqueue, "" )
+{
+	return TSQueueBench_Run( 65536, 8, false );
+}
+
+DEFINE_LIBBENCH( tsqueue_bench, "[operations] [max threads]" )
+{
+	int nOps = ( argc > 1 ) ? MAX( TSQUEUE_BENCH_BATCH, atoi( argv[1] ) ) : 1000000;
+	int nMaxThreads = ( argc > 2 ) ? clamp( atoi( argv[2] ), 1, 32 ) : 32;
+
+	Msg( "tsqueue_bench: %d push/pop pairs and calls per run, millions per second\n", nOps );
+	Msg( "  threads  CTSQueue      ring  ring x%d  CCallQueue  CInlineCallQueue\n", TSQUEUE_BENCH_BATCH );
+
+	return TSQueueBench_Run( nOps, nMaxThreads, true );
+}
@@ -57,6 +57,7 @@ float		g_MaxDispPatchRadius = 1500.0f;			// Maximum radius allowed for displacem
 qboolean	g_bDumpPatches;
 bool	    bDumpNormals = false;
 bool		g_bDumpRtEnv = false;
+int			g_nDispCollBenchTests = 0;
 bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
 bool        g_bNoSkyRecurse = false;
@@ -2214,6 +2215,11 @@ void VRAD_LoadBSP( char const *pFilename )
 	StaticPropMgr()->Init();
 	StaticDispMgr()->Init();
 
+	if ( g_nDispCollBenchTests > 0 )
+	{
+		StaticDispMgr()->BenchmarkCollision( g_nDispCollBenchTests );
+	}
+
 	if (!visdatasize)
 	{
 		Msg("No vis information, direct lighting only.\n");
@@ -2400,6 +2406,18 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bDumpRtEnv = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-dispcollbench" ) )
+		{
+			if ( ++i < argc )
+			{
+				g_nDispCollBenchTests = atoi( argv[i] );
+			}
+			else
+			{
+				Warning( "Error: expected a test count after '-dispcollbench'\n" );
+				return 1;
+			}
+		}
 		else if ( !Q_stricmp( argv[i], "-LargeDispSampleRadius" ) )
 		{
 			g_bLargeDispSampleRadius = true;
@@ -2792,6 +2810,8 @@ void PrintUsage( int argc, char **argv )
 		"  -dump           : Write debugging .txt files.\n"
 		"  -dumpnormals    : Write normals to debug files.\n"
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
+		"  -dispcollbench <n> : Time n random rays, hulls and boxes against the\n"
+		"                    displacement collision trees.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
@@ -529,6 +529,9 @@ public:
 	// general timing -- should be moved!!
 	virtual void StartTimer( const char *name ) = 0;
 	virtual void EndTimer( void ) = 0;
+
+	// "-dispcollbench"
+	virtual void BenchmarkCollision( int nTests ) = 0;
 };
 
 IVRadDispMgr *StaticDispMgr( void );
@@ -47,6 +47,7 @@ class CIKState;
 class ConVar;
 class C_RopeKeyframe;
 class CBoneBitList;
+class CHitboxBVH;
 class CBoneList;
 class KeyValues;
 class CJiggleBones;
@@ -618,6 +619,7 @@ private:
 	
 	CUtlVector< matrix3x4_t >		m_CachedBoneData; // never access this directly. Use m_BoneAccessor.
 	memhandle_t						m_hitboxBoneCacheHandle;
+	CHitboxBVH						*m_pHitboxBVH;		// Made by the first hitbox trace
 	float							m_flLastBoneSetupTime;
 	CJiggleBones					*m_pJiggleBones;
 
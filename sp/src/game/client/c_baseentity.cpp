@@ -40,6 +40,7 @@
 #include "cdll_bounded_cvars.h"
 #include "inetchannelinfo.h"
 #include "proto_version.h"
+#include "tier1/smallobjectallocator.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -4812,6 +4813,11 @@ CON_COMMAND( cl_sizeof, "Determines the size of the specified client class." )
 }
 #endif
 
+CON_COMMAND( cl_smallobject_stats, "Prints the client's small object allocator size classes and the live counts of the classes that use it." )
+{
+	SmallObjectAllocator().ReportStats();
+}
+
 CON_COMMAND_F( dlight_debug, "Creates a dlight in front of the player", FCVAR_CHEAT )
 {
 	dlight_t *el = effects->CL_AllocDlight( 1 );
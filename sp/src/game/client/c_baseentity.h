@@ -953,6 +953,7 @@ public:
 	virtual unsigned int	PhysicsSolidMaskForEntity( void ) const;
 
 	void					SetGroundEntity( C_BaseEntity *ground );
+	void					UpdateGroundLinks( C_BaseEntity *oldGround, C_BaseEntity *ground );
 	C_BaseEntity			*GetGroundEntity( void );
 
 	void					PhysicsPushEntity( const Vector& push, trace_t *pTrace );
@@ -32,7 +32,10 @@ class VMatrix;  // forward decl
 static ConVar cl_drawleaf("cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
-static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
+static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0", 0, "Enumerate the leaves of dirty renderables in parallel jobs"  );
+static ConVar cl_leafsystem_fastpath( "cl_leafsystem_fastpath", "1", 0, "Skip reinsertion of renderables whose bounds are still inside the box their leaves were built from" );
+static ConVar cl_leafsystem_bloat( "cl_leafsystem_bloat", "0", 0, "Amount renderable bounds are grown by when building their leaf list, so small movements take the fast path. Non-zero values can put renderables near area portals into extra leaves and areas" );
+static ConVar cl_leafsystem_stats( "cl_leafsystem_stats", "0", FCVAR_CHEAT, "Show per-frame renderable reinsertion stats" );
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -160,9 +163,17 @@ private:
 	short GetRenderableArea( ClientRenderHandle_t handle );
 
 	// remove renderables from leaves
-	void InsertIntoTree( ClientRenderHandle_t &handle );
 	void RemoveFromTree( ClientRenderHandle_t handle );
 
+	// Dirty renderable reinsertion; the leaf enumeration can run in parallel jobs
+	struct DirtyInsert_t;
+	void ComputeInsertBounds( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs );
+	bool IsInsideInsertBounds( ClientRenderHandle_t handle, const Vector &absMins, const Vector &absMaxs ) const;
+	void InsertDirtyRenderables( int nDirty );
+	void EnumerateInsertLeaves( DirtyInsert_t &insert );
+	void BeginInsertJob();
+	void EndInsertJob();
+
 	// Returns if it's a view model render group
 	inline bool IsViewModelRenderGroup( RenderGroup_t group ) const;
 
@@ -255,6 +266,8 @@ private:
 		unsigned short		m_FirstShadow;	// The first shadow caster that cast on it
 		short m_Area;	// -1 if the renderable spans multiple areas.
 		signed char			m_TranslucencyCalculatedView;
+		Vector				m_vecInsertMins;	// (bloated) box the leaf list was built from
+		Vector				m_vecInsertMaxs;
 	};
 
 	// The leaf contains an index into a list of renderables
@@ -280,16 +293,23 @@ private:
 		unsigned short	m_Flags;
 	};
 
-	struct EnumResult_t
+	struct DirtyInsert_t
 	{
-		int leaf;
-		EnumResult_t *pNext;
+		ClientRenderHandle_t m_Handle;
+		Vector	m_vecMins;
+		Vector	m_vecMaxs;
+		int		m_nLeafList;	// which of m_InsertLeafLists the leaves went into
+		int		m_nFirstLeaf;
+		int		m_nLeafCount;
 	};
 
-	struct EnumResultList_t
+	struct InsertStats_t
 	{
-		EnumResult_t *pHead;
-		ClientRenderHandle_t handle;
+		int m_nDirty;
+		int m_nFastPath;
+		int m_nReinserted;
+		int m_nShadowsProjected;
+		bool m_bThreaded;
 	};
 
 	// Stores data associated with each leaf.
@@ -323,9 +343,16 @@ private:
 	// A little enumerator to help us when adding shadows to renderables
 	int	m_ShadowEnum;
 
-	CTSList<EnumResultList_t> m_DeferredInserts;
+	// Reinsertion work; one leaf list per job so the enumeration doesn't need locks
+	CUtlVector< DirtyInsert_t >	m_DirtyInserts;
+	CUtlVector< CUtlVector< int > > m_InsertLeafLists;
+	CInterlockedInt m_nInsertLeafListsUsed;
+	InsertStats_t m_InsertStats;
 };
 
+// Which of m_InsertLeafLists the current job thread writes to
+static CThreadLocalInt<> s_nInsertLeafList;
+
 
 //-----------------------------------------------------------------------------
 // Expose IClientLeafSystem to the client dll.
@@ -441,6 +468,7 @@ CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObj
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
 	m_ShadowsInLeaf.Init( FirstShadowInLeaf, FirstLeafInShadow ); 
 	m_ShadowsOnRenderable.Init( FirstShadowOnRenderable, FirstRenderableInShadow );
+	memset( &m_InsertStats, 0, sizeof( m_InsertStats ) );
 }
 
 CClientLeafSystem::~CClientLeafSystem()
@@ -518,6 +546,8 @@ void CClientLeafSystem::LevelShutdownPostEntity()
 	m_ShadowsInLeaf.Purge();
 	m_ShadowsOnRenderable.Purge();
 	m_DirtyRenderables.Purge();
+	m_DirtyInserts.Purge();
+	m_InsertLeafLists.Purge();
 }
 
 
@@ -530,6 +560,8 @@ void CClientLeafSystem::PreRender()
 
 	int i;
 	int nIterations = 0;
+	m_InsertStats.m_nDirty = m_InsertStats.m_nFastPath = m_InsertStats.m_nReinserted = 0;
+	m_InsertStats.m_bThreaded = false;
 
 	while ( m_DirtyRenderables.Count() )
 	{
@@ -540,62 +572,138 @@ void CClientLeafSystem::PreRender()
 		}
 
 		int nDirty = m_DirtyRenderables.Count();
+		InsertDirtyRenderables( nDirty );
+
 		for ( i = nDirty; --i >= 0; )
 		{
+			// Cache off the area it's sitting in.
 			ClientRenderHandle_t handle = m_DirtyRenderables[i];
-			Assert( m_Renderables[ handle ].m_Flags & RENDER_FLAGS_HASCHANGED );
+			RenderableInfo_t& renderable = m_Renderables[ handle ];
 
-			// Update position in leaf system
-			RemoveFromTree( handle );
+			renderable.m_Flags &= ~RENDER_FLAGS_HASCHANGED;
+			m_Renderables[handle].m_Area = GetRenderableArea( handle );
 		}
 
-		bool bThreaded = false;//( nDirty > 5 && cl_threaded_client_leaf_system.GetBool() && g_pThreadPool->NumThreads() );
+		m_DirtyRenderables.RemoveMultiple( 0, nDirty );
+	}
 
-		if ( !bThreaded )
-		{
-			for ( i = nDirty; --i >= 0; )
-			{
-				InsertIntoTree( m_DirtyRenderables[i] );
-			}
-		}
-		else
+	if ( cl_leafsystem_stats.GetBool() )
+	{
+		engine->Con_NPrintf( 2, "leaf system: %d dirty, %d fast path, %d reinserted%s", m_InsertStats.m_nDirty,
+			m_InsertStats.m_nFastPath, m_InsertStats.m_nReinserted, m_InsertStats.m_bThreaded ? " (threaded)" : "" );
+		engine->Con_NPrintf( 3, "leaf system: %d shadows projected", m_InsertStats.m_nShadowsProjected );
+	}
+
+	// Shadows are projected after this during the frame, so these cover everything since the last PreRender
+	m_InsertStats.m_nShadowsProjected = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reinserts the first nDirty dirty renderables. Renderables still inside the
+// box their leaves came from keep their leaves; the rest get their leaves
+// enumerated (in parallel if enabled) and are then added serially, in dirty
+// list order, so the result doesn't depend on the job scheduling.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::InsertDirtyRenderables( int nDirty )
+{
+	m_DirtyInserts.RemoveAll();
+	m_DirtyInserts.EnsureCapacity( nDirty );
+	m_InsertStats.m_nDirty += nDirty;
+
+	bool bFastPath = cl_leafsystem_fastpath.GetBool();
+	for ( int i = nDirty; --i >= 0; )
+	{
+		ClientRenderHandle_t handle = m_DirtyRenderables[i];
+		Assert( m_Renderables[ handle ].m_Flags & RENDER_FLAGS_HASCHANGED );
+
+		Vector absMins, absMaxs;
+		CalcRenderableWorldSpaceAABB_Fast( m_Renderables[handle].m_pRenderable, absMins, absMaxs );
+		Assert( absMins.IsValid() && absMaxs.IsValid() );
+
+		if ( bFastPath && IsInsideInsertBounds( handle, absMins, absMaxs ) )
 		{
-			// InsertIntoTree can result in new renderables being added, so copy:
-			ClientRenderHandle_t *pDirtyRenderables = (ClientRenderHandle_t *)alloca( sizeof(ClientRenderHandle_t) * nDirty );
-			memcpy( pDirtyRenderables, m_DirtyRenderables.Base(), sizeof(ClientRenderHandle_t) * nDirty );
-			ParallelProcess( "CClientLeafSystem::PreRender", pDirtyRenderables, nDirty, this, &CClientLeafSystem::InsertIntoTree, &CClientLeafSystem::FrameLock, &CClientLeafSystem::FrameUnlock );
+			++m_InsertStats.m_nFastPath;
+			continue;
 		}
 
-		if ( m_DeferredInserts.Count() )
+		// Update position in leaf system
+		RemoveFromTree( handle );
+		ComputeInsertBounds( handle, absMins, absMaxs );
+
+		DirtyInsert_t &insert = m_DirtyInserts[ m_DirtyInserts.AddToTail() ];
+		insert.m_Handle = handle;
+		insert.m_vecMins = absMins;
+		insert.m_vecMaxs = absMaxs;
+		insert.m_nLeafList = 0;
+		insert.m_nFirstLeaf = 0;
+		insert.m_nLeafCount = 0;
+	}
+
+	int nInserts = m_DirtyInserts.Count();
+	if ( !nInserts )
+		return;
+	m_InsertStats.m_nReinserted += nInserts;
+
+	int nLists = 1;
+	bool bThreaded = ( nInserts > 5 && cl_threaded_client_leaf_system.GetBool() && g_pThreadPool && g_pThreadPool->NumThreads() );
+	if ( bThreaded )
+	{
+		nLists = g_pThreadPool->NumThreads() + 1;
+		m_InsertStats.m_bThreaded = true;
+	}
+	if ( m_InsertLeafLists.Count() < nLists )
+	{
+		m_InsertLeafLists.SetCount( nLists );
+	}
+	for ( int i = 0; i < nLists; ++i )
+	{
+		m_InsertLeafLists[i].RemoveAll();
+	}
+	m_nInsertLeafListsUsed = 0;
+
+	if ( !bThreaded )
+	{
+		BeginInsertJob();
+		for ( int i = 0; i < nInserts; ++i )
 		{
-			EnumResultList_t enumResultList;
-			while ( m_DeferredInserts.PopItem( &enumResultList ) )
-			{
-				m_ShadowEnum++;
-				while ( enumResultList.pHead )
-				{
-					EnumResult_t *p = enumResultList.pHead;
-					enumResultList.pHead = p->pNext;
-					AddRenderableToLeaf( p->leaf, enumResultList.handle );
-					delete p;
-				}
-			}
+			EnumerateInsertLeaves( m_DirtyInserts[i] );
 		}
+		EndInsertJob();
+	}
+	else
+	{
+		ParallelProcess( "CClientLeafSystem::PreRender", m_DirtyInserts.Base(), nInserts, this, 
+			&CClientLeafSystem::EnumerateInsertLeaves, &CClientLeafSystem::BeginInsertJob, &CClientLeafSystem::EndInsertJob );
+	}
 
-		for ( i = nDirty; --i >= 0; )
-		{
-			// Cache off the area it's sitting in.
-			ClientRenderHandle_t handle = m_DirtyRenderables[i];
-			RenderableInfo_t& renderable = m_Renderables[ handle ];
+	// Merge the per-job leaf lists
+	for ( int i = 0; i < nInserts; ++i )
+	{
+		const DirtyInsert_t &insert = m_DirtyInserts[i];
+		const int *pLeaves = m_InsertLeafLists[insert.m_nLeafList].Base() + insert.m_nFirstLeaf;
 
-			renderable.m_Flags &= ~RENDER_FLAGS_HASCHANGED;
-			m_Renderables[handle].m_Area = GetRenderableArea( handle );
+		// When we insert into the tree, increase the shadow enumerator
+		// to make sure each shadow is added exactly once to each renderable
+		m_ShadowEnum++;
+		for ( int j = 0; j < insert.m_nLeafCount; ++j )
+		{
+			AddRenderableToLeaf( pLeaves[j], insert.m_Handle );
 		}
-
-		m_DirtyRenderables.RemoveMultiple( 0, nDirty );
 	}
 }
 
+void CClientLeafSystem::BeginInsertJob()
+{
+	int nList = ++m_nInsertLeafListsUsed - 1;
+	Assert( nList < m_InsertLeafLists.Count() );
+	s_nInsertLeafList = nList;
+}
+
+void CClientLeafSystem::EndInsertJob()
+{
+}
+
 
 //-----------------------------------------------------------------------------
 // Creates a new renderable
@@ -630,6 +738,8 @@ void CClientLeafSystem::NewRenderable( IClientRenderable* pRenderable, RenderGro
 	info.m_RenderGroup = (unsigned char)type;
 	info.m_EnumCount = 0;
 	info.m_RenderLeaf = 0xFFFF;
+	info.m_vecInsertMins.Init( FLT_MAX, FLT_MAX, FLT_MAX );
+	info.m_vecInsertMaxs.Init( -FLT_MAX, -FLT_MAX, -FLT_MAX );
 	if ( IsViewModelRenderGroup( (RenderGroup_t)info.m_RenderGroup ) )
 	{
 		AddToViewModelList( handle );
@@ -1016,6 +1126,8 @@ void CClientLeafSystem::RemoveShadowFromLeaves( ClientLeafShadowHandle_t handle
 //-----------------------------------------------------------------------------
 void CClientLeafSystem::ProjectShadow( ClientLeafShadowHandle_t handle, int nLeafCount, const int *pLeafList )
 {
+	++m_InsertStats.m_nShadowsProjected;
+
 	// Remove the shadow from any leaves it current exists in
 	RemoveShadowFromLeaves( handle );
 	RemoveShadowFromRenderables( handle );
@@ -1035,6 +1147,8 @@ void CClientLeafSystem::ProjectFlashlight( ClientLeafShadowHandle_t handle, int
 {
 	VPROF_BUDGET( "CClientLeafSystem::ProjectFlashlight", VPROF_BUDGETGROUP_SHADOW_DEPTH_TEXTURING );
 
+	++m_InsertStats.m_nShadowsProjected;
+
 	// Remove the shadow from any leaves it current exists in
 	RemoveShadowFromLeaves( handle );
 	RemoveShadowFromRenderables( handle );
@@ -1134,46 +1248,45 @@ void CClientLeafSystem::AddRenderableToLeaves( ClientRenderHandle_t handle, int
 //-----------------------------------------------------------------------------
 bool CClientLeafSystem::EnumerateLeaf( int leaf, int context )
 {
-	EnumResultList_t *pList = (EnumResultList_t *)context;
-	if ( ThreadInMainThread() )
-	{
-		AddRenderableToLeaf( leaf, pList->handle );
-	}
-	else
-	{
-		EnumResult_t *p = new EnumResult_t;
-		p->leaf = leaf;
-		p->pNext = pList->pHead;
-		pList->pHead = p;
-	}
+	// Collects into one of the job leaf lists, see EnumerateInsertLeaves
+	CUtlVector< int > *pLeaves = (CUtlVector< int > *)context;
+	pLeaves->AddToTail( leaf );
 	return true;
 }
 
-void CClientLeafSystem::InsertIntoTree( ClientRenderHandle_t &handle )
+void CClientLeafSystem::ComputeInsertBounds( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs )
 {
-	if ( ThreadInMainThread() )
-	{
-		// When we insert into the tree, increase the shadow enumerator
-		// to make sure each shadow is added exactly once to each renderable
-		m_ShadowEnum++;
-	}
+	float flBloat = cl_leafsystem_fastpath.GetBool() ? cl_leafsystem_bloat.GetFloat() : 0.0f;
+	Vector vecBloat( flBloat, flBloat, flBloat );
+	absMins -= vecBloat;
+	absMaxs += vecBloat;
 
-	EnumResultList_t list = { NULL, handle };
+	RenderableInfo_t &info = m_Renderables[handle];
+	info.m_vecInsertMins = absMins;
+	info.m_vecInsertMaxs = absMaxs;
+}
 
-	// NOTE: The render bounds here are relative to the renderable's coordinate system
-	IClientRenderable* pRenderable = m_Renderables[handle].m_pRenderable;
-	Vector absMins, absMaxs;
-	
-	CalcRenderableWorldSpaceAABB_Fast( pRenderable, absMins, absMaxs );
-	Assert( absMins.IsValid() && absMaxs.IsValid() );
+bool CClientLeafSystem::IsInsideInsertBounds( ClientRenderHandle_t handle, const Vector &absMins, const Vector &absMaxs ) const
+{
+	// Never inserted (or removed from the tree) renderables have an inverted box
+	const RenderableInfo_t &info = m_Renderables[handle];
+	return ( absMins.x >= info.m_vecInsertMins.x ) && ( absMins.y >= info.m_vecInsertMins.y ) && ( absMins.z >= info.m_vecInsertMins.z ) &&
+		( absMaxs.x <= info.m_vecInsertMaxs.x ) && ( absMaxs.y <= info.m_vecInsertMaxs.y ) && ( absMaxs.z <= info.m_vecInsertMaxs.z );
+}
+
+//-----------------------------------------------------------------------------
+// Job body: only touches the BSP and this job's leaf list
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::EnumerateInsertLeaves( DirtyInsert_t &insert )
+{
+	CUtlVector< int > &leaves = m_InsertLeafLists[ s_nInsertLeafList ];
+	insert.m_nLeafList = s_nInsertLeafList;
+	insert.m_nFirstLeaf = leaves.Count();
 
 	ISpatialQuery* pQuery = engine->GetBSPTreeQuery();
-	pQuery->EnumerateLeavesInBox( absMins, absMaxs, this, (int)&list );
+	pQuery->EnumerateLeavesInBox( insert.m_vecMins, insert.m_vecMaxs, this, (int)&leaves );
 
-	if ( list.pHead )
-	{
-		m_DeferredInserts.PushItem( list );
-	}
+	insert.m_nLeafCount = leaves.Count() - insert.m_nFirstLeaf;
 }
 
 //-----------------------------------------------------------------------------
@@ -1182,6 +1295,8 @@ void CClientLeafSystem::InsertIntoTree( ClientRenderHandle_t &handle )
 void CClientLeafSystem::RemoveFromTree( ClientRenderHandle_t handle )
 {
 	m_RenderablesInLeaf.RemoveElement( handle );
+	m_Renderables[handle].m_vecInsertMins.Init( FLT_MAX, FLT_MAX, FLT_MAX );
+	m_Renderables[handle].m_vecInsertMaxs.Init( -FLT_MAX, -FLT_MAX, -FLT_MAX );
 
 	// Remove all shadows cast onto the object
 	m_ShadowsOnRenderable.RemoveBucket( handle );
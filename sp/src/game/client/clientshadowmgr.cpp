@@ -81,6 +81,8 @@
 #include "toolframework_client.h"
 #include "bonetoworldarray.h"
 #include "cmodel.h"
+#include "checksum_crc.h"
+#include "c_baseanimatingoverlay.h"
 
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -101,6 +103,13 @@ ConVar r_flashlightdepthres( "r_flashlightdepthres", "8192" );
 
 ConVar r_threaded_client_shadow_manager( "r_threaded_client_shadow_manager", "0" );
 
+static ConVar r_shadow_batchprojection( "r_shadow_batchprojection", "1", 0, "Re-project dirty shadows as a batch: leaf lists are built together (on the thread pool if r_threaded_client_shadow_manager is set), then submitted in order" );
+static ConVar r_shadow_batchprojection_min( "r_shadow_batchprojection_min", "8", 0, "Minimum number of dirty shadows before shadow leaf lists are built on the thread pool" );
+static ConVar r_shadow_texturecache( "r_shadow_texturecache", "1", 0, "Don't re-render animating render-to-texture shadows whose animation state and shadow transform are unchanged. Models with flexes, IK chains or jiggle bones, and models blending between sequences, always re-render. Bones that an entity class moves itself in BuildTransformations aren't checked" );
+static ConVar r_shadow_texturebudget( "r_shadow_texturebudget", "0", 0, "Maximum number of animating render-to-texture shadows re-rendered per frame, largest on screen first (0 = no limit)" );
+static ConVar r_shadow_texturemaxstale( "r_shadow_texturemaxstale", "8", 0, "Number of frames an animating shadow texture can be held back by r_shadow_texturebudget before it must re-render" );
+static ConVar r_shadow_updatestats( "r_shadow_updatestats", "0", FCVAR_CHEAT, "Display shadow projection and render-to-texture update counts" );
+
 #ifdef _WIN32
 #pragma warning( disable: 4701 )
 #endif
@@ -806,6 +815,7 @@ private:
 		SHADOW_FLAGS_BRUSH_MODEL =		(CLIENT_SHADOW_FLAGS_LAST_FLAG << 2), 
 		SHADOW_FLAGS_USING_LOD_SHADOW = (CLIENT_SHADOW_FLAGS_LAST_FLAG << 3),
 		SHADOW_FLAGS_LIGHT_WORLD =		(CLIENT_SHADOW_FLAGS_LAST_FLAG << 4),
+		SHADOW_FLAGS_POSE_KEY_VALID =	(CLIENT_SHADOW_FLAGS_LAST_FLAG << 5),
 	};
 
 	struct ClientShadow_t
@@ -822,6 +832,49 @@ private:
 		CTextureReference		m_ShadowDepthTexture;
 		int						m_nRenderFrame;
 		EHANDLE					m_hTargetEntity;
+
+		// Render-to-texture cache for animating casters; see ScheduleShadowTextureUpdates
+		CRC32_t					m_nPoseKey;
+		CRC32_t					m_nPendingPoseKey;
+		int						m_nPoseKeyFrame;
+		int						m_nTextureUpdateFrame;
+	};
+
+	// The parts of a shadow projection that get handed to the shadow manager
+	// and the client leaf system; built up front so the leaf lists can be batched
+	struct ShadowProjection_t
+	{
+		IClientRenderable		*m_pRenderable;
+		ClientShadowHandle_t	m_Handle;
+		bool					m_bExtraClipPlanes;
+		Vector					m_vecBasis[3];
+		Vector					m_vecMins;
+		Vector					m_vecMaxs;
+		Vector					m_vecLocalShadowDir;
+		Vector					m_vecWorldOrigin;
+		Vector					m_vecShadowDir;
+		Vector					m_vecRenderOrigin;
+		VMatrix					m_matWorldToTexture;
+		Vector2D				m_Size;
+		float					m_flMaxHeight;
+		float					m_flFalloffStart;
+		int						m_nLeafList;
+	};
+
+	struct ShadowTextureCandidate_t
+	{
+		ClientShadowHandle_t	m_hShadow;
+		float					m_flPriority;
+	};
+
+	struct ShadowUpdateStats_t
+	{
+		int m_nProjected;
+		int m_nBatched;
+		int m_nUnchanged;
+		int m_nTexturesRendered;
+		int m_nTexturesCached;
+		int m_nTexturesDeferred;
 	};
 
 private:
@@ -869,6 +922,12 @@ private:
 	void BuildRenderToTextureShadow( IClientRenderable* pRenderable, 
 			ClientShadowHandle_t handle, const Vector& mins, const Vector& maxs );
 
+	// Projects the shadow immediately, or queues it up if we're batching
+	void SubmitShadowProjection( const ShadowProjection_t &projection );
+	void ApplyShadowProjection( const ShadowProjection_t &projection, int nLeafCount, const int *pLeafList );
+	void EnumerateProjectionLeaves( ShadowProjection_t &projection );
+	void FlushShadowProjections();
+
 	// Build a projected-texture flashlight
 	void BuildFlashlight( ClientShadowHandle_t handle );
 
@@ -895,6 +954,13 @@ private:
 
 	// One of these gets called with every shadow that potentially will need to re-render
 	bool DrawRenderToTextureShadow( unsigned short clientShadowHandle, float flArea );
+
+	// Decides which animating shadows actually need to re-render their texture this frame
+	void ScheduleShadowTextureUpdates( int nVisibleCount );
+	bool ComputeShadowPoseKey( IClientRenderable *pRenderable, const ClientShadow_t &shadow, CRC32_t &nKey );
+	static int __cdecl ShadowTextureCandidateCompare( const ShadowTextureCandidate_t *pLeft, const ShadowTextureCandidate_t *pRight );
+
+	void DisplayShadowUpdateStats();
 	void DrawRenderToTextureShadowLOD( unsigned short clientShadowHandle );
 
 	// Draws all children shadows into our own
@@ -969,6 +1035,14 @@ private:
 	CUtlRBTree< ClientShadowHandle_t, unsigned short >	m_DirtyShadows;
 	CUtlVector< ClientShadowHandle_t > m_TransparentShadows;
 
+	// Shadow projections deferred while PreRender walks the dirty list
+	bool m_bBatchingProjections;
+	CUtlVector< ShadowProjection_t > m_PendingProjections;
+	CUtlVector< CUtlVector< int > > m_ProjectionLeafLists;
+
+	CUtlVector< ShadowTextureCandidate_t > m_TextureCandidates;
+	ShadowUpdateStats_t m_UpdateStats;
+
 	// These members maintain current state of depth texturing (size and global active state)
 	// If either changes in a frame, PreRender() will catch it and do the appropriate allocation, deallocation or reallocation
 	bool m_bDepthTextureActive;
@@ -1190,6 +1264,8 @@ CClientShadowMgr::CClientShadowMgr() :
 	m_nDepthTextureResolution = r_flashlightdepthres.GetInt();
 	m_bThreaded = false;
 	m_ShadowToAsw.SetLessFunc( shadow_to_asw_lessfunc );
+	m_bBatchingProjections = false;
+	memset( &m_UpdateStats, 0, sizeof(m_UpdateStats) );
 }
 
 
@@ -1852,6 +1928,10 @@ ClientShadowHandle_t CClientShadowMgr::CreateProjectedTexture( ClientEntityHandl
 	shadow.m_nRenderFrame = -1;
 	shadow.m_LastOrigin.Init( FLT_MAX, FLT_MAX, FLT_MAX );
 	shadow.m_LastAngles.Init( FLT_MAX, FLT_MAX, FLT_MAX );
+	shadow.m_nPoseKey = 0;
+	shadow.m_nPendingPoseKey = 0;
+	shadow.m_nPoseKeyFrame = -1;
+	shadow.m_nTextureUpdateFrame = -1;
 	Assert( ( ( shadow.m_Flags & SHADOW_FLAGS_FLASHLIGHT ) == 0 ) != 
 			( ( shadow.m_Flags & SHADOW_FLAGS_SHADOW ) == 0 ) );
 
@@ -2439,21 +2519,23 @@ void CClientShadowMgr::BuildOrthoShadow( IClientRenderable* pRenderable,
 	float flShadowCastDistance = GetShadowDistance( pRenderable );
 	float maxHeight = flShadowCastDistance + falloffStart; //3.0f * sqrt( shadowArea );
 
-	CShadowLeafEnum leafList;
-	BuildShadowLeafList( &leafList, worldOrigin, vecShadowDir, size, maxHeight );
-	int nCount = leafList.m_LeafList.Count();
-	const int *pLeafList = leafList.m_LeafList.Base();
-
-	shadowmgr->ProjectShadow( m_Shadows[handle].m_ShadowHandle, worldOrigin,
-		vecShadowDir, matWorldToTexture, size, nCount, pLeafList, maxHeight, falloffStart, MAX_FALLOFF_AMOUNT, pRenderable->GetRenderOrigin() );
+	ShadowProjection_t projection;
+	projection.m_pRenderable = pRenderable;
+	projection.m_Handle = handle;
 
 	// Compute extra clip planes to prevent poke-thru
 // FIXME!!!!!!!!!!!!!!  Removing this for now since it seems to mess up the blobby shadows.
 //	ComputeExtraClipPlanes( pEnt, handle, vec, mins, maxs, localShadowDir );
+	projection.m_bExtraClipPlanes = false;
 
-	// Add the shadow to the client leaf system so it correctly marks 
-	// leafs as being affected by a particular shadow
-	ClientLeafSystem()->ProjectShadow( m_Shadows[handle].m_ClientLeafShadowHandle, nCount, pLeafList );
+	projection.m_vecWorldOrigin = worldOrigin;
+	projection.m_vecShadowDir = vecShadowDir;
+	projection.m_vecRenderOrigin = pRenderable->GetRenderOrigin();
+	projection.m_matWorldToTexture = matWorldToTexture;
+	projection.m_Size = size;
+	projection.m_flMaxHeight = maxHeight;
+	projection.m_flFalloffStart = falloffStart;
+	SubmitShadowProjection( projection );
 }
 
 
@@ -2619,20 +2701,118 @@ void CClientShadowMgr::BuildRenderToTextureShadow( IClientRenderable* pRenderabl
 	float flShadowCastDistance = GetShadowDistance( pRenderable );
 	float maxHeight = flShadowCastDistance + falloffStart; //3.0f * sqrt( shadowArea );
 
+	ShadowProjection_t projection;
+	projection.m_pRenderable = pRenderable;
+	projection.m_Handle = handle;
+
+	// Compute extra clip planes to prevent poke-thru
+	projection.m_bExtraClipPlanes = true;
+	projection.m_vecBasis[0] = vec[0];
+	projection.m_vecBasis[1] = vec[1];
+	projection.m_vecBasis[2] = vec[2];
+	projection.m_vecMins = mins;
+	projection.m_vecMaxs = maxs;
+	projection.m_vecLocalShadowDir = localShadowDir;
+
+	projection.m_vecWorldOrigin = worldOrigin;
+	projection.m_vecShadowDir = vecShadowDir;
+	projection.m_vecRenderOrigin = pRenderable->GetRenderOrigin();
+	projection.m_matWorldToTexture = matWorldToTexture;
+	projection.m_Size = size;
+	projection.m_flMaxHeight = maxHeight;
+	projection.m_flFalloffStart = falloffStart;
+	SubmitShadowProjection( projection );
+}
+
+
+//-----------------------------------------------------------------------------
+// Hands a shadow projection to the shadow manager. While PreRender is walking
+// the dirty list we only queue it up; FlushShadowProjections builds all the
+// leaf lists in one go and then submits the projections in their original order.
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::SubmitShadowProjection( const ShadowProjection_t &projection )
+{
+	if ( m_bBatchingProjections )
+	{
+		m_PendingProjections.AddToTail( projection );
+		return;
+	}
+
 	CShadowLeafEnum leafList;
-	BuildShadowLeafList( &leafList, worldOrigin, vecShadowDir, size, maxHeight );
-	int nCount = leafList.m_LeafList.Count();
-	const int *pLeafList = leafList.m_LeafList.Base();
+	BuildShadowLeafList( &leafList, projection.m_vecWorldOrigin, projection.m_vecShadowDir, projection.m_Size, projection.m_flMaxHeight );
+	ApplyShadowProjection( projection, leafList.m_LeafList.Count(), leafList.m_LeafList.Base() );
+}
 
-	shadowmgr->ProjectShadow( m_Shadows[handle].m_ShadowHandle, worldOrigin, 
-		vecShadowDir, matWorldToTexture, size, nCount, pLeafList, maxHeight, falloffStart, MAX_FALLOFF_AMOUNT, pRenderable->GetRenderOrigin() );
+void CClientShadowMgr::ApplyShadowProjection( const ShadowProjection_t &projection, int nLeafCount, const int *pLeafList )
+{
+	ClientShadow_t &shadow = m_Shadows[projection.m_Handle];
 
-	// Compute extra clip planes to prevent poke-thru
-	ComputeExtraClipPlanes( pRenderable, handle, vec, mins, maxs, localShadowDir );
+	shadowmgr->ProjectShadow( shadow.m_ShadowHandle, projection.m_vecWorldOrigin,
+		projection.m_vecShadowDir, projection.m_matWorldToTexture, projection.m_Size, nLeafCount, pLeafList,
+		projection.m_flMaxHeight, projection.m_flFalloffStart, MAX_FALLOFF_AMOUNT, projection.m_vecRenderOrigin );
+
+	if ( projection.m_bExtraClipPlanes )
+	{
+		ComputeExtraClipPlanes( projection.m_pRenderable, projection.m_Handle, projection.m_vecBasis,
+			projection.m_vecMins, projection.m_vecMaxs, projection.m_vecLocalShadowDir );
+	}
 
 	// Add the shadow to the client leaf system so it correctly marks 
 	// leafs as being affected by a particular shadow
-	ClientLeafSystem()->ProjectShadow( m_Shadows[handle].m_ClientLeafShadowHandle, nCount, pLeafList );
+	ClientLeafSystem()->ProjectShadow( shadow.m_ClientLeafShadowHandle, nLeafCount, pLeafList );
+}
+
+//-----------------------------------------------------------------------------
+// Job callback; each projection owns its own leaf list
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::EnumerateProjectionLeaves( ShadowProjection_t &projection )
+{
+	CShadowLeafEnum leafList;
+	BuildShadowLeafList( &leafList, projection.m_vecWorldOrigin, projection.m_vecShadowDir, projection.m_Size, projection.m_flMaxHeight );
+
+	CUtlVector< int > &leaves = m_ProjectionLeafLists[ projection.m_nLeafList ];
+	leaves.CopyArray( leafList.m_LeafList.Base(), leafList.m_LeafList.Count() );
+}
+
+void CClientShadowMgr::FlushShadowProjections()
+{
+	int nCount = m_PendingProjections.Count();
+	if ( nCount == 0 )
+		return;
+
+	VPROF_BUDGET( "CClientShadowMgr::FlushShadowProjections", VPROF_BUDGETGROUP_SHADOW_RENDERING );
+
+	if ( m_ProjectionLeafLists.Count() < nCount )
+	{
+		m_ProjectionLeafLists.AddMultipleToTail( nCount - m_ProjectionLeafLists.Count() );
+	}
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		m_PendingProjections[i].m_nLeafList = i;
+	}
+
+	if ( r_threaded_client_shadow_manager.GetBool() && ( nCount >= r_shadow_batchprojection_min.GetInt() ) && g_pThreadPool->NumIdleThreads() )
+	{
+		ParallelProcess( "CClientShadowMgr::FlushShadowProjections", m_PendingProjections.Base(), nCount, this, &CClientShadowMgr::EnumerateProjectionLeaves );
+	}
+	else
+	{
+		for ( int i = 0; i < nCount; ++i )
+		{
+			EnumerateProjectionLeaves( m_PendingProjections[i] );
+		}
+	}
+
+	// The shadow manager and leaf system aren't thread safe; submit in dirty list order
+	for ( int i = 0; i < nCount; ++i )
+	{
+		const CUtlVector< int > &leaves = m_ProjectionLeafLists[i];
+		ApplyShadowProjection( m_PendingProjections[i], leaves.Count(), leaves.Base() );
+	}
+
+	m_UpdateStats.m_nBatched += nCount;
+	m_PendingProjections.RemoveAll();
 }
 
 static void LineDrawHelper( const Vector &startShadowSpace, const Vector &endShadowSpace, 
@@ -2941,6 +3121,13 @@ void CClientShadowMgr::PreRender()
 	VPROF_BUDGET( "CClientShadowMgr::PreRender", VPROF_BUDGETGROUP_SHADOW_RENDERING );
 	MDLCACHE_CRITICAL_SECTION();
 
+	// Counters cover PreRender + the shadow texture pass of the previous frame
+	if ( r_shadow_updatestats.GetBool() )
+	{
+		DisplayShadowUpdateStats();
+	}
+	memset( &m_UpdateStats, 0, sizeof(m_UpdateStats) );
+
 	//
 	// -- Shadow Depth Textures -----------------------
 	//
@@ -3004,6 +3191,7 @@ void CClientShadowMgr::PreRender()
 	}
 
 	m_bUpdatingDirtyShadows = true;
+	m_bBatchingProjections = r_shadow_batchprojection.GetBool();
 
 	unsigned short i = m_DirtyShadows.FirstInorder();
 	while ( i != m_DirtyShadows.InvalidIndex() )
@@ -3016,6 +3204,13 @@ void CClientShadowMgr::PreRender()
 	}
 	m_DirtyShadows.RemoveAll();
 
+	if ( m_bBatchingProjections )
+	{
+		MDLCACHE_CRITICAL_SECTION();
+		FlushShadowProjections();
+		m_bBatchingProjections = false;
+	}
+
 	// Transparent shadows must remain dirty, since they were not re-projected
 	int nCount = m_TransparentShadows.Count();
 	for ( int i = 0; i < nCount; ++i )
@@ -3207,6 +3402,8 @@ void CClientShadowMgr::UpdateShadow( ClientShadowHandle_t handle, bool force )
 		VectorCopy( origin, shadow.m_LastOrigin );
 		VectorCopy( angles, shadow.m_LastAngles );
 
+		++m_UpdateStats.m_nProjected;
+
 		CMatRenderContextPtr pRenderContext( materials );
 		const model_t *pModel = pRenderable->GetModel();
 		MaterialFogMode_t fogMode = pRenderContext->GetFogMode();
@@ -3228,6 +3425,10 @@ void CClientShadowMgr::UpdateShadow( ClientShadowHandle_t handle, bool force )
 		}
 		pRenderContext->FogMode( fogMode );
 	}
+	else
+	{
+		++m_UpdateStats.m_nUnchanged;
+	}
 
 	// NOTE: We can't do this earlier because pEnt->GetRenderOrigin() can
 	// provoke a recomputation of render origin, which, for aiments, can cause everything
@@ -3814,6 +4015,12 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 	// Mark texture as being used...
 	bool bDirtyTexture = (shadow.m_Flags & SHADOW_FLAGS_TEXTURE_DIRTY) != 0;
 	bool bDrewTexture = false;
+
+	// Animating casters always redraw unless ScheduleShadowTextureUpdates looked at them this frame
+	if ( ( shadow.m_Flags & SHADOW_FLAGS_ANIMATING_SOURCE ) && ( shadow.m_nPoseKeyFrame != gpGlobals->framecount ) )
+	{
+		bDirtyTexture = true;
+	}
 	bool bNeedsRedraw = ( !m_bThreaded && m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture, flArea ) );
 
 	if ( !m_ShadowAllocator.HasValidTexture( shadow.m_ShadowTexture ) )
@@ -3858,11 +4065,21 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 			DevMsg( "Didn't draw shadow hierarchy.. bad shadow texcoords probably going to happen..grab Brian!\n" );
 		}
 
-		// Only clear the dirty flag if the caster isn't animating
+		++m_UpdateStats.m_nTexturesRendered;
+
+		// Only clear the dirty flag if the caster isn't animating, unless the
+		// scheduler looked at its pose this frame; it'll re-dirty it when the pose changes
 		if ( (shadow.m_Flags & SHADOW_FLAGS_ANIMATING_SOURCE) == 0 )
 		{
 			shadow.m_Flags &= ~SHADOW_FLAGS_TEXTURE_DIRTY;
 		}
+		else if ( shadow.m_nPoseKeyFrame == gpGlobals->framecount )
+		{
+			shadow.m_nPoseKey = shadow.m_nPendingPoseKey;
+			shadow.m_nTextureUpdateFrame = gpGlobals->framecount;
+			shadow.m_Flags |= SHADOW_FLAGS_POSE_KEY_VALID;
+			shadow.m_Flags &= ~SHADOW_FLAGS_TEXTURE_DIRTY;
+		}
 
 		SetRenderToTextureShadowTexCoords( shadow.m_ShadowHandle, x, y, w, h );
 	}
@@ -3879,6 +4096,186 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 }
 
 
+//-----------------------------------------------------------------------------
+// Hashes everything that ends up in an animating caster's shadow texture: the
+// model, the animation state its bones are set up from, and the shadow transform.
+// This only reads state the entity already has, so it doesn't cost a bone setup.
+// Returns false for casters whose pose depends on anything else: bones from
+// physics or a parent, flexes, jiggle bones, IK and sequence transitions.
+//-----------------------------------------------------------------------------
+bool CClientShadowMgr::ComputeShadowPoseKey( IClientRenderable *pRenderable, const ClientShadow_t &shadow, CRC32_t &nKey )
+{
+	C_BaseEntity *pEntity = pRenderable->GetIClientUnknown()->GetBaseEntity();
+	C_BaseAnimating *pAnimating = pEntity ? pEntity->GetBaseAnimating() : NULL;
+	if ( !pAnimating )
+		return false;
+
+	// Ragdolls and bone merged models get their bones from physics or their parent
+	if ( pAnimating->IsRagdoll() || pAnimating->IsEffectActive( EF_BONEMERGE ) )
+		return false;
+
+	CStudioHdr *pStudioHdr = pAnimating->GetModelPtr();
+	if ( !pStudioHdr )
+		return false;
+
+	// Flex weights, IK targets and the blend out of the previous sequence aren't
+	// in the key, so these always re-render
+	if ( pStudioHdr->numflexdesc() > 0 )
+		return false;
+
+	if ( pStudioHdr->numikchains() > 0 && !( pAnimating->m_EntClientFlags & ENTCLIENTFLAG_DONTUSEIK ) && !pAnimating->IsModelScaled() )
+		return false;
+
+	if ( pAnimating->m_SequenceTransitioner.m_animationQueue.Count() > 1 )
+		return false;
+
+	// Jiggle bones are simulated over time rather than posed
+	for ( int i = 0; i < pStudioHdr->numbones(); ++i )
+	{
+		if ( pStudioHdr->pBone( i )->proctype == STUDIO_PROC_JIGGLE )
+			return false;
+	}
+
+	CRC32_Init( &nKey );
+
+	const model_t *pModel = pRenderable->GetModel();
+	int pModelState[3] = { pRenderable->GetBody(), pRenderable->GetSkin(), pAnimating->GetSequence() };
+	float pAnimState[2] = { pAnimating->GetCycle(), pAnimating->GetModelScale() };
+	CRC32_ProcessBuffer( &nKey, &pModel, sizeof(pModel) );
+	CRC32_ProcessBuffer( &nKey, pModelState, sizeof(pModelState) );
+	CRC32_ProcessBuffer( &nKey, pAnimState, sizeof(pAnimState) );
+	CRC32_ProcessBuffer( &nKey, &pRenderable->GetRenderAngles(), sizeof(QAngle) );
+
+	float pPoseParameters[MAXSTUDIOPOSEPARAM];
+	pAnimating->GetPoseParameters( pStudioHdr, pPoseParameters );
+	CRC32_ProcessBuffer( &nKey, pPoseParameters, pStudioHdr->GetNumPoseParameters() * sizeof(float) );
+
+	float pControllers[MAXSTUDIOBONECTRLS];
+	pAnimating->GetBoneControllers( pControllers );
+	CRC32_ProcessBuffer( &nKey, pControllers, pStudioHdr->numbonecontrollers() * sizeof(float) );
+
+	// Gesture layers blended over the base sequence
+	C_BaseAnimatingOverlay *pOverlay = dynamic_cast<C_BaseAnimatingOverlay *>( pAnimating );
+	int nLayers = pOverlay ? pOverlay->GetNumAnimOverlays() : 0;
+	for ( int i = 0; i < nLayers; ++i )
+	{
+		C_AnimationLayer *pLayer = pOverlay->GetAnimOverlay( i );
+		if ( pLayer->m_flWeight <= 0.0f )
+			continue;
+
+		int nLayerSequence = pLayer->m_nSequence;
+		float pLayerState[2] = { pLayer->m_flCycle, pLayer->m_flWeight };
+		CRC32_ProcessBuffer( &nKey, &nLayerSequence, sizeof(nLayerSequence) );
+		CRC32_ProcessBuffer( &nKey, pLayerState, sizeof(pLayerState) );
+	}
+
+	// The texture is drawn in shadow space, so it only depends on the shadow's
+	// orientation, its size and where the caster sits inside it
+	Vector vecShadowSpaceOrigin;
+	Vector3DMultiplyPosition( shadow.m_WorldToShadow, pRenderable->GetRenderOrigin(), vecShadowSpaceOrigin );
+	for ( int i = 0; i < 3; ++i )
+	{
+		CRC32_ProcessBuffer( &nKey, shadow.m_WorldToShadow[i], 3 * sizeof(vec_t) );
+	}
+	CRC32_ProcessBuffer( &nKey, &vecShadowSpaceOrigin, sizeof(vecShadowSpaceOrigin) );
+	CRC32_ProcessBuffer( &nKey, &shadow.m_WorldSize, sizeof(shadow.m_WorldSize) );
+
+	CRC32_Final( &nKey );
+	return true;
+}
+
+int __cdecl CClientShadowMgr::ShadowTextureCandidateCompare( const ShadowTextureCandidate_t *pLeft, const ShadowTextureCandidate_t *pRight )
+{
+	if ( pLeft->m_flPriority > pRight->m_flPriority )
+		return -1;
+	if ( pLeft->m_flPriority < pRight->m_flPriority )
+		return 1;
+	return (int)pLeft->m_hShadow - (int)pRight->m_hShadow;
+}
+
+
+//-----------------------------------------------------------------------------
+// Animating casters normally re-render their shadow texture every frame. Here we
+// only mark them dirty when their pose key changed, and if there's a budget,
+// only the ones with the most screen area * frames since their last update.
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::ScheduleShadowTextureUpdates( int nVisibleCount )
+{
+	VPROF_BUDGET( "CClientShadowMgr::ScheduleShadowTextureUpdates", VPROF_BUDGETGROUP_SHADOW_RENDERING );
+
+	m_TextureCandidates.RemoveAll();
+
+	int nMaxStale = r_shadow_texturemaxstale.GetInt();
+	for ( int i = 0; i < nVisibleCount; ++i )
+	{
+		const VisibleShadowInfo_t &info = s_VisibleShadowList.GetVisibleShadow( i );
+		ClientShadow_t &shadow = m_Shadows[info.m_hShadow];
+		if ( (shadow.m_Flags & SHADOW_FLAGS_ANIMATING_SOURCE) == 0 )
+			continue;
+
+		IClientRenderable *pRenderable = ClientEntityList().GetClientRenderableFromHandle( shadow.m_Entity );
+		if ( !pRenderable )
+			continue;
+
+		// Children get drawn into the texture too; don't try to track their poses
+		if ( pRenderable->FirstShadowChild() || !ComputeShadowPoseKey( pRenderable, shadow, shadow.m_nPendingPoseKey ) )
+		{
+			shadow.m_Flags |= SHADOW_FLAGS_TEXTURE_DIRTY;
+			continue;
+		}
+		shadow.m_nPoseKeyFrame = gpGlobals->framecount;
+
+		// Someone explicitly asked for a redraw
+		if ( shadow.m_Flags & SHADOW_FLAGS_TEXTURE_DIRTY )
+			continue;
+
+		bool bPoseValid = (shadow.m_Flags & SHADOW_FLAGS_POSE_KEY_VALID) != 0;
+		if ( bPoseValid && ( shadow.m_nPendingPoseKey == shadow.m_nPoseKey ) )
+		{
+			++m_UpdateStats.m_nTexturesCached;
+			continue;
+		}
+
+		int nFramesStale = gpGlobals->framecount - shadow.m_nTextureUpdateFrame;
+		if ( !bPoseValid || ( nFramesStale >= nMaxStale ) )
+		{
+			shadow.m_Flags |= SHADOW_FLAGS_TEXTURE_DIRTY;
+			continue;
+		}
+
+		int j = m_TextureCandidates.AddToTail();
+		m_TextureCandidates[j].m_hShadow = info.m_hShadow;
+		m_TextureCandidates[j].m_flPriority = info.m_flArea * nFramesStale;
+	}
+
+	int nBudget = r_shadow_texturebudget.GetInt();
+	int nCandidates = m_TextureCandidates.Count();
+	if ( nBudget > 0 && nCandidates > nBudget )
+	{
+		m_TextureCandidates.Sort( ShadowTextureCandidateCompare );
+		m_UpdateStats.m_nTexturesDeferred += nCandidates - nBudget;
+		nCandidates = nBudget;
+	}
+
+	for ( int i = 0; i < nCandidates; ++i )
+	{
+		m_Shadows[ m_TextureCandidates[i].m_hShadow ].m_Flags |= SHADOW_FLAGS_TEXTURE_DIRTY;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Shadow update counters, shown with r_shadow_updatestats
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::DisplayShadowUpdateStats()
+{
+	engine->Con_NPrintf( 0, "Shadow projections: %d updated (%d batched), %d unchanged",
+		m_UpdateStats.m_nProjected, m_UpdateStats.m_nBatched, m_UpdateStats.m_nUnchanged );
+	engine->Con_NPrintf( 1, "Shadow textures: %d rendered, %d cached, %d deferred",
+		m_UpdateStats.m_nTexturesRendered, m_UpdateStats.m_nTexturesCached, m_UpdateStats.m_nTexturesDeferred );
+}
+
+
 //-----------------------------------------------------------------------------
 // "Draws" the shadow LOD, which really means just set up the blobby shadow
 //-----------------------------------------------------------------------------
@@ -4219,6 +4616,11 @@ void CClientShadowMgr::ComputeShadowTextures( const CViewSetup &view, int leafCo
 	int nModelsRendered = 0;
 	int i;
 
+	if ( r_shadow_texturecache.GetBool() )
+	{
+		ScheduleShadowTextureUpdates( nCount );
+	}
+
 	if ( m_bThreaded && g_pThreadPool->NumIdleThreads() )
 	{
 		s_NPCShadowBoneSetups.RemoveAll();
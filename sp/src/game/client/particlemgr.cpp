@@ -13,6 +13,7 @@
 #include "materialsystem/imesh.h"
 #include "materialsystem/imaterialvar.h"
 #include "mempool.h"
+#include "tier1/smallobjectallocator.h"
 #include "iclientmode.h"
 #include "view_scene.h"
 #include "tier0/vprof.h"
@@ -970,7 +971,7 @@ void CParticleEffectBinding::RemoveParticle( Particle *pParticle )
 	m_pSim->NotifyDestroyParticle(pParticle);
 
 	// Remove it from the list of particles and deallocate
-	m_pParticleMgr->FreeParticle(pParticle);
+	m_pParticleMgr->FreeParticle( pParticle, PARTICLE_SIZE );
 }
 
 
@@ -1166,26 +1167,29 @@ void CParticleMgr::LevelInit()
 }
 
 
+static CSmallObjectAllocStats s_ParticleAllocStats( "Particle", PARTICLE_SIZE );
+
 Particle *CParticleMgr::AllocParticle( int size )
 {
 	// Enforce max particle limit.
 	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
 		return NULL;
 		
-	Particle *pRet = (Particle *)malloc( size );
+	Particle *pRet = (Particle *)SmallObjectAllocator().Alloc( size, &s_ParticleAllocStats );
 	if ( pRet )
 		++m_nCurrentParticlesAllocated;
 
 	return pRet;
 }
 
-void CParticleMgr::FreeParticle( Particle *pParticle )
+void CParticleMgr::FreeParticle( Particle *pParticle, int size )
 {
 	Assert( m_nCurrentParticlesAllocated > 0 );
-	if ( pParticle )
-		--m_nCurrentParticlesAllocated;
-	
-	free( pParticle );
+	if ( !pParticle )
+		return;
+
+	--m_nCurrentParticlesAllocated;
+	SmallObjectAllocator().Free( pParticle, size, &s_ParticleAllocStats );
 }
 
 
@@ -659,7 +659,7 @@ public:
 	VMatrix&		GetModelView();
 
 	Particle		*AllocParticle( int size );
-	void			FreeParticle( Particle * );
+	void			FreeParticle( Particle *, int size );
 
 	PMaterialHandle	GetPMaterial( const char *pMaterialName );
 	IMaterial*		PMaterialToIMaterial( PMaterialHandle hMaterial );
@@ -29,6 +29,8 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Only score the rules whose required concept (or other required equality criterion) matches the query." );
+ConVar rr_querylog_record( "rr_querylog_record", "0", FCVAR_CHEAT, "Record every response rules query so rr_querylog_save can write them out for rr_querylog_bench." );
 
 static CUtlSymbolTable g_RS;
 
@@ -683,6 +685,15 @@ public:
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	float		GatherBestRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int > &bestrules );
+
+	// Compiled rule index. Rules are bucketed by one required equality
+	// criterion (preferably concept), so a query only scores the rules in the
+	// buckets its own values select, plus the rules that couldn't be bucketed.
+	void		BuildRuleIndex();
+	void		GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< short > &candidates );
+	int			FindCriterionIndex( const AI_CriteriaSet& set, int icriterion );
+	int			LookupCriterionName( const AI_CriteriaSet& set, int nameId );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -727,6 +738,21 @@ public:
 
 	CUtlVector< ScriptEntry >		m_ScriptStack;
 
+	bool							m_bRuleIndexDirty;
+	int								m_nIndexedRules;
+	CUtlDict< int, int >			m_RuleBuckets;			// "name\1value" -> index into m_RuleBucketRules
+	CUtlVector< CUtlVector< short > >	m_RuleBucketRules;	// Rule indices, ascending
+	CUtlVector< short >				m_UnindexedRules;		// Ascending
+	CUtlVector< int >				m_RuleKeyNames;			// Criterion names rules are bucketed by
+
+	// Criterion names are resolved against a query once, not once per rule
+	CUtlDict< int, int >			m_CriteriaNames;
+	CUtlVector< int >				m_CriteriaNameIds;		// Per criterion, -1 if unnamed
+	CUtlVector< int >				m_NameLookup;			// Per name, the set index found for the current query
+	CUtlVector< int >				m_NameLookupStamp;
+	int								m_nLookupStamp;
+	const AI_CriteriaSet			*m_pLookupSet;
+
 	friend class CDefaultResponseSystemSaveRestoreBlockHandler;
 	friend class CResponseSystemSaveRestoreOps;
 };
@@ -762,6 +788,10 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_bRuleIndexDirty = true;
+	m_nIndexedRules = 0;
+	m_nLookupStamp = 0;
+	m_pLookupSet = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +847,7 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -1164,7 +1195,7 @@ float CResponseSystem::ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& s
 
 	const char *actualValue = "";
 
-	int found = set.FindCriterionIndex( c->name );
+	int found = FindCriterionIndex( set, icriterion );
 	if ( found != -1 )
 	{
 		actualValue = set.GetValue( found );
@@ -1685,13 +1716,86 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose )
 {
 	CUtlVector< int >	bestrules;
+
+	// Debug output describes every rule, so it needs the full scan
+	bool bUseIndex = rr_ruleindex.GetBool() && !verbose && !rr_debugrule.GetString()[0];
+	GatherBestRules( set, verbose, bUseIndex, bestrules );
+
+	int bestCount = bestrules.Count();
+	if ( bestCount <= 0 )
+		return -1;
+
+	if ( bestCount == 1 )
+		return bestrules[ 0 ];
+
+	// Randomly pick one of the tied matching rules
+	int idx = random->RandomInt( 0, bestCount - 1 );
+	if ( verbose )
+	{
+		DevMsg( "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+	}
+	return bestrules[ idx ];
+}
+
+//-----------------------------------------------------------------------------
+// Query log, replayed by rr_querylog_bench. Each query is saved as a key per
+// criterion, plus a "$weights" key for criteria with a weight other than 1.
+//-----------------------------------------------------------------------------
+static KeyValues *s_pQueryLog = NULL;
+
+static void RecordResponseQuery( const AI_CriteriaSet& set )
+{
+	if ( !s_pQueryLog )
+	{
+		s_pQueryLog = new KeyValues( "queries" );
+	}
+
+	KeyValues *pQuery = s_pQueryLog->CreateNewKey();
+	KeyValues *pWeights = NULL;
+	for ( int i = 0; i < set.GetCount(); i++ )
+	{
+		pQuery->SetString( set.GetName( i ), set.GetValue( i ) );
+		if ( set.GetWeight( i ) != 1.0f )
+		{
+			if ( !pWeights )
+			{
+				pWeights = pQuery->FindKey( "$weights", true );
+			}
+			pWeights->SetFloat( set.GetName( i ), set.GetWeight( i ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Scores the rules and collects every rule that ties for the best
+//			score, in rule order. The index only skips rules that would have
+//			scored zero, so both paths produce the same list.
+// Output : The best score, or 0 if nothing matched
+//-----------------------------------------------------------------------------
+float CResponseSystem::GatherBestRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int > &bestrules )
+{
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
+	if ( m_bRuleIndexDirty || m_nIndexedRules != m_Rules.Count() || m_CriteriaNameIds.Count() != m_Criteria.Count() )
+	{
+		BuildRuleIndex();
+	}
+
+	m_pLookupSet = &set;
+	m_nLookupStamp++;
+
+	CUtlVector< short > candidates;
+	if ( bUseIndex )
+	{
+		GetCandidateRules( set, candidates );
+	}
+
+	int c = bUseIndex ? candidates.Count() : m_Rules.Count();
 	int i;
 	for ( i = 0; i < c; i++ )
 	{
-		float score = ScoreCriteriaAgainstRule( set, i, verbose );
+		int irule = bUseIndex ? candidates[ i ] : i;
+		float score = ScoreCriteriaAgainstRule( set, irule, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
 		{
@@ -1703,24 +1807,161 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 			}
 
 			// Add to bucket
-			bestrules.AddToTail( i );
+			bestrules.AddToTail( irule );
 		}
 	}
 
-	int bestCount = bestrules.Count();
-	if ( bestCount <= 0 )
-		return -1;
+	m_pLookupSet = NULL;
+	return bestrules.Count() ? bestscore : 0.0f;
+}
 
-	if ( bestCount == 1 )
-		return bestrules[ 0 ];
+//-----------------------------------------------------------------------------
+// Purpose: Finds a criterion's value in a query, resolving each criterion
+//			name against the set at most once per query
+//-----------------------------------------------------------------------------
+int CResponseSystem::FindCriterionIndex( const AI_CriteriaSet& set, int icriterion )
+{
+	if ( &set != m_pLookupSet || icriterion >= m_CriteriaNameIds.Count() || m_CriteriaNameIds[ icriterion ] < 0 )
+		return set.FindCriterionIndex( m_Criteria[ icriterion ].name );
 
-	// Randomly pick one of the tied matching rules
-	int idx = random->RandomInt( 0, bestCount - 1 );
-	if ( verbose )
+	return LookupCriterionName( set, m_CriteriaNameIds[ icriterion ] );
+}
+
+int CResponseSystem::LookupCriterionName( const AI_CriteriaSet& set, int nameId )
+{
+	if ( m_NameLookupStamp[ nameId ] != m_nLookupStamp )
 	{
-		DevMsg( "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+		m_NameLookupStamp[ nameId ] = m_nLookupStamp;
+		m_NameLookup[ nameId ] = set.FindCriterionIndex( m_CriteriaNames.GetElementName( nameId ) );
+	}
+	return m_NameLookup[ nameId ];
+}
+
+static int __cdecl CompareRuleIndices( const short *a, const short *b )
+{
+	return (int)*a - (int)*b;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the rules. A rule can only score above zero if all of its
+//			required criteria match, so a rule with a required, case
+//			insensitive string equality criterion only needs scoring when the
+//			query has that value. Numeric, ranged and negated criteria and
+//			subcriteria can't be bucketed this way.
+//-----------------------------------------------------------------------------
+void CResponseSystem::BuildRuleIndex()
+{
+	m_bRuleIndexDirty = false;
+	m_nIndexedRules = m_Rules.Count();
+
+	m_RuleBuckets.RemoveAll();
+	m_RuleBucketRules.Purge();
+	m_UnindexedRules.RemoveAll();
+	m_RuleKeyNames.RemoveAll();
+	m_CriteriaNames.RemoveAll();
+	m_CriteriaNameIds.RemoveAll();
+
+	int nCriteria = m_Criteria.Count();
+	m_CriteriaNameIds.EnsureCount( nCriteria );
+	for ( int i = 0; i < nCriteria; i++ )
+	{
+		const char *pszName = m_Criteria[ i ].name;
+		if ( !pszName || m_Criteria[ i ].IsSubCriteriaType() )
+		{
+			m_CriteriaNameIds[ i ] = -1;
+			continue;
+		}
+
+		int idx = m_CriteriaNames.Find( pszName );
+		if ( idx == m_CriteriaNames.InvalidIndex() )
+		{
+			idx = m_CriteriaNames.Insert( pszName, m_CriteriaNames.Count() );
+		}
+		m_CriteriaNameIds[ i ] = m_CriteriaNames[ idx ];
+	}
+
+	int nNames = m_CriteriaNames.Count();
+	m_NameLookup.SetCount( nNames );
+	m_NameLookupStamp.SetCount( nNames );
+	for ( int i = 0; i < nNames; i++ )
+	{
+		m_NameLookupStamp[ i ] = m_nLookupStamp - 1;
+	}
+
+	char key[ 512 ];
+	int nRules = m_Rules.Count();
+	for ( int irule = 0; irule < nRules; irule++ )
+	{
+		Rule *rule = &m_Rules[ irule ];
+
+		int ikey = -1;
+		for ( int i = 0; i < rule->m_Criteria.Count(); i++ )
+		{
+			int icriterion = rule->m_Criteria[ i ];
+			Criteria *c = &m_Criteria[ icriterion ];
+			Matcher &m = c->matcher;
+			if ( !c->required || m_CriteriaNameIds[ icriterion ] < 0 )
+				continue;
+			if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax || !m.GetToken()[0] )
+				continue;
+
+			// Concept is on every query and splits the rules the finest
+			if ( ikey == -1 || !Q_stricmp( c->name, "concept" ) )
+			{
+				ikey = icriterion;
+			}
+		}
+
+		if ( ikey == -1 )
+		{
+			m_UnindexedRules.AddToTail( irule );
+			continue;
+		}
+
+		int nameId = m_CriteriaNameIds[ ikey ];
+		if ( m_RuleKeyNames.Find( nameId ) == m_RuleKeyNames.InvalidIndex() )
+		{
+			m_RuleKeyNames.AddToTail( nameId );
+		}
+
+		Q_snprintf( key, sizeof( key ), "%s\1%s", m_CriteriaNames.GetElementName( nameId ), m_Criteria[ ikey ].matcher.GetToken() );
+		int bucket = m_RuleBuckets.Find( key );
+		if ( bucket == m_RuleBuckets.InvalidIndex() )
+		{
+			bucket = m_RuleBuckets.Insert( key, m_RuleBucketRules.AddToTail() );
+		}
+		m_RuleBucketRules[ m_RuleBuckets[ bucket ] ].AddToTail( irule );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the rules that can match a query, in rule order
+//-----------------------------------------------------------------------------
+void CResponseSystem::GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< short > &candidates )
+{
+	candidates.AddVectorToTail( m_UnindexedRules );
+
+	char key[ 512 ];
+	for ( int i = 0; i < m_RuleKeyNames.Count(); i++ )
+	{
+		int nameId = m_RuleKeyNames[ i ];
+		int found = LookupCriterionName( set, nameId );
+		if ( found == -1 )
+			continue;
+
+		Q_snprintf( key, sizeof( key ), "%s\1%s", m_CriteriaNames.GetElementName( nameId ), set.GetValue( found ) );
+		int bucket = m_RuleBuckets.Find( key );
+		if ( bucket != m_RuleBuckets.InvalidIndex() )
+		{
+			candidates.AddVectorToTail( m_RuleBucketRules[ m_RuleBuckets[ bucket ] ] );
+		}
+	}
+
+	// Every rule is in exactly one list, so sorting restores rule order
+	if ( candidates.Count() > m_UnindexedRules.Count() )
+	{
+		candidates.Sort( CompareRuleIndices );
 	}
-	return bestrules[ idx ];
 }
 
 //-----------------------------------------------------------------------------
@@ -1732,6 +1973,11 @@ bool CResponseSystem::FindBestResponse( const AI_CriteriaSet& set, AI_Response&
 {
 	bool valid = false;
 
+	if ( rr_querylog_record.GetBool() )
+	{
+		RecordResponseQuery( set );
+	}
+
 	int iDbgResponse = rr_debugresponses.GetInt();
 	bool showRules = ( iDbgResponse == 2 );
 	bool showResult = ( iDbgResponse == 1 || iDbgResponse == 2 );
@@ -3051,6 +3297,131 @@ CON_COMMAND( rr_reloadresponsesystems, "Reload all response system scripts." )
 #endif
 }
 
+CON_COMMAND( rr_querylog_save, "Writes the queries recorded while rr_querylog_record was set to a file and clears the log. Usage: rr_querylog_save <file>" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: rr_querylog_save <file>\n" );
+		return;
+	}
+
+	if ( !s_pQueryLog )
+	{
+		Msg( "No queries recorded; set rr_querylog_record 1 first\n" );
+		return;
+	}
+
+	int count = 0;
+	for ( KeyValues *pQuery = s_pQueryLog->GetFirstTrueSubKey(); pQuery; pQuery = pQuery->GetNextTrueSubKey() )
+	{
+		count++;
+	}
+
+	if ( s_pQueryLog->SaveToFile( filesystem, args[1], "MOD" ) )
+	{
+		Msg( "Saved %d queries to %s\n", count, args[1] );
+	}
+	else
+	{
+		Warning( "Couldn't write %s\n", args[1] );
+	}
+
+	s_pQueryLog->deleteThis();
+	s_pQueryLog = NULL;
+}
+
+CON_COMMAND( rr_querylog_bench, "Replays a query log against the default response system with and without the rule index. Usage: rr_querylog_bench <file> [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: rr_querylog_bench <file> [iterations]\n" );
+		return;
+	}
+
+	int iterations = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 10;
+
+	KeyValues *pLog = new KeyValues( "queries" );
+	if ( !pLog->LoadFromFile( filesystem, args[1], "MOD" ) )
+	{
+		Warning( "Couldn't load %s\n", args[1] );
+		pLog->deleteThis();
+		return;
+	}
+
+	CUtlVector< AI_CriteriaSet > sets;
+	for ( KeyValues *pQuery = pLog->GetFirstTrueSubKey(); pQuery; pQuery = pQuery->GetNextTrueSubKey() )
+	{
+		AI_CriteriaSet &set = sets[ sets.AddToTail() ];
+		KeyValues *pWeights = pQuery->FindKey( "$weights" );
+		for ( KeyValues *pValue = pQuery->GetFirstValue(); pValue; pValue = pValue->GetNextValue() )
+		{
+			float weight = pWeights ? pWeights->GetFloat( pValue->GetName(), 1.0f ) : 1.0f;
+			set.AppendCriteria( pValue->GetName(), pValue->GetString(), weight );
+		}
+	}
+	pLog->deleteThis();
+
+	if ( !sets.Count() )
+	{
+		Msg( "%s has no queries\n", args[1] );
+		return;
+	}
+
+	// Check that both paths pick from the same rules before timing them
+	int mismatches = 0;
+	int candidates = 0;
+	CUtlVector< int > scanRules, indexRules;
+	CUtlVector< short > candidateRules;
+	for ( int i = 0; i < sets.Count(); i++ )
+	{
+		scanRules.RemoveAll();
+		indexRules.RemoveAll();
+		float scanScore = defaultresponsesytem.GatherBestRules( sets[i], false, false, scanRules );
+		float indexScore = defaultresponsesytem.GatherBestRules( sets[i], false, true, indexRules );
+		if ( scanScore != indexScore || scanRules.Count() != indexRules.Count() ||
+			V_memcmp( scanRules.Base(), indexRules.Base(), scanRules.Count() * sizeof( int ) ) )
+		{
+			mismatches++;
+		}
+
+		candidateRules.RemoveAll();
+		defaultresponsesytem.GetCandidateRules( sets[i], candidateRules );
+		candidates += candidateRules.Count();
+	}
+
+	double flTime[2];
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		CFastTimer timer;
+		timer.Start();
+		for ( int iter = 0; iter < iterations; iter++ )
+		{
+			for ( int i = 0; i < sets.Count(); i++ )
+			{
+				scanRules.RemoveAll();
+				defaultresponsesytem.GatherBestRules( sets[i], false, pass == 1, scanRules );
+			}
+		}
+		timer.End();
+		flTime[pass] = timer.GetDuration().GetMicrosecondsF() / ( (double)iterations * sets.Count() );
+	}
+
+	Msg( "%d queries x %d iterations, %d rules, %.1f candidates per query on average\n",
+		sets.Count(), iterations, defaultresponsesytem.m_Rules.Count(), (float)candidates / sets.Count() );
+	Msg( "  full scan   %8.2f us/query\n", flTime[0] );
+	Msg( "  rule index  %8.2f us/query (%.1fx)\n", flTime[1], flTime[0] / MAX( flTime[1], 1e-6 ) );
+	if ( mismatches )
+	{
+		Warning( "  %d queries chose from different rules!\n", mismatches );
+	}
+}
+
 static short RESPONSESYSTEM_SAVE_RESTORE_VERSION = 1;
 
 // note:  this won't save/restore settings from instanced response systems.  Could add that with a CDefSaveRestoreOps implementation if needed
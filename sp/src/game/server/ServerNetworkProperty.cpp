@@ -9,6 +9,7 @@
 #include "ServerNetworkProperty.h"
 #include "tier0/dbg.h"
 #include "gameinterface.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -16,6 +17,243 @@
 extern CTimedEventMgr g_NetworkPropertyEventMgr;
 
 
+//-----------------------------------------------------------------------------
+// Per-cluster index of networked entities.  Each cluster that has entities
+// touching it owns a bucket with one bit per edict; buckets change only when
+// an entity's cluster list is rebuilt.  Entities that touch too many clusters
+// (headnode entities) are left out and tested the old way.
+//-----------------------------------------------------------------------------
+#define TRANSMIT_VISIBLE_CACHE	4
+
+struct ALIGN16 TransmitBits_t
+{
+	fltx4 m_Bits[ MAX_EDICTS / 128 ];
+
+	FORCEINLINE uint32 *Words() { return (uint32 *)m_Bits; }
+	FORCEINLINE const uint32 *Words() const { return (const uint32 *)m_Bits; }
+
+	FORCEINLINE bool IsBitSet( int i ) const { return ( Words()[ i >> 5 ] & ( 1 << ( i & 31 ) ) ) != 0; }
+	FORCEINLINE void Set( int i ) { Words()[ i >> 5 ] |= ( 1 << ( i & 31 ) ); }
+	FORCEINLINE void Clear( int i ) { Words()[ i >> 5 ] &= ~( 1 << ( i & 31 ) ); }
+
+	FORCEINLINE void ClearAll()
+	{
+		for ( int i = 0; i < ARRAYSIZE( m_Bits ); i++ )
+		{
+			m_Bits[i] = Four_Zeros;
+		}
+	}
+
+	FORCEINLINE void Or( const TransmitBits_t &src )
+	{
+		for ( int i = 0; i < ARRAYSIZE( m_Bits ); i++ )
+		{
+			m_Bits[i] = OrSIMD( m_Bits[i], src.m_Bits[i] );
+		}
+	}
+} ALIGN16_POST;
+
+COMPILE_TIME_ASSERT( ( MAX_EDICTS % 128 ) == 0 );
+
+// The entities touching any cluster of one PVS
+struct ALIGN16 TransmitVisibleSet_t
+{
+	TransmitBits_t	m_Entities;
+	uint64			m_nGeneration;		// index generation it was built from, 0 if unused
+	int				m_nPVSSize;
+	byte			m_PVS[ PAD_NUMBER( MAX_MAP_CLUSTERS, 8 ) / 8 ];
+} ALIGN16_POST;
+
+class CTransmitClusterIndex
+{
+public:
+	CTransmitClusterIndex();
+	~CTransmitClusterIndex();
+
+	void Update( int iEdict, const PVSInfo_t &info );
+	void Remove( int iEdict );
+
+	// Entities touching a cluster in pInfo's PVS; clients with the same PVS share the result
+	const TransmitVisibleSet_t *FindVisible( const CCheckTransmitInfo *pInfo );
+
+	// Generation of the last change to this edict's clusters
+	uint64 EntityGeneration( int iEdict ) const { return m_EntityGeneration[iEdict]; }
+
+private:
+	TransmitBits_t *Bucket( int nCluster );
+
+	CUtlVector< TransmitBits_t * > m_Buckets;
+	CUtlVector< unsigned short > m_EntityClusters[MAX_EDICTS];
+	uint64 m_EntityGeneration[MAX_EDICTS];
+	uint64 m_nGeneration;
+
+	TransmitVisibleSet_t m_Visible[TRANSMIT_VISIBLE_CACHE];
+	int m_nNextVisible;
+};
+
+static CTransmitClusterIndex g_TransmitClusterIndex;
+
+CTransmitClusterIndex::CTransmitClusterIndex()
+{
+	memset( m_EntityGeneration, 0, sizeof( m_EntityGeneration ) );
+	m_nGeneration = 1;
+	for ( int i = 0; i < TRANSMIT_VISIBLE_CACHE; i++ )
+	{
+		m_Visible[i].m_nGeneration = 0;
+	}
+	m_nNextVisible = 0;
+}
+
+CTransmitClusterIndex::~CTransmitClusterIndex()
+{
+	for ( int i = 0; i < m_Buckets.Count(); i++ )
+	{
+		if ( m_Buckets[i] )
+		{
+			MemAlloc_FreeAligned( m_Buckets[i] );
+		}
+	}
+}
+
+TransmitBits_t *CTransmitClusterIndex::Bucket( int nCluster )
+{
+	if ( nCluster >= m_Buckets.Count() )
+	{
+		int nOldCount = m_Buckets.Count();
+		m_Buckets.AddMultipleToTail( nCluster + 1 - nOldCount );
+		for ( int i = nOldCount; i < m_Buckets.Count(); i++ )
+		{
+			m_Buckets[i] = NULL;
+		}
+	}
+
+	if ( !m_Buckets[nCluster] )
+	{
+		m_Buckets[nCluster] = (TransmitBits_t *)MemAlloc_AllocAligned( sizeof( TransmitBits_t ), 16 );
+		m_Buckets[nCluster]->ClearAll();
+	}
+	return m_Buckets[nCluster];
+}
+
+void CTransmitClusterIndex::Remove( int iEdict )
+{
+	CUtlVector< unsigned short > &clusters = m_EntityClusters[iEdict];
+	if ( !clusters.Count() )
+		return;
+
+	for ( int i = 0; i < clusters.Count(); i++ )
+	{
+		m_Buckets[ clusters[i] ]->Clear( iEdict );
+	}
+	clusters.RemoveAll();
+	m_EntityGeneration[iEdict] = ++m_nGeneration;
+}
+
+void CTransmitClusterIndex::Update( int iEdict, const PVSInfo_t &info )
+{
+	Remove( iEdict );
+
+	if ( info.m_nClusterCount <= 0 )
+		return;
+
+	CUtlVector< unsigned short > &clusters = m_EntityClusters[iEdict];
+	for ( int i = 0; i < info.m_nClusterCount; i++ )
+	{
+		Bucket( info.m_pClusters[i] )->Set( iEdict );
+		clusters.AddToTail( info.m_pClusters[i] );
+	}
+	m_EntityGeneration[iEdict] = ++m_nGeneration;
+}
+
+const TransmitVisibleSet_t *CTransmitClusterIndex::FindVisible( const CCheckTransmitInfo *pInfo )
+{
+	for ( int i = 0; i < TRANSMIT_VISIBLE_CACHE; i++ )
+	{
+		const TransmitVisibleSet_t &visible = m_Visible[i];
+		if ( visible.m_nGeneration == m_nGeneration && visible.m_nPVSSize == pInfo->m_nPVSSize &&
+			 !memcmp( visible.m_PVS, pInfo->m_PVS, pInfo->m_nPVSSize ) )
+		{
+			return &visible;
+		}
+	}
+
+	TransmitVisibleSet_t &visible = m_Visible[m_nNextVisible];
+	m_nNextVisible = ( m_nNextVisible + 1 ) % TRANSMIT_VISIBLE_CACHE;
+
+	visible.m_nGeneration = m_nGeneration;
+	visible.m_nPVSSize = pInfo->m_nPVSSize;
+	memcpy( visible.m_PVS, pInfo->m_PVS, pInfo->m_nPVSSize );
+	visible.m_Entities.ClearAll();
+
+	int nBytes = MIN( pInfo->m_nPVSSize, ( m_Buckets.Count() + 7 ) >> 3 );
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		int nBits = pInfo->m_PVS[i];
+		while ( nBits )
+		{
+			int nCluster = FirstBitInWord( nBits, i << 3 );
+			nBits &= nBits - 1;
+
+			if ( nCluster < m_Buckets.Count() && m_Buckets[nCluster] )
+			{
+				visible.m_Entities.Or( *m_Buckets[nCluster] );
+			}
+		}
+	}
+
+	return &visible;
+}
+
+
+//-----------------------------------------------------------------------------
+// CTransmitVisibility
+//-----------------------------------------------------------------------------
+void CTransmitVisibility::Init( const CCheckTransmitInfo *pInfo )
+{
+	m_pInfo = pInfo;
+	m_pVisible = g_TransmitClusterIndex.FindVisible( pInfo );
+	memset( m_AreaVisible, -1, sizeof( m_AreaVisible ) );
+}
+
+bool CTransmitVisibility::IsAreaVisible( int nArea )
+{
+	if ( m_AreaVisible[nArea] < 0 )
+	{
+		m_AreaVisible[nArea] = 0;
+		for ( int i = 0; i < m_pInfo->m_AreasNetworked; i++ )
+		{
+			int clientArea = m_pInfo->m_Areas[i];
+			if ( clientArea == nArea || engine->CheckAreasConnected( clientArea, nArea ) )
+			{
+				m_AreaVisible[nArea] = 1;
+				break;
+			}
+		}
+	}
+	return m_AreaVisible[nArea] != 0;
+}
+
+bool CTransmitVisibility::IsInPVS( CServerNetworkProperty *pNetProp, int iEdict )
+{
+	const PVSInfo_t &info = pNetProp->m_PVSInfo;
+
+	// Headnode entities, entities whose clusters changed after the visible set
+	// was built, and out of range areas take the per-entity test
+	if ( info.m_nClusterCount < 0 ||
+		 g_TransmitClusterIndex.EntityGeneration( iEdict ) > m_pVisible->m_nGeneration ||
+		 (unsigned)info.m_nAreaNum >= MAX_MAP_AREAS || (unsigned)info.m_nAreaNum2 >= MAX_MAP_AREAS )
+	{
+		return pNetProp->IsInPVS( m_pInfo );
+	}
+
+	if ( !m_pVisible->m_Entities.IsBitSet( iEdict ) )
+		return false;
+
+	// doors can legally straddle two areas
+	return IsAreaVisible( info.m_nAreaNum ) || ( info.m_nAreaNum2 && IsAreaVisible( info.m_nAreaNum2 ) );
+}
+
+
 //-----------------------------------------------------------------------------
 // Save/load
 //-----------------------------------------------------------------------------
@@ -47,6 +285,7 @@ CServerNetworkProperty::~CServerNetworkProperty()
 		m_pTransmitProxy->Release();
 	}*/
 
+	RemoveFromTransmitClusterIndex();
 	engine->CleanUpEntityClusterList( &m_PVSInfo );
 
 	// remove the attached edict if it exists
@@ -90,6 +329,7 @@ void CServerNetworkProperty::DetachEdict()
 {
 	if ( m_pPev )
 	{
+		RemoveFromTransmitClusterIndex();
 		m_pPev->SetEdict( NULL, false );
 		engine->RemoveEdict( m_pPev );
 		m_pPev = NULL;
@@ -144,6 +384,15 @@ void CServerNetworkProperty::RecomputePVSInformation()
 	{
 		m_pPev->m_fStateFlags &= ~FL_EDICT_DIRTY_PVS_INFORMATION;
 		engine->BuildEntityClusterList( edict(), &m_PVSInfo );
+		g_TransmitClusterIndex.Update( entindex(), m_PVSInfo );
+	}
+}
+
+void CServerNetworkProperty::RemoveFromTransmitClusterIndex()
+{
+	if ( m_pPev )
+	{
+		g_TransmitClusterIndex.Remove( entindex() );
 	}
 }
 
@@ -104,6 +104,9 @@ public:
 private:
 	// Detaches the edict.. should only be called by CBaseNetworkable's destructor.
 	void DetachEdict();
+
+	// Drops this entity's clusters from the transmit cluster index
+	void RemoveFromTransmitClusterIndex();
 	CBaseEntity *GetOuter();
 
 	// Marks the networkable that it will should transmit
@@ -125,6 +128,30 @@ private:
 	bool m_bPendingStateChange : 1;
 
 //	friend class CBaseTransmitProxy;
+	friend class CTransmitVisibility;
+};
+
+
+//-----------------------------------------------------------------------------
+// Answers CServerNetworkProperty::IsInPVS( pInfo ) for one client from the
+// per-cluster entity index: the buckets of every cluster in the client's PVS
+// are OR'd together once (and shared with other clients that have the same
+// PVS), then each entity is a bit test plus a cached area lookup.
+//-----------------------------------------------------------------------------
+struct TransmitVisibleSet_t;
+
+class CTransmitVisibility
+{
+public:
+	void Init( const CCheckTransmitInfo *pInfo );
+	bool IsInPVS( CServerNetworkProperty *pNetProp, int iEdict );
+
+private:
+	bool IsAreaVisible( int nArea );
+
+	const CCheckTransmitInfo *m_pInfo;
+	const TransmitVisibleSet_t *m_pVisible;
+	signed char m_AreaVisible[MAX_MAP_AREAS];
 };
 
 
@@ -244,7 +271,10 @@ inline const edict_t *CServerNetworkProperty::edict() const
 //-----------------------------------------------------------------------------
 inline void CServerNetworkProperty::SetEdict( edict_t *pEdict )
 {
+	// the transmit cluster index is keyed by edict, so register again under the new one
+	RemoveFromTransmitClusterIndex();
 	m_pPev = pEdict;
+	MarkPVSInformationDirty();
 }
 
 
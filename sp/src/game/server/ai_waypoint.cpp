@@ -14,13 +14,11 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
-#define	WAYPOINT_POOL_SIZE 512
-
 //-----------------------------------------------------------------------------
 // Init static variables
 //-----------------------------------------------------------------------------
 
-DEFINE_FIXEDSIZE_ALLOCATOR( AI_Waypoint_t, WAYPOINT_POOL_SIZE, CUtlMemoryPool::GROW_FAST );
+DEFINE_SMALLOBJECT_ALLOCATOR( AI_Waypoint_t );
 
 //-------------------------------------
 
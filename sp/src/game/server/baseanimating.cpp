@@ -287,6 +287,7 @@ CBaseAnimating::CBaseAnimating()
 	m_nNewSequenceParity = 0;
 	m_nResetEventsParity = 0;
 	m_boneCacheHandle = 0;
+	m_pHitboxBVH = NULL;
 	m_pStudioHdr = NULL;
 	m_fadeMinDist = 0;
 	m_fadeMaxDist = 0;
@@ -301,6 +302,7 @@ CBaseAnimating::CBaseAnimating()
 CBaseAnimating::~CBaseAnimating()
 {
 	Studio_DestroyBoneCache( m_boneCacheHandle );
+	delete m_pHitboxBVH;
 	delete m_pIk;
 	UnlockStudioHdr();
 	delete m_pStudioHdr;
@@ -2742,7 +2744,18 @@ bool CBaseAnimating::TestHitboxes( const Ray_t &ray, unsigned int fContentsMask,
 	matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
 	pcache->ReadCachedBonePointers( hitboxbones, pStudioHdr->numbones() );
 
-	if ( TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, GetAbsOrigin(), GetModelScale(), tr ) )
+	CHitboxBVH *pBVH = NULL;
+	if ( CHitboxBVH::IsEnabled() )
+	{
+		if ( !m_pHitboxBVH )
+		{
+			m_pHitboxBVH = new CHitboxBVH;
+		}
+		m_pHitboxBVH->Update( pStudioHdr, set, hitboxbones, pcache->m_nSerial );
+		pBVH = m_pHitboxBVH;
+	}
+
+	if ( TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, GetAbsOrigin(), GetModelScale(), tr, pBVH ) )
 	{
 		mstudiobbox_t *pbox = set->pHitbox( tr.hitbox );
 		mstudiobone_t *pBone = pStudioHdr->pBone(pbox->bone);
@@ -492,6 +492,7 @@ public:
 	MoveType_t				GetMoveType() const;
 	MoveCollide_t			GetMoveCollide() const;
 	void					SetMoveType( MoveType_t val, MoveCollide_t moveCollide = MOVECOLLIDE_DEFAULT );
+	void					ApplyMoveType( void );
 	void					SetMoveCollide( MoveCollide_t val );
 
 	// Returns the entity-to-world transform
@@ -1271,6 +1272,7 @@ public:
 	bool					GetCheckUntouch() const;
 
 	void					SetGroundEntity( CBaseEntity *ground );
+	void					UpdateGroundLinks( CBaseEntity *oldGround, CBaseEntity *ground );
 	CBaseEntity				*GetGroundEntity( void );
 	CBaseEntity				*GetGroundEntity( void ) const { return const_cast<CBaseEntity *>(this)->GetGroundEntity(); }
 
@@ -15,6 +15,7 @@
 
 #include "baseentity.h"
 #include "entitylist.h"
+#include "tier1/smallobjectallocator.h"
 
 //-----------------------------------------------------------------------------
 // Purpose: Used to request a value, or a set of values, from a set of entities.
@@ -32,11 +33,7 @@ public:
 		int	outputID;		// the ID number of the output that sent this
 		inputitem_t *next;
 
-		// allocate and free from MPool memory
-		static void *operator new( size_t stAllocBlock );	
-		static void *operator new( size_t stAllocateBlock, int nBlockUse, const char *pFileName, int nLine );
-		static void operator delete( void *pMem );
-		static void operator delete( void *pMem, int nBlockUse, const char *pFileName, int nLine ) { operator delete(pMem); }
+		DECLARE_SMALLOBJECT_ALLOCATOR( inputitem_t );
 	};
 
 	inputitem_t *m_InputList;	// list of data
@@ -15,6 +15,7 @@
 
 
 #include "baseentity.h"
+#include "tier1/smallobjectallocator.h"
 
 
 #define EVENT_FIRE_ALWAYS	-1
@@ -42,13 +43,9 @@ public:
 
 	CEventAction *m_pNext; 
 
-	// allocates memory from engine.MPool/g_EntityListPool
-	static void *operator new( size_t stAllocateBlock );
-	static void *operator new( size_t stAllocateBlock, int nBlockUse, const char *pFileName, int nLine );
-	static void operator delete( void *pMem );
-	static void operator delete( void *pMem , int nBlockUse, const char *pFileName, int nLine ) { operator delete(pMem); }
-
 	DECLARE_SIMPLE_DATADESC();
+
+	DECLARE_SMALLOBJECT_ALLOCATOR( CEventAction );
 };
 
 
@@ -14,7 +14,7 @@
 #pragma once
 #endif
 
-#include "mempool.h"
+#include "tier1/smallobjectallocator.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -33,7 +33,7 @@ struct EventQueuePrioritizedEvent_t
 
 	DECLARE_SIMPLE_DATADESC();
 
-	DECLARE_FIXEDSIZE_ALLOCATOR( PrioritizedEvent_t );
+	DECLARE_SMALLOBJECT_ALLOCATOR( EventQueuePrioritizedEvent_t );
 };
 
 class CEventQueue
@@ -89,6 +89,7 @@
 #include "tier3/tier3.h"
 #include "serverbenchmark_base.h"
 #include "querycache.h"
+#include "sendtable_plan.h"
 
 #ifdef GRID_DLL
 #include "grid_utils.h"
@@ -212,6 +213,7 @@ static ConVar s_UseNetworkVars( "UseNetworkVars", "1", FCVAR_CHEAT, "For profili
 extern ConVar sv_noclipduringpause;
 ConVar sv_massreport( "sv_massreport", "0" );
 ConVar sv_force_transmit_ents( "sv_force_transmit_ents", "0", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Will transmit all entities to client, regardless of PVS conditions (will still skip based on transmit flags, however)." );
+ConVar sv_transmit_clusterindex( "sv_transmit_clusterindex", "1", 0, "Test entity PVS visibility in CheckTransmit against the per-cluster entity index." );
 
 ConVar sv_autosave( "sv_autosave", "1", 0, "Set to 1 to autosave game on level transition. Does not affect autosave triggers." );
 ConVar *sv_maxreplay = NULL;
@@ -1316,6 +1318,9 @@ void CServerGameDLL::PreClientUpdate( bool simulating )
 	
 	IGameSystem::PreClientUpdateAllSystems();
 
+	// Runs last so it sees every change the systems above made
+	SendTablePlan_PreClientUpdate();
+
 #ifdef _DEBUG
 	if ( sv_showhitboxes.GetInt() == -1 )
 		return;
@@ -2447,6 +2452,29 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 		    bIsReplay == ( pInfo->m_pTransmitAlways != NULL) );
 #endif
 
+	// Build the client's visible entity set from the cluster index.  Cluster
+	// lists are rebuilt first so the index is current for every entity that
+	// may get a PVS test.
+	CTransmitVisibility visibility;
+	bool bUseClusterIndex = sv_transmit_clusterindex.GetBool();
+#ifndef _X360
+	bUseClusterIndex = bUseClusterIndex && !bIsHLTV && !bIsReplay;
+#endif
+	if ( bUseClusterIndex )
+	{
+		for ( int i=0; i < nEdicts; i++ )
+		{
+			edict_t *pEdict = &pBaseEdict[ pEdictIndices[i] ];
+			int nFlags = pEdict->m_fStateFlags;
+			if ( ( nFlags & FL_EDICT_DIRTY_PVS_INFORMATION ) && ( nFlags & (FL_EDICT_PVSCHECK|FL_EDICT_FULLCHECK) ) && !( nFlags & FL_EDICT_DONTSEND ) )
+			{
+				static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() )->RecomputePVSInformation();
+			}
+		}
+
+		visibility.Init( pInfo );
+	}
+
 	for ( int i=0; i < nEdicts; i++ )
 	{
 		int iEdict = pEdictIndices[i];
@@ -2541,7 +2569,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			continue;
 		}
 
-		bool bInPVS = netProp->IsInPVS( pInfo );
+		bool bInPVS = bUseClusterIndex ? visibility.IsInPVS( netProp, iEdict ) : netProp->IsInPVS( pInfo );
 		if ( bInPVS || sv_force_transmit_ents.GetBool() )
 		{
 			// only send if entity is in PVS
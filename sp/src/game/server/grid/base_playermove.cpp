@@ -15,4 +15,14 @@ static CPlayerMove g_PlayerMove;
 CPlayerMove *PlayerMove()
 {
 	return &g_PlayerMove;
-}
\ No newline at end of file
+}
+
+CPlayerMove *CreatePlayerMove()
+{
+	return new CPlayerMove;
+}
+
+CMoveData *CreatePlayerMoveData()
+{
+	return new CMoveData;
+}
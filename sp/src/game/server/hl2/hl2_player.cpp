@@ -45,6 +45,7 @@
 #include "eventqueue.h"
 #include "gamestats.h"
 #include "filters.h"
+#include "func_ladder.h"
 #include "tier0/icommandline.h"
 
 #ifdef HL2_EPISODIC
@@ -1103,6 +1104,41 @@ void CHL2_Player::PlayerRunCommand(CUserCmd *ucmd, IMoveHelper *moveHelper)
 	BaseClass::PlayerRunCommand( ucmd, moveHelper );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Ladder movement mounts, dismounts and spawns reserved spots, so
+//			keep players that are on or could reach a ladder this command on
+//			the serial path.
+//-----------------------------------------------------------------------------
+bool CHL2_Player::CanRunUserCmdInParallel( void )
+{
+	if ( !BaseClass::CanRunUserCmdInParallel() )
+		return false;
+
+	if ( m_HL2Local.m_hLadder.Get() || m_HL2Local.m_LadderMove.m_bForceLadderMove )
+		return false;
+
+	// CHL2GameMovement::LadderMove looks for ladders within 64 units
+	float flReach = 64.0f + ( GetAbsVelocity().Length() + MaxSpeed() ) * TICK_INTERVAL + GetStepSize();
+	float flReachSqr = flReach * flReach;
+
+	int nLadders = CFuncLadder::GetLadderCount();
+	for ( int i = 0; i < nLadders; i++ )
+	{
+		CFuncLadder *pLadder = CFuncLadder::GetLadder( i );
+		if ( !pLadder->IsEnabled() )
+			continue;
+
+		Vector vecTop, vecBottom, vecClosest;
+		pLadder->GetTopPosition( vecTop );
+		pLadder->GetBottomPosition( vecBottom );
+		CalcClosestPointOnLineSegment( GetAbsOrigin(), vecBottom, vecTop, vecClosest, NULL );
+		if ( GetAbsOrigin().DistToSqr( vecClosest ) < flReachSqr )
+			return false;
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Sets HL2 specific defaults.
 //-----------------------------------------------------------------------------
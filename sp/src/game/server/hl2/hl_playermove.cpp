@@ -60,6 +60,16 @@ CPlayerMove *PlayerMove()
 static CHLMoveData g_HLMoveData;
 CMoveData *g_pMoveData = &g_HLMoveData;
 
+CPlayerMove *CreatePlayerMove()
+{
+	return new CHLPlayerMove;
+}
+
+CMoveData *CreatePlayerMoveData()
+{
+	return new CHLMoveData;
+}
+
 IPredictionSystem *IPredictionSystem::g_pPredictionSystems = NULL;
 
 void CHLPlayerMove::SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *pHelper, CMoveData *move )
@@ -13,6 +13,7 @@
 #include "movehelper_server.h"
 #include "shake.h"				// For screen fade constants
 #include "engine/IEngineSound.h"
+#include "player_parallelmove.h"
 
 //=============================================================================
 // HPE_BEGIN
@@ -167,6 +168,14 @@ char const* CMoveHelperServer::GetName( EntityHandle_t handle ) const
 
 void CMoveHelperServer::ResetTouchList( void )
 {
+	// Movement running on a worker thread records into its own list
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->ResetTouchList();
+		return;
+	}
+
 	m_TouchList.RemoveAll();
 }
 
@@ -177,6 +186,10 @@ void CMoveHelperServer::ResetTouchList( void )
 
 bool CMoveHelperServer::AddToTouched( const trace_t &tr, const Vector& impactvelocity )
 {
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+		return pDeferred->AddToTouched( tr, impactvelocity );
+
 	Assert( m_pHostPlayer );
 
 	// Trace missed
@@ -272,6 +285,13 @@ void CMoveHelperServer::StartSound( const Vector& origin, const char *soundname
 	//MDB - Changing this to send to PAS, as the overloaded function below has done.
 	//Also removed the UsePredictionRules, client does not yet play the equivalent sound
 
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->StartSound( origin, soundname );
+		return;
+	}
+
 	CRecipientFilter filter;
 	filter.AddRecipientsByPAS( origin );
 
@@ -284,6 +304,12 @@ void CMoveHelperServer::StartSound( const Vector& origin, const char *soundname
 void CMoveHelperServer::StartSound( const Vector& origin, int channel, char const* sample, 
 						float volume, soundlevel_t soundlevel, int fFlags, int pitch )
 {
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->StartSound( origin, channel, sample, volume, soundlevel, fFlags, pitch );
+		return;
+	}
 
 	CRecipientFilter filter;
 	filter.AddRecipientsByPAS( origin );
@@ -342,6 +368,10 @@ IPhysicsSurfaceProps *CMoveHelperServer::GetSurfaceProps( void )
 //-----------------------------------------------------------------------------
 void CMoveHelperServer::Con_NPrintf( int idx, char const* pFormat, ...)
 {
+	// Debug output only; not worth recording
+	if ( CDeferredPlayerMove::GetActive() )
+		return;
+
 	va_list marker;
 	char msg[8192];
 
@@ -359,6 +389,10 @@ void CMoveHelperServer::Con_NPrintf( int idx, char const* pFormat, ...)
 //-----------------------------------------------------------------------------
 bool CMoveHelperServer::PlayerFallingDamage( void )
 {
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+		return pDeferred->PlayerFallingDamage();
+
 	float flFallDamage = g_pGameRules->FlPlayerFallDamage( m_pHostPlayer );	
 	if ( flFallDamage > 0 )
 	{
@@ -407,6 +441,13 @@ bool CMoveHelperServer::PlayerFallingDamage( void )
 //-----------------------------------------------------------------------------
 void CMoveHelperServer::PlayerSetAnimation( PLAYER_ANIM eAnim )
 {
+	CDeferredPlayerMove *pDeferred = CDeferredPlayerMove::GetActive();
+	if ( pDeferred )
+	{
+		pDeferred->PlayerSetAnimation( eAnim );
+		return;
+	}
+
 	m_pHostPlayer->SetAnimation( eAnim );
 }
 
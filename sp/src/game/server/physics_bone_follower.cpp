@@ -10,10 +10,25 @@
 #include "physics_bone_follower.h"
 #include "vcollide_parse.h"
 #include "saverestore_utlvector.h"
+#include "tier0/vprof.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+ConVar phys_pose_sync_batch( "phys_pose_sync_batch", "1", 0, "Update bone followers and ragdoll network state in one batched pass per entity, skipping bones that haven't moved." );
+ConVar phys_pose_sync_tolerance( "phys_pose_sync_tolerance", "0.01", 0, "How far a bone must move, in units, before bone followers and ragdolls send it again." );
+ConVar phys_pose_sync_angle_tolerance( "phys_pose_sync_angle_tolerance", "0.0002", 0, "How much a bone's rotation matrix terms must change before bone followers and ragdolls send it again." );
+
+bool PhysPoseSyncTolerance( fltx4 &tolerance )
+{
+	if ( !phys_pose_sync_batch.GetBool() )
+		return false;
+
+	float flAngleTolerance = phys_pose_sync_angle_tolerance.GetFloat();
+	tolerance = LoadUnalignedSIMD( Vector4D( flAngleTolerance, flAngleTolerance, flAngleTolerance, phys_pose_sync_tolerance.GetFloat() ).Base() );
+	return true;
+}
+
 
 BEGIN_SIMPLE_DATADESC( physfollower_t )
 DEFINE_FIELD( boneIndex,			FIELD_INTEGER	),
@@ -145,6 +160,13 @@ void CBoneFollowerManager::UpdateBoneFollowers( CBaseAnimating *pParentEntity )
 {
 	if ( m_iNumBones )
 	{
+		fltx4 tolerance;
+		if ( PhysPoseSyncTolerance( tolerance ) )
+		{
+			UpdateBoneFollowersBatched( pParentEntity, tolerance );
+			return;
+		}
+
 		matrix3x4_t boneToWorld;
 		Vector bonePosition;
 		QAngle boneAngles;
@@ -160,6 +182,101 @@ void CBoneFollowerManager::UpdateBoneFollowers( CBaseAnimating *pParentEntity )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Reads every follower's bone out of the bone cache in one pass and
+//			only updates the followers whose bone moved past the tolerance.
+//			Their angles are worked out four at a time.
+//-----------------------------------------------------------------------------
+void CBoneFollowerManager::UpdateBoneFollowersBatched( CBaseAnimating *pParentEntity, const fltx4 &tolerance )
+{
+	VPROF( "CBoneFollowerManager::UpdateBoneFollowersBatched" );
+
+	CStudioHdr *pStudioHdr = pParentEntity->GetModelPtr();
+	if ( !pStudioHdr )
+		return;
+
+	// Followers were added since the last update, start over
+	if ( m_followerTargets.Count() != m_iNumBones )
+	{
+		m_followerTargets.SetCount( m_iNumBones );
+		for ( int i = 0; i < m_iNumBones; i++ )
+		{
+			m_followerTargets[i].valid = false;
+		}
+	}
+
+	CBoneCache *pCache = pParentEntity->GetBoneCache();
+
+	int moved[4];
+	const matrix3x4_t *pMoved[4];
+	int nMoved = 0;
+	int nSkipped = 0;
+	for ( int i = 0; i < m_iNumBones; i++ )
+	{
+		if ( !m_physBones[i].hFollower )
+			continue;
+
+		int boneIndex = m_physBones[i].boneIndex;
+		if ( boneIndex < 0 || boneIndex >= pStudioHdr->numbones() )
+			continue;
+
+		const matrix3x4_t *pBoneToWorld = pCache->GetCachedBone( boneIndex );
+		if ( !pBoneToWorld )
+		{
+			pBoneToWorld = &pParentEntity->EntityToWorldTransform();
+		}
+
+		followertarget_t &target = m_followerTargets[i];
+		if ( target.valid && !MatricesDifferSIMD( *pBoneToWorld, target.matrix, tolerance ) )
+		{
+			nSkipped++;
+			continue;
+		}
+
+		MatrixCopy( *pBoneToWorld, target.matrix );
+		target.valid = true;
+
+		moved[nMoved] = i;
+		pMoved[nMoved] = &target.matrix;
+		if ( ++nMoved == 4 )
+		{
+			SendFollowerTargets( moved, pMoved, nMoved );
+			nMoved = 0;
+		}
+	}
+
+	if ( nMoved )
+	{
+		SendFollowerTargets( moved, pMoved, nMoved );
+	}
+
+	VPROF_INCREMENT_COUNTER( "Bone followers skipped", nSkipped );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends up to four followers to their bones
+//-----------------------------------------------------------------------------
+void CBoneFollowerManager::SendFollowerTargets( const int *pFollowers, const matrix3x4_t **ppTargets, int count )
+{
+	Assert( count > 0 && count <= 4 );
+
+	// Pad out a short batch, the extra lanes are ignored
+	for ( int i = count; i < 4; i++ )
+	{
+		ppTargets[i] = ppTargets[0];
+	}
+
+	FourVectors angles, positions;
+	FourMatricesAnglesSIMD( ppTargets, angles, positions );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		Vector bonePosition = positions.Vec( i );
+		Vector boneAngles = angles.Vec( i );
+		m_physBones[ pFollowers[i] ].hFollower->UpdateFollower( bonePosition, QAngle( boneAngles.x, boneAngles.y, boneAngles.z ), 0.1 );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -175,6 +292,7 @@ void CBoneFollowerManager::DestroyBoneFollowers( void )
 	}
 
 	m_physBones.Purge();
+	m_followerTargets.Purge();
 	m_iNumBones = 0;
 }
 
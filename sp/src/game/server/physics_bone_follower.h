@@ -10,6 +10,8 @@
 #pragma once
 #endif
 
+#include "mathlib/ssemath.h"
+
 class CBoneFollower;
 
 //
@@ -30,6 +32,11 @@ struct vcollide_t;
 // create a manager and a list of followers directly from a ragdoll
 void CreateBoneFollowersFromRagdoll( CBaseAnimating *pEntity, class CBoneFollowerManager *pManager, vcollide_t *pCollide );
 
+// Bone followers and ragdolls send their bones to vphysics / the network in
+// one batched pass, skipping bones that moved less than this tolerance since
+// they were last sent. Returns false if the batched pass is turned off.
+bool PhysPoseSyncTolerance( fltx4 &tolerance );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -56,10 +63,20 @@ public:
 
 private:
 	bool CreatePhysicsFollower( CBaseAnimating *pParentEntity, physfollower_t &follow, const char *pBoneName, solid_t *pSolid );
+	void UpdateBoneFollowersBatched( CBaseAnimating *pParentEntity, const fltx4 &tolerance );
+	void SendFollowerTargets( const int *pFollowers, const matrix3x4_t **ppTargets, int count );
 
 private:
+	// Bone each follower was last sent to, so unmoved bones can be skipped
+	struct followertarget_t
+	{
+		matrix3x4_t	matrix;
+		bool		valid;
+	};
+
 	int							m_iNumBones;
 	CUtlVector<physfollower_t>	m_physBones;
+	CUtlVector<followertarget_t>	m_followerTargets;	// Not saved; rebuilt on the first update
 };
 
 
@@ -17,6 +17,7 @@
 
 #include "physics.h"
 #include "tier1/callqueue.h"
+#include "tier1/utlhashtable.h"
 
 extern CCallQueue g_PostSimulationQueue;
 
@@ -56,6 +57,46 @@ struct penetrateevent_t
 	int				collisionState;
 };
 
+// Kinds of events counted for phys_collision_event_stats
+enum
+{
+	COLLISION_EVENT_COLLISION = 0,
+	COLLISION_EVENT_FRICTION,
+	COLLISION_EVENT_TOUCH_START,
+	COLLISION_EVENT_TOUCH_END,
+	COLLISION_EVENT_TRIGGER,
+	COLLISION_EVENT_DAMAGE,
+	COLLISION_EVENT_PENETRATE,
+	COLLISION_EVENT_REMOVE,
+
+	COLLISION_EVENT_TYPE_COUNT
+};
+
+// Two objects named by a queued event, used to find an earlier event for the same pair
+struct collisioneventpair_t
+{
+	void			*pObject0;
+	void			*pObject1;
+};
+
+struct CollisionEventPairHashFunctor
+{
+	unsigned int operator()( const collisioneventpair_t &pair ) const
+	{
+		return PointerHashFunctor()( pair.pObject0 ) ^ ( PointerHashFunctor()( pair.pObject1 ) * 31 );
+	}
+};
+
+struct CollisionEventPairEqualFunctor
+{
+	bool operator()( const collisioneventpair_t &a, const collisioneventpair_t &b ) const
+	{
+		return a.pObject0 == b.pObject0 && a.pObject1 == b.pObject1;
+	}
+};
+
+typedef CUtlHashtable< collisioneventpair_t, int, CollisionEventPairHashFunctor, CollisionEventPairEqualFunctor > CollisionEventPairTable;
+
 class CCollisionEvent : public IPhysicsCollisionEvent, public IPhysicsCollisionSolver, public IPhysicsObjectEvent
 {
 public:
@@ -117,6 +158,10 @@ public:
 	void GetListOfPenetratingEntities( CBaseEntity *pSearch, CUtlVector<CBaseEntity *> &list );
 	bool IsInCallback() { return m_inCallback > 0 ? true : false; }
 
+	// Event counts since the last reset, printed by phys_collision_event_stats
+	void ReportEventStats();
+	void ResetEventStats();
+
 private:
 #if _DEBUG
 	int		ShouldCollide_2( IPhysicsObject *pObj0, IPhysicsObject *pObj1, void *pGameData0, void *pGameData1 );
@@ -129,6 +174,7 @@ private:
 	void UpdateFluidEvents();
 	void UpdateRemoveObjects();
 	void AddTouchEvent( CBaseEntity *pEntity0, CBaseEntity *pEntity1, int touchType, const Vector &point, const Vector &normal );
+	bool MergeDamageEvent( CBaseEntity *pEntity, const CTakeDamageInfo &info, IPhysicsObject *pInflictorPhysics, bool bRestoreVelocity );
 	penetrateevent_t &FindOrAddPenetrateEvent( CBaseEntity *pEntity0, CBaseEntity *pEntity1 );
 	float DeltaTimeSinceLastFluid( CBaseEntity *pEntity );
 
@@ -165,9 +211,16 @@ private:
 	CUtlVector<touchevent_t>	m_touchEvents;
 	CUtlVector<damageevent_t>	m_damageEvents;
 	CUtlVector<inflictorstate_t>	m_damageInflictors;
+	CUtlHashtable<IPhysicsObject *, int, PointerHashFunctor, PointerEqualFunctor> m_damageInflictorIndex;	// last state added for each object
 	CUtlVector<penetrateevent_t> m_penetrateEvents;
 	CUtlVector<fluidevent_t>	m_fluidEvents;
 	CUtlVector<IServerNetworkable *> m_removeObjects;
+	CollisionEventPairTable		m_touchEventPairs;		// entity pair -> its last queued touch event
+	CollisionEventPairTable		m_damageEventPairs;		// hurt entity and inflictor -> its queued damage event
+	int							m_eventCounts[COLLISION_EVENT_TYPE_COUNT];
+	int							m_mergedEventCounts[COLLISION_EVENT_TYPE_COUNT];
+	int							m_eventFrames;
+	int							m_iDamageEventDispatch;	// damage event UpdateDamageEvents is delivering, -1 otherwise
 	int							m_inCallback;
 	int							m_lastTickFrictionError;	// counter to control printing of the dev warning for large contact systems
 	bool						m_bBufferTouchEvents;
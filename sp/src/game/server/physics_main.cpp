@@ -33,6 +33,7 @@
 #include "vphysicsupdateai.h"
 #include "tier0/vcrmode.h"
 #include "pushentity.h"
+#include "player_parallelmove.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2045,6 +2046,11 @@ void Physics_RunThinkFunctions( bool simulating )
 	else
 	{
 		UTIL_DisableRemoveImmediate();
+
+		// Players that can move in parallel run first; Physics_SimulateEntity skips them below
+		ParallelPlayerMove()->SimulatePlayers();
+		gpGlobals->curtime = starttime;
+
 		int listMax = SimThink_ListCount();
 		listMax = MAX(listMax,1);
 		CBaseEntity **list = (CBaseEntity **)stackalloc( sizeof(CBaseEntity *) * listMax );
@@ -12,6 +12,7 @@
 
 #include "ragdoll_shared.h"
 #include "player_pickup.h"
+#include "mathlib/ssemath.h"
 
 
 //-----------------------------------------------------------------------------
@@ -113,6 +114,8 @@ protected:
 
 private:
 	void UpdateNetworkDataFromVPhysics( IPhysicsObject *pPhysics, int index );
+	void UpdateNetworkPoseBatched( const matrix3x4_t *pPhysMatrices, const fltx4 &tolerance );
+	void SendNetworkPose( const int *pElements, const matrix3x4_t **ppBones, int count );
 	void FadeOutThink();
 
 	bool				m_bStartDisabled;
@@ -147,6 +150,11 @@ private:
 	
 	Vector				m_ragdollMins[RAGDOLL_MAX_ELEMENTS];
 	Vector				m_ragdollMaxs[RAGDOLL_MAX_ELEMENTS];
+
+	// Bone each element was last networked from, valid where its bit in
+	// m_ragSentMask is set. Not saved; everything is sent again after a restore.
+	matrix3x4_t			m_ragSentBones[RAGDOLL_MAX_ELEMENTS];
+	unsigned int		m_ragSentMask;
 };
 
 CBaseEntity *CreateServerRagdoll( CBaseAnimating *pAnimating, int forceBone, const CTakeDamageInfo &info, int collisionGroup, bool bUseLRURetirement = false );
@@ -3225,11 +3225,78 @@ void CBasePlayer::PhysicsSimulate( void )
 	float savetime		= gpGlobals->curtime;
 	float saveframetime = gpGlobals->frametime;
 
-	int command_context_count = GetCommandContextCount();
-	
-
 	// Build a list of all available commands
 	CUtlVector< CUserCmd >	vecAvailCommands;
+	int commandsToRun = GetUserCmdsToRun( vecAvailCommands );
+
+	float vphysicsArrivalTime = TICK_INTERVAL;
+
+	// Now run the commands
+	if ( commandsToRun > 0 )
+	{
+		m_flLastUserCommandTime = savetime;
+
+		MoveHelperServer()->SetHost( this );
+
+		// Suppress predicted events, etc.
+		if ( IsPredictingWeapons() )
+		{
+			IPredictionSystem::SuppressHostEvents( this );
+		}
+
+		for ( int i = 0; i < commandsToRun; ++i )
+		{
+			PlayerRunCommand( &vecAvailCommands[ i ], MoveHelperServer() );
+
+			// Update our vphysics object.
+			if ( m_pPhysicsController )
+			{
+				VPROF( "CBasePlayer::PhysicsSimulate-UpdateVPhysicsPosition" );
+				// If simulating at 2 * TICK_INTERVAL, add an extra TICK_INTERVAL to position arrival computation
+				UpdateVPhysicsPosition( m_vNewVPhysicsPosition, m_vNewVPhysicsVelocity, vphysicsArrivalTime );
+				vphysicsArrivalTime += TICK_INTERVAL;
+			}
+		}
+
+		// Always reset after running commands
+		IPredictionSystem::SuppressHostEvents( NULL );
+
+		MoveHelperServer()->SetHost( NULL );
+
+		RecordSimulationInfo( commandsToRun );
+	}
+
+	// Restore the true server clock
+	// FIXME:  Should this occur after simulation of children so
+	//  that they are in the timespace of the player?
+	gpGlobals->curtime		= savetime;
+	gpGlobals->frametime	= saveframetime;	
+
+// 	// Kick the player if they haven't sent a user command in awhile in order to prevent clients
+// 	// from using packet-level manipulation to mess with gamestate.  Not sending usercommands seems
+// 	// to have all kinds of bad effects, such as stalling a bunch of Think()'s and gamestate handling.
+// 	// An example from TF: A medic stops sending commands after deploying an uber on another player.
+// 	// As a result, invuln is permanently on the heal target because the maintenance code is stalled.
+// 	if ( GetTimeSinceLastUserCommand() > player_usercommand_timeout.GetFloat() )
+// 	{
+// 		// If they have an active netchan, they're almost certainly messing with usercommands?
+// 		INetChannelInfo *pNetChanInfo = engine->GetPlayerNetInfo( entindex() );
+// 		if ( pNetChanInfo && pNetChanInfo->GetTimeSinceLastReceived() < 5.f )
+// 		{
+// 			engine->ServerCommand( UTIL_VarArgs( "kickid %d %s\n", GetUserID(), "UserCommand Timeout" ) );
+// 		}
+// 	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers the queued usercmds that should run this tick, oldest first,
+//			and grants the player's movement time budget for them
+// Output : Number of commands in vecAvailCommands to run now
+//-----------------------------------------------------------------------------
+int CBasePlayer::GetUserCmdsToRun( CUtlVector< CUserCmd > &vecAvailCommands )
+{
+	int command_context_count = GetCommandContextCount();
+	
 
 	// Contexts go from oldest to newest
 	for ( int context_number = 0; context_number < command_context_count; context_number++ )
@@ -3306,8 +3373,6 @@ void CBasePlayer::PhysicsSimulate( void )
 		RemoveAllCommandContexts();
 	}
 
-	float vphysicsArrivalTime = TICK_INTERVAL;
-
 #ifdef _DEBUG
 	if ( sv_player_net_suppress_usercommands.GetBool() )
 	{
@@ -3331,70 +3396,22 @@ void CBasePlayer::PhysicsSimulate( void )
 		m_flMovementTimeForUserCmdProcessingRemaining = FLT_MAX;
 	}
 
-	// Now run the commands
-	if ( commandsToRun > 0 )
-	{
-		m_flLastUserCommandTime = savetime;
-
-		MoveHelperServer()->SetHost( this );
-
-		// Suppress predicted events, etc.
-		if ( IsPredictingWeapons() )
-		{
-			IPredictionSystem::SuppressHostEvents( this );
-		}
-
-		for ( int i = 0; i < commandsToRun; ++i )
-		{
-			PlayerRunCommand( &vecAvailCommands[ i ], MoveHelperServer() );
-
-			// Update our vphysics object.
-			if ( m_pPhysicsController )
-			{
-				VPROF( "CBasePlayer::PhysicsSimulate-UpdateVPhysicsPosition" );
-				// If simulating at 2 * TICK_INTERVAL, add an extra TICK_INTERVAL to position arrival computation
-				UpdateVPhysicsPosition( m_vNewVPhysicsPosition, m_vNewVPhysicsVelocity, vphysicsArrivalTime );
-				vphysicsArrivalTime += TICK_INTERVAL;
-			}
-		}
-
-		// Always reset after running commands
-		IPredictionSystem::SuppressHostEvents( NULL );
-
-		MoveHelperServer()->SetHost( NULL );
+	return commandsToRun;
+}
 
-		// Copy in final origin from simulation
-		CPlayerSimInfo *pi = NULL;
-		if ( m_vecPlayerSimInfo.Count() > 0 )
-		{
-			pi = &m_vecPlayerSimInfo[ m_vecPlayerSimInfo.Tail() ];
-			pi->m_flTime = Plat_FloatTime();
-			pi->m_vecAbsOrigin = GetAbsOrigin();
-			pi->m_flGameSimulationTime = gpGlobals->curtime;
-			pi->m_nNumCmds = commandsToRun;
-		}
+//-----------------------------------------------------------------------------
+// Purpose: Copies the final origin from simulation into the sim info history
+//-----------------------------------------------------------------------------
+void CBasePlayer::RecordSimulationInfo( int commandsToRun )
+{
+	if ( m_vecPlayerSimInfo.Count() > 0 )
+	{
+		CPlayerSimInfo *pi = &m_vecPlayerSimInfo[ m_vecPlayerSimInfo.Tail() ];
+		pi->m_flTime = Plat_FloatTime();
+		pi->m_vecAbsOrigin = GetAbsOrigin();
+		pi->m_flGameSimulationTime = gpGlobals->curtime;
+		pi->m_nNumCmds = commandsToRun;
 	}
-
-	// Restore the true server clock
-	// FIXME:  Should this occur after simulation of children so
-	//  that they are in the timespace of the player?
-	gpGlobals->curtime		= savetime;
-	gpGlobals->frametime	= saveframetime;	
-
-// 	// Kick the player if they haven't sent a user command in awhile in order to prevent clients
-// 	// from using packet-level manipulation to mess with gamestate.  Not sending usercommands seems
-// 	// to have all kinds of bad effects, such as stalling a bunch of Think()'s and gamestate handling.
-// 	// An example from TF: A medic stops sending commands after deploying an uber on another player.
-// 	// As a result, invuln is permanently on the heal target because the maintenance code is stalled.
-// 	if ( GetTimeSinceLastUserCommand() > player_usercommand_timeout.GetFloat() )
-// 	{
-// 		// If they have an active netchan, they're almost certainly messing with usercommands?
-// 		INetChannelInfo *pNetChanInfo = engine->GetPlayerNetInfo( entindex() );
-// 		if ( pNetChanInfo && pNetChanInfo->GetTimeSinceLastReceived() < 5.f )
-// 		{
-// 			engine->ServerCommand( UTIL_VarArgs( "kickid %d %s\n", GetUserID(), "UserCommand Timeout" ) );
-// 		}
-// 	}
 }
 
 unsigned int CBasePlayer::PhysicsSolidMaskForEntity() const
@@ -3410,6 +3427,26 @@ void CBasePlayer::ForceSimulation()
 	m_nSimulationTick = -1;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if the movement of the next usercmd only changes this
+//			player, so that it can run on a worker thread while other players
+//			move. Anything that might reach further (vehicles, parents, noclip,
+//			ladders, scaled frametimes) keeps the player on the serial path.
+//-----------------------------------------------------------------------------
+bool CBasePlayer::CanRunUserCmdInParallel( void )
+{
+	if ( IsHLTV() || IsReplay() || !IsAlive() )
+		return false;
+
+	if ( GetMoveType() != MOVETYPE_WALK || GetMoveParent() || IsInAVehicle() )
+		return false;
+
+	if ( m_bGamePaused || GetLaggedMovementValue() != 1.0f )
+		return false;
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *buf - 
@@ -29,6 +29,7 @@ ConVar sv_maxusrcmdprocessticks_warning( "sv_maxusrcmdprocessticks_warning", "-1
 //-----------------------------------------------------------------------------
 CPlayerMove::CPlayerMove( void )
 {
+	m_pStage = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -312,6 +313,26 @@ void CommentarySystem_PePlayerRunCommand( CBasePlayer *player, CUserCmd *ucmd );
 // Output : void CPlayerMove::RunCommand
 //-----------------------------------------------------------------------------
 void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper )
+{
+	if ( m_pStage )
+	{
+		m_pStage->m_bStarted = m_pStage->m_pPlayerMove->RunCommandPreMove( player, ucmd, moveHelper, m_pStage->m_pMoveData, &m_pStage->m_pVehicle );
+		return;
+	}
+
+	IServerVehicle *pVehicle;
+	if ( !RunCommandPreMove( player, ucmd, moveHelper, g_pMoveData, &pVehicle ) )
+		return;
+
+	RunCommandMove( player, g_pGameMovement, pVehicle, g_pMoveData );
+	RunCommandPostMove( player, ucmd, moveHelper, g_pMoveData );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the command up to the movement: weapon selection, buttons,
+//			think functions and SetupMove
+//-----------------------------------------------------------------------------
+bool CPlayerMove::RunCommandPreMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper, CMoveData *move, IServerVehicle **ppVehicle )
 {
 	const float playerCurTime = player->m_nTickBase * TICK_INTERVAL; 
 	const float playerFrameTime = player->m_bGamePaused ? 0 : TICK_INTERVAL;
@@ -330,7 +351,7 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 				Warning( "sv_maxusrcmdprocessticks_warning at server tick %u: Ignored client %s usrcmd (%.6f < %.6f)!\n", gpGlobals->tickcount, player->GetPlayerName(), flTimeAllowedForProcessing, playerFrameTime );
 			}
 		}
-		return; // Don't process this command
+		return false; // Don't process this command
 	}
 
 	StartCommand( player, ucmd );
@@ -405,7 +426,7 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 
 	CheckMovingGround( player, TICK_INTERVAL );
 
-	g_pMoveData->m_vecOldAngles = player->pl.v_angle;
+	move->m_vecOldAngles = player->pl.v_angle;
 
 	// Copy from command to player unless game .dll has set angle using fixangle
 	if ( player->pl.fixangle == FIXANGLE_NONE )
@@ -424,23 +445,38 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 	RunThink( player, TICK_INTERVAL );
 
 	// Setup input.
-	SetupMove( player, ucmd, moveHelper, g_pMoveData );
+	SetupMove( player, ucmd, moveHelper, move );
 
+	*ppVehicle = pVehicle;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the player's movement for a command started by RunCommandPreMove
+//-----------------------------------------------------------------------------
+void CPlayerMove::RunCommandMove( CBasePlayer *player, IGameMovement *pMovement, IServerVehicle *pVehicle, CMoveData *move )
+{
 	// Let the game do the movement.
 	if ( !pVehicle )
 	{
 		VPROF( "g_pGameMovement->ProcessMovement()" );
-		Assert( g_pGameMovement );
-		g_pGameMovement->ProcessMovement( player, g_pMoveData );
+		Assert( pMovement );
+		pMovement->ProcessMovement( player, move );
 	}
 	else
 	{
 		VPROF( "pVehicle->ProcessMovement()" );
-		pVehicle->ProcessMovement( player, g_pMoveData );
+		pVehicle->ProcessMovement( player, move );
 	}
-			
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the movement back to the player and finishes the command
+//-----------------------------------------------------------------------------
+void CPlayerMove::RunCommandPostMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *moveHelper, CMoveData *move )
+{
 	// Copy output
-	FinishMove( player, ucmd, g_pMoveData );
+	FinishMove( player, ucmd, move );
 
 	// Let server invoke any needed impact functions
 	VPROF_SCOPE_BEGIN( "moveHelper->ProcessImpacts" );
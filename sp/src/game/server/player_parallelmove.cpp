@@ -0,0 +1,834 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Parallel usercmd processing for players that can't affect each
+//			other.
+//
+//			A tick is run in rounds; round N runs the Nth queued usercmd of
+//			every player that has one:
+//
+//			1. On the main thread, in player index order, PlayerRunCommand
+//			   runs everything before the movement (buttons, weapon selection,
+//			   PreThink, Think, SetupMove) and stops.
+//			2. ProcessMovement runs on worker threads. Each player has its own
+//			   game movement and move data, and anything that reaches outside
+//			   the player is recorded instead of done.
+//			3. On the main thread, in player index order, the recorded side
+//			   effects are applied, then FinishMove, impacts and PostThink run.
+//			4. Players that were near another player, or could do something
+//			   the workers can't (vehicles, ladders, ...), run their whole
+//			   command serially.
+//
+//			Because of the rounds, one player's PostThink sees the others
+//			after their move for the round instead of before it. PlayerRunCommand
+//			overrides must call down last, as RunCommand only starts the
+//			command while a stage is set.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "player.h"
+#include "player_command.h"
+#include "player_parallelmove.h"
+#include "movehelper_server.h"
+#include "igamemovement.h"
+#include "ipredictionsystem.h"
+#include "env_player_surface_trigger.h"
+#include "collisionutils.h"
+#include "datacache/imdlcache.h"
+#include "vstdlib/jobthread.h"
+#include "tier0/vprof.h"
+
+extern IGameMovement *g_pGameMovement;
+extern CMoveData *g_pMoveData;
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_parallel_usercmds( "sv_parallel_usercmds", "0", FCVAR_NONE, "Run the movement of players that can't reach each other on worker threads." );
+ConVar sv_parallel_usercmds_minplayers( "sv_parallel_usercmds_minplayers", "4", FCVAR_NONE, "Fewest players that must be able to move in parallel before sv_parallel_usercmds is used." );
+
+// Speed a jump can add in one command, on top of the player's velocity
+#define PARALLELMOVE_JUMP_SPEED		300.0f
+
+// Slack around the move bounds; covers unducking, which grows the hull
+#define PARALLELMOVE_SKIN			48.0f
+
+// Entities listed per player by CacheAbsState before it falls back to all of them
+#define PARALLELMOVE_MAX_NEARBY		1024
+
+
+//-----------------------------------------------------------------------------
+// CDeferredPlayerMove
+//-----------------------------------------------------------------------------
+CThreadLocalPtr<CDeferredPlayerMove> CDeferredPlayerMove::s_pActive;
+bool CDeferredPlayerMove::s_bAnyActive = false;
+
+CDeferredPlayerMove::CDeferredPlayerMove() : m_Events( 0, 16 ), m_Touches( 0, 8 ), m_Strings( 0, 128 )
+{
+	m_pPlayer = NULL;
+}
+
+void CDeferredPlayerMove::SetActive( CDeferredPlayerMove *pDeferred )
+{
+	s_pActive = pDeferred;
+}
+
+void CDeferredPlayerMove::Reset( CBasePlayer *pPlayer )
+{
+	m_pPlayer = pPlayer;
+	m_Events.RemoveAll();
+	m_Touches.RemoveAll();
+	m_Strings.RemoveAll();
+}
+
+CDeferredPlayerMove::Event_t &CDeferredPlayerMove::AddEvent( int nType )
+{
+	Event_t &event = m_Events[ m_Events.AddToTail() ];
+	event.m_nType = nType;
+	event.m_pSurface = NULL;
+	event.m_nString = -1;
+	return event;
+}
+
+int CDeferredPlayerMove::AddString( const char *pString )
+{
+	if ( !pString )
+		return -1;
+
+	int nOffset = m_Strings.Count();
+	m_Strings.AddMultipleToTail( Q_strlen( pString ) + 1, pString );
+	return nOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same rules as CMoveHelperServer, so the list replays unchanged
+//-----------------------------------------------------------------------------
+void CDeferredPlayerMove::ResetTouchList()
+{
+	m_Touches.RemoveAll();
+}
+
+bool CDeferredPlayerMove::AddToTouched( const trace_t &tr, const Vector &impactvelocity )
+{
+	if ( !tr.m_pEnt || tr.m_pEnt == m_pPlayer )
+		return false;
+
+	for ( int i = m_Touches.Count(); --i >= 0; )
+	{
+		if ( m_Touches[i].m_Trace.m_pEnt == tr.m_pEnt )
+			return false;
+	}
+
+	Touch_t &touch = m_Touches[ m_Touches.AddToTail() ];
+	touch.m_Trace = tr;
+	touch.m_vecVelocity = impactvelocity;
+	return true;
+}
+
+void CDeferredPlayerMove::StartSound( const Vector &origin, const char *soundname )
+{
+	Event_t &event = AddEvent( DEFERRED_START_SOUND );
+	event.m_vecOrigin = origin;
+	event.m_nString = AddString( soundname );
+}
+
+void CDeferredPlayerMove::StartSound( const Vector &origin, int channel, const char *sample, float volume, soundlevel_t soundlevel, int fFlags, int pitch )
+{
+	Event_t &event = AddEvent( DEFERRED_START_SOUND_EX );
+	event.m_vecOrigin = origin;
+	event.m_nString = AddString( sample );
+	event.m_flValue[0] = volume;
+	event.m_nValue[0] = channel;
+	event.m_nValue[1] = soundlevel;
+	event.m_nValue[2] = fFlags;
+	event.m_nValue[3] = pitch;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The damage is applied on replay, with the fall velocity the
+//			movement had at this point. The movement assumes the player lives;
+//			if not, the animations that follow are dropped on replay.
+//-----------------------------------------------------------------------------
+bool CDeferredPlayerMove::PlayerFallingDamage()
+{
+	Event_t &event = AddEvent( DEFERRED_FALLING_DAMAGE );
+	event.m_flValue[0] = m_pPlayer->m_Local.m_flFallVelocity;
+	return true;
+}
+
+void CDeferredPlayerMove::PlayerSetAnimation( PLAYER_ANIM eAnim )
+{
+	Event_t &event = AddEvent( DEFERRED_SET_ANIMATION );
+	event.m_nValue[0] = eAnim;
+}
+
+void CDeferredPlayerMove::UpdateStepSound( surfacedata_t *psurface, const Vector &vecOrigin, const Vector &vecVelocity )
+{
+	Event_t &event = AddEvent( DEFERRED_UPDATE_STEP_SOUND );
+	event.m_pSurface = psurface;
+	event.m_vecOrigin = vecOrigin;
+	event.m_vecVelocity = vecVelocity;
+	event.m_flValue[0] = m_pPlayer->m_flStepSoundTime;
+}
+
+void CDeferredPlayerMove::PlayStepSound( const Vector &vecOrigin, surfacedata_t *psurface, float fvol, bool force )
+{
+	Event_t &event = AddEvent( DEFERRED_PLAY_STEP_SOUND );
+	event.m_pSurface = psurface;
+	event.m_vecOrigin = vecOrigin;
+	event.m_flValue[0] = fvol;
+	event.m_nValue[0] = force;
+}
+
+void CDeferredPlayerMove::Splash()
+{
+	AddEvent( DEFERRED_SPLASH );
+}
+
+void CDeferredPlayerMove::RumbleEffect( unsigned char index, unsigned char rumbleData, unsigned char rumbleFlags )
+{
+	Event_t &event = AddEvent( DEFERRED_RUMBLE );
+	event.m_nValue[0] = index;
+	event.m_nValue[1] = rumbleData;
+	event.m_nValue[2] = rumbleFlags;
+}
+
+void CDeferredPlayerMove::SetPlayerSurface( char gameMaterial )
+{
+	Event_t &event = AddEvent( DEFERRED_PLAYER_SURFACE );
+	event.m_nValue[0] = gameMaterial;
+}
+
+void CDeferredPlayerMove::UpdateGroundLinks( CBaseEntity *pEntity, CBaseEntity *pOldGround, CBaseEntity *pGround )
+{
+	Event_t &event = AddEvent( DEFERRED_GROUND_LINKS );
+	event.m_hEntity = pEntity;
+	event.m_hOther[0] = pOldGround;
+	event.m_hOther[1] = pGround;
+}
+
+void CDeferredPlayerMove::ApplyMoveType( CBaseEntity *pEntity )
+{
+	Event_t &event = AddEvent( DEFERRED_MOVE_TYPE );
+	event.m_hEntity = pEntity;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Applies the recorded calls on the main thread
+//-----------------------------------------------------------------------------
+void CDeferredPlayerMove::Replay( IMoveHelper *pMoveHelper )
+{
+	Assert( m_pPlayer );
+
+	bool bDied = false;
+	for ( int i = 0; i < m_Events.Count(); i++ )
+	{
+		const Event_t &event = m_Events[i];
+		const char *pString = ( event.m_nString >= 0 ) ? &m_Strings[ event.m_nString ] : NULL;
+
+		switch ( event.m_nType )
+		{
+		case DEFERRED_START_SOUND:
+			pMoveHelper->StartSound( event.m_vecOrigin, pString );
+			break;
+
+		case DEFERRED_START_SOUND_EX:
+			pMoveHelper->StartSound( event.m_vecOrigin, event.m_nValue[0], pString, event.m_flValue[0], (soundlevel_t)event.m_nValue[1], event.m_nValue[2], event.m_nValue[3] );
+			break;
+
+		case DEFERRED_FALLING_DAMAGE:
+			{
+				float flFallVelocity = m_pPlayer->m_Local.m_flFallVelocity;
+				m_pPlayer->m_Local.m_flFallVelocity = event.m_flValue[0];
+				bDied = !pMoveHelper->PlayerFallingDamage() || bDied;
+				m_pPlayer->m_Local.m_flFallVelocity = flFallVelocity;
+			}
+			break;
+
+		case DEFERRED_SET_ANIMATION:
+			if ( !bDied )
+			{
+				pMoveHelper->PlayerSetAnimation( (PLAYER_ANIM)event.m_nValue[0] );
+			}
+			break;
+
+		case DEFERRED_UPDATE_STEP_SOUND:
+			{
+				// Run against the timer the movement saw. If the movement set
+				// the timer again afterwards (landing), that write wins.
+				float flStepSoundTime = m_pPlayer->m_flStepSoundTime;
+				m_pPlayer->m_flStepSoundTime = event.m_flValue[0];
+				m_pPlayer->UpdateStepSound( event.m_pSurface, event.m_vecOrigin, event.m_vecVelocity );
+				if ( flStepSoundTime != event.m_flValue[0] )
+				{
+					m_pPlayer->m_flStepSoundTime = flStepSoundTime;
+				}
+			}
+			break;
+
+		case DEFERRED_PLAY_STEP_SOUND:
+			{
+				Vector vecOrigin = event.m_vecOrigin;
+				m_pPlayer->PlayStepSound( vecOrigin, event.m_pSurface, event.m_flValue[0], event.m_nValue[0] != 0 );
+			}
+			break;
+
+		case DEFERRED_SPLASH:
+			m_pPlayer->Splash();
+			break;
+
+		case DEFERRED_RUMBLE:
+			m_pPlayer->RumbleEffect( event.m_nValue[0], event.m_nValue[1], event.m_nValue[2] );
+			break;
+
+		case DEFERRED_PLAYER_SURFACE:
+			CEnvPlayerSurfaceTrigger::SetPlayerSurface( m_pPlayer, (char)event.m_nValue[0] );
+			break;
+
+		case DEFERRED_GROUND_LINKS:
+			if ( event.m_hEntity.Get() )
+			{
+				event.m_hEntity->UpdateGroundLinks( event.m_hOther[0], event.m_hOther[1] );
+			}
+			break;
+
+		case DEFERRED_MOVE_TYPE:
+			if ( event.m_hEntity.Get() )
+			{
+				event.m_hEntity->ApplyMoveType();
+			}
+			break;
+		}
+	}
+
+	for ( int i = 0; i < m_Touches.Count(); i++ )
+	{
+		pMoveHelper->AddToTouched( m_Touches[i].m_Trace, m_Touches[i].m_vecVelocity );
+	}
+
+	m_Events.RemoveAll();
+	m_Touches.RemoveAll();
+	m_Strings.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// CParallelPlayerMove
+//-----------------------------------------------------------------------------
+struct CParallelPlayerMove::PlayerSlot_t
+{
+	CBasePlayer				*m_pPlayer;
+	CUtlVector< CUserCmd >	m_Commands;
+	int						m_nCommandsToRun;
+	float					m_flVPhysicsArrivalTime;
+	float					m_flCurTime;			// Clock as the player's last command left it
+	float					m_flFrameTime;
+	PlayerMoveStage_t		m_Stage;
+	IGameMovement			*m_pGameMovement;
+	CDeferredPlayerMove		m_Deferred;
+	Vector					m_vecMoveMins;			// Everything the next command could reach
+	Vector					m_vecMoveMaxs;
+	bool					m_bParallel;
+};
+
+static CParallelPlayerMove g_ParallelPlayerMove;
+
+CParallelPlayerMove *ParallelPlayerMove()
+{
+	return &g_ParallelPlayerMove;
+}
+
+CParallelPlayerMove::CParallelPlayerMove()
+{
+	memset( m_pSlots, 0, sizeof( m_pSlots ) );
+	m_flServerTime = 0.0f;
+	m_flServerFrameTime = 0.0f;
+	m_nTicks = 0;
+	m_nParallelMoves = 0;
+	m_nSerialMoves = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Slots are made the first time a player moves in parallel, and
+//			kept for whoever uses that player index next
+//-----------------------------------------------------------------------------
+CParallelPlayerMove::PlayerSlot_t *CParallelPlayerMove::GetSlot( CBasePlayer *pPlayer )
+{
+	int iSlot = pPlayer->entindex() - 1;
+	Assert( iSlot >= 0 && iSlot < MAX_PLAYERS );
+
+	if ( !m_pSlots[iSlot] )
+	{
+		PlayerSlot_t *pSlot = new PlayerSlot_t;
+		pSlot->m_Stage.m_pPlayerMove = CreatePlayerMove();
+		pSlot->m_Stage.m_pMoveData = CreatePlayerMoveData();
+		// Accumulated by the movement and only cleared by PostThinkVPhysics
+		pSlot->m_Stage.m_pMoveData->m_outStepHeight = 0.0f;
+		pSlot->m_Stage.m_pMoveData->m_outWishVel.Init();
+		pSlot->m_pGameMovement = CreateGameMovement();
+		m_pSlots[iSlot] = pSlot;
+	}
+
+	m_pSlots[iSlot]->m_pPlayer = pPlayer;
+	return m_pSlots[iSlot];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes over the start of CBasePlayer::PhysicsSimulate
+// Output : True if the player has commands to run
+//-----------------------------------------------------------------------------
+bool CParallelPlayerMove::BeginPlayer( PlayerSlot_t *pSlot )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+
+	pPlayer->m_nSimulationTick = gpGlobals->tickcount;
+
+	int simulation_ticks = pPlayer->DetermineSimulationTicks();
+	if ( simulation_ticks > 0 )
+	{
+		pPlayer->AdjustPlayerTimeBase( simulation_ticks );
+	}
+
+	pSlot->m_Commands.RemoveAll();
+	pSlot->m_nCommandsToRun = pPlayer->GetUserCmdsToRun( pSlot->m_Commands );
+	pSlot->m_flVPhysicsArrivalTime = TICK_INTERVAL;
+	pSlot->m_flCurTime = m_flServerTime;
+	pSlot->m_flFrameTime = m_flServerFrameTime;
+
+	if ( pSlot->m_nCommandsToRun <= 0 )
+		return false;
+
+	pPlayer->m_flLastUserCommandTime = m_flServerTime;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the usercmds of the players that can move in parallel. Called
+//			before the entities are simulated.
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::SimulatePlayers()
+{
+	// The 360 crouch hint in CGameMovement::Duck sends a message from the movement
+	if ( !sv_parallel_usercmds.GetBool() || IsX360() )
+		return;
+
+	VPROF_BUDGET( "CParallelPlayerMove::SimulatePlayers", VPROF_BUDGETGROUP_PLAYER );
+
+	int nCandidates = 0;
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( pPlayer && pPlayer->m_nSimulationTick != gpGlobals->tickcount && pPlayer->CanRunUserCmdInParallel() )
+		{
+			nCandidates++;
+		}
+	}
+
+	if ( nCandidates < MAX( sv_parallel_usercmds_minplayers.GetInt(), 2 ) )
+		return;
+
+	m_flServerTime = gpGlobals->curtime;
+	m_flServerFrameTime = gpGlobals->frametime;
+	m_Active.RemoveAll();
+
+	int nRounds = 0;
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( !pPlayer || pPlayer->m_nSimulationTick == gpGlobals->tickcount || !pPlayer->CanRunUserCmdInParallel() )
+			continue;
+
+		PlayerSlot_t *pSlot = GetSlot( pPlayer );
+		if ( BeginPlayer( pSlot ) )
+		{
+			m_Active.AddToTail( pSlot );
+			nRounds = MAX( nRounds, pSlot->m_nCommandsToRun );
+		}
+	}
+
+	for ( int nRound = 0; nRound < nRounds; nRound++ )
+	{
+		RunRound( nRound );
+	}
+
+	// Finish up the way CBasePlayer::PhysicsSimulate does
+	for ( int i = 0; i < m_Active.Count(); i++ )
+	{
+		PlayerSlot_t *pSlot = m_Active[i];
+		gpGlobals->curtime = pSlot->m_flCurTime;
+		pSlot->m_pPlayer->RecordSimulationInfo( pSlot->m_nCommandsToRun );
+		pSlot->m_pPlayer = NULL;
+	}
+	m_Active.RemoveAll();
+
+	IPredictionSystem::SuppressHostEvents( NULL );
+	MoveHelperServer()->SetHost( NULL );
+
+	gpGlobals->curtime = m_flServerTime;
+	gpGlobals->frametime = m_flServerFrameTime;
+
+	m_nTicks++;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Bounds of everything the player's next command could touch:
+//			current speed, acceleration up to max speed and a jump
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::ComputeMoveBounds( CBasePlayer *pPlayer, Vector *pMins, Vector *pMaxs )
+{
+	float flSpeed = pPlayer->GetAbsVelocity().Length() + pPlayer->GetBaseVelocity().Length() + pPlayer->MaxSpeed() + PARALLELMOVE_JUMP_SPEED;
+	float flReach = flSpeed * TICK_INTERVAL + pPlayer->GetStepSize() + PARALLELMOVE_SKIN;
+	Vector vecReach( flReach, flReach, flReach );
+
+	pPlayer->CollisionProp()->WorldSpaceAABB( pMins, pMaxs );
+	*pMins -= vecReach;
+	*pMaxs += vecReach;
+}
+
+bool CParallelPlayerMove::AnyOverlap( PlayerSlot_t **ppSlots, int nSlots, int iSlot )
+{
+	const PlayerSlot_t *pSlot = ppSlots[iSlot];
+	for ( int i = 0; i < nSlots; i++ )
+	{
+		if ( i == iSlot )
+			continue;
+
+		if ( IsBoxIntersectingBox( pSlot->m_vecMoveMins, pSlot->m_vecMoveMaxs, ppSlots[i]->m_vecMoveMins, ppSlots[i]->m_vecMoveMaxs ) )
+			return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: GetAbsOrigin and GetAbsVelocity recompute dirty values in place,
+//			so two workers asking about the same ground entity, or anything
+//			they trace against, would both write it. Computes them here, on
+//			the main thread, for every entity the staged moves could reach;
+//			the workers then only read them.
+//-----------------------------------------------------------------------------
+static void CacheEntityAbsState( CBaseEntity *pEntity )
+{
+	// These also compute the angles and the move parent's state
+	pEntity->GetAbsOrigin();
+	pEntity->GetAbsVelocity();
+}
+
+void CParallelPlayerMove::CacheAbsState( PlayerSlot_t **ppSlots, int nSlots )
+{
+	CBaseEntity *pList[PARALLELMOVE_MAX_NEARBY];
+	for ( int i = 0; i < nSlots; i++ )
+	{
+		CFlaggedEntitiesEnum nearby( pList, ARRAYSIZE( pList ), 0 );
+		partition->EnumerateElementsInBox( PARTITION_ENGINE_NON_STATIC_EDICTS | PARTITION_ENGINE_TRIGGER_EDICTS,
+			ppSlots[i]->m_vecMoveMins, ppSlots[i]->m_vecMoveMaxs, false, &nearby );
+
+		int nCount = nearby.GetCount();
+		if ( nCount >= ARRAYSIZE( pList ) )
+		{
+			// The list may have been cut short
+			for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+			{
+				CacheEntityAbsState( pEntity );
+			}
+			return;
+		}
+
+		for ( int j = 0; j < nCount; j++ )
+		{
+			CacheEntityAbsState( pList[j] );
+		}
+
+		CBaseEntity *pGround = ppSlots[i]->m_pPlayer->GetGroundEntity();
+		if ( pGround )
+		{
+			CacheEntityAbsState( pGround );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the nRound'th command of every player that has one
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::RunRound( int nRound )
+{
+	PlayerSlot_t *pCandidates[MAX_PLAYERS];
+	int nCandidates = 0;
+
+	for ( int i = 0; i < m_Active.Count(); i++ )
+	{
+		PlayerSlot_t *pSlot = m_Active[i];
+		pSlot->m_bParallel = false;
+		if ( nRound >= pSlot->m_nCommandsToRun || !pSlot->m_pPlayer->CanRunUserCmdInParallel() )
+			continue;
+
+		ComputeMoveBounds( pSlot->m_pPlayer, &pSlot->m_vecMoveMins, &pSlot->m_vecMoveMaxs );
+		pCandidates[nCandidates++] = pSlot;
+	}
+
+	// Players whose moves could meet run serially
+	int nStaged = 0;
+	for ( int i = 0; i < nCandidates; i++ )
+	{
+		if ( !AnyOverlap( pCandidates, nCandidates, i ) )
+		{
+			pCandidates[i]->m_bParallel = true;
+			nStaged++;
+		}
+	}
+
+	if ( nStaged >= 2 )
+	{
+		PlayerSlot_t *pStaged[MAX_PLAYERS];
+		nStaged = 0;
+
+		{
+			MDLCACHE_CRITICAL_SECTION();
+
+			for ( int i = 0; i < m_Active.Count(); i++ )
+			{
+				PlayerSlot_t *pSlot = m_Active[i];
+				if ( !pSlot->m_bParallel )
+					continue;
+
+				StartStagedCommand( pSlot, &pSlot->m_Commands[nRound] );
+				if ( pSlot->m_Stage.m_bStarted )
+				{
+					ComputeMoveBounds( pSlot->m_pPlayer, &pSlot->m_vecMoveMins, &pSlot->m_vecMoveMaxs );
+					pStaged[nStaged++] = pSlot;
+				}
+				else
+				{
+					// Dropped; nothing left but the vphysics update
+					FinishStagedCommand( pSlot, &pSlot->m_Commands[nRound], false );
+				}
+			}
+
+			// PreThink may have put the player in a vehicle, on a ladder or
+			// next to someone; finish those moves here, on the main thread
+			int nParallel = 0;
+			for ( int i = 0; i < nStaged; i++ )
+			{
+				PlayerSlot_t *pSlot = pStaged[i];
+				if ( pSlot->m_Stage.m_pVehicle || !pSlot->m_pPlayer->CanRunUserCmdInParallel() || AnyOverlap( pStaged, nStaged, i ) )
+				{
+					FinishStagedCommand( pSlot, &pSlot->m_Commands[nRound], true );
+					m_nSerialMoves++;
+				}
+				else
+				{
+					pStaged[nParallel++] = pSlot;
+				}
+			}
+			nStaged = nParallel;
+		}
+
+		// The workers can only mark the player's edict as fully changed
+		for ( int i = 0; i < nStaged; i++ )
+		{
+			pStaged[i]->m_pPlayer->edict()->StateChanged();
+		}
+
+		// Nothing moves the shared entities from here until the workers are done
+		CacheAbsState( pStaged, nStaged );
+
+		// The movement reads gpGlobals, so run one batch per clock
+		CDeferredPlayerMove::EnableHooks( true );
+		for ( int iFirst = 0; iFirst < nStaged; )
+		{
+			float flCurTime = pStaged[iFirst]->m_flCurTime;
+			float flFrameTime = pStaged[iFirst]->m_flFrameTime;
+
+			int iLast = iFirst + 1;
+			for ( int i = iLast; i < nStaged; i++ )
+			{
+				if ( pStaged[i]->m_flCurTime == flCurTime && pStaged[i]->m_flFrameTime == flFrameTime )
+				{
+					V_swap( pStaged[i], pStaged[iLast] );
+					iLast++;
+				}
+			}
+
+			gpGlobals->curtime = flCurTime;
+			gpGlobals->frametime = flFrameTime;
+			ParallelProcess( "CParallelPlayerMove::ProcessMove", pStaged + iFirst, iLast - iFirst, this, &CParallelPlayerMove::ProcessMove );
+			iFirst = iLast;
+		}
+		CDeferredPlayerMove::EnableHooks( false );
+
+		MDLCACHE_CRITICAL_SECTION();
+
+		// Back in player index order for the rest of the commands
+		for ( int i = 0; i < m_Active.Count(); i++ )
+		{
+			PlayerSlot_t *pSlot = m_Active[i];
+			if ( pSlot->m_bParallel && pSlot->m_Stage.m_bStarted )
+			{
+				FinishStagedCommand( pSlot, &pSlot->m_Commands[nRound], false );
+				m_nParallelMoves++;
+			}
+		}
+	}
+	else
+	{
+		for ( int i = 0; i < nCandidates; i++ )
+		{
+			pCandidates[i]->m_bParallel = false;
+		}
+	}
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	for ( int i = 0; i < m_Active.Count(); i++ )
+	{
+		PlayerSlot_t *pSlot = m_Active[i];
+		if ( !pSlot->m_bParallel && nRound < pSlot->m_nCommandsToRun )
+		{
+			RunSerialCommand( pSlot, &pSlot->m_Commands[nRound] );
+			m_nSerialMoves++;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a whole command, as CBasePlayer::PhysicsSimulate would
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::RunSerialCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+
+	gpGlobals->curtime = pSlot->m_flCurTime;
+	gpGlobals->frametime = pSlot->m_flFrameTime;
+
+	MoveHelperServer()->SetHost( pPlayer );
+	IPredictionSystem::SuppressHostEvents( pPlayer->IsPredictingWeapons() ? pPlayer : NULL );
+
+	pPlayer->PlayerRunCommand( pCmd, MoveHelperServer() );
+
+	IPredictionSystem::SuppressHostEvents( NULL );
+
+	pSlot->m_flCurTime = gpGlobals->curtime;
+	pSlot->m_flFrameTime = gpGlobals->frametime;
+
+	UpdateVPhysics( pSlot );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a command up to its movement
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::StartStagedCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+
+	gpGlobals->curtime = pSlot->m_flCurTime;
+	gpGlobals->frametime = pSlot->m_flFrameTime;
+
+	MoveHelperServer()->SetHost( pPlayer );
+	IPredictionSystem::SuppressHostEvents( pPlayer->IsPredictingWeapons() ? pPlayer : NULL );
+
+	pSlot->m_Stage.m_pVehicle = NULL;
+	pSlot->m_Stage.m_bStarted = false;
+	pSlot->m_Deferred.Reset( pPlayer );
+
+	PlayerMove()->SetStage( &pSlot->m_Stage );
+	pPlayer->PlayerRunCommand( pCmd, MoveHelperServer() );
+	PlayerMove()->SetStage( NULL );
+
+	IPredictionSystem::SuppressHostEvents( NULL );
+
+	pSlot->m_flCurTime = gpGlobals->curtime;
+	pSlot->m_flFrameTime = gpGlobals->frametime;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs on a worker thread
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::ProcessMove( PlayerSlot_t *&pSlot )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+
+	CDeferredPlayerMove::SetActive( &pSlot->m_Deferred );
+
+	pSlot->m_pGameMovement->StartTrackPredictionErrors( pPlayer );
+	pSlot->m_Stage.m_pPlayerMove->RunCommandMove( pPlayer, pSlot->m_pGameMovement, NULL, pSlot->m_Stage.m_pMoveData );
+
+	CDeferredPlayerMove::SetActive( NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finishes a staged command on the main thread. bRunMove runs the
+//			movement here too, for players that couldn't move in parallel.
+//-----------------------------------------------------------------------------
+void CParallelPlayerMove::FinishStagedCommand( PlayerSlot_t *pSlot, CUserCmd *pCmd, bool bRunMove )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+
+	if ( pSlot->m_Stage.m_bStarted )
+	{
+		gpGlobals->curtime = pSlot->m_flCurTime;
+		gpGlobals->frametime = pSlot->m_flFrameTime;
+
+		// Other players' commands have run since this one started
+		CBaseEntity::SetPredictionRandomSeed( pCmd );
+		CBaseEntity::SetPredictionPlayer( pPlayer );
+
+		MoveHelperServer()->SetHost( pPlayer );
+		IPredictionSystem::SuppressHostEvents( pPlayer->IsPredictingWeapons() ? pPlayer : NULL );
+
+		if ( bRunMove )
+		{
+			g_pGameMovement->StartTrackPredictionErrors( pPlayer );
+			pSlot->m_Stage.m_pPlayerMove->RunCommandMove( pPlayer, g_pGameMovement, pSlot->m_Stage.m_pVehicle, pSlot->m_Stage.m_pMoveData );
+		}
+		else
+		{
+			pSlot->m_Deferred.Replay( MoveHelperServer() );
+		}
+
+		// PostThinkVPhysics reads and clears this move's wish velocity and step
+		// height through g_pMoveData
+		CMoveData *pSerialMoveData = g_pMoveData;
+		g_pMoveData = pSlot->m_Stage.m_pMoveData;
+		pSlot->m_Stage.m_pPlayerMove->RunCommandPostMove( pPlayer, pCmd, MoveHelperServer(), pSlot->m_Stage.m_pMoveData );
+		g_pMoveData = pSerialMoveData;
+
+		IPredictionSystem::SuppressHostEvents( NULL );
+
+		pSlot->m_flCurTime = gpGlobals->curtime;
+		pSlot->m_flFrameTime = gpGlobals->frametime;
+		pSlot->m_Stage.m_bStarted = false;
+	}
+
+	UpdateVPhysics( pSlot );
+}
+
+void CParallelPlayerMove::UpdateVPhysics( PlayerSlot_t *pSlot )
+{
+	CBasePlayer *pPlayer = pSlot->m_pPlayer;
+	if ( pPlayer->m_pPhysicsController )
+	{
+		VPROF( "CBasePlayer::PhysicsSimulate-UpdateVPhysicsPosition" );
+		// If simulating at 2 * TICK_INTERVAL, add an extra TICK_INTERVAL to position arrival computation
+		pPlayer->UpdateVPhysicsPosition( pPlayer->m_vNewVPhysicsPosition, pPlayer->m_vNewVPhysicsVelocity, pSlot->m_flVPhysicsArrivalTime );
+		pSlot->m_flVPhysicsArrivalTime += TICK_INTERVAL;
+	}
+}
+
+void CParallelPlayerMove::ReportStats()
+{
+	int nMoves = m_nParallelMoves + m_nSerialMoves;
+	Msg( "Parallel usercmds: %d ticks, %d moves, %d in parallel (%.1f%%), %d serial\n",
+		m_nTicks, nMoves, m_nParallelMoves, nMoves ? 100.0f * m_nParallelMoves / nMoves : 0.0f, m_nSerialMoves );
+
+	m_nTicks = 0;
+	m_nParallelMoves = 0;
+	m_nSerialMoves = 0;
+}
+
+CON_COMMAND( sv_parallel_usercmds_stats, "Prints and resets how many usercmd moves ran in parallel." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	ParallelPlayerMove()->ReportStats();
+}
@@ -9,6 +9,7 @@
 #include "soundent.h"
 #include "game.h"
 #include "world.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -27,6 +28,65 @@ LINK_ENTITY_TO_CLASS( soundent, CSoundEnt );
 
 static CSoundEnt *g_pSoundEnt = NULL;
 
+//-----------------------------------------------------------------------------
+// Spatial grid over the active sound list, so a listener only tests the sounds
+// whose audible radius reaches its cell. The grid is 2D and hashed; each
+// expiring sound is added to every cell its radius (scaled by the largest
+// hearing sensitivity asked for so far) overlaps. Sounds that span too many
+// cells go in a global segment that every query tests. Sounds that never
+// expire, like the client reserved sounds, are moved and re-volumed in place
+// by their owners, so they are read live instead of snapshotted.
+//
+// The grid is rebuilt on the first query after the active list changes. Each
+// segment is stored as padded SoA arrays so ranges are tested four at a time.
+//-----------------------------------------------------------------------------
+#define SOUNDGRID_CELL_SIZE		1024.0f
+#define SOUNDGRID_HASH_SIZE		64			// Must be a power of two
+#define SOUNDGRID_MAX_SPAN		4			// Sounds spanning more cells than this on an axis are global
+#define SOUNDGRID_GLOBAL		SOUNDGRID_HASH_SIZE
+#define SOUNDGRID_NUM_SEGMENTS	( SOUNDGRID_HASH_SIZE + 1 )
+#define SOUNDGRID_MAX_ENTRIES	( MAX_WORLD_SOUNDS_MP * SOUNDGRID_MAX_SPAN * SOUNDGRID_MAX_SPAN + SOUNDGRID_NUM_SEGMENTS * 3 )
+#define SOUNDGRID_RANGE_SLACK	8.0f		// Keeps the conservative tests clear of float rounding
+
+struct SoundGrid_t
+{
+	bool	m_bDirty;
+	float	m_flSensitivity;				// Largest hearing sensitivity the footprints cover
+
+	int		m_nSounds;
+	int		m_iSoundForRank[ MAX_WORLD_SOUNDS_MP ];	// Rank is the position in the active list
+	int		m_nLive;
+	int		m_LiveRanks[ MAX_WORLD_SOUNDS_MP ];
+
+	int		m_nSegmentStart[ SOUNDGRID_NUM_SEGMENTS + 1 ];
+	int		m_nSegmentCount[ SOUNDGRID_NUM_SEGMENTS ];
+	float	m_x[ SOUNDGRID_MAX_ENTRIES ];
+	float	m_y[ SOUNDGRID_MAX_ENTRIES ];
+	float	m_z[ SOUNDGRID_MAX_ENTRIES ];
+	float	m_flVolume[ SOUNDGRID_MAX_ENTRIES ];
+	int		m_iType[ SOUNDGRID_MAX_ENTRIES ];	// Padding entries have no type, so never match
+	int		m_nRank[ SOUNDGRID_MAX_ENTRIES ];
+
+	// Stats
+	int		m_nRebuilds;
+	int		m_nQueries;
+	int		m_nCandidates;
+	int		m_nTested;
+};
+
+static SoundGrid_t g_SoundGrid = { true, 1.0f };
+
+static inline void SoundGridCell( float x, float y, int *pCellX, int *pCellY )
+{
+	*pCellX = (int)floorf( x * ( 1.0f / SOUNDGRID_CELL_SIZE ) );
+	*pCellY = (int)floorf( y * ( 1.0f / SOUNDGRID_CELL_SIZE ) );
+}
+
+static inline int SoundGridBucket( int nCellX, int nCellY )
+{
+	return ( ( (unsigned)nCellX * 73856093u ) ^ ( (unsigned)nCellY * 19349663u ) ) & ( SOUNDGRID_HASH_SIZE - 1 );
+}
+
 BEGIN_SIMPLE_DATADESC( CSound )
 
 	DEFINE_FIELD( m_hOwner,				FIELD_EHANDLE ),
@@ -71,6 +131,8 @@ void CSound::Reset ( void )
 	m_iType			= 0;
 	m_iVolume		= 0;
 	m_iNext			= SOUNDLIST_EMPTY;
+
+	g_SoundGrid.m_bDirty = true;
 }
 
 //=========================================================
@@ -253,6 +315,7 @@ void CSoundEnt::OnRestore()
 		UTIL_Remove( g_pSoundEnt );
 	}
 	g_pSoundEnt = this;
+	g_SoundGrid.m_bDirty = true;
 }
 
 
@@ -385,6 +448,8 @@ void CSoundEnt::FreeSound ( int iSound, int iPrevious )
 	// make iSound the head of the Free list.
 	g_pSoundEnt->m_SoundPool[ iSound ].m_iNext = g_pSoundEnt->m_iFreeSound;
 	g_pSoundEnt->m_iFreeSound = iSound;
+
+	g_SoundGrid.m_bDirty = true;
 }
 
 //=========================================================
@@ -415,6 +480,8 @@ int CSoundEnt::IAllocSound( void )
 
 	m_iActiveSound = iNewSound;// now make the new sound the top of the active list. You're done.
 
+	g_SoundGrid.m_bDirty = true;
+
 #ifdef DEBUG
 	m_SoundPool[ iNewSound ].m_iMyIndex = iNewSound;
 #endif // DEBUG
@@ -465,6 +532,8 @@ void CSoundEnt::InsertSound ( int iType, const Vector &vecOrigin, int iVolume, f
 	pSound->m_hTarget.Set( pSoundTarget );
 	pSound->m_ownerChannelIndex = soundChannelIndex;
 
+	g_SoundGrid.m_bDirty = true;
+
 	// Keep track of whether this sound had an owner when it was made. If the sound has a long duration,
 	// the owner could disappear by the time someone hears this sound, so we have to look at this boolean
 	// and throw out sounds who have a NULL owner but this field set to true. (sjb) 12/2/2005
@@ -520,6 +589,7 @@ void CSoundEnt::Initialize ( void )
 	m_cLastActiveSounds;
 	m_iFreeSound = 0;
 	m_iActiveSound = SOUNDLIST_EMPTY;
+	g_SoundGrid.m_bDirty = true;
 
 	// In SP, we should only use the first 64 slots so save/load works right.
 	// In MP, have one for each player and 32 extras.
@@ -710,6 +780,247 @@ CSound*	CSoundEnt::GetLoudestSoundOfType( int iType, const Vector &vecEarPositio
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the sound grid from the active list
+//-----------------------------------------------------------------------------
+void CSoundEnt::RebuildSoundGrid( void )
+{
+	SoundGrid_t &grid = g_SoundGrid;
+
+	grid.m_bDirty = false;
+	grid.m_nRebuilds++;
+	grid.m_nSounds = 0;
+	grid.m_nLive = 0;
+	memset( grid.m_nSegmentCount, 0, sizeof( grid.m_nSegmentCount ) );
+
+	// Each sound adds itself to a bucket once, even if several of its cells hash there
+	int nLastRank[ SOUNDGRID_NUM_SEGMENTS ];
+	memset( nLastRank, 0xff, sizeof( nLastRank ) );
+
+	// First pass ranks the sounds and counts the bucket entries
+	int iSound;
+	for ( iSound = m_iActiveSound; iSound != SOUNDLIST_EMPTY && grid.m_nSounds < MAX_WORLD_SOUNDS_MP; iSound = m_SoundPool[ iSound ].m_iNext )
+	{
+		CSound &sound = m_SoundPool[ iSound ];
+		int nRank = grid.m_nSounds++;
+		grid.m_iSoundForRank[ nRank ] = iSound;
+
+		if ( sound.m_bNoExpirationTime )
+		{
+			grid.m_LiveRanks[ grid.m_nLive++ ] = nRank;
+			continue;
+		}
+
+		float flRadius = fabsf( (float)sound.m_iVolume ) * grid.m_flSensitivity + SOUNDGRID_RANGE_SLACK;
+		int x0, y0, x1, y1;
+		SoundGridCell( sound.m_vecOrigin.x - flRadius, sound.m_vecOrigin.y - flRadius, &x0, &y0 );
+		SoundGridCell( sound.m_vecOrigin.x + flRadius, sound.m_vecOrigin.y + flRadius, &x1, &y1 );
+		if ( x1 - x0 >= SOUNDGRID_MAX_SPAN || y1 - y0 >= SOUNDGRID_MAX_SPAN )
+		{
+			grid.m_nSegmentCount[ SOUNDGRID_GLOBAL ]++;
+			continue;
+		}
+
+		for ( int y = y0; y <= y1; ++y )
+		{
+			for ( int x = x0; x <= x1; ++x )
+			{
+				int nBucket = SoundGridBucket( x, y );
+				if ( nLastRank[ nBucket ] != nRank )
+				{
+					nLastRank[ nBucket ] = nRank;
+					grid.m_nSegmentCount[ nBucket ]++;
+				}
+			}
+		}
+	}
+
+	// Lay the segments out, each padded to a multiple of four
+	int nCursor = 0;
+	int i;
+	for ( i = 0; i < SOUNDGRID_NUM_SEGMENTS; ++i )
+	{
+		grid.m_nSegmentStart[ i ] = nCursor;
+		int nPadded = ( grid.m_nSegmentCount[ i ] + 3 ) & ~3;
+		for ( int j = nCursor + grid.m_nSegmentCount[ i ]; j < nCursor + nPadded; ++j )
+		{
+			grid.m_x[ j ] = grid.m_y[ j ] = grid.m_z[ j ] = grid.m_flVolume[ j ] = 0.0f;
+			grid.m_iType[ j ] = 0;
+			grid.m_nRank[ j ] = 0;
+		}
+		nCursor += nPadded;
+	}
+	grid.m_nSegmentStart[ SOUNDGRID_NUM_SEGMENTS ] = nCursor;
+	Assert( nCursor <= SOUNDGRID_MAX_ENTRIES );
+
+	// Second pass fills them in, in rank order
+	int nFill[ SOUNDGRID_NUM_SEGMENTS ];
+	memcpy( nFill, grid.m_nSegmentStart, sizeof( nFill ) );
+	memset( nLastRank, 0xff, sizeof( nLastRank ) );
+
+	for ( int nRank = 0; nRank < grid.m_nSounds; ++nRank )
+	{
+		CSound &sound = m_SoundPool[ grid.m_iSoundForRank[ nRank ] ];
+		if ( sound.m_bNoExpirationTime )
+			continue;
+
+		float flRadius = fabsf( (float)sound.m_iVolume ) * grid.m_flSensitivity + SOUNDGRID_RANGE_SLACK;
+		int x0, y0, x1, y1;
+		SoundGridCell( sound.m_vecOrigin.x - flRadius, sound.m_vecOrigin.y - flRadius, &x0, &y0 );
+		SoundGridCell( sound.m_vecOrigin.x + flRadius, sound.m_vecOrigin.y + flRadius, &x1, &y1 );
+		bool bGlobal = ( x1 - x0 >= SOUNDGRID_MAX_SPAN || y1 - y0 >= SOUNDGRID_MAX_SPAN );
+		if ( bGlobal )
+		{
+			x0 = x1 = y0 = y1 = 0;
+		}
+
+		for ( int y = y0; y <= y1; ++y )
+		{
+			for ( int x = x0; x <= x1; ++x )
+			{
+				int nBucket = bGlobal ? SOUNDGRID_GLOBAL : SoundGridBucket( x, y );
+				if ( nLastRank[ nBucket ] == nRank )
+					continue;
+
+				nLastRank[ nBucket ] = nRank;
+				int j = nFill[ nBucket ]++;
+				grid.m_x[ j ] = sound.m_vecOrigin.x;
+				grid.m_y[ j ] = sound.m_vecOrigin.y;
+				grid.m_z[ j ] = sound.m_vecOrigin.z;
+				grid.m_flVolume[ j ] = (float)sound.m_iVolume;
+				grid.m_iType[ j ] = sound.m_iType;
+				grid.m_nRank[ j ] = nRank;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the sounds a listener might hear using the sound grid
+//-----------------------------------------------------------------------------
+int CSoundEnt::GetAudibleSounds( const Vector &vecEarPosition, float flHearingSensitivity, int iTypeMask, int *pSounds, int nMaxSounds )
+{
+	if ( !g_pSoundEnt || iTypeMask == SOUND_NONE )
+		return 0;
+
+	SoundGrid_t &grid = g_SoundGrid;
+
+	// A more sensitive listener than the footprints were built for needs bigger footprints
+	float flSensitivity = fabsf( flHearingSensitivity );
+	if ( flSensitivity > grid.m_flSensitivity )
+	{
+		grid.m_flSensitivity = flSensitivity;
+		grid.m_bDirty = true;
+	}
+
+	if ( grid.m_bDirty )
+	{
+		g_pSoundEnt->RebuildSoundGrid();
+	}
+
+	grid.m_nQueries++;
+
+	// Sounds that pass, by rank, so they come out in active list order
+	uint32 heard[ MAX_WORLD_SOUNDS_MP / 32 ];
+	memset( heard, 0, sizeof( heard ) );
+
+	// Within range if distSq <= (volume * sensitivity)^2, loosened a little
+	float flScale = flSensitivity * flSensitivity * 1.001f;
+	fltx4 earX = ReplicateX4( vecEarPosition.x );
+	fltx4 earY = ReplicateX4( vecEarPosition.y );
+	fltx4 earZ = ReplicateX4( vecEarPosition.z );
+	fltx4 scale = ReplicateX4( flScale );
+	fltx4 bias = ReplicateX4( SOUNDGRID_RANGE_SLACK * SOUNDGRID_RANGE_SLACK );
+
+	int nCellX, nCellY;
+	SoundGridCell( vecEarPosition.x, vecEarPosition.y, &nCellX, &nCellY );
+	int segments[2] = { SoundGridBucket( nCellX, nCellY ), SOUNDGRID_GLOBAL };
+
+	for ( int s = 0; s < 2; ++s )
+	{
+		int nEnd = grid.m_nSegmentStart[ segments[s] ] + grid.m_nSegmentCount[ segments[s] ];
+		for ( int i = grid.m_nSegmentStart[ segments[s] ]; i < nEnd; i += 4 )
+		{
+			fltx4 dx = SubSIMD( LoadUnalignedSIMD( &grid.m_x[i] ), earX );
+			fltx4 dy = SubSIMD( LoadUnalignedSIMD( &grid.m_y[i] ), earY );
+			fltx4 dz = SubSIMD( LoadUnalignedSIMD( &grid.m_z[i] ), earZ );
+			fltx4 distSq = MaddSIMD( dx, dx, MaddSIMD( dy, dy, MulSIMD( dz, dz ) ) );
+			fltx4 volume = LoadUnalignedSIMD( &grid.m_flVolume[i] );
+			fltx4 hearSq = MaddSIMD( MulSIMD( volume, volume ), scale, bias );
+
+			int nMask = TestSignSIMD( CmpLeSIMD( distSq, hearSq ) );
+			grid.m_nTested += 4;
+			for ( int j = 0; nMask; ++j, nMask >>= 1 )
+			{
+				if ( ( nMask & 1 ) && ( grid.m_iType[ i + j ] & iTypeMask ) )
+				{
+					int nRank = grid.m_nRank[ i + j ];
+					heard[ nRank >> 5 ] |= ( 1u << ( nRank & 31 ) );
+				}
+			}
+		}
+	}
+
+	// Live sounds are tested where they are now
+	for ( int i = 0; i < grid.m_nLive; ++i )
+	{
+		int nRank = grid.m_LiveRanks[i];
+		CSound &sound = g_pSoundEnt->m_SoundPool[ grid.m_iSoundForRank[ nRank ] ];
+		grid.m_nTested++;
+		if ( !( sound.m_iType & iTypeMask ) )
+			continue;
+
+		float flVolume = (float)sound.m_iVolume;
+		if ( sound.m_vecOrigin.DistToSqr( vecEarPosition ) <= flVolume * flVolume * flScale + SOUNDGRID_RANGE_SLACK * SOUNDGRID_RANGE_SLACK )
+		{
+			heard[ nRank >> 5 ] |= ( 1u << ( nRank & 31 ) );
+		}
+	}
+
+	int nCount = 0;
+	for ( int nRank = 0; nRank < grid.m_nSounds && nCount < nMaxSounds; ++nRank )
+	{
+		if ( heard[ nRank >> 5 ] & ( 1u << ( nRank & 31 ) ) )
+		{
+			pSounds[ nCount++ ] = grid.m_iSoundForRank[ nRank ];
+		}
+	}
+
+	grid.m_nCandidates += nCount;
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints the sound grid's layout and query counts
+//-----------------------------------------------------------------------------
+void CSoundEnt::ReportSoundGridStats( void )
+{
+	if ( !g_pSoundEnt )
+		return;
+
+	SoundGrid_t &grid = g_SoundGrid;
+	if ( grid.m_bDirty )
+	{
+		g_pSoundEnt->RebuildSoundGrid();
+	}
+
+	int nEntries = 0, nUsed = 0, nMax = 0;
+	for ( int i = 0; i < SOUNDGRID_HASH_SIZE; ++i )
+	{
+		nEntries += grid.m_nSegmentCount[i];
+		nUsed += ( grid.m_nSegmentCount[i] != 0 );
+		nMax = MAX( nMax, grid.m_nSegmentCount[i] );
+	}
+
+	Msg( "Sound grid: %d sounds (%d live, %d global), %d cell entries in %d/%d buckets (max %d), sensitivity %.2f\n",
+		grid.m_nSounds, grid.m_nLive, grid.m_nSegmentCount[ SOUNDGRID_GLOBAL ], nEntries, nUsed, SOUNDGRID_HASH_SIZE, nMax, grid.m_flSensitivity );
+	Msg( "  %d rebuilds, %d queries, %.1f sounds tested and %.1f candidates per query\n",
+		grid.m_nRebuilds, grid.m_nQueries,
+		grid.m_nQueries ? (float)grid.m_nTested / grid.m_nQueries : 0.0f,
+		grid.m_nQueries ? (float)grid.m_nCandidates / grid.m_nQueries : 0.0f );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Inserts an AI sound into the world sound list.
 //-----------------------------------------------------------------------------
@@ -239,12 +239,21 @@ public:
 	static CSound*	GetLoudestSoundOfType( int iType, const Vector &vecEarPosition );
 	static int		ClientSoundIndex ( edict_t *pClient );
 
+	// Fills pSounds with the active sounds matching iTypeMask that a listener
+	// at vecEarPosition might hear, in active list order. Only the grid cells
+	// near the listener are searched. The range test is slightly generous, so
+	// callers still make their own exact test.
+	static int		GetAudibleSounds( const Vector &vecEarPosition, float flHearingSensitivity, int iTypeMask, int *pSounds, int nMaxSounds );
+	static void		ReportSoundGridStats( void );
+
 	bool	IsEmpty( void );
 	int		ISoundsInList ( int iListType );
 	int		IAllocSound ( void );
 	int		FindOrAllocateSound( CBaseEntity *pOwner, int soundChannelIndex );
 	
 private:
+	void	RebuildSoundGrid( void );
+
 	int		m_iFreeSound;	// index of the first sound in the free sound list
 	int		m_iActiveSound; // indes of the first sound in the active sound list
 	int		m_cLastActiveSounds; // keeps track of the number of active sounds at the last update. (for diagnostic work)
@@ -15,6 +15,7 @@
 #include "igamemovement.h"
 #include "cmodel.h"
 #include "tier0/vprof.h"
+#include "movetracecache.h"
 
 #define CTEXTURESMAX		512			// max number of textures loaded
 #define CBTEXTURENAMEMAX	13			// only load first n chars of name
@@ -210,6 +211,9 @@ protected:
 	void ResetGetPointContentsCache();
 	int GetPointContentsCached( const Vector &point, int slot );
 
+	// Hull trace ignoring the player, answered from m_TraceCache when it can be
+	void TraceHullCached( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm );
+
 	// Ducking
 	virtual void	Duck( void );
 	virtual void	HandleDuckingSpeedCrop();
@@ -268,6 +272,9 @@ protected:
 	int m_CachedGetPointContents[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];
 	Vector m_CachedGetPointContentsPoint[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];	
 
+	// Recent hull traces, see sv_movement_tracecache
+	CMoveTraceCache	m_TraceCache;
+
 	Vector			m_vecProximityMins;		// Used to be globals in sv_user.cpp.
 	Vector			m_vecProximityMaxs;
 
@@ -31,4 +31,12 @@ CGridGameMovement::CGridGameMovement()
 static CGridGameMovement g_GameMovement;
 IGameMovement *g_pGameMovement = ( IGameMovement * )&g_GameMovement;
 
+#ifdef GAME_DLL
+// More instances, for players whose movement runs in parallel
+IGameMovement *CreateGameMovement()
+{
+	return new CGridGameMovement;
+}
+#endif
+
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CGameMovement, IGameMovement,INTERFACENAME_GAMEMOVEMENT, g_GameMovement );
\ No newline at end of file
@@ -1148,5 +1148,13 @@ bool CHL2GameMovement::CanAccelerate()
 	static CHL2GameMovement g_GameMovement;
 	IGameMovement *g_pGameMovement = ( IGameMovement * )&g_GameMovement;
 
+#ifdef GAME_DLL
+	// More instances, for players whose movement runs in parallel
+	IGameMovement *CreateGameMovement()
+	{
+		return new CHL2GameMovement;
+	}
+#endif
+
 	EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CGameMovement, IGameMovement,INTERFACENAME_GAMEMOVEMENT, g_GameMovement );
 #endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Player movement hull trace cache
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "movetracecache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar sv_movement_tracecache( "sv_movement_tracecache", "0", FCVAR_REPLICATED, "Reuse player movement hull traces until something they could hit moves." );
+
+int g_nMoveTraceWorldVersion = 0;
+int g_nMoveTracePlayersVersion = 0;
+int g_nMoveTracePlayerVersion[ MAX_PLAYERS + 1 ];
+
+CMoveTraceCache *CMoveTraceCache::s_pCaches = NULL;
+
+CMoveTraceCache::CMoveTraceCache()
+{
+	m_nEntries = 0;
+	m_nNextEntry = 0;
+	m_hOwner.Term();
+	m_iOwner = 0;
+	m_nLookups = 0;
+	m_nHits = 0;
+
+	m_pNext = s_pCaches;
+	s_pCaches = this;
+}
+
+CMoveTraceCache::~CMoveTraceCache()
+{
+	for ( CMoveTraceCache **ppCache = &s_pCaches; *ppCache; ppCache = &(*ppCache)->m_pNext )
+	{
+		if ( *ppCache == this )
+		{
+			*ppCache = m_pNext;
+			break;
+		}
+	}
+}
+
+bool CMoveTraceCache::IsEnabled()
+{
+	return sv_movement_tracecache.GetBool();
+}
+
+void CMoveTraceCache::Flush()
+{
+	m_nEntries = 0;
+	m_nNextEntry = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Switches the cache to another player's traces
+// Output : False if the cache was emptied
+//-----------------------------------------------------------------------------
+bool CMoveTraceCache::SetOwner( CBaseEntity *pPlayer )
+{
+	CBaseHandle hPlayer = pPlayer ? pPlayer->GetRefEHandle() : CBaseHandle();
+	if ( hPlayer == m_hOwner )
+		return true;
+
+	Flush();
+	m_hOwner = hPlayer;
+	m_iOwner = ( pPlayer && pPlayer->IsPlayer() ) ? pPlayer->entindex() : 0;
+	if ( m_iOwner < 0 || m_iOwner > MAX_PLAYERS )
+	{
+		m_iOwner = 0;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves of every player but the owner
+//-----------------------------------------------------------------------------
+int CMoveTraceCache::GetPlayersVersion() const
+{
+	return g_nMoveTracePlayersVersion - ( m_iOwner ? g_nMoveTracePlayerVersion[ m_iOwner ] : 0 );
+}
+
+bool CMoveTraceCache::Lookup( CBaseEntity *pPlayer, const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, trace_t &pm )
+{
+	m_nLookups++;
+
+	if ( !SetOwner( pPlayer ) )
+		return false;
+
+	int nPlayersVersion = GetPlayersVersion();
+	for ( int i = 0; i < m_nEntries; i++ )
+	{
+		const Entry_t &entry = m_Entries[i];
+		if ( entry.m_nWorldVersion != g_nMoveTraceWorldVersion || entry.m_nPlayersVersion != nPlayersVersion )
+			continue;
+
+		if ( entry.m_fMask != fMask || entry.m_nCollisionGroup != collisionGroup )
+			continue;
+
+		if ( entry.m_vecStart != start || entry.m_vecEnd != end || entry.m_vecMins != mins || entry.m_vecMaxs != maxs )
+			continue;
+
+		pm = entry.m_Trace;
+		m_nHits++;
+		return true;
+	}
+
+	return false;
+}
+
+void CMoveTraceCache::Store( CBaseEntity *pPlayer, const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, const trace_t &pm )
+{
+	SetOwner( pPlayer );
+
+	// Stale entries go first, then the oldest
+	int nPlayersVersion = GetPlayersVersion();
+	int iEntry = -1;
+	for ( int i = 0; i < m_nEntries; i++ )
+	{
+		if ( m_Entries[i].m_nWorldVersion != g_nMoveTraceWorldVersion || m_Entries[i].m_nPlayersVersion != nPlayersVersion )
+		{
+			iEntry = i;
+			break;
+		}
+	}
+
+	if ( iEntry < 0 )
+	{
+		if ( m_nEntries < MOVETRACECACHE_ENTRIES )
+		{
+			iEntry = m_nEntries++;
+		}
+		else
+		{
+			iEntry = m_nNextEntry;
+			m_nNextEntry = ( m_nNextEntry + 1 ) % MOVETRACECACHE_ENTRIES;
+		}
+	}
+
+	Entry_t &entry = m_Entries[iEntry];
+	entry.m_vecStart = start;
+	entry.m_vecEnd = end;
+	entry.m_vecMins = mins;
+	entry.m_vecMaxs = maxs;
+	entry.m_fMask = fMask;
+	entry.m_nCollisionGroup = collisionGroup;
+	entry.m_nWorldVersion = g_nMoveTraceWorldVersion;
+	entry.m_nPlayersVersion = nPlayersVersion;
+	entry.m_Trace = pm;
+}
+
+void CMoveTraceCache::ReportStats()
+{
+	int nCaches = 0;
+	int nLookups = 0;
+	int nHits = 0;
+	for ( CMoveTraceCache *pCache = s_pCaches; pCache; pCache = pCache->m_pNext )
+	{
+		nCaches++;
+		nLookups += pCache->m_nLookups;
+		nHits += pCache->m_nHits;
+	}
+
+	Msg( "Movement trace cache (%s): %d lookups, %d hits (%.1f%%), %d caches, world version %d\n",
+		IsEnabled() ? "on" : "off", nLookups, nHits, nLookups ? 100.0f * nHits / nLookups : 0.0f, nCaches, g_nMoveTraceWorldVersion );
+}
+
+void CMoveTraceCache::ResetStats()
+{
+	for ( CMoveTraceCache *pCache = s_pCaches; pCache; pCache = pCache->m_pNext )
+	{
+		pCache->m_nLookups = 0;
+		pCache->m_nHits = 0;
+	}
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_movement_tracecache_stats, "Print the client's movement trace cache hit rate. Pass 'reset' to clear the counters." )
+#else
+CON_COMMAND( sv_movement_tracecache_stats, "Print the server's movement trace cache hit rate. Pass 'reset' to clear the counters." )
+#endif
+{
+#ifndef CLIENT_DLL
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+#endif
+
+	CMoveTraceCache::ReportStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		CMoveTraceCache::ResetStats();
+	}
+}
@@ -0,0 +1,110 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Remembers recent player movement hull traces so identical ones
+//			can be answered without tracing again. Results stay valid until
+//			a solid entity moves or changes how it collides; moves of the
+//			player doing the tracing don't count, since its traces skip it.
+//			That lets prediction reruns and multi-command server ticks reuse
+//			the traces of earlier commands.
+//
+//=============================================================================//
+
+#ifndef MOVETRACECACHE_H
+#define MOVETRACECACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cmodel.h"
+
+//-----------------------------------------------------------------------------
+// Versions of the things movement traces can hit. Only changed on the main
+// thread.
+//-----------------------------------------------------------------------------
+extern int g_nMoveTraceWorldVersion;						// Everything but players
+extern int g_nMoveTracePlayersVersion;						// Sum of the ones below
+extern int g_nMoveTracePlayerVersion[ MAX_PLAYERS + 1 ];
+
+// Call when an entity that traces can hit moves, changes its bounds, or
+// changes whether or how it collides
+inline void MoveTraceCache_EntityChanged( CBaseEntity *pEntity )
+{
+	if ( pEntity->IsPlayer() )
+	{
+		int iPlayer = pEntity->entindex();
+		if ( iPlayer >= 1 && iPlayer <= MAX_PLAYERS )
+		{
+			g_nMoveTracePlayerVersion[ iPlayer ]++;
+			g_nMoveTracePlayersVersion++;
+			return;
+		}
+	}
+
+	g_nMoveTraceWorldVersion++;
+}
+
+// For changes where the entity may no longer be usable, e.g. while it's being destroyed
+inline void MoveTraceCache_WorldChanged()
+{
+	g_nMoveTraceWorldVersion++;
+}
+
+
+//-----------------------------------------------------------------------------
+// A few recent traces for one player. Each CGameMovement has one; it's
+// emptied whenever that movement starts tracing for a different player.
+//-----------------------------------------------------------------------------
+class CMoveTraceCache
+{
+public:
+	CMoveTraceCache();
+	~CMoveTraceCache();
+
+	// pPlayer is the entity the traces ignore. Returns true and fills in pm on a hit.
+	bool	Lookup( CBaseEntity *pPlayer, const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, trace_t &pm );
+	void	Store( CBaseEntity *pPlayer, const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, const trace_t &pm );
+
+	void	Flush();
+
+	static bool	IsEnabled();
+
+	// Totals over every cache, printed by the stats commands
+	static void	ReportStats();
+	static void	ResetStats();
+
+private:
+	enum
+	{
+		MOVETRACECACHE_ENTRIES = 16,
+	};
+
+	struct Entry_t
+	{
+		Vector			m_vecStart;
+		Vector			m_vecEnd;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		unsigned int	m_fMask;
+		int				m_nCollisionGroup;
+		int				m_nWorldVersion;
+		int				m_nPlayersVersion;		// Other players' moves, see GetPlayersVersion()
+		trace_t			m_Trace;
+	};
+
+	bool	SetOwner( CBaseEntity *pPlayer );
+	int		GetPlayersVersion() const;
+
+	Entry_t		m_Entries[ MOVETRACECACHE_ENTRIES ];
+	int			m_nEntries;
+	int			m_nNextEntry;					// Oldest entry, replaced next
+	CBaseHandle	m_hOwner;
+	int			m_iOwner;						// Owner's player index, 0 if it isn't a player
+
+	int			m_nLookups;
+	int			m_nHits;
+
+	CMoveTraceCache	*m_pNext;					// All the caches, for the stats
+	static CMoveTraceCache *s_pCaches;
+};
+
+#endif // MOVETRACECACHE_H
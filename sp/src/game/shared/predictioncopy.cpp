@@ -21,6 +21,7 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier1/utlmap.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -988,13 +989,167 @@ CPredictionCopy::difftype_t CPredictionCopy::CompareEHandle( EHANDLE *outvalue,
 	return IDENTICAL;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Compares/copies/describes a single non-embedded field (m_pCurrentField)
+//-----------------------------------------------------------------------------
+void CPredictionCopy::TransferField( void *pOutputData, void const *pInputData )
+{
+	int fieldSize = m_pCurrentField->fieldSize;
+
+	// Assume we can report
+	m_bShouldReport = m_bReportErrors;
+	m_bShouldDescribe = true;
+
+	bool bShouldWatch = m_pWatchField == m_pCurrentField;
+
+	difftype_t difftype;
+
+	switch( m_pCurrentField->fieldType )
+	{
+	case FIELD_FLOAT:
+		{
+			difftype = CompareFloat( (float *)pOutputData, (float const *)pInputData, fieldSize );
+			CopyFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_TIME:
+	case FIELD_TICK:
+		Assert( 0 );
+		break;
+
+	case FIELD_STRING:
+		{
+			difftype = CompareString( (char *)pOutputData, (char const*)pInputData );
+			CopyString( difftype, (char *)pOutputData, (char const*)pInputData );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeString( difftype,(char *)pOutputData, (char const*)pInputData );
+			if ( bShouldWatch ) WatchString( difftype,(char *)pOutputData, (char const*)pInputData );
+		}
+		break;
+
+	case FIELD_MODELINDEX:
+		Assert( 0 );
+		break;
+
+	case FIELD_MODELNAME:
+	case FIELD_SOUNDNAME:
+		Assert( 0 );
+		break;
+
+	case FIELD_CUSTOM:
+		Assert( 0 );
+		break;
+
+	case FIELD_CLASSPTR:
+	case FIELD_EDICT:
+		Assert( 0 );
+		break;
+
+	case FIELD_POSITION_VECTOR:
+		Assert( 0 );
+		break;
+
+	case FIELD_VECTOR:
+		{
+			difftype = CompareVector( (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			CopyVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_QUATERNION:
+		{
+			difftype = CompareQuaternion( (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			CopyQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_COLOR32:
+		{
+			difftype = CompareData( 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			CopyData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			if ( bShouldWatch ) WatchData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+		}
+		break;
+
+	case FIELD_BOOLEAN:
+		{
+			difftype = CompareBool( (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			CopyBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_INTEGER:
+		{
+			difftype = CompareInt( (int *)pOutputData, (int const *)pInputData, fieldSize );
+			CopyInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_SHORT:
+		{
+			difftype = CompareShort( (short *)pOutputData, (short const *)pInputData, fieldSize );
+			CopyShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_CHARACTER:
+		{
+			difftype = CompareData( fieldSize, ((char *)pOutputData), (const char *)pInputData );
+			CopyData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
+			
+			int valOut = *((char *)pOutputData);
+			int valIn  = *((const char *)pInputData);
+			
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, &valOut, &valIn, fieldSize );
+			if ( bShouldWatch ) WatchData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
+		}
+		break;
+	case FIELD_EHANDLE:
+		{
+			difftype = CompareEHandle( (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			CopyEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+		}
+		break;
+	case FIELD_FUNCTION:
+		{
+		Assert( 0 );
+		}
+		break;
+	case FIELD_VOID:
+		{
+			// Don't do anything, it's an empty data description
+		}
+		break;
+	default:
+		{
+			Warning( "Bad field type\n" );
+			Assert(0);
+		}
+		break;
+	}
+}
+
 void CPredictionCopy::CopyFields( int chain_count, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount )
 {
 	int				i;
 	int				flags;
 	int				fieldOffsetSrc;
 	int				fieldOffsetDest;
-	int				fieldSize;
 
 	m_pCurrentMap = pRootMap;
 	if ( !m_pCurrentClassName )
@@ -1040,187 +1195,43 @@ void CPredictionCopy::CopyFields( int chain_count, datamap_t *pRootMap, typedesc
 
 		fieldOffsetDest = m_pCurrentField->fieldOffset[ m_nDestOffsetIndex ];
 		fieldOffsetSrc	= m_pCurrentField->fieldOffset[ m_nSrcOffsetIndex ];
-		fieldSize = m_pCurrentField->fieldSize;
 
 		pOutputData = (void *)((char *)m_pDest + fieldOffsetDest );
 		pInputData = (void const *)((char *)m_pSrc + fieldOffsetSrc );
 
-		// Assume we can report
-		m_bShouldReport = m_bReportErrors;
-		m_bShouldDescribe = true;
-
-		bool bShouldWatch = m_pWatchField == m_pCurrentField;
-
-		difftype_t difftype;
-
-		switch( m_pCurrentField->fieldType )
+		if ( m_pCurrentField->fieldType == FIELD_EMBEDDED )
 		{
-		case FIELD_EMBEDDED:
-			{
-				typedescription_t *save = m_pCurrentField;
-				void *saveDest = m_pDest;
-				void const *saveSrc = m_pSrc;
-				const char *saveName = m_pCurrentClassName;
-
-				m_pCurrentClassName = m_pCurrentField->td->dataClassName;
-
-				// FIXME: Should this be done outside the FIELD_EMBEDDED case??
-				// Don't follow the pointer if we're reading from a compressed packet
-				m_pSrc = pInputData;
-				if ( ( flags & FTYPEDESC_PTR ) && (m_nSrcOffsetIndex == PC_DATA_NORMAL) )
-				{
-					m_pSrc = *((void**)m_pSrc);
-				}
-
-				m_pDest = pOutputData;
-				if ( ( flags & FTYPEDESC_PTR ) && (m_nDestOffsetIndex == PC_DATA_NORMAL) )
-				{
-					m_pDest = *((void**)m_pDest);
-				}
-
-				CopyFields( chain_count, pRootMap, m_pCurrentField->td->dataDesc, m_pCurrentField->td->dataNumFields );
-
-				m_pCurrentClassName = saveName;
-				m_pCurrentField = save;
-				m_pDest = saveDest;
-				m_pSrc = saveSrc;
-			}
-			break;
-		case FIELD_FLOAT:
-			{
-				difftype = CompareFloat( (float *)pOutputData, (float const *)pInputData, fieldSize );
-				CopyFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_TIME:
-		case FIELD_TICK:
-			Assert( 0 );
-			break;
-
-		case FIELD_STRING:
-			{
-				difftype = CompareString( (char *)pOutputData, (char const*)pInputData );
-				CopyString( difftype, (char *)pOutputData, (char const*)pInputData );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeString( difftype,(char *)pOutputData, (char const*)pInputData );
-				if ( bShouldWatch ) WatchString( difftype,(char *)pOutputData, (char const*)pInputData );
-			}
-			break;
-
-		case FIELD_MODELINDEX:
-			Assert( 0 );
-			break;
-
-		case FIELD_MODELNAME:
-		case FIELD_SOUNDNAME:
-			Assert( 0 );
-			break;
-
-		case FIELD_CUSTOM:
-			Assert( 0 );
-			break;
-
-		case FIELD_CLASSPTR:
-		case FIELD_EDICT:
-			Assert( 0 );
-			break;
+			typedescription_t *save = m_pCurrentField;
+			void *saveDest = m_pDest;
+			void const *saveSrc = m_pSrc;
+			const char *saveName = m_pCurrentClassName;
 
-		case FIELD_POSITION_VECTOR:
-			Assert( 0 );
-			break;
+			m_pCurrentClassName = m_pCurrentField->td->dataClassName;
 
-		case FIELD_VECTOR:
+			// FIXME: Should this be done outside the FIELD_EMBEDDED case??
+			// Don't follow the pointer if we're reading from a compressed packet
+			m_pSrc = pInputData;
+			if ( ( flags & FTYPEDESC_PTR ) && (m_nSrcOffsetIndex == PC_DATA_NORMAL) )
 			{
-				difftype = CompareVector( (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				CopyVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+				m_pSrc = *((void**)m_pSrc);
 			}
-			break;
 
-		case FIELD_QUATERNION:
+			m_pDest = pOutputData;
+			if ( ( flags & FTYPEDESC_PTR ) && (m_nDestOffsetIndex == PC_DATA_NORMAL) )
 			{
-				difftype = CompareQuaternion( (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				CopyQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+				m_pDest = *((void**)m_pDest);
 			}
-			break;
 
-		case FIELD_COLOR32:
-			{
-				difftype = CompareData( 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				CopyData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				if ( bShouldWatch ) WatchData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-			}
-			break;
-
-		case FIELD_BOOLEAN:
-			{
-				difftype = CompareBool( (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				CopyBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-			}
-			break;
+			CopyFields( chain_count, pRootMap, m_pCurrentField->td->dataDesc, m_pCurrentField->td->dataNumFields );
 
-		case FIELD_INTEGER:
-			{
-				difftype = CompareInt( (int *)pOutputData, (int const *)pInputData, fieldSize );
-				CopyInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_SHORT:
-			{
-				difftype = CompareShort( (short *)pOutputData, (short const *)pInputData, fieldSize );
-				CopyShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_CHARACTER:
-			{
-				difftype = CompareData( fieldSize, ((char *)pOutputData), (const char *)pInputData );
-				CopyData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
-				
-				int valOut = *((char *)pOutputData);
-				int valIn  = *((const char *)pInputData);
-				
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, &valOut, &valIn, fieldSize );
-				if ( bShouldWatch ) WatchData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
-			}
-			break;
-		case FIELD_EHANDLE:
-			{
-				difftype = CompareEHandle( (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				CopyEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-			}
-			break;
-		case FIELD_FUNCTION:
-			{
-			Assert( 0 );
-			}
-			break;
-		case FIELD_VOID:
-			{
-				// Don't do anything, it's an empty data description
-			}
-			break;
-		default:
-			{
-				Warning( "Bad field type\n" );
-				Assert(0);
-			}
-			break;
+			m_pCurrentClassName = saveName;
+			m_pCurrentField = save;
+			m_pDest = saveDest;
+			m_pSrc = saveSrc;
+		}
+		else
+		{
+			TransferField( pOutputData, pInputData );
 		}
 	}
 
@@ -1373,6 +1384,431 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+//-----------------------------------------------------------------------------
+// Compiled transfer plans
+//
+// Walking the datamaps field by field for every save, restore and error check
+// is slow. The common cases (plain copies, and compares that only count errors)
+// use a plan built once per datamap/copy type/packing instead: the fields that
+// would be visited are flattened into runs that are contiguous on both sides and
+// can be memcpy'd or memcmp'd as a block. A compare run that doesn't match falls
+// back to TransferField for each of its fields, so tolerances, EHANDLEs and the
+// error counts come out the same as with the walker. Bitwise identical floats are
+// always treated as identical, even if they are NaNs.
+//-----------------------------------------------------------------------------
+static ConVar cl_pred_compiledcopy( "cl_pred_compiledcopy", "1", 0, "Use precompiled per-class plans to save, restore and error check predicted entity data." );
+
+enum PredictionCopyOpType_t
+{
+	PC_OP_BYTES = 0,		// run of plain fields, copied/compared as one block
+	PC_OP_STRING,			// null terminated string, only strlen + 1 bytes get copied
+	PC_OP_EMBEDDED_PTR,		// embedded datamap behind a pointer, has its own plan
+};
+
+struct PredictionCopyField_t
+{
+	typedescription_t		*m_pField;
+	int						m_nDestOffset;
+	int						m_nSrcOffset;
+};
+
+struct PredictionCopyOp_t
+{
+	PredictionCopyOpType_t	m_nType;
+	int						m_nDestOffset;
+	int						m_nSrcOffset;
+	int						m_nBytes;
+	int						m_nFirstField;
+	int						m_nFieldCount;
+	bool					m_bDerefDest;
+	bool					m_bDerefSrc;
+	PredictionCopyPlan_t	*m_pEmbedded;
+};
+
+struct PredictionCopyPlan_t
+{
+	~PredictionCopyPlan_t()
+	{
+		m_Embedded.PurgeAndDeleteElements();
+	}
+
+	CUtlVector< PredictionCopyOp_t >		m_Ops;
+	CUtlVector< PredictionCopyField_t >		m_Fields;
+	CUtlVector< PredictionCopyPlan_t * >	m_Embedded;
+};
+
+//-----------------------------------------------------------------------------
+// Builds plans, visiting fields exactly the way CopyFields/TransferData_R would
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlanCompiler
+{
+public:
+	CPredictionCopyPlanCompiler( int nType, int nDestOffsetIndex, int nSrcOffsetIndex ) :
+		m_nType( nType ), m_nDestOffsetIndex( nDestOffsetIndex ), m_nSrcOffsetIndex( nSrcOffsetIndex )
+	{
+	}
+
+	bool CompileMap( PredictionCopyPlan_t *pPlan, datamap_t *dmap )
+	{
+		// Copy from here first, then baseclasses
+		for ( ; dmap; dmap = dmap->baseMap )
+		{
+			if ( !CompileFields( pPlan, dmap->dataDesc, dmap->dataNumFields, 0, 0 ) )
+				return false;
+		}
+		return true;
+	}
+
+private:
+	static int FieldBytes( const typedescription_t *pField )
+	{
+		switch( pField->fieldType )
+		{
+		case FIELD_FLOAT:		return sizeof( float ) * pField->fieldSize;
+		case FIELD_VECTOR:		return sizeof( Vector ) * pField->fieldSize;
+		case FIELD_QUATERNION:	return sizeof( Quaternion ) * pField->fieldSize;
+		case FIELD_COLOR32:		return 4 * pField->fieldSize;
+		case FIELD_BOOLEAN:		return sizeof( bool ) * pField->fieldSize;
+		case FIELD_INTEGER:		return sizeof( int ) * pField->fieldSize;
+		case FIELD_SHORT:		return sizeof( short ) * pField->fieldSize;
+		case FIELD_CHARACTER:	return pField->fieldSize;
+		case FIELD_EHANDLE:		return sizeof( EHANDLE ) * pField->fieldSize;
+		default:				return 0;
+		}
+	}
+
+	void AddField( PredictionCopyPlan_t *pPlan, PredictionCopyOpType_t nOpType, typedescription_t *pField, int nDestOffset, int nSrcOffset, int nBytes )
+	{
+		int nField = pPlan->m_Fields.AddToTail();
+		pPlan->m_Fields[nField].m_pField = pField;
+		pPlan->m_Fields[nField].m_nDestOffset = nDestOffset;
+		pPlan->m_Fields[nField].m_nSrcOffset = nSrcOffset;
+
+		if ( nOpType == PC_OP_BYTES && pPlan->m_Ops.Count() )
+		{
+			PredictionCopyOp_t &last = pPlan->m_Ops.Tail();
+			if ( last.m_nType == PC_OP_BYTES && 
+				( last.m_nDestOffset + last.m_nBytes == nDestOffset ) &&
+				( last.m_nSrcOffset + last.m_nBytes == nSrcOffset ) &&
+				( last.m_nFirstField + last.m_nFieldCount == nField ) )
+			{
+				last.m_nBytes += nBytes;
+				++last.m_nFieldCount;
+				return;
+			}
+		}
+
+		PredictionCopyOp_t &op = pPlan->m_Ops[ pPlan->m_Ops.AddToTail() ];
+		op.m_nType = nOpType;
+		op.m_nDestOffset = nDestOffset;
+		op.m_nSrcOffset = nSrcOffset;
+		op.m_nBytes = nBytes;
+		op.m_nFirstField = nField;
+		op.m_nFieldCount = 1;
+		op.m_bDerefDest = false;
+		op.m_bDerefSrc = false;
+		op.m_pEmbedded = NULL;
+	}
+
+	bool CompileFields( PredictionCopyPlan_t *pPlan, typedescription_t *pFields, int fieldCount, int nDestBase, int nSrcBase )
+	{
+		for ( int i = 0; i < fieldCount; i++ )
+		{
+			typedescription_t *pField = &pFields[ i ];
+			int flags = pField->flags;
+
+			// Mark any subchains first
+			if ( pField->override_field != NULL )
+			{
+				m_Overridden.AddToTail( pField->override_field );
+			}
+
+			// Skip this field?
+			if ( m_Overridden.Find( pField ) != m_Overridden.InvalidIndex() )
+				continue;
+
+			// Always recurse into embeddeds
+			if ( pField->fieldType != FIELD_EMBEDDED )
+			{
+				if ( flags & FTYPEDESC_PRIVATE )
+					continue;
+
+				if ( m_nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+					continue;
+
+				if ( m_nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+					continue;
+			}
+
+			int nDestOffset = nDestBase + pField->fieldOffset[ m_nDestOffsetIndex ];
+			int nSrcOffset = nSrcBase + pField->fieldOffset[ m_nSrcOffsetIndex ];
+
+			switch( pField->fieldType )
+			{
+			case FIELD_EMBEDDED:
+				{
+					bool bDerefDest = ( flags & FTYPEDESC_PTR ) && ( m_nDestOffsetIndex == PC_DATA_NORMAL );
+					bool bDerefSrc = ( flags & FTYPEDESC_PTR ) && ( m_nSrcOffsetIndex == PC_DATA_NORMAL );
+					if ( !bDerefDest && !bDerefSrc )
+					{
+						if ( !CompileFields( pPlan, pField->td->dataDesc, pField->td->dataNumFields, nDestOffset, nSrcOffset ) )
+							return false;
+						break;
+					}
+
+					// Where it points can change, so this one gets resolved at transfer time
+					PredictionCopyPlan_t *pEmbedded = new PredictionCopyPlan_t;
+					pPlan->m_Embedded.AddToTail( pEmbedded );
+					if ( !CompileFields( pEmbedded, pField->td->dataDesc, pField->td->dataNumFields, 0, 0 ) )
+						return false;
+
+					PredictionCopyOp_t &op = pPlan->m_Ops[ pPlan->m_Ops.AddToTail() ];
+					op.m_nType = PC_OP_EMBEDDED_PTR;
+					op.m_nDestOffset = nDestOffset;
+					op.m_nSrcOffset = nSrcOffset;
+					op.m_nBytes = 0;
+					op.m_nFirstField = 0;
+					op.m_nFieldCount = 0;
+					op.m_bDerefDest = bDerefDest;
+					op.m_bDerefSrc = bDerefSrc;
+					op.m_pEmbedded = pEmbedded;
+				}
+				break;
+
+			case FIELD_STRING:
+				AddField( pPlan, PC_OP_STRING, pField, nDestOffset, nSrcOffset, 0 );
+				break;
+
+			case FIELD_FLOAT:
+			case FIELD_VECTOR:
+			case FIELD_QUATERNION:
+			case FIELD_COLOR32:
+			case FIELD_BOOLEAN:
+			case FIELD_INTEGER:
+			case FIELD_SHORT:
+			case FIELD_CHARACTER:
+			case FIELD_EHANDLE:
+				AddField( pPlan, PC_OP_BYTES, pField, nDestOffset, nSrcOffset, FieldBytes( pField ) );
+				break;
+
+			case FIELD_TIME:
+			case FIELD_TICK:
+			case FIELD_MODELINDEX:
+			case FIELD_MODELNAME:
+			case FIELD_SOUNDNAME:
+			case FIELD_CUSTOM:
+			case FIELD_CLASSPTR:
+			case FIELD_EDICT:
+			case FIELD_POSITION_VECTOR:
+			case FIELD_FUNCTION:
+			case FIELD_VOID:
+				// Not transferred by CopyFields either
+				break;
+
+			default:
+				// Let the walker complain about it
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	int m_nType;
+	int m_nDestOffsetIndex;
+	int m_nSrcOffsetIndex;
+	CUtlVector< typedescription_t * > m_Overridden;
+};
+
+//-----------------------------------------------------------------------------
+// Plans are built on first use and live until shutdown
+//-----------------------------------------------------------------------------
+struct PredictionCopyPlanKey_t
+{
+	datamap_t	*m_pMap;
+	int			m_nType;
+	int			m_nDestOffsetIndex;
+	int			m_nSrcOffsetIndex;
+};
+
+static bool PredictionCopyPlanKeyLessFunc( const PredictionCopyPlanKey_t &lhs, const PredictionCopyPlanKey_t &rhs )
+{
+	if ( lhs.m_pMap != rhs.m_pMap )
+		return lhs.m_pMap < rhs.m_pMap;
+	if ( lhs.m_nType != rhs.m_nType )
+		return lhs.m_nType < rhs.m_nType;
+	if ( lhs.m_nDestOffsetIndex != rhs.m_nDestOffsetIndex )
+		return lhs.m_nDestOffsetIndex < rhs.m_nDestOffsetIndex;
+	return lhs.m_nSrcOffsetIndex < rhs.m_nSrcOffsetIndex;
+}
+
+class CPredictionCopyPlanCache
+{
+public:
+	CPredictionCopyPlanCache() : m_Plans( 0, 0, PredictionCopyPlanKeyLessFunc )
+	{
+	}
+
+	~CPredictionCopyPlanCache()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			delete m_Plans[i];
+		}
+	}
+
+	// Returns NULL if the datamap can't be compiled
+	PredictionCopyPlan_t *FindOrCompile( datamap_t *dmap, int nType, int nDestOffsetIndex, int nSrcOffsetIndex )
+	{
+		PredictionCopyPlanKey_t key;
+		key.m_pMap = dmap;
+		key.m_nType = nType;
+		key.m_nDestOffsetIndex = nDestOffsetIndex;
+		key.m_nSrcOffsetIndex = nSrcOffsetIndex;
+
+		unsigned short i = m_Plans.Find( key );
+		if ( i != m_Plans.InvalidIndex() )
+			return m_Plans[i];
+
+		PredictionCopyPlan_t *pPlan = new PredictionCopyPlan_t;
+		CPredictionCopyPlanCompiler compiler( nType, nDestOffsetIndex, nSrcOffsetIndex );
+		if ( !compiler.CompileMap( pPlan, dmap ) )
+		{
+			delete pPlan;
+			pPlan = NULL;
+		}
+
+		m_Plans.Insert( key, pPlan );
+		return pPlan;
+	}
+
+private:
+	CUtlMap< PredictionCopyPlanKey_t, PredictionCopyPlan_t * > m_Plans;
+};
+
+static CPredictionCopyPlanCache g_PredictionCopyPlans;
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the compiled plan for dmap if nothing needs to be reported
+// Output : false if the caller has to walk the datamap instead
+//-----------------------------------------------------------------------------
+bool CPredictionCopy::TransferCompiledPlan( datamap_t *dmap )
+{
+	if ( !cl_pred_compiledcopy.GetBool() )
+		return false;
+
+	// Anything that prints needs the walker's field by field bookkeeping
+	if ( m_pWatchField || m_bReportErrors || m_bDescribeFields )
+		return false;
+
+	if ( !m_bErrorCheck && !m_bPerformCopy )
+		return true;
+
+	bool bPacked = ( m_nDestOffsetIndex == TD_OFFSET_PACKED ) || ( m_nSrcOffsetIndex == TD_OFFSET_PACKED );
+	if ( bPacked && !dmap->packed_offsets_computed )
+		return false;
+
+	PredictionCopyPlan_t *pPlan = g_PredictionCopyPlans.FindOrCompile( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+	if ( !pPlan )
+		return false;
+
+	m_pCurrentMap = dmap;
+	m_pCurrentClassName = dmap->dataClassName;
+	if ( m_bErrorCheck )
+	{
+		ExecuteComparePlan( pPlan, (char *)m_pDest, (const char *)m_pSrc );
+	}
+	else
+	{
+		ExecuteCopyPlan( pPlan, (char *)m_pDest, (const char *)m_pSrc );
+	}
+	m_pCurrentClassName = NULL;
+	return true;
+}
+
+void CPredictionCopy::ExecuteCopyPlan( const PredictionCopyPlan_t *pPlan, char *pDest, const char *pSrc )
+{
+	int nCount = pPlan->m_Ops.Count();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		const PredictionCopyOp_t &op = pPlan->m_Ops[i];
+		switch( op.m_nType )
+		{
+		case PC_OP_BYTES:
+			memcpy( pDest + op.m_nDestOffset, pSrc + op.m_nSrcOffset, op.m_nBytes );
+			break;
+
+		case PC_OP_STRING:
+			{
+				const char *pInString = pSrc + op.m_nSrcOffset;
+				memcpy( pDest + op.m_nDestOffset, pInString, Q_strlen( pInString ) + 1 );
+			}
+			break;
+
+		case PC_OP_EMBEDDED_PTR:
+			{
+				char *pEmbeddedDest = pDest + op.m_nDestOffset;
+				const char *pEmbeddedSrc = pSrc + op.m_nSrcOffset;
+				if ( op.m_bDerefDest )
+				{
+					pEmbeddedDest = *((char **)pEmbeddedDest);
+				}
+				if ( op.m_bDerefSrc )
+				{
+					pEmbeddedSrc = *((char * const *)pEmbeddedSrc);
+				}
+				ExecuteCopyPlan( op.m_pEmbedded, pEmbeddedDest, pEmbeddedSrc );
+			}
+			break;
+		}
+	}
+}
+
+void CPredictionCopy::ExecuteComparePlan( const PredictionCopyPlan_t *pPlan, char *pDest, const char *pSrc )
+{
+	int nCount = pPlan->m_Ops.Count();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		const PredictionCopyOp_t &op = pPlan->m_Ops[i];
+		switch( op.m_nType )
+		{
+		case PC_OP_BYTES:
+			if ( !memcmp( pDest + op.m_nDestOffset, pSrc + op.m_nSrcOffset, op.m_nBytes ) )
+				break;
+
+			// Something in here differs, find out what the walker would have made of it
+			// fall through
+
+		case PC_OP_STRING:
+			{
+				for ( int j = 0; j < op.m_nFieldCount; ++j )
+				{
+					const PredictionCopyField_t &field = pPlan->m_Fields[ op.m_nFirstField + j ];
+					m_pCurrentField = field.m_pField;
+					TransferField( pDest + field.m_nDestOffset, pSrc + field.m_nSrcOffset );
+				}
+			}
+			break;
+
+		case PC_OP_EMBEDDED_PTR:
+			{
+				char *pEmbeddedDest = pDest + op.m_nDestOffset;
+				const char *pEmbeddedSrc = pSrc + op.m_nSrcOffset;
+				if ( op.m_bDerefDest )
+				{
+					pEmbeddedDest = *((char **)pEmbeddedDest);
+				}
+				if ( op.m_bDerefSrc )
+				{
+					pEmbeddedSrc = *((char * const *)pEmbeddedSrc);
+				}
+				ExecuteComparePlan( op.m_pEmbedded, pEmbeddedDest, pEmbeddedSrc );
+			}
+			break;
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1391,7 +1827,10 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
-	TransferData_R( g_nChainCount, dmap );
+	if ( !TransferCompiledPlan( dmap ) )
+	{
+		TransferData_R( g_nChainCount, dmap );
+	}
 
 	return m_nErrorCount;
 }
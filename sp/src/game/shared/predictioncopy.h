@@ -41,6 +41,8 @@ enum
 #define PC_DATA_PACKED			true
 #define PC_DATA_NORMAL			false
 
+struct PredictionCopyPlan_t;
+
 typedef void ( *FN_FIELD_COMPARE )( const char *classname, const char *fieldname, const char *fieldtype,
 	bool networked, bool noterrorchecked, bool differs, bool withintolerance, const char *value );
 
@@ -85,6 +87,11 @@ public:
 private:
 	void	TransferData_R( int chaincount, datamap_t *dmap );
 
+	// Flattened per-class copy/compare plans, used when nothing needs to be reported
+	bool	TransferCompiledPlan( datamap_t *dmap );
+	void	ExecuteCopyPlan( const PredictionCopyPlan_t *pPlan, char *pDest, const char *pSrc );
+	void	ExecuteComparePlan( const PredictionCopyPlan_t *pPlan, char *pDest, const char *pSrc );
+
 	void	DetermineWatchField( const char *operation, int entindex,  datamap_t *dmap );
 	void	DumpWatchField( typedescription_t *field );
 	void	WatchMsg( PRINTF_FORMAT_STRING const char *fmt, ... );
@@ -132,6 +139,7 @@ private:
 	bool	CanCheck( void );
 
 	void	CopyFields( int chaincount, datamap_t *pMap, typedescription_t *pFields, int fieldCount );
+	void	TransferField( void *pOutputData, void const *pInputData );
 
 private:
 
@@ -28,6 +28,7 @@ struct edict_t;
 struct datamap_t;
 class CBaseEntity;
 struct interval_t;
+struct SaveBlockRecord_t;
 
 //-----------------------------------------------------------------------------
 //
@@ -166,6 +167,12 @@ private:
 	
 	bool			WriteGameField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	int				EntityIndex( const edict_t *pentLookup );
+
+	//---------------------------------
+	// Incremental save support
+	//
+
+	void			RecordFixups( int type, int nPos, const void *pData, int nStride, int count );
 	
 	//---------------------------------
 	
@@ -179,6 +186,12 @@ private:
 
 	FileHandle_t		m_hLogFile;
 	bool				m_bAsync;
+
+	// Set while an entity block is recorded for the incremental save cache
+	SaveBlockRecord_t	*m_pRecord;
+	int					m_nWriteAllDepth;
+
+	friend class CSaveBlockCache;
 };
 
 //-----------------------------------------------------------------------------
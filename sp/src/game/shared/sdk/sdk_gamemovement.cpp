@@ -39,6 +39,14 @@ public:
 static CSDKGameMovement g_GameMovement;
 IGameMovement *g_pGameMovement = ( IGameMovement * )&g_GameMovement;
 
+#ifdef GAME_DLL
+// More instances, for players whose movement runs in parallel
+IGameMovement *CreateGameMovement()
+{
+	return new CSDKGameMovement;
+}
+#endif
+
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CGameMovement, IGameMovement,INTERFACENAME_GAMEMOVEMENT, g_GameMovement );
 
 
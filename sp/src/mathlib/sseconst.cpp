@@ -1162,3 +1162,50 @@ void TransformManyPointsBy(VectorAligned * RESTRICT pVectors, unsigned int numVe
 
 }
 #endif
+
+//-----------------------------------------------------------------------------
+// Angles and origins of four matrices at once. Transposing the rows of the
+// four matrices lines up their forward and left columns, so the math is the
+// same as MatrixAngles() done one lane per matrix, gimbal lock branch included.
+// On PC ArcTan2SIMD() is double atan2 where MatrixAngles() uses atan2f, so
+// results agree to within 0.001 degrees rather than bit for bit; the
+// fourmatricesangles libtest checks that.
+//-----------------------------------------------------------------------------
+void FourMatricesAnglesSIMD( const matrix3x4_t * const *ppMatrices, FourVectors &angles, FourVectors &positions )
+{
+	// Named for what they hold after the transpose
+	fltx4 forwardX = LoadUnalignedSIMD( (*ppMatrices[0])[0] );
+	fltx4 leftX = LoadUnalignedSIMD( (*ppMatrices[1])[0] );
+	fltx4 upX = LoadUnalignedSIMD( (*ppMatrices[2])[0] );
+	fltx4 originX = LoadUnalignedSIMD( (*ppMatrices[3])[0] );
+	TransposeSIMD( forwardX, leftX, upX, originX );
+
+	fltx4 forwardY = LoadUnalignedSIMD( (*ppMatrices[0])[1] );
+	fltx4 leftY = LoadUnalignedSIMD( (*ppMatrices[1])[1] );
+	fltx4 upY = LoadUnalignedSIMD( (*ppMatrices[2])[1] );
+	fltx4 originY = LoadUnalignedSIMD( (*ppMatrices[3])[1] );
+	TransposeSIMD( forwardY, leftY, upY, originY );
+
+	fltx4 forwardZ = LoadUnalignedSIMD( (*ppMatrices[0])[2] );
+	fltx4 leftZ = LoadUnalignedSIMD( (*ppMatrices[1])[2] );
+	fltx4 upZ = LoadUnalignedSIMD( (*ppMatrices[2])[2] );
+	fltx4 originZ = LoadUnalignedSIMD( (*ppMatrices[3])[2] );
+	TransposeSIMD( forwardZ, leftZ, upZ, originZ );
+
+	positions.x = originX;
+	positions.y = originY;
+	positions.z = originZ;
+
+	fltx4 xyDist = SqrtSIMD( MaddSIMD( forwardX, forwardX, MulSIMD( forwardY, forwardY ) ) );
+
+	// Lanes where forward is mostly Z are in gimbal lock; those take their yaw from left and have no roll
+	fltx4 fl4Locked = CmpLeSIMD( xyDist, ReplicateX4( 0.001f ) );
+	fltx4 yaw = MaskedAssign( fl4Locked, ArcTan2SIMD( fnegate( leftX ), leftY ), ArcTan2SIMD( forwardY, forwardX ) );
+	fltx4 pitch = ArcTan2SIMD( fnegate( forwardZ ), xyDist );
+	fltx4 roll = AndNotSIMD( fl4Locked, ArcTan2SIMD( leftZ, upZ ) );
+
+	fltx4 fl4RadToDeg = ReplicateX4( (float)(180.f / M_PI_F) );
+	angles.x = MulSIMD( pitch, fl4RadToDeg );
+	angles.y = MulSIMD( yaw, fl4RadToDeg );
+	angles.z = MulSIMD( roll, fl4RadToDeg );
+}
@@ -284,6 +284,47 @@ bool FASTCALL IsBoxIntersectingRay( const fltx4& boxMin, const fltx4& boxMax,
 								   const Ray_t& ray, float flTolerance = 0.0f );
 
 
+//-----------------------------------------------------------------------------
+// 
+// Batched ray tests
+//
+// One ray against four boxes, or four rays against one box, with the boxes
+// or rays stored as structures of arrays. Each returns a mask with bit i set
+// if box or ray i intersects. Lanes that aren't in use may hold anything;
+// mask them off the result.
+//
+// pEnterFractions, if given, receives where each ray enters its box (0 if it
+// starts inside). Lanes that miss are undefined.
+//
+//-----------------------------------------------------------------------------
+
+int FASTCALL IsFourBoxesIntersectingRay( const FourVectors& boxMin, const FourVectors& boxMax, 
+										const Ray_t& ray, float flTolerance = 0.0f, fltx4 *pEnterFractions = NULL );
+
+int FASTCALL IsBoxIntersectingFourRays( const Vector& boxMin, const Vector& boxMax, 
+									   const FourVectors& origin, const FourVectors& delta, float flTolerance = 0.0f, fltx4 *pEnterFractions = NULL );
+
+// matOBBToWorld must be a rotation and translation, as for IntersectRayWithOBB
+int FASTCALL IsOBBIntersectingFourRays( const matrix3x4_t &matOBBToWorld, const Vector &vecOBBMins, const Vector &vecOBBMaxs, 
+									   const FourVectors& origin, const FourVectors& delta, float flTolerance = 0.0f, fltx4 *pEnterFractions = NULL );
+
+// Four oriented boxes as centers, unit axes and half sizes along those axes
+struct FourOBBs_t
+{
+	FourVectors	m_vecCenter;
+	FourVectors	m_vecAxis[3];
+	FourVectors	m_vecExtents;
+
+	// Sets box i. The transform may scale each axis, e.g. a scaled bone.
+	void Set( int i, const matrix3x4_t &matOBBToWorld, const Vector &vecOBBMins, const Vector &vecOBBMaxs );
+};
+
+// Separating axis test. Exact for rays. For swept boxes it skips the box
+// edge vs. box edge axes, so it can report an overlap that isn't there
+// (never the reverse), which is fine for culling before IntersectRayWithOBB.
+int FASTCALL IsFourOBBsIntersectingRay( const FourOBBs_t &obbs, const Ray_t& ray, float flTolerance = 0.0f );
+
+
 
 //-----------------------------------------------------------------------------
 // 
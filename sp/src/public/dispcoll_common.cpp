@@ -53,6 +53,124 @@ public:
 
 CUtlHash<DispCollPlaneIndex_t, CPlaneIndexHashFuncs, CPlaneIndexHashFuncs> g_DispCollPlaneIndexHash( 512 );
 
+bool g_bDispCollCullFourTris = true;
+
+
+//=============================================================================
+//	Four-wide triangle culling
+//
+//	Each cull returns a mask of the triangles that may still be hit and need
+//	the exact test. They only reject a triangle when it is clear of its plane
+//	by more than DISPCOLL_DIST_EPSILON, so the exact tests see every triangle
+//	they could report a hit on.
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers the triangles of the next two leaves in the list. When only
+//          one leaf is left its triangles fill the other lanes too, and the
+//          returned mask leaves them out.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int GatherFourTris( const CDispCollLeaf *pLeaves, int nNodes, const int *pNodeList, int listIndex, int maxIndex, int *pTris )
+{
+	const CDispCollLeaf &leaf0 = pLeaves[pNodeList[listIndex] - nNodes];
+	pTris[0] = leaf0.m_tris[0];
+	pTris[1] = leaf0.m_tris[1];
+
+	if ( listIndex < maxIndex )
+	{
+		const CDispCollLeaf &leaf1 = pLeaves[pNodeList[listIndex + 1] - nNodes];
+		pTris[2] = leaf1.m_tris[0];
+		pTris[3] = leaf1.m_tris[1];
+		return 0xf;
+	}
+
+	pTris[2] = pTris[0];
+	pTris[3] = pTris[1];
+	return 0x3;
+}
+
+static FORCEINLINE void LoadFourTriPlanes( const Vector4D *pPlanes, const int *pTris, FourVectors &normals, fltx4 &dists )
+{
+	fltx4 x = LoadUnalignedSIMD( pPlanes[pTris[0]].Base() );
+	fltx4 y = LoadUnalignedSIMD( pPlanes[pTris[1]].Base() );
+	fltx4 z = LoadUnalignedSIMD( pPlanes[pTris[2]].Base() );
+	fltx4 w = LoadUnalignedSIMD( pPlanes[pTris[3]].Base() );
+	TransposeSIMD( x, y, z, w );
+	normals.x = x;
+	normals.y = y;
+	normals.z = z;
+	dists = w;
+}
+
+// Distance the box reaches toward each plane from its center
+static FORCEINLINE fltx4 FourPlanesBoxRadius( const FourVectors &normals, const Vector &vecExtents )
+{
+	fltx4 radius = MulSIMD( fabs( normals.x ), ReplicateX4( vecExtents.x ) );
+	radius = MaddSIMD( fabs( normals.y ), ReplicateX4( vecExtents.y ), radius );
+	radius = MaddSIMD( fabs( normals.z ), ReplicateX4( vecExtents.z ), radius );
+	return radius;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rejects what SweepAABBTriIntersect would: triangles the box moves
+//          away from, and ones it stays in front of for the whole sweep.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int CullFourTrisSweep( const Vector4D *pPlanes, const int *pTris, const Ray_t &ray )
+{
+	FourVectors normals;
+	fltx4 dists;
+	LoadFourTriPlanes( pPlanes, pTris, normals, dists );
+
+	fltx4 margin = ReplicateX4( DISPCOLL_DIST_EPSILON );
+
+	fltx4 distAlongNormal = normals * ray.m_Delta;
+	fltx4 reject = CmpGtSIMD( distAlongNormal, AddSIMD( margin, margin ) );
+
+	fltx4 start = SubSIMD( normals * ray.m_Start, AddSIMD( dists, FourPlanesBoxRadius( normals, ray.m_Extents ) ) );
+	fltx4 end = AddSIMD( start, distAlongNormal );
+	reject = OrSIMD( reject, AndSIMD( CmpGtSIMD( start, margin ), CmpGtSIMD( end, margin ) ) );
+
+	return ~TestSignSIMD( reject ) & 0xf;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rejects triangles a ray (no extents) stays on one side of.
+//          IntersectRayWithTriangle takes hits a little past either end of
+//          the ray, so the margin grows with the ray's length.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int CullFourTrisRay( const Vector4D *pPlanes, const int *pTris, const Ray_t &ray )
+{
+	FourVectors normals;
+	fltx4 dists;
+	LoadFourTriPlanes( pPlanes, pTris, normals, dists );
+
+	fltx4 start = SubSIMD( normals * ray.m_Start, dists );
+	fltx4 delta = normals * ray.m_Delta;
+	fltx4 end = AddSIMD( start, delta );
+
+	fltx4 margin = MaddSIMD( fabs( delta ), ReplicateX4( 1e-3f ), ReplicateX4( DISPCOLL_DIST_EPSILON ) );
+	fltx4 negMargin = SubSIMD( Four_Zeros, margin );
+	fltx4 reject = AndSIMD( CmpGtSIMD( start, margin ), CmpGtSIMD( end, margin ) );
+	reject = OrSIMD( reject, AndSIMD( CmpLtSIMD( start, negMargin ), CmpLtSIMD( end, negMargin ) ) );
+
+	return ~TestSignSIMD( reject ) & 0xf;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rejects triangles whose plane misses the box.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int CullFourTrisBox( const Vector4D *pPlanes, const int *pTris, const Vector &vecCenter, const Vector &vecExtents )
+{
+	FourVectors normals;
+	fltx4 dists;
+	LoadFourTriPlanes( pPlanes, pTris, normals, dists );
+
+	fltx4 dist = SubSIMD( normals * vecCenter, dists );
+	fltx4 radius = AddSIMD( FourPlanesBoxRadius( normals, vecExtents ), ReplicateX4( DISPCOLL_DIST_EPSILON ) );
+	fltx4 reject = CmpGtSIMD( fabs( dist ), radius );
+
+	return ~TestSignSIMD( reject ) & 0xf;
+}
+
 
 //=============================================================================
 //	Displacement Collision Triangle
@@ -336,6 +454,7 @@ void CDispCollTree::AABBTree_CopyDispData( CCoreDispInfo *pDisp )
 	{
 	MEM_ALLOC_CREDIT();
 	m_aTris.SetSize( GetTriSize() );
+	m_aTriPlanes.SetSize( GetTriSize() );
 	}
 
 	{
@@ -352,6 +471,7 @@ void CDispCollTree::AABBTree_CopyDispData( CCoreDispInfo *pDisp )
 	m_nSize = sizeof( this );
 	m_nSize += sizeof( Vector ) * GetSize();
 	m_nSize += sizeof( CDispCollTri ) * GetTriSize();
+	m_nSize += sizeof( Vector4D ) * GetTriSize();
 #if OLD_DISP_AABB
 	m_nSize += sizeof( CDispCollAABBNode ) * Nodes_CalcCount( m_nPower );
 #endif
@@ -397,6 +517,9 @@ void CDispCollTree::AABBTree_CopyDispData( CCoreDispInfo *pDisp )
 		// Calculate the plane normal and the min max.
 		m_aTris[iTri].CalcPlane( m_aVerts );
 		m_aTris[iTri].FindMinMax( m_aVerts );
+
+		m_aTriPlanes[iTri].AsVector3D() = m_aTris[iTri].m_vecNormal;
+		m_aTriPlanes[iTri].w = m_aTris[iTri].m_flDist;
 	}
 }
 
@@ -691,23 +814,30 @@ void CDispCollTree::AABBTree_TreeTrisRayTest( const Ray_t &ray, const Vector &ve
 	list.rayExtents.DuplicateVector(ext);
 	int listIndex = BuildRayLeafList( iNode, list );
 
-	for ( ;listIndex <= list.maxIndex; listIndex++ )
+	// Swept boxes hit triangles off their planes, so only pure rays are culled
+	bool bCull = g_bDispCollCullFourTris && ray.m_IsRay;
+
+	int iTris[4];
+	for ( ; listIndex <= list.maxIndex; listIndex += 2 )
 	{
-		int leafIndex = list.nodeList[listIndex] - m_nodes.Count();
-		CDispCollTri *pTri0 = &m_aTris[m_leaves[leafIndex].m_tris[0]];
-		CDispCollTri *pTri1 = &m_aTris[m_leaves[leafIndex].m_tris[1]];
-		float flFrac = IntersectRayWithTriangle( ray, m_aVerts[pTri0->GetVert( 0 )], m_aVerts[pTri0->GetVert( 2 )], m_aVerts[pTri0->GetVert( 1 )], bSide );
-		if( ( flFrac >= 0.0f ) && ( flFrac < pTrace->fraction ) )
+		int mask = GatherFourTris( m_leaves.Base(), m_nodes.Count(), list.nodeList, listIndex, list.maxIndex, iTris );
+		if ( bCull )
 		{
-			pTrace->fraction = flFrac;
-			(*pImpactTri) = pTri0;
+			mask &= CullFourTrisRay( m_aTriPlanes.Base(), iTris, ray );
 		}
-		
-		flFrac = IntersectRayWithTriangle( ray, m_aVerts[pTri1->GetVert( 0 )], m_aVerts[pTri1->GetVert( 2 )], m_aVerts[pTri1->GetVert( 1 )], bSide );
-		if( ( flFrac >= 0.0f ) && ( flFrac < pTrace->fraction ) )
+
+		for ( int i = 0; i < 4; i++ )
 		{
-			pTrace->fraction = flFrac;
-			(*pImpactTri) = pTri1;
+			if ( !( mask & ( 1 << i ) ) )
+				continue;
+
+			CDispCollTri *pTri = &m_aTris[iTris[i]];
+			float flFrac = IntersectRayWithTriangle( ray, m_aVerts[pTri->GetVert( 0 )], m_aVerts[pTri->GetVert( 2 )], m_aVerts[pTri->GetVert( 1 )], bSide );
+			if( ( flFrac >= 0.0f ) && ( flFrac < pTrace->fraction ) )
+			{
+				pTrace->fraction = flFrac;
+				(*pImpactTri) = pTri;
+			}
 		}
 	}
 }
@@ -818,34 +948,33 @@ bool CDispCollTree::AABBTree_IntersectAABB( const Vector &absMins, const Vector
 		if ( IsLeafNode(iNode) )
 		{
 			VPROF("Tris");
-			for ( --listIndex; listIndex <= maxIndex; listIndex++ )
+			int iTris[4];
+			for ( --listIndex; listIndex <= maxIndex; listIndex += 2 )
 			{
-				int leafIndex = nodeList[listIndex] - m_nodes.Count();
-				CDispCollTri *pTri0 = &m_aTris[m_leaves[leafIndex].m_tris[0]];
-				CDispCollTri *pTri1 = &m_aTris[m_leaves[leafIndex].m_tris[1]];
-
-				VectorCopy( pTri0->m_vecNormal, plane.normal );
-				plane.dist = pTri0->m_flDist;
-				plane.signbits = pTri0->m_ucSignBits;
-				plane.type = pTri0->m_ucPlaneType;
-
-				if ( IsBoxIntersectingTriangle( center, extents,
-					m_aVerts[pTri0->GetVert( 0 )],
-					m_aVerts[pTri0->GetVert( 2 )],
-					m_aVerts[pTri0->GetVert( 1 )],
-					plane, 0.0f ) )
-					return true;
-				VectorCopy( pTri1->m_vecNormal, plane.normal );
-				plane.dist = pTri1->m_flDist;
-				plane.signbits = pTri1->m_ucSignBits;
-				plane.type = pTri1->m_ucPlaneType;
-
-				if ( IsBoxIntersectingTriangle( center, extents,
-					m_aVerts[pTri1->GetVert( 0 )],
-					m_aVerts[pTri1->GetVert( 2 )],
-					m_aVerts[pTri1->GetVert( 1 )],
-					plane, 0.0f ) )
-					return true;
+				int mask = GatherFourTris( m_leaves.Base(), m_nodes.Count(), nodeList, listIndex, maxIndex, iTris );
+				if ( g_bDispCollCullFourTris )
+				{
+					mask &= CullFourTrisBox( m_aTriPlanes.Base(), iTris, center, extents );
+				}
+
+				for ( int i = 0; i < 4; i++ )
+				{
+					if ( !( mask & ( 1 << i ) ) )
+						continue;
+
+					CDispCollTri *pTri = &m_aTris[iTris[i]];
+					VectorCopy( pTri->m_vecNormal, plane.normal );
+					plane.dist = pTri->m_flDist;
+					plane.signbits = pTri->m_ucSignBits;
+					plane.type = pTri->m_ucPlaneType;
+
+					if ( IsBoxIntersectingTriangle( center, extents,
+						m_aVerts[pTri->GetVert( 0 )],
+						m_aVerts[pTri->GetVert( 2 )],
+						m_aVerts[pTri->GetVert( 1 )],
+						plane, 0.0f ) )
+						return true;
+				}
 			}
 			break;
 		}
@@ -912,20 +1041,37 @@ bool CDispCollTree::AABBTree_SweepAABB( const Ray_t &ray, const Vector &vecInvDe
 	list.rayExtents.DuplicateVector(ext);
 	int listIndex = BuildRayLeafList( 0, list );
 
-	if ( listIndex <= list.maxIndex )
+	// The edge plane cache is only needed for the exact test, so it isn't
+	// locked until a triangle gets past the plane cull
+	bool bLocked = false;
+	int iTris[4];
+	for ( ; listIndex <= list.maxIndex; listIndex += 2 )
 	{
-		LockCache();
-		for ( ; listIndex <= list.maxIndex; listIndex++ )
+		int mask = GatherFourTris( m_leaves.Base(), m_nodes.Count(), list.nodeList, listIndex, list.maxIndex, iTris );
+		if ( g_bDispCollCullFourTris )
+		{
+			mask &= CullFourTrisSweep( m_aTriPlanes.Base(), iTris, ray );
+			if ( !mask )
+				continue;
+		}
+
+		if ( !bLocked )
 		{
-			int leafIndex = list.nodeList[listIndex] - m_nodes.Count();
-			int iTri0 = m_leaves[leafIndex].m_tris[0];
-			int iTri1 = m_leaves[leafIndex].m_tris[1];
-			CDispCollTri *pTri0 = &m_aTris[iTri0];
-			CDispCollTri *pTri1 = &m_aTris[iTri1];
-
-			SweepAABBTriIntersect( ray, rayDir, iTri0, pTri0, pTrace );
-			SweepAABBTriIntersect( ray, rayDir, iTri1, pTri1, pTrace );
+			LockCache();
+			bLocked = true;
 		}
+
+		for ( int i = 0; i < 4; i++ )
+		{
+			if ( mask & ( 1 << i ) )
+			{
+				SweepAABBTriIntersect( ray, rayDir, iTris[i], &m_aTris[iTris[i]], pTrace );
+			}
+		}
+	}
+
+	if ( bLocked )
+	{
 		UnlockCache();
 	}
 
@@ -1418,6 +1564,7 @@ CDispCollTree::CDispCollTree()
 
 	m_aVerts.Purge();
 	m_aTris.Purge();
+	m_aTriPlanes.Purge();
 	m_aEdgePlanes.Purge();
 #ifdef ENGINE_DLL
 	m_hCache = INVALID_MEMHANDLE;
@@ -1435,6 +1582,7 @@ CDispCollTree::~CDispCollTree()
 #endif
 	m_aVerts.Purge();
 	m_aTris.Purge();
+	m_aTriPlanes.Purge();
 	m_aEdgePlanes.Purge();
 }
 
@@ -0,0 +1,344 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per entity hitbox bounds trees and batched rays for hitbox traces
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "tier0/dbg.h"
+#include "tier0/vprof.h"
+#include "tier0/threadtools.h"
+#include "mathlib/mathlib.h"
+#include "studio.h"
+#include "cmodel.h"
+#include "collisionutils.h"
+#include "convar.h"
+#include "hitbox_bvh.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar hitbox_trace_bvh( "hitbox_trace_bvh", "1", FCVAR_REPLICATED, "Keep a tree of hitbox bounds per entity to skip hitboxes traces can't reach, and test batches of rays such as shotgun pellets against it together." );
+
+//-----------------------------------------------------------------------------
+// Ray batches
+//-----------------------------------------------------------------------------
+CHitboxRayBatch *CHitboxRayBatch::s_pActive = NULL;
+static int s_nHitboxRayBatchSerial = 0;
+
+CHitboxRayBatch::CHitboxRayBatch()
+{
+	m_nRays = 0;
+	m_nSerial = 0;
+	m_bActive = false;
+	m_pPrevActive = NULL;
+}
+
+CHitboxRayBatch::~CHitboxRayBatch()
+{
+	if ( m_bActive )
+	{
+		Assert( s_pActive == this );
+		s_pActive = m_pPrevActive;
+	}
+}
+
+bool CHitboxRayBatch::AddRay( const Vector &vecStart, const Vector &vecEnd )
+{
+	Assert( !m_bActive );
+	if ( m_bActive || m_nRays >= HITBOX_RAY_BATCH_MAX )
+		return false;
+
+	Ray_t ray;
+	ray.Init( vecStart, vecEnd );
+
+	// Fill out the rest of the group with this ray, so unused lanes are harmless
+	FourVectors &starts = m_Starts[ m_nRays / 4 ];
+	FourVectors &deltas = m_Deltas[ m_nRays / 4 ];
+	for ( int i = m_nRays % 4; i < 4; i++ )
+	{
+		starts.X( i ) = ray.m_Start.x;
+		starts.Y( i ) = ray.m_Start.y;
+		starts.Z( i ) = ray.m_Start.z;
+		deltas.X( i ) = ray.m_Delta.x;
+		deltas.Y( i ) = ray.m_Delta.y;
+		deltas.Z( i ) = ray.m_Delta.z;
+	}
+	m_nRays++;
+	return true;
+}
+
+void CHitboxRayBatch::Activate()
+{
+	if ( m_bActive || !m_nRays || !ThreadInMainThread() )
+		return;
+
+	m_nSerial = ++s_nHitboxRayBatchSerial;
+	m_pPrevActive = s_pActive;
+	s_pActive = this;
+	m_bActive = true;
+}
+
+const CHitboxRayBatch *CHitboxRayBatch::GetActive()
+{
+	// Traces on other threads never use the batch
+	return ThreadInMainThread() ? s_pActive : NULL;
+}
+
+int CHitboxRayBatch::FindRay( const Ray_t &ray ) const
+{
+	if ( !ray.m_IsRay )
+		return -1;
+
+	for ( int i = 0; i < m_nRays; i++ )
+	{
+		const FourVectors &starts = m_Starts[ i / 4 ];
+		const FourVectors &deltas = m_Deltas[ i / 4 ];
+		int j = i % 4;
+		if ( starts.X( j ) == ray.m_Start.x && starts.Y( j ) == ray.m_Start.y && starts.Z( j ) == ray.m_Start.z &&
+			 deltas.X( j ) == ray.m_Delta.x && deltas.Y( j ) == ray.m_Delta.y && deltas.Z( j ) == ray.m_Delta.z )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Hitbox trees
+//-----------------------------------------------------------------------------
+CHitboxBVH::CHitboxBVH()
+{
+	m_nBoneSerial = 0;
+	m_pStudioHdr = NULL;
+	m_pSet = NULL;
+	m_nBatchSerial = 0;
+}
+
+bool CHitboxBVH::IsEnabled()
+{
+	return hitbox_trace_bvh.GetBool();
+}
+
+void CHitboxBVH::Update( CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int nBoneSerial )
+{
+	if ( nBoneSerial == m_nBoneSerial && pStudioHdr == m_pStudioHdr && set == m_pSet )
+		return;
+
+	VPROF( "CHitboxBVH::Update" );
+
+	m_nBoneSerial = nBoneSerial;
+	m_pStudioHdr = pStudioHdr;
+	m_pSet = set;
+	m_nBatchSerial = 0;
+	m_Nodes.RemoveAll();
+
+	int nHitboxes = set->numhitboxes;
+	if ( nHitboxes <= 0 || nHitboxes > HITBOX_BVH_MAX_HITBOXES )
+		return;
+
+	int hitboxes[HITBOX_BVH_MAX_HITBOXES];
+	Vector mins[HITBOX_BVH_MAX_HITBOXES];
+	Vector maxs[HITBOX_BVH_MAX_HITBOXES];
+	for ( int i = 0; i < nHitboxes; i++ )
+	{
+		mstudiobbox_t *pbox = set->pHitbox(i);
+		if ( !hitboxbones[pbox->bone] )
+			return;
+
+		TransformAABB( *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax, mins[i], maxs[i] );
+		hitboxes[i] = i;
+	}
+
+	Vector vecMins, vecMaxs;
+	BuildNode( hitboxes, nHitboxes, mins, maxs, vecMins, vecMaxs );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sorts the hitboxes along the axis their centers are most spread
+//			out on and splits them into up to four children. Returns the new
+//			node and the bounds of all of its hitboxes.
+//-----------------------------------------------------------------------------
+int CHitboxBVH::BuildNode( int *pHitboxes, int nHitboxes, const Vector *pMins, const Vector *pMaxs, Vector &vecMins, Vector &vecMaxs )
+{
+	int iNode = m_Nodes.AddToTail();
+
+	// Centers are left doubled, only their order matters
+	Vector vecCenterMins, vecCenterMaxs;
+	ClearBounds( vecCenterMins, vecCenterMaxs );
+	for ( int i = 0; i < nHitboxes; i++ )
+	{
+		AddPointToBounds( pMins[ pHitboxes[i] ] + pMaxs[ pHitboxes[i] ], vecCenterMins, vecCenterMaxs );
+	}
+
+	Vector vecSpread = vecCenterMaxs - vecCenterMins;
+	int nAxis = ( vecSpread.x >= vecSpread.y && vecSpread.x >= vecSpread.z ) ? 0 : ( ( vecSpread.y >= vecSpread.z ) ? 1 : 2 );
+	for ( int i = 1; i < nHitboxes; i++ )
+	{
+		int iHitbox = pHitboxes[i];
+		float flCenter = pMins[iHitbox][nAxis] + pMaxs[iHitbox][nAxis];
+		int j = i;
+		for ( ; j > 0 && pMins[ pHitboxes[j - 1] ][nAxis] + pMaxs[ pHitboxes[j - 1] ][nAxis] > flCenter; j-- )
+		{
+			pHitboxes[j] = pHitboxes[j - 1];
+		}
+		pHitboxes[j] = iHitbox;
+	}
+
+	// Built on the side, since building the children can grow m_Nodes
+	Node_t node;
+	node.m_nChildren = MIN( nHitboxes, 4 );
+	ClearBounds( vecMins, vecMaxs );
+	int iFirst = 0;
+	for ( int i = 0; i < node.m_nChildren; i++ )
+	{
+		int nCount = ( nHitboxes - iFirst ) / ( node.m_nChildren - i );
+		Vector vecChildMins, vecChildMaxs;
+		if ( nCount == 1 )
+		{
+			int iHitbox = pHitboxes[iFirst];
+			vecChildMins = pMins[iHitbox];
+			vecChildMaxs = pMaxs[iHitbox];
+			node.m_iChild[i] = ~iHitbox;
+		}
+		else
+		{
+			node.m_iChild[i] = BuildNode( pHitboxes + iFirst, nCount, pMins, pMaxs, vecChildMins, vecChildMaxs );
+		}
+		iFirst += nCount;
+
+		node.m_vecMins.X( i ) = vecChildMins.x;
+		node.m_vecMins.Y( i ) = vecChildMins.y;
+		node.m_vecMins.Z( i ) = vecChildMins.z;
+		node.m_vecMaxs.X( i ) = vecChildMaxs.x;
+		node.m_vecMaxs.Y( i ) = vecChildMaxs.y;
+		node.m_vecMaxs.Z( i ) = vecChildMaxs.z;
+		AddPointToBounds( vecChildMins, vecMins, vecMaxs );
+		AddPointToBounds( vecChildMaxs, vecMins, vecMaxs );
+	}
+
+	// Unused lanes are masked off; just give them real numbers
+	for ( int i = node.m_nChildren; i < 4; i++ )
+	{
+		node.m_vecMins.X( i ) = node.m_vecMins.X( 0 );
+		node.m_vecMins.Y( i ) = node.m_vecMins.Y( 0 );
+		node.m_vecMins.Z( i ) = node.m_vecMins.Z( 0 );
+		node.m_vecMaxs.X( i ) = node.m_vecMaxs.X( 0 );
+		node.m_vecMaxs.Y( i ) = node.m_vecMaxs.Y( 0 );
+		node.m_vecMaxs.Z( i ) = node.m_vecMaxs.Z( 0 );
+		node.m_iChild[i] = node.m_iChild[0];
+	}
+
+	m_Nodes[iNode] = node;
+	return iNode;
+}
+
+uint64 CHitboxBVH::TestRay( const Ray_t &ray, float flTolerance ) const
+{
+	uint64 candidates = 0;
+
+	// Every node goes on the stack at most once
+	int stack[HITBOX_BVH_MAX_HITBOXES];
+	int nStack = 0;
+	stack[nStack++] = 0;
+	while ( nStack )
+	{
+		const Node_t &node = m_Nodes[ stack[--nStack] ];
+		int mask = IsFourBoxesIntersectingRay( node.m_vecMins, node.m_vecMaxs, ray, flTolerance );
+		for ( int i = 0; i < node.m_nChildren; i++ )
+		{
+			if ( !( mask & ( 1 << i ) ) )
+				continue;
+
+			int iChild = node.m_iChild[i];
+			if ( iChild < 0 )
+			{
+				candidates |= (uint64)1 << ~iChild;
+			}
+			else
+			{
+				stack[nStack++] = iChild;
+			}
+		}
+	}
+
+	return candidates;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks the tree with four rays at a time, keeping track of which
+//			of the four reached each node
+//-----------------------------------------------------------------------------
+void CHitboxBVH::TestRayBatch( const CHitboxRayBatch &batch, float flTolerance )
+{
+	int nRays = batch.GetRayCount();
+	for ( int iGroup = 0; iGroup * 4 < nRays; iGroup++ )
+	{
+		const FourVectors &starts = batch.GetStarts( iGroup );
+		const FourVectors &deltas = batch.GetDeltas( iGroup );
+		int nGroupRays = MIN( nRays - iGroup * 4, 4 );
+
+		uint64 candidates[4] = { 0, 0, 0, 0 };
+		int stackNodes[HITBOX_BVH_MAX_HITBOXES];
+		int stackRays[HITBOX_BVH_MAX_HITBOXES];
+		int nStack = 0;
+		stackNodes[nStack] = 0;
+		stackRays[nStack] = ( 1 << nGroupRays ) - 1;
+		nStack++;
+		while ( nStack )
+		{
+			nStack--;
+			const Node_t &node = m_Nodes[ stackNodes[nStack] ];
+			int rays = stackRays[nStack];
+			for ( int i = 0; i < node.m_nChildren; i++ )
+			{
+				int hits = rays & IsBoxIntersectingFourRays( node.m_vecMins.Vec( i ), node.m_vecMaxs.Vec( i ), starts, deltas, flTolerance );
+				if ( !hits )
+					continue;
+
+				int iChild = node.m_iChild[i];
+				if ( iChild < 0 )
+				{
+					for ( int j = 0; j < nGroupRays; j++ )
+					{
+						if ( hits & ( 1 << j ) )
+						{
+							candidates[j] |= (uint64)1 << ~iChild;
+						}
+					}
+				}
+				else
+				{
+					stackNodes[nStack] = iChild;
+					stackRays[nStack] = hits;
+					nStack++;
+				}
+			}
+		}
+
+		for ( int j = 0; j < nGroupRays; j++ )
+		{
+			m_BatchCandidates[ iGroup * 4 + j ] = candidates[j];
+		}
+	}
+}
+
+uint64 CHitboxBVH::FindCandidates( const Ray_t &ray, float flTolerance )
+{
+	Assert( IsValid() );
+
+	const CHitboxRayBatch *pBatch = CHitboxRayBatch::GetActive();
+	int iRay = pBatch ? pBatch->FindRay( ray ) : -1;
+	if ( iRay < 0 )
+		return TestRay( ray, flTolerance );
+
+	if ( m_nBatchSerial != pBatch->GetSerial() )
+	{
+		TestRayBatch( *pBatch, flTolerance );
+		m_nBatchSerial = pBatch->GetSerial();
+	}
+
+	return m_BatchCandidates[iRay];
+}
@@ -0,0 +1,115 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per entity hitbox bounds trees and batched rays for hitbox traces
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef HITBOX_BVH_H
+#define HITBOX_BVH_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "mathlib/ssemath.h"
+#include "tier1/utlvector.h"
+
+
+class CStudioHdr;
+struct mstudiohitboxset_t;
+struct Ray_t;
+
+
+//-----------------------------------------------------------------------------
+// Rays fired together, e.g. shotgun pellets. While a batch is active, the
+// first time one of its rays is traced against an entity's hitbox tree all
+// of them are tested against it at once, four at a time, and the later
+// traces of the other rays reuse that.
+//-----------------------------------------------------------------------------
+#define HITBOX_RAY_BATCH_MAX	32
+
+class CHitboxRayBatch
+{
+public:
+	CHitboxRayBatch();
+	~CHitboxRayBatch();
+
+	// Same ray a trace line from vecStart to vecEnd would use. Returns false once the batch is full.
+	bool	AddRay( const Vector &vecStart, const Vector &vecEnd );
+
+	// Makes this the active batch on the main thread until it's destroyed
+	void	Activate();
+
+	static const CHitboxRayBatch *GetActive();
+
+	// Index of the batched ray identical to this one, or -1
+	int		FindRay( const Ray_t &ray ) const;
+
+	int		GetSerial() const { return m_nSerial; }
+	int		GetRayCount() const { return m_nRays; }
+
+	// Rays 4 * iGroup to 4 * iGroup + 3; lanes past the last ray repeat it
+	const FourVectors &GetStarts( int iGroup ) const { return m_Starts[iGroup]; }
+	const FourVectors &GetDeltas( int iGroup ) const { return m_Deltas[iGroup]; }
+
+private:
+	FourVectors			m_Starts[ HITBOX_RAY_BATCH_MAX / 4 ];
+	FourVectors			m_Deltas[ HITBOX_RAY_BATCH_MAX / 4 ];
+	int					m_nRays;
+	int					m_nSerial;
+	bool				m_bActive;
+	CHitboxRayBatch		*m_pPrevActive;		// Batch this one replaced, restored when it's destroyed
+
+	static CHitboxRayBatch *s_pActive;
+};
+
+
+//-----------------------------------------------------------------------------
+// Per entity tree of hitbox bounds for ray tests, rebuilt lazily when the
+// bones are set up again. Every node holds the world bounds of its four
+// children side by side, so one SIMD test culls all of them. Models with
+// more than HITBOX_BVH_MAX_HITBOXES hitboxes don't get a tree.
+//-----------------------------------------------------------------------------
+#define HITBOX_BVH_MAX_HITBOXES		64
+
+// Slack for the hitbox culls, so float error never drops a hitbox the exact test would hit
+#define HITBOX_CULL_TOLERANCE		0.1f
+
+class CHitboxBVH
+{
+public:
+	CHitboxBVH();
+
+	static bool	IsEnabled();
+
+	// Rebuilds the tree if the bones changed since the last call
+	void	Update( CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int nBoneSerial );
+	bool	IsValid() const { return m_Nodes.Count() > 0; }
+
+	// Bit i is set if the ray may touch hitbox i. Uses the active ray batch when the ray is in it.
+	uint64	FindCandidates( const Ray_t &ray, float flTolerance );
+
+private:
+	struct Node_t
+	{
+		FourVectors	m_vecMins;			// Bounds of each child
+		FourVectors	m_vecMaxs;
+		short		m_iChild[4];		// Index of a child node, or ~hitbox for a hitbox
+		int			m_nChildren;
+	};
+
+	int		BuildNode( int *pHitboxes, int nHitboxes, const Vector *pMins, const Vector *pMaxs, Vector &vecMins, Vector &vecMaxs );
+	uint64	TestRay( const Ray_t &ray, float flTolerance ) const;
+	void	TestRayBatch( const CHitboxRayBatch &batch, float flTolerance );
+
+	CUtlVector< Node_t, CUtlMemoryAligned< Node_t, 16 > >	m_Nodes;	// Root first
+	int						m_nBoneSerial;
+	CStudioHdr				*m_pStudioHdr;
+	mstudiohitboxset_t		*m_pSet;
+
+	// Candidates for each ray of the batch with serial m_nBatchSerial
+	int						m_nBatchSerial;
+	uint64					m_BatchCandidates[ HITBOX_RAY_BATCH_MAX ];
+};
+
+#endif // HITBOX_BVH_H
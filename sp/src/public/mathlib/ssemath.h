@@ -3068,6 +3068,26 @@ FORCEINLINE fltx4 BiasSIMD( const fltx4 &val, const fltx4 &precalc_param )
 	return DivSIMD( val, AddSIMD( MulSIMD( precalc_param, SubSIMD( Four_Ones, val ) ), Four_Ones ) );
 }
 
+//-----------------------------------------------------------------------------
+// MatrixAngles( matrix, angles, position ) for four matrices at once; x, y
+// and z of angles are pitch, yaw and roll. Repeat a pointer to fill out a
+// short batch.
+//-----------------------------------------------------------------------------
+void FourMatricesAnglesSIMD( const matrix3x4_t * const *ppMatrices, FourVectors &angles, FourVectors &positions );
+
+//-----------------------------------------------------------------------------
+// Does any term of one matrix differ from the other's by more than the
+// tolerance? tolerance is ( rotation, rotation, rotation, translation ),
+// matching the layout of a matrix row.
+//-----------------------------------------------------------------------------
+FORCEINLINE bool MatricesDifferSIMD( const matrix3x4_t &m1, const matrix3x4_t &m2, const fltx4 &tolerance )
+{
+	fltx4 diff = fabs( SubSIMD( LoadUnalignedSIMD( m1[0] ), LoadUnalignedSIMD( m2[0] ) ) );
+	diff = MaxSIMD( diff, fabs( SubSIMD( LoadUnalignedSIMD( m1[1] ), LoadUnalignedSIMD( m2[1] ) ) ) );
+	diff = MaxSIMD( diff, fabs( SubSIMD( LoadUnalignedSIMD( m1[2] ), LoadUnalignedSIMD( m2[2] ) ) ) );
+	return !IsAllGreaterThanOrEq( tolerance, diff );
+}
+
 //-----------------------------------------------------------------------------
 // Box/plane test 
 // NOTE: The w component of emins + emaxs must be 1 for this to work
@@ -995,6 +995,262 @@ private:
 	CTSListBase m_FreeNodes;
 } TSLIST_NODE_ALIGN_POST;
 
+//-----------------------------------------------------------------------------
+// Bounded lock free multi-producer, multi-consumer queue. Elements live in a
+// fixed ring of cells, so pushes and pops never allocate and never touch a
+// node that another thread just freed. Each cell carries a sequence number
+// that says whether it is free or holds an element for the current lap
+// around the ring; producers and consumers claim cells by advancing the
+// tail and head counters with a 32-bit CAS. The counters sit on their own
+// cache lines so producers and consumers don't contend on the same line.
+//
+// The capacity is rounded up to a power of two. Pushes fail when the ring is
+// full rather than growing it.
+//-----------------------------------------------------------------------------
+
+#define TSRING_CACHE_LINE_SIZE 128
+#define TSRING_CELL_ALIGNMENT 16
+
+template <typename T>
+class CTSRingQueue
+{
+public:
+	CTSRingQueue( int nCapacity = 1024 )
+	{
+		int nCells = 2;
+		while ( nCells < nCapacity )
+		{
+			nCells <<= 1;
+		}
+
+		// Elements may hold SSE types, and new[] doesn't promise 16 byte alignment
+		m_nMask = nCells - 1;
+		m_pCells = (Cell_t *)MemAlloc_AllocAligned( nCells * sizeof(Cell_t), TSRING_CELL_ALIGNMENT, __FILE__, __LINE__ );
+		for ( int i = 0; i < nCells; i++ )
+		{
+			new ( &m_pCells[i] ) Cell_t;
+			m_pCells[i].m_nSequence = i;
+		}
+		m_nHead = m_nTail = 0;
+	}
+
+	~CTSRingQueue()
+	{
+		for ( unsigned i = 0; i <= m_nMask; i++ )
+		{
+			m_pCells[i].~Cell_t();
+		}
+		MemAlloc_FreeAligned( m_pCells );
+	}
+
+	bool PushItem( const T &item )
+	{
+		T *pElem = BeginPush();
+		if ( !pElem )
+			return false;
+
+		*pElem = item;
+		EndPush( pElem );
+		return true;
+	}
+
+	bool PopItem( T *pResult )
+	{
+		T *pElem = BeginPop();
+		if ( !pElem )
+			return false;
+
+		*pResult = *pElem;
+		EndPop( pElem );
+		return true;
+	}
+
+	// Pushes as many of the items as fit with a single CAS; returns the number pushed
+	int PushItems( const T *pItems, int nItems )
+	{
+		unsigned nPos = m_nTail;
+		for (;;)
+		{
+			int nFree = 0;
+			int nDiff = 0;
+			while ( nFree < nItems )
+			{
+				nDiff = (int)( m_pCells[ ( nPos + nFree ) & m_nMask ].m_nSequence - ( nPos + nFree ) );
+				if ( nDiff != 0 )
+					break;
+				nFree++;
+			}
+			ThreadMemoryBarrier();
+
+			if ( !nFree && nDiff < 0 )
+				return 0; // full
+
+			if ( nFree && ThreadInterlockedAssignIf( &m_nTail, nPos + nFree, nPos ) )
+			{
+				for ( int i = 0; i < nFree; i++ )
+				{
+					m_pCells[ ( nPos + i ) & m_nMask ].m_Elem = pItems[i];
+				}
+				ThreadMemoryBarrier();
+				for ( int i = 0; i < nFree; i++ )
+				{
+					m_pCells[ ( nPos + i ) & m_nMask ].m_nSequence = nPos + i + 1;
+				}
+				return nFree;
+			}
+
+			nPos = m_nTail;
+		}
+	}
+
+	// Pops up to nMaxItems with a single CAS; returns the number popped
+	int PopItems( T *pResults, int nMaxItems )
+	{
+		unsigned nPos = m_nHead;
+		for (;;)
+		{
+			int nFull = 0;
+			int nDiff = 0;
+			while ( nFull < nMaxItems )
+			{
+				nDiff = (int)( m_pCells[ ( nPos + nFull ) & m_nMask ].m_nSequence - ( nPos + nFull + 1 ) );
+				if ( nDiff != 0 )
+					break;
+				nFull++;
+			}
+			ThreadMemoryBarrier();
+
+			if ( !nFull && nDiff < 0 )
+				return 0; // empty
+
+			if ( nFull && ThreadInterlockedAssignIf( &m_nHead, nPos + nFull, nPos ) )
+			{
+				for ( int i = 0; i < nFull; i++ )
+				{
+					pResults[i] = m_pCells[ ( nPos + i ) & m_nMask ].m_Elem;
+				}
+				ThreadMemoryBarrier();
+				for ( int i = 0; i < nFull; i++ )
+				{
+					m_pCells[ ( nPos + i ) & m_nMask ].m_nSequence = nPos + i + m_nMask + 1;
+				}
+				return nFull;
+			}
+
+			nPos = m_nHead;
+		}
+	}
+
+	// Two phase push and pop, for callers that build or consume an element in
+	// place. Begin returns NULL if the ring is full (or empty); the cell is
+	// invisible to other threads until the matching End call.
+	T *BeginPush()
+	{
+		unsigned nPos = m_nTail;
+		for (;;)
+		{
+			Cell_t *pCell = &m_pCells[ nPos & m_nMask ];
+			int nDiff = (int)( pCell->m_nSequence - nPos );
+			ThreadMemoryBarrier();
+
+			if ( nDiff == 0 )
+			{
+				if ( ThreadInterlockedAssignIf( &m_nTail, nPos + 1, nPos ) )
+					return &pCell->m_Elem;
+			}
+			else if ( nDiff < 0 )
+			{
+				return NULL;
+			}
+
+			nPos = m_nTail;
+		}
+	}
+
+	void EndPush( T *pElem )
+	{
+		Cell_t *pCell = GetCell( pElem );
+		ThreadMemoryBarrier();
+		pCell->m_nSequence = pCell->m_nSequence + 1;
+	}
+
+	T *BeginPop()
+	{
+		unsigned nPos = m_nHead;
+		for (;;)
+		{
+			Cell_t *pCell = &m_pCells[ nPos & m_nMask ];
+			int nDiff = (int)( pCell->m_nSequence - ( nPos + 1 ) );
+			ThreadMemoryBarrier();
+
+			if ( nDiff == 0 )
+			{
+				if ( ThreadInterlockedAssignIf( &m_nHead, nPos + 1, nPos ) )
+					return &pCell->m_Elem;
+			}
+			else if ( nDiff < 0 )
+			{
+				return NULL;
+			}
+
+			nPos = m_nHead;
+		}
+	}
+
+	void EndPop( T *pElem )
+	{
+		Cell_t *pCell = GetCell( pElem );
+		ThreadMemoryBarrier();
+		pCell->m_nSequence = pCell->m_nSequence + m_nMask;
+	}
+
+	// Returns the element whose storage contains p, or NULL if p isn't in the ring
+	T *FindElement( const void *p )
+	{
+		size_t nOffset = (const char *)p - (const char *)m_pCells;
+		if ( (const char *)p < (const char *)m_pCells || nOffset >= ( m_nMask + 1 ) * sizeof(Cell_t) )
+			return NULL;
+		return &m_pCells[ nOffset / sizeof(Cell_t) ].m_Elem;
+	}
+
+	// Approximate while other threads are pushing or popping
+	int Count() const
+	{
+		int nCount = (int)( m_nTail - m_nHead );
+		if ( nCount < 0 )
+			return 0;
+		return ( nCount > (int)m_nMask + 1 ) ? (int)m_nMask + 1 : nCount;
+	}
+
+	int GetCapacity() const
+	{
+		return m_nMask + 1;
+	}
+
+private:
+	struct Cell_t
+	{
+		volatile unsigned	m_nSequence;
+		T					m_Elem;
+	};
+
+	Cell_t *GetCell( T *pElem )
+	{
+		size_t nOffset = (char *)pElem - (char *)&m_pCells[0].m_Elem;
+		Assert( nOffset % sizeof(Cell_t) == 0 && nOffset / sizeof(Cell_t) <= m_nMask );
+		return &m_pCells[ nOffset / sizeof(Cell_t) ];
+	}
+
+	Cell_t				*m_pCells;
+	unsigned			m_nMask;
+
+	char				m_Pad0[TSRING_CACHE_LINE_SIZE];
+	volatile unsigned	m_nHead;
+	char				m_Pad1[TSRING_CACHE_LINE_SIZE - sizeof(unsigned)];
+	volatile unsigned	m_nTail;
+	char				m_Pad2[TSRING_CACHE_LINE_SIZE - sizeof(unsigned)];
+};
+
 #if defined( _WIN32 )
 // Suppress this spurious warning:
 // warning C4700: uninitialized local variable 'oldHead' used
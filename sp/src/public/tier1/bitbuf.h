@@ -217,6 +217,11 @@ public:
 	void			WriteBitVec3Normal( const Vector& fa );
 	void			WriteBitAngles( const QAngle& fa );
 
+	// Batched versions of WriteBitVec3Coord / WriteBitVec3Normal. The output is
+	// identical to writing each vector in turn.
+	void			WriteBitVec3CoordArray( const Vector *pVecs, int nCount );
+	void			WriteBitVec3NormalArray( const Vector *pVecs, int nCount );
+
 
 // Byte functions.
 public:
@@ -417,6 +422,20 @@ BITBUF_INLINE void bf_write::WriteUBitLong( unsigned int curData, int numbits, b
 	Assert( (iDWord*4 + sizeof(long)) <= (unsigned int)m_nDataBytes );
 	unsigned long * RESTRICT pOut = &m_pData[iDWord];
 
+#if VALVE_LITTLE_ENDIAN
+	// If the next dword is in the buffer too, merge through one 64-bit word
+	// instead of selecting and masking the two dwords separately.
+	if ( (iDWord + 2) * 4 <= m_nDataBytes )
+	{
+		uint64 qword;
+		memcpy( &qword, pOut, sizeof( qword ) );
+		uint64 mask64 = ( ( (uint64)2 << (numbits-1) ) - 1 ) << iCurBitMasked;
+		qword ^= mask64 & ( ( (uint64)curData << iCurBitMasked ) ^ qword );
+		memcpy( pOut, &qword, sizeof( qword ) );
+		return;
+	}
+#endif
+
 	// Rotate data into dword alignment
 	curData = (curData << iCurBitMasked) | (curData >> (32 - iCurBitMasked));
 
@@ -791,6 +810,16 @@ BITBUF_INLINE unsigned int bf_read::ReadUBitLong( int numbits ) RESTRICT
 	unsigned int bitmask = g_ExtraMasks[numbits];
 #endif
 
+#if VALVE_LITTLE_ENDIAN
+	// One 64-bit load covers both dwords when the second one is in the buffer
+	if ( (iWordOffset1 + 2) * 4 <= (unsigned int)m_nDataBytes )
+	{
+		uint64 qword;
+		memcpy( &qword, m_pData + iWordOffset1 * 4, sizeof( qword ) );
+		return (unsigned int)( qword >> iStartBit ) & bitmask;
+	}
+#endif
+
 	unsigned int dw1 = LoadLittleDWord( (unsigned long* RESTRICT)m_pData, iWordOffset1 ) >> iStartBit;
 	unsigned int dw2 = LoadLittleDWord( (unsigned long* RESTRICT)m_pData, iWordOffset2 ) << (32 - iStartBit);
 
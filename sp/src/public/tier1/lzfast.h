@@ -0,0 +1,119 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+//	LZFast Codec. LZ4 style byte oriented LZ77: literal runs and matches are
+//	copied whole instead of a flag bit at a time, so decoding is many times
+//	faster than CLZSS and compression is faster too. The data is split into
+//	independent 64k chunks, which lets large buffers compress on several
+//	threads and lets CUtlBuffer streams be processed a chunk at a time.
+//
+//	Compressed data starts with the same lzss_header_t as the other tier1
+//	codecs, so the id tells LZSS, Snappy and LZFast data apart.
+//
+//=====================================================================================//
+
+#ifndef _LZFAST_H
+#define _LZFAST_H
+#pragma once
+
+#include "tier1/lzss.h"
+
+#define LZFAST_ID			uint32( BigLong( ('L'<<24)|('Z'<<16)|('F'<<8)|('T') ) )
+#define LZFAST_CHUNK_SIZE	65536
+
+class CUtlBuffer;
+
+enum LZFastLevel_t
+{
+	LZFAST_LEVEL_FAST = 0,		// greedy, single hash probe
+	LZFAST_LEVEL_HIGH,			// hash chains with lazy matching; slower, smaller
+};
+
+// Which codec produced a buffer, from its header id
+enum LZFormat_t
+{
+	LZFORMAT_NONE = 0,
+	LZFORMAT_LZSS,
+	LZFORMAT_SNAPPY,
+	LZFORMAT_LZFAST,
+};
+
+class CLZFast
+{
+public:
+	FORCEINLINE CLZFast( int nLevel = LZFAST_LEVEL_FAST );
+
+	// Same conventions as CLZSS; returns NULL if the data didn't get smaller.
+	// CompressNoAlloc needs GetMaxCompressedSize( inputlen ) bytes of output.
+	unsigned char*	Compress( const unsigned char *pInput, int inputlen, unsigned int *pOutputSize );
+	unsigned char*	CompressNoAlloc( const unsigned char *pInput, int inputlen, unsigned char *pOutput, unsigned int *pOutputSize );
+	unsigned int	Uncompress( const unsigned char *pInput, unsigned char *pOutput );
+	unsigned int	SafeUncompress( const unsigned char *pInput, unsigned char *pOutput, unsigned int unBufSize );
+
+	// Streaming versions. Compress consumes input from its get position to the
+	// end and appends a compressed block to output, storing chunks that don't
+	// shrink; Uncompress reads one block from input and appends the data to
+	// output. Both work a chunk at a time, so either buffer can be a file
+	// backed stream.
+	bool			Compress( CUtlBuffer &input, CUtlBuffer &output );
+	bool			Uncompress( CUtlBuffer &input, CUtlBuffer &output );
+
+	// Limits the threads used to compress large buffers. 0 uses every core,
+	// 1 keeps all the work on the calling thread.
+	void			SetMaxThreads( int nThreads ) { m_nMaxThreads = nThreads; }
+
+	static unsigned int	GetMaxCompressedSize( unsigned int inputlen );
+	static bool			IsCompressed( const unsigned char *pInput );
+
+	// These work on LZSS, Snappy and LZFast headers
+	static LZFormat_t	GetFormat( const unsigned char *pInput );
+	static unsigned int	GetActualSize( const unsigned char *pInput );
+
+	// Chunk level API, used by the streaming compressor. pDst needs room for
+	// nSrc bytes; returns the compressed size, or 0 if it didn't get smaller.
+	static int		CompressChunk( const unsigned char *pSrc, int nSrc, unsigned char *pDst, int nLevel, void *pScratch );
+	static bool		UncompressChunk( const unsigned char *pSrc, int nSrc, unsigned char *pDst, int nDst );
+	static int		GetChunkScratchSize( int nLevel );
+
+private:
+	int				m_nLevel;
+	int				m_nMaxThreads;
+};
+
+FORCEINLINE CLZFast::CLZFast( int nLevel )
+{
+	m_nLevel = nLevel;
+	m_nMaxThreads = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Compresses data as it is produced, so the whole input never has to be in
+// memory. The header's size is filled in by Finish(), which seeks the
+// output's put position back to the start of the block.
+//-----------------------------------------------------------------------------
+class CLZFastCompressStream
+{
+public:
+	CLZFastCompressStream( CUtlBuffer &output, int nLevel = LZFAST_LEVEL_FAST );
+	~CLZFastCompressStream();
+
+	void			Write( const void *pData, int nBytes );
+
+	// Flushes the last chunk; returns the compressed size including the header
+	unsigned int	Finish();
+
+private:
+	void			FlushChunk();
+
+	CUtlBuffer		&m_Output;
+	int				m_nLevel;
+	int				m_nHeaderPos;
+	unsigned int	m_nActualSize;
+	int				m_nChunkBytes;
+	unsigned char	*m_pChunk;			// LZFAST_CHUNK_SIZE of pending input
+	unsigned char	*m_pCompressed;		// LZFAST_CHUNK_SIZE of compressed output
+	void			*m_pScratch;
+	bool			m_bFinished;
+};
+
+#endif
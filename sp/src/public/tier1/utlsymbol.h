@@ -23,6 +23,7 @@
 //-----------------------------------------------------------------------------
 class CUtlSymbolTable;
 class CUtlSymbolTableMT;
+class CUtlHashedSymbolTableMT;
 
 
 //-----------------------------------------------------------------------------
@@ -67,10 +68,10 @@ protected:
 	static void Initialize();
 	
 	// returns the current symbol table
-	static CUtlSymbolTableMT* CurrTable();
+	static CUtlHashedSymbolTableMT* CurrTable();
 		
 	// The standard global symbol table
-	static CUtlSymbolTableMT* s_pSymbolTable; 
+	static CUtlHashedSymbolTableMT* s_pSymbolTable; 
 
 	static bool s_bAllowStaticSymbolTable;
 
@@ -212,6 +213,126 @@ private:
 };
 
 
+//-----------------------------------------------------------------------------
+// CUtlHashedSymbolTable:
+// description:
+//    Same interface and symbol ids as CUtlSymbolTable, but strings are found
+//    through an open addressed hash table of precomputed hashes instead of
+//    an RB tree doing a string compare per level. Symbols and their strings
+//    never move once added, so Find() and String() can run on any number of
+//    threads while one thread at a time adds strings.
+//    Case insensitive tables fold ASCII only, like V_stricmp does in the
+//    C locale.
+//-----------------------------------------------------------------------------
+class CUtlHashedSymbolTable
+{
+public:
+	// constructor, destructor
+	CUtlHashedSymbolTable( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlHashedSymbolTable();
+
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( const char* pString );
+
+	// Finds the symbol for pString
+	CUtlSymbol Find( const char* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbol id ) const;
+
+	// Remove all symbols in the table. Not safe with concurrent readers.
+	void  RemoveAll();
+
+	int GetNumStrings( void ) const
+	{
+		return m_nSymbols;
+	}
+
+protected:
+	enum
+	{
+		SYMBOL_BLOCK_SHIFT = 8,
+		SYMBOL_BLOCK_SIZE = ( 1 << SYMBOL_BLOCK_SHIFT ),
+		SYMBOL_BLOCK_COUNT = ( ( UTL_INVAL_SYMBOL + 1 ) >> SYMBOL_BLOCK_SHIFT ),
+		EMPTY_SLOT = UTL_INVAL_SYMBOL,
+	};
+
+	struct Symbol_t
+	{
+		const char *m_pString;
+		unsigned int m_nHash;
+	};
+
+	// Each slot holds the top 16 bits of a symbol's hash and its id. Tables
+	// replaced by a bigger one are kept until RemoveAll, since a reader may
+	// still be probing them.
+	struct HashTable_t
+	{
+		HashTable_t *m_pRetired;
+		unsigned int m_nMask;
+		uint32 m_Slots[1];
+	};
+
+	unsigned int HashString( const char *pString ) const;
+	UtlSymId_t FindHashed( const char *pString, unsigned int nHash ) const;
+	HashTable_t *AllocTable( int nSlots );
+	void InsertSlot( HashTable_t *pTable, UtlSymId_t id, unsigned int nHash );
+	const char *CopyString( const char *pString, int nLen );
+
+	Symbol_t *m_pBlocks[SYMBOL_BLOCK_COUNT];
+	HashTable_t * volatile m_pTable;
+	int m_nSymbols;
+	int m_nInitSize;
+	bool m_bInsensitive;
+
+	// stores the string data
+	CUtlVector<char*> m_StringPools;
+	char *m_pPoolNext;
+	int m_nPoolSpaceLeft;
+};
+
+class CUtlHashedSymbolTableMT : private CUtlHashedSymbolTable
+{
+public:
+	CUtlHashedSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false )
+		: CUtlHashedSymbolTable( growSize, initSize, caseInsensitive )
+	{
+	}
+
+	CUtlSymbol AddString( const char* pString )
+	{
+		// Most adds are for strings that are already there
+		CUtlSymbol result = CUtlHashedSymbolTable::Find( pString );
+		if ( result.IsValid() || !pString )
+			return result;
+
+		m_lock.Lock();
+		result = CUtlHashedSymbolTable::AddString( pString );
+		m_lock.Unlock();
+		return result;
+	}
+
+	// Readers never take the lock
+	CUtlSymbol Find( const char* pString ) const
+	{
+		return CUtlHashedSymbolTable::Find( pString );
+	}
+
+	const char* String( CUtlSymbol id ) const
+	{
+		return CUtlHashedSymbolTable::String( id );
+	}
+
+	int GetNumStrings( void ) const
+	{
+		return CUtlHashedSymbolTable::GetNumStrings();
+	}
+
+private:
+	CThreadFastMutex m_lock;
+};
+
+
 
 //-----------------------------------------------------------------------------
 // CUtlFilenameSymbolTable:
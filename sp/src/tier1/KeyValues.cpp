@@ -28,6 +28,12 @@
 #include "utlhash.h"
 #include "UtlSortVector.h"
 #include "convar.h"
+#include "bitvec.h"
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __SSE2__ ) )
+#include <emmintrin.h>
+#define KEYVALUES_SSE2
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -518,6 +524,171 @@ const char *KeyValues::GetName( void ) const
 	return s_pfGetStringForSymbol( m_iKeyName );
 }
 
+//-----------------------------------------------------------------------------
+// Token scanning helpers for buffers that are entirely in memory
+//-----------------------------------------------------------------------------
+static inline bool KeyValues_IsSpace( unsigned char c )
+{
+	return c == ' ' || ( c >= '\t' && c <= '\r' );
+}
+
+// Returns the offset of the first a or b in pData, or nLen if there isn't one
+static int KeyValues_FindEither( const char *pData, int nLen, char a, char b )
+{
+	int i = 0;
+#ifdef KEYVALUES_SSE2
+	__m128i va = _mm_set1_epi8( a );
+	__m128i vb = _mm_set1_epi8( b );
+	for ( ; i + 16 <= nLen; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)( pData + i ) );
+		int nMask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, va ), _mm_cmpeq_epi8( v, vb ) ) );
+		if ( nMask )
+			return FirstBitInWord( nMask, i );
+	}
+#endif
+	for ( ; i < nLen; i++ )
+	{
+		if ( pData[i] == a || pData[i] == b )
+			break;
+	}
+	return i;
+}
+
+// Returns the offset of the first character that ends an unquoted token
+// ( whitespace, a quote, a brace or a NULL ), or nLen if there isn't one
+static int KeyValues_FindTokenEnd( const char *pData, int nLen )
+{
+	int i = 0;
+#ifdef KEYVALUES_SSE2
+	__m128i vZero = _mm_setzero_si128();
+	__m128i vQuote = _mm_set1_epi8( '"' );
+	__m128i vOpen = _mm_set1_epi8( '{' );
+	__m128i vClose = _mm_set1_epi8( '}' );
+	__m128i vSpace = _mm_set1_epi8( ' ' );
+	__m128i vTab = _mm_set1_epi8( '\t' );
+	__m128i vCtrlRange = _mm_set1_epi8( '\r' - '\t' );
+	for ( ; i + 16 <= nLen; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)( pData + i ) );
+
+		// \t \n \v \f \r are the unsigned range [ \t, \r ]
+		__m128i vCtrl = _mm_sub_epi8( v, vTab );
+		vCtrl = _mm_cmpeq_epi8( _mm_min_epu8( vCtrl, vCtrlRange ), vCtrl );
+
+		__m128i vEnd = _mm_or_si128( _mm_cmpeq_epi8( v, vZero ), _mm_cmpeq_epi8( v, vQuote ) );
+		vEnd = _mm_or_si128( vEnd, _mm_or_si128( _mm_cmpeq_epi8( v, vOpen ), _mm_cmpeq_epi8( v, vClose ) ) );
+		vEnd = _mm_or_si128( vEnd, _mm_or_si128( _mm_cmpeq_epi8( v, vSpace ), vCtrl ) );
+
+		int nMask = _mm_movemask_epi8( vEnd );
+		if ( nMask )
+			return FirstBitInWord( nMask, i );
+	}
+#endif
+	for ( ; i < nLen; i++ )
+	{
+		char c = pData[i];
+		if ( c == 0 || c == '"' || c == '{' || c == '}' || KeyValues_IsSpace( c ) )
+			break;
+	}
+	return i;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a token straight out of the buffer's memory. Returns NULL and
+//			leaves the buffer untouched if the token needs anything the
+//			CUtlBuffer path handles specially (escape sequences, hitting the
+//			end of the buffer, streamed buffers), so both paths always agree.
+//-----------------------------------------------------------------------------
+static const char *KeyValues_ReadResidentToken( CUtlBuffer &buf, CUtlCharConversion *pConv, bool &wasQuoted, bool &wasConditional )
+{
+	if ( !buf.IsText() )
+		return NULL;
+
+	int nGet = buf.TellGet();
+	int nEnd = buf.TellMaxPut();
+	if ( nGet >= nEnd || buf.Size() < nEnd )
+		return NULL;
+
+	const char *pBase = (const char *)buf.Base();
+	if ( buf.PeekGet( sizeof(char), 0 ) != pBase + nGet )
+		return NULL;
+
+	const char *p = pBase + nGet;
+	const char *pEnd = pBase + nEnd;
+
+	// eat white spaces and remarks
+	while ( true )
+	{
+		while ( p < pEnd && KeyValues_IsSpace( *p ) )
+		{
+			++p;
+		}
+
+		if ( pEnd - p < 2 )
+			return NULL;
+
+		if ( p[0] != '/' || p[1] != '/' )
+			break;
+
+		const char *pNewLine = (const char *)memchr( p + 2, '\n', pEnd - p - 2 );
+		if ( !pNewLine )
+			return NULL;
+
+		p = pNewLine + 1;
+	}
+
+	if ( *p == '\"' )
+	{
+		// Only plain strings; escapes go through the char conversion
+		const char *pString = p + 1;
+		int nLen = KeyValues_FindEither( pString, pEnd - pString, '\"', pConv->GetEscapeChar() );
+		if ( pString + nLen == pEnd || pString[nLen] != '\"' )
+			return NULL;
+
+		int nCopy = MIN( nLen, KEYVALUES_TOKEN_SIZE - 1 );
+		Q_memcpy( s_pTokenBuf, pString, nCopy );
+		s_pTokenBuf[nCopy] = 0;
+
+		wasQuoted = true;
+		buf.SeekGet( CUtlBuffer::SEEK_HEAD, pString + nLen + 1 - pBase );
+		return s_pTokenBuf;
+	}
+
+	if ( *p == '{' || *p == '}' )
+	{
+		s_pTokenBuf[0] = *p;
+		s_pTokenBuf[1] = 0;
+		buf.SeekGet( CUtlBuffer::SEEK_HEAD, p + 1 - pBase );
+		return s_pTokenBuf;
+	}
+
+	int nLen = KeyValues_FindTokenEnd( p, pEnd - p );
+	if ( p + nLen == pEnd )
+		return NULL;
+
+	// [ followed anywhere later by ] makes this a conditional
+	const char *pOpen = (const char *)memchr( p, '[', nLen );
+	if ( pOpen && memchr( pOpen + 1, ']', p + nLen - pOpen - 1 ) )
+	{
+		wasConditional = true;
+	}
+
+	int nCopy = nLen;
+	if ( nCopy > KEYVALUES_TOKEN_SIZE - 1 )
+	{
+		nCopy = KEYVALUES_TOKEN_SIZE - 1;
+		g_KeyValuesErrorStack.ReportError(" ReadToken overflow" );
+	}
+	Q_memcpy( s_pTokenBuf, p, nCopy );
+	s_pTokenBuf[nCopy] = 0;
+
+	buf.SeekGet( CUtlBuffer::SEEK_HEAD, p + nLen - pBase );
+	return s_pTokenBuf;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Read a single token from buffer (0 terminated)
 //-----------------------------------------------------------------------------
@@ -530,6 +701,12 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	if ( !buf.IsValid() )
 		return NULL; 
 
+	// Most buffers are loaded whole; scan those in place
+	const char *pToken = KeyValues_ReadResidentToken( buf, m_bHasEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion(),
+		wasQuoted, wasConditional );
+	if ( pToken )
+		return pToken;
+
 	// eating white spaces and remarks loop
 	while ( true )
 	{
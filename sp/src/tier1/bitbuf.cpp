@@ -119,6 +119,128 @@ public:
 static CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+//-----------------------------------------------------------------------------
+// Appends runs of up to 32 bits to a bf_write through a 64-bit accumulator.
+// Every append stores the low dword unconditionally and shifts the
+// accumulator down when it fills, so there's no branch per flush. The caller
+// must have checked that all the bits fit. Bits past the end of the written
+// range are restored in Finish(), so the buffer ends up exactly as if the
+// bits had gone through WriteUBitLong one at a time.
+//-----------------------------------------------------------------------------
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write &buf ) : m_Buf( buf )
+	{
+		m_pData = buf.m_pData;
+		m_iDWord = buf.m_iCurBit >> 5;
+		m_nLastDWord = ( buf.m_nDataBytes >> 2 ) - 1;
+		m_nBits = buf.m_iCurBit & 31;
+		m_nTotalBits = 0;
+		m_nOriginal = ( m_iDWord <= m_nLastDWord ) ? LoadLittleDWord( m_pData, m_iDWord ) : 0;
+		m_Accum = m_nOriginal & g_ExtraMasks[m_nBits];
+	}
+
+	FORCEINLINE void Write( unsigned int data, int numbits )
+	{
+		Assert( numbits > 0 && numbits <= 32 );
+
+		m_Accum |= (uint64)( data & g_ExtraMasks[numbits] ) << m_nBits;
+		m_nBits += numbits;
+		m_nTotalBits += numbits;
+
+		// Grab the next dword's old contents before anything can overwrite it
+		unsigned int nNext = LoadLittleDWord( m_pData, MIN( m_iDWord + 1, m_nLastDWord ) );
+		StoreLittleDWord( m_pData, m_iDWord, (unsigned long)m_Accum );
+
+		unsigned int nFull = m_nBits >> 5;
+		m_nOriginal ^= ( nNext ^ m_nOriginal ) & ( 0u - nFull );
+		m_iDWord += nFull;
+		m_Accum >>= ( nFull << 5 );
+		m_nBits -= ( nFull << 5 );
+	}
+
+	void Finish()
+	{
+		if ( m_nBits )
+		{
+			unsigned int mask = g_ExtraMasks[m_nBits];
+			StoreLittleDWord( m_pData, m_iDWord, ( (unsigned int)m_Accum & mask ) | ( m_nOriginal & ~mask ) );
+		}
+
+		m_Buf.m_iCurBit += m_nTotalBits;
+	}
+
+private:
+	bf_write		&m_Buf;
+	unsigned long	*m_pData;
+	uint64			m_Accum;
+	unsigned int	m_nOriginal;	// Old contents of the dword the accumulator is filling
+	unsigned int	m_iDWord;
+	unsigned int	m_nLastDWord;
+	int				m_nBits;
+	int				m_nTotalBits;
+};
+
+
+//-----------------------------------------------------------------------------
+// Coord and normal encodings, packed into a single run of bits in the order
+// WriteBitCoord / WriteBitNormal put them on the wire.
+//-----------------------------------------------------------------------------
+static FORCEINLINE unsigned int EncodeBitCoord( const float f, int *pNumBits )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	// Integer and fraction flags, then the sign and whichever parts are present
+	unsigned int bits = ( intval ? 1 : 0 ) | ( fractval ? 2 : 0 );
+	int numbits = 2;
+
+	if ( intval || fractval )
+	{
+		bits |= signbit << 2;
+		numbits = 3;
+
+		if ( intval )
+		{
+			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
+			bits |= (unsigned int)( ( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) << numbits;
+			numbits += COORD_INTEGER_BITS;
+		}
+
+		if ( fractval )
+		{
+			bits |= (unsigned int)fractval << numbits;
+			numbits += COORD_FRACTIONAL_BITS;
+		}
+	}
+
+	*pNumBits = numbits;
+	return bits;
+}
+
+static FORCEINLINE unsigned int EncodeBitNormal( float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+
+	// clamp..
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	return signbit | ( fractval << 1 );
+}
+
+// Worst case sizes of the encodings above
+#define BITCOORD_MAX_BITS		( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS )
+#define BITVEC3COORD_MAX_BITS	( 3 + 3 * BITCOORD_MAX_BITS )
+#define BITNORMAL_BITS			( 1 + NORMAL_FRACTIONAL_BITS )
+#define BITVEC3NORMAL_MAX_BITS	( 3 + 2 * BITNORMAL_BITS )
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -536,7 +658,58 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 
 bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 {
-	// This could be optimized a little by
+	// Fast paths only when both sides have room, so overflows behave exactly as before
+	if ( nBits > 32 && GetNumBitsLeft() >= nBits && pIn->GetNumBitsLeft() >= nBits )
+	{
+		if ( ( ( m_iCurBit | pIn->m_iCurBit ) & 7 ) == 0 )
+		{
+			// Both byte aligned; whole bytes are a straight copy
+			int nBytes = nBits >> 3;
+			Q_memcpy( (unsigned char*)m_pData + ( m_iCurBit >> 3 ), pIn->m_pData + ( pIn->m_iCurBit >> 3 ), nBytes );
+			m_iCurBit += nBytes << 3;
+			pIn->m_iCurBit += nBytes << 3;
+			nBits -= nBytes << 3;
+
+			if ( nBits )
+			{
+				WriteUBitLong( pIn->ReadUBitLong( nBits ), nBits );
+			}
+			return !IsOverflowed() && !pIn->IsOverflowed();
+		}
+
+#if VALVE_LITTLE_ENDIAN
+		// Unaligned: unaligned 64-bit loads from the source feed the write accumulator
+		CBitWriteAccumulator accum( *this );
+		const unsigned char *pSrc = pIn->m_pData;
+		int iSrcByteLimit = pIn->m_nDataBytes - (int)sizeof( uint64 );
+
+		while ( nBits > 0 )
+		{
+			int numbits = MIN( nBits, 32 );
+			unsigned int chunk;
+
+			int iSrcByte = pIn->m_iCurBit >> 3;
+			if ( iSrcByte <= iSrcByteLimit )
+			{
+				uint64 qword;
+				memcpy( &qword, pSrc + iSrcByte, sizeof( qword ) );
+				chunk = (unsigned int)( qword >> ( pIn->m_iCurBit & 7 ) );
+				pIn->m_iCurBit += numbits;
+			}
+			else
+			{
+				chunk = pIn->ReadUBitLong( numbits );
+			}
+
+			accum.Write( chunk, numbits );
+			nBits -= numbits;
+		}
+
+		accum.Finish();
+		return !IsOverflowed() && !pIn->IsOverflowed();
+#endif
+	}
+
 	while ( nBits > 32 )
 	{
 		WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
@@ -621,34 +794,10 @@ void bf_write::WriteBitCoord (const float f)
 #if defined( BB_PROFILING )
 	VPROF( "bf_write::WriteBitCoord" );
 #endif
-	int		signbit = (f <= -COORD_RESOLUTION);
-	int		intval = (int)abs(f);
-	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
-
-
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
-
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+	// Flags, sign, integer and fraction all go out in one write
+	int numbits;
+	unsigned int bits = EncodeBitCoord( f, &numbits );
+	WriteUBitLong( bits, numbits );
 }
 
 void bf_write::WriteBitVec3Coord( const Vector& fa )
@@ -673,20 +822,8 @@ void bf_write::WriteBitVec3Coord( const Vector& fa )
 
 void bf_write::WriteBitNormal( float f )
 {
-	int	signbit = (f <= -NORMAL_RESOLUTION);
-
-	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
-	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
-
-	// clamp..
-	if (fractval > NORMAL_DENOMINATOR)
-		fractval = NORMAL_DENOMINATOR;
-
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	// Sign bit followed by the fractional component
+	WriteUBitLong( EncodeBitNormal( f ), BITNORMAL_BITS );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
@@ -709,6 +846,85 @@ void bf_write::WriteBitVec3Normal( const Vector& fa )
 	WriteOneBit( signbit );
 }
 
+void bf_write::WriteBitVec3CoordArray( const Vector *pVecs, int nCount )
+{
+	if ( GetNumBitsLeft() < nCount * BITVEC3COORD_MAX_BITS )
+	{
+		// Might not fit; let the single vector path handle the overflow
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitVec3Coord( pVecs[i] );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator accum( *this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		const Vector &fa = pVecs[i];
+
+		int xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+		int yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+		int zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+
+		accum.Write( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
+
+		int numbits;
+		if ( xflag )
+		{
+			unsigned int bits = EncodeBitCoord( fa[0], &numbits );
+			accum.Write( bits, numbits );
+		}
+		if ( yflag )
+		{
+			unsigned int bits = EncodeBitCoord( fa[1], &numbits );
+			accum.Write( bits, numbits );
+		}
+		if ( zflag )
+		{
+			unsigned int bits = EncodeBitCoord( fa[2], &numbits );
+			accum.Write( bits, numbits );
+		}
+	}
+	accum.Finish();
+}
+
+void bf_write::WriteBitVec3NormalArray( const Vector *pVecs, int nCount )
+{
+	if ( GetNumBitsLeft() < nCount * BITVEC3NORMAL_MAX_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitVec3Normal( pVecs[i] );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator accum( *this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		const Vector &fa = pVecs[i];
+
+		int xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
+		int yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
+
+		accum.Write( xflag | ( yflag << 1 ), 2 );
+
+		if ( xflag )
+		{
+			accum.Write( EncodeBitNormal( fa[0] ), BITNORMAL_BITS );
+		}
+		if ( yflag )
+		{
+			accum.Write( EncodeBitNormal( fa[1] ), BITNORMAL_BITS );
+		}
+
+		// z sign bit
+		accum.Write( fa[2] <= -NORMAL_RESOLUTION, 1 );
+	}
+	accum.Finish();
+}
+
 void bf_write::WriteBitAngles( const QAngle& fa )
 {
 	// FIXME:
@@ -767,6 +983,16 @@ bool bf_write::WriteBytes( const void *pBuf, int nBytes )
 
 bool bf_write::WriteString(const char *pStr)
 {
+	if ( pStr )
+	{
+		// The whole string and its terminator in one go when it fits
+		int nBytes = Q_strlen( pStr ) + 1;
+		if ( GetNumBitsLeft() >= ( nBytes << 3 ) )
+		{
+			return WriteBits( pStr, nBytes << 3 );
+		}
+	}
+
 	if(pStr)
 	{
 		do
@@ -1090,26 +1316,30 @@ float bf_read::ReadBitCoord (void)
 
 
 	// Read the required integer and fraction flags
-	intval = ReadOneBit();
-	fractval = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 2 );
 
 	// If we got either parse them, otherwise it's a zero.
-	if ( intval || fractval )
+	if ( flags )
 	{
-		// Read the sign bit
-		signbit = ReadOneBit();
+		// Sign bit, integer and fraction come in as one read
+		int numbits = 1 + ( ( flags & 1 ) ? COORD_INTEGER_BITS : 0 ) + ( ( flags & 2 ) ? COORD_FRACTIONAL_BITS : 0 );
+		unsigned int bits = ReadUBitLong( numbits );
+
+		signbit = bits & 1;
+		bits >>= 1;
 
 		// If there's an integer, read it in
-		if ( intval )
+		if ( flags & 1 )
 		{
 			// Adjust the integers from [0..MAX_COORD_VALUE-1] to [1..MAX_COORD_VALUE]
-			intval = ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			intval = ( bits & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) + 1;
+			bits >>= COORD_INTEGER_BITS;
 		}
 
 		// If there's a fraction, read it in
-		if ( fractval )
+		if ( flags & 2 )
 		{
-			fractval = ReadUBitLong( COORD_FRACTIONAL_BITS );
+			fractval = bits;
 		}
 
 		// Calculate the correct floating point value
@@ -1276,9 +1506,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 	// the corresponding component will not be read and will be stack garbage.
 	fa.Init( 0, 0, 0 );
 
-	xflag = ReadOneBit();
-	yflag = ReadOneBit(); 
-	zflag = ReadOneBit();
+	int flags = ReadUBitLong( 3 );
+	xflag = flags & 1;
+	yflag = flags & 2;
+	zflag = flags & 4;
 
 	if ( xflag )
 		fa[0] = ReadBitCoord();
@@ -1290,11 +1521,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 
 float bf_read::ReadBitNormal (void)
 {
-	// Read the sign bit
-	int	signbit = ReadOneBit();
-
-	// Read the fractional part
-	unsigned int fractval = ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+	// Sign bit and fractional part in one read
+	unsigned int bits = ReadUBitLong( BITNORMAL_BITS );
+	int	signbit = bits & 1;
+	unsigned int fractval = bits >> 1;
 
 	// Calculate the correct floating point value
 	float value = (float)fractval * NORMAL_RESOLUTION;
@@ -1308,8 +1538,9 @@ float bf_read::ReadBitNormal (void)
 
 void bf_read::ReadBitVec3Normal( Vector& fa )
 {
-	int xflag = ReadOneBit();
-	int yflag = ReadOneBit(); 
+	int flags = ReadUBitLong( 2 );
+	int xflag = flags & 1;
+	int yflag = flags & 2;
 
 	if (xflag)
 		fa[0] = ReadBitNormal();
@@ -1378,6 +1609,36 @@ bool bf_read::ReadString( char *pStr, int maxLen, bool bLine, int *pOutNumChars
 
 	bool bTooSmall = false;
 	int iChar = 0;
+
+	if ( ( m_iCurBit & 7 ) == 0 )
+	{
+		// Byte aligned: find the terminator in place instead of pulling chars through ReadUBitLong.
+		// If it isn't in the buffer, fall through and let the loop below overflow as usual.
+		const char *pSrc = (const char*)m_pData + ( m_iCurBit >> 3 );
+		int nAvailable = GetNumBitsLeft() >> 3;
+		int nLength = 0;
+		while ( nLength < nAvailable && pSrc[nLength] != 0 && !( bLine && pSrc[nLength] == '\n' ) )
+		{
+			++nLength;
+		}
+
+		if ( nLength < nAvailable )
+		{
+			iChar = MIN( nLength, maxLen - 1 );
+			bTooSmall = ( nLength > iChar );
+			memcpy( pStr, pSrc, iChar );
+			m_iCurBit += ( nLength + 1 ) << 3;
+
+			Assert( iChar < maxLen );
+			pStr[iChar] = 0;
+
+			if ( pOutNumChars )
+				*pOutNumChars = iChar;
+
+			return !IsOverflowed() && !bTooSmall;
+		}
+	}
+
 	while(1)
 	{
 		char val = ReadChar();
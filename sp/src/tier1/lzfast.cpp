@@ -0,0 +1,794 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+//	LZFast Codec. See lzfast.h.
+//
+//	Each chunk is a series of sequences: a token byte holding the literal
+//	count in the high nibble and the match length - 4 in the low nibble (15
+//	means more length bytes follow, each 255 meaning "keep going"), the
+//	literals, then a little endian 16 bit match offset. The last sequence of
+//	a chunk is literals only. Chunks are preceded by a little endian word
+//	holding their compressed size, with LZFAST_STORED set for chunks that
+//	didn't compress and are stored as is.
+//
+//=====================================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/lzfast.h"
+#include "tier1/utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define LZFAST_MIN_MATCH			4
+#define LZFAST_LAST_LITERALS		5		// a chunk always ends with at least this many literals
+#define LZFAST_MATCH_LIMIT			12		// no match starts in the last this many bytes of a chunk
+#define LZFAST_STORED				0x80000000u
+
+#define LZFAST_FAST_HASH_BITS		14
+#define LZFAST_HIGH_HASH_BITS		16
+#define LZFAST_HIGH_SEARCH_DEPTH	64
+
+#define LZFAST_PARALLEL_MIN_CHUNKS	4
+#define LZFAST_MAX_THREADS			8
+
+static FORCEINLINE uint32 LZFast_Read32( const uint8 *p )
+{
+	uint32 n;
+	memcpy( &n, p, sizeof( n ) );
+	return n;
+}
+
+static FORCEINLINE bool LZFast_Equal8( const uint8 *a, const uint8 *b )
+{
+	uint64 x, y;
+	memcpy( &x, a, sizeof( x ) );
+	memcpy( &y, b, sizeof( y ) );
+	return x == y;
+}
+
+static FORCEINLINE uint32 LZFast_Hash( uint32 n, int nBits )
+{
+	return ( n * 2654435761u ) >> ( 32 - nBits );
+}
+
+// Number of bytes that match, stopping at pLimit
+static FORCEINLINE int LZFast_Count( const uint8 *p, const uint8 *pRef, const uint8 *pLimit )
+{
+	const uint8 *pStart = p;
+	while ( p + 8 <= pLimit && LZFast_Equal8( p, pRef ) )
+	{
+		p += 8;
+		pRef += 8;
+	}
+	while ( p < pLimit && *p == *pRef )
+	{
+		++p;
+		++pRef;
+	}
+	return p - pStart;
+}
+
+static FORCEINLINE uint8 *LZFast_WriteLength( uint8 *pOut, int nLength )
+{
+	for ( ; nLength >= 255; nLength -= 255 )
+	{
+		*pOut++ = 255;
+	}
+	*pOut++ = (uint8)nLength;
+	return pOut;
+}
+
+// Worst case bytes a sequence takes, so the encoder can bail out before overrunning
+static FORCEINLINE int LZFast_SequenceBound( int nLiterals, int nMatch )
+{
+	return 1 + nLiterals + nLiterals / 255 + 1 + 2 + nMatch / 255 + 1;
+}
+
+static FORCEINLINE uint8 *LZFast_WriteSequence( uint8 *pOut, const uint8 *pLiterals, int nLiterals, int nOffset, int nMatch )
+{
+	int nMatchCode = nMatch - LZFAST_MIN_MATCH;
+	uint8 *pToken = pOut++;
+	*pToken = (uint8)( ( MIN( nLiterals, 15 ) << 4 ) | MIN( nMatchCode, 15 ) );
+	if ( nLiterals >= 15 )
+	{
+		pOut = LZFast_WriteLength( pOut, nLiterals - 15 );
+	}
+	memcpy( pOut, pLiterals, nLiterals );
+	pOut += nLiterals;
+
+	pOut[0] = (uint8)( nOffset & 0xFF );
+	pOut[1] = (uint8)( nOffset >> 8 );
+	pOut += 2;
+
+	if ( nMatchCode >= 15 )
+	{
+		pOut = LZFast_WriteLength( pOut, nMatchCode - 15 );
+	}
+	return pOut;
+}
+
+static FORCEINLINE uint8 *LZFast_WriteLastLiterals( uint8 *pOut, const uint8 *pLiterals, int nLiterals )
+{
+	*pOut++ = (uint8)( MIN( nLiterals, 15 ) << 4 );
+	if ( nLiterals >= 15 )
+	{
+		pOut = LZFast_WriteLength( pOut, nLiterals - 15 );
+	}
+	memcpy( pOut, pLiterals, nLiterals );
+	return pOut + nLiterals;
+}
+
+
+//-----------------------------------------------------------------------------
+// Greedy compressor; one hash probe per position, stepping faster through
+// data that isn't matching
+//-----------------------------------------------------------------------------
+static int LZFast_CompressChunkFast( const uint8 *pSrc, int nSrc, uint8 *pDst, uint16 *pHash )
+{
+	const uint8 *pEnd = pSrc + nSrc;
+	const uint8 *pMatchLimit = pEnd - LZFAST_LAST_LITERALS;
+	const uint8 *pSearchLimit = pEnd - LZFAST_MATCH_LIMIT;
+	const uint8 *ip = pSrc + 1;
+	const uint8 *pAnchor = pSrc;
+	uint8 *op = pDst;
+	uint8 *pOutLimit = pDst + nSrc;
+
+	// Stale entries are harmless; every candidate is verified and anything
+	// earlier in the chunk is in range
+	memset( pHash, 0, sizeof( uint16 ) << LZFAST_FAST_HASH_BITS );
+
+	while ( nSrc > LZFAST_MATCH_LIMIT && ip < pSearchLimit )
+	{
+		const uint8 *pRef = NULL;
+		int nAttempts = 1 << 6;
+		while ( ip < pSearchLimit )
+		{
+			uint32 h = LZFast_Hash( LZFast_Read32( ip ), LZFAST_FAST_HASH_BITS );
+			pRef = pSrc + pHash[h];
+			pHash[h] = (uint16)( ip - pSrc );
+			if ( pRef < ip && LZFast_Read32( pRef ) == LZFast_Read32( ip ) )
+				break;
+
+			ip += nAttempts++ >> 6;
+			pRef = NULL;
+		}
+
+		if ( !pRef )
+			break;
+
+		while ( ip > pAnchor && pRef > pSrc && ip[-1] == pRef[-1] )
+		{
+			--ip;
+			--pRef;
+		}
+
+		int nMatch = LZFAST_MIN_MATCH + LZFast_Count( ip + LZFAST_MIN_MATCH, pRef + LZFAST_MIN_MATCH, pMatchLimit );
+		int nLiterals = ip - pAnchor;
+		if ( op + LZFast_SequenceBound( nLiterals, nMatch ) > pOutLimit )
+			return 0;
+
+		op = LZFast_WriteSequence( op, pAnchor, nLiterals, ip - pRef, nMatch );
+		ip += nMatch;
+		pAnchor = ip;
+
+		if ( ip < pSearchLimit )
+		{
+			pHash[LZFast_Hash( LZFast_Read32( ip - 2 ), LZFAST_FAST_HASH_BITS )] = (uint16)( ip - 2 - pSrc );
+		}
+	}
+
+	int nLiterals = pEnd - pAnchor;
+	if ( op + LZFast_SequenceBound( nLiterals, 0 ) > pOutLimit )
+		return 0;
+
+	op = LZFast_WriteLastLiterals( op, pAnchor, nLiterals );
+	return op - pDst;
+}
+
+
+//-----------------------------------------------------------------------------
+// Hash chain compressor. Every position is inserted, the longest of up to
+// LZFAST_HIGH_SEARCH_DEPTH candidates is taken, and a match is deferred by a
+// byte when the next position has a longer one.
+//-----------------------------------------------------------------------------
+struct LZFastChains_t
+{
+	uint16 m_Head[1 << LZFAST_HIGH_HASH_BITS];	// position + 1 of the newest entry, 0 if none
+	uint16 m_Chain[LZFAST_CHUNK_SIZE];			// distance back to the previous entry, 0 at the end
+};
+
+static FORCEINLINE void LZFast_InsertChains( LZFastChains_t *pChains, const uint8 *pSrc, int &nNextInsert, int nUpTo )
+{
+	for ( ; nNextInsert < nUpTo; ++nNextInsert )
+	{
+		uint32 h = LZFast_Hash( LZFast_Read32( pSrc + nNextInsert ), LZFAST_HIGH_HASH_BITS );
+		int nPrev = pChains->m_Head[h] - 1;
+		pChains->m_Chain[nNextInsert] = ( nPrev >= 0 ) ? (uint16)( nNextInsert - nPrev ) : 0;
+		pChains->m_Head[h] = (uint16)( nNextInsert + 1 );
+	}
+}
+
+static FORCEINLINE int LZFast_FindLongest( LZFastChains_t *pChains, const uint8 *pSrc, int nPos, const uint8 *pMatchLimit, int &nNextInsert, int &nMatchPos )
+{
+	LZFast_InsertChains( pChains, pSrc, nNextInsert, nPos );
+
+	const uint8 *ip = pSrc + nPos;
+	uint32 nFirst = LZFast_Read32( ip );
+	int nBest = 0;
+	int nCandidate = pChains->m_Head[LZFast_Hash( nFirst, LZFAST_HIGH_HASH_BITS )] - 1;
+	for ( int nDepth = 0; nCandidate >= 0 && nDepth < LZFAST_HIGH_SEARCH_DEPTH; ++nDepth )
+	{
+		const uint8 *pRef = pSrc + nCandidate;
+		if ( pRef[nBest] == ip[nBest] && LZFast_Read32( pRef ) == nFirst )
+		{
+			int nLen = LZFAST_MIN_MATCH + LZFast_Count( ip + LZFAST_MIN_MATCH, pRef + LZFAST_MIN_MATCH, pMatchLimit );
+			if ( nLen > nBest )
+			{
+				nBest = nLen;
+				nMatchPos = nCandidate;
+			}
+		}
+
+		int nDelta = pChains->m_Chain[nCandidate];
+		if ( !nDelta )
+			break;
+		nCandidate -= nDelta;
+	}
+
+	return nBest;
+}
+
+static int LZFast_CompressChunkHigh( const uint8 *pSrc, int nSrc, uint8 *pDst, LZFastChains_t *pChains )
+{
+	const uint8 *pEnd = pSrc + nSrc;
+	const uint8 *pMatchLimit = pEnd - LZFAST_LAST_LITERALS;
+	int nSearchLimit = nSrc - LZFAST_MATCH_LIMIT;
+	int nPos = 0;
+	int nAnchor = 0;
+	int nNextInsert = 0;
+	uint8 *op = pDst;
+	uint8 *pOutLimit = pDst + nSrc;
+
+	memset( pChains->m_Head, 0, sizeof( pChains->m_Head ) );
+
+	while ( nPos < nSearchLimit )
+	{
+		int nMatchPos = 0;
+		int nMatch = LZFast_FindLongest( pChains, pSrc, nPos, pMatchLimit, nNextInsert, nMatchPos );
+		if ( !nMatch )
+		{
+			++nPos;
+			continue;
+		}
+
+		// Lazy evaluation: take the next position's match if it's longer
+		while ( nPos + 1 < nSearchLimit )
+		{
+			int nNextMatchPos = 0;
+			int nNextMatch = LZFast_FindLongest( pChains, pSrc, nPos + 1, pMatchLimit, nNextInsert, nNextMatchPos );
+			if ( nNextMatch <= nMatch )
+				break;
+
+			++nPos;
+			nMatch = nNextMatch;
+			nMatchPos = nNextMatchPos;
+		}
+
+		int nLiterals = nPos - nAnchor;
+		if ( op + LZFast_SequenceBound( nLiterals, nMatch ) > pOutLimit )
+			return 0;
+
+		op = LZFast_WriteSequence( op, pSrc + nAnchor, nLiterals, nPos - nMatchPos, nMatch );
+		nPos += nMatch;
+		nAnchor = nPos;
+	}
+
+	int nLiterals = nSrc - nAnchor;
+	if ( op + LZFast_SequenceBound( nLiterals, 0 ) > pOutLimit )
+		return 0;
+
+	op = LZFast_WriteLastLiterals( op, pSrc + nAnchor, nLiterals );
+	return op - pDst;
+}
+
+
+//-----------------------------------------------------------------------------
+// Chunk level entry points
+//-----------------------------------------------------------------------------
+int CLZFast::GetChunkScratchSize( int nLevel )
+{
+	return ( nLevel == LZFAST_LEVEL_HIGH ) ? sizeof( LZFastChains_t ) : ( sizeof( uint16 ) << LZFAST_FAST_HASH_BITS );
+}
+
+int CLZFast::CompressChunk( const unsigned char *pSrc, int nSrc, unsigned char *pDst, int nLevel, void *pScratch )
+{
+	Assert( nSrc > 0 && nSrc <= LZFAST_CHUNK_SIZE );
+	if ( nLevel == LZFAST_LEVEL_HIGH )
+		return LZFast_CompressChunkHigh( pSrc, nSrc, pDst, (LZFastChains_t *)pScratch );
+	return LZFast_CompressChunkFast( pSrc, nSrc, pDst, (uint16 *)pScratch );
+}
+
+bool CLZFast::UncompressChunk( const unsigned char *pSrc, int nSrc, unsigned char *pDst, int nDst )
+{
+	const uint8 *ip = pSrc;
+	const uint8 *pInEnd = pSrc + nSrc;
+	uint8 *op = pDst;
+	uint8 *pOutEnd = pDst + nDst;
+
+	while ( ip < pInEnd )
+	{
+		uint32 nToken = *ip++;
+
+		uint32 nLiterals = nToken >> 4;
+		if ( nLiterals == 15 )
+		{
+			uint32 nByte;
+			do
+			{
+				if ( ip >= pInEnd )
+					return false;
+				nByte = *ip++;
+				nLiterals += nByte;
+			} while ( nByte == 255 );
+		}
+
+		if ( nLiterals > (uint32)( pInEnd - ip ) || nLiterals > (uint32)( pOutEnd - op ) )
+			return false;
+
+		if ( op + nLiterals + 8 <= pOutEnd && ip + nLiterals + 8 <= pInEnd )
+		{
+			// Both sides have slack, so copy in whole words
+			for ( uint32 i = 0; i < nLiterals; i += 8 )
+			{
+				memcpy( op + i, ip + i, 8 );
+			}
+		}
+		else
+		{
+			memcpy( op, ip, nLiterals );
+		}
+		ip += nLiterals;
+		op += nLiterals;
+
+		// The last sequence has no match
+		if ( op == pOutEnd )
+			return ( ip == pInEnd );
+
+		if ( pInEnd - ip < 2 )
+			return false;
+
+		uint32 nOffset = ip[0] | ( ip[1] << 8 );
+		ip += 2;
+		if ( nOffset == 0 || nOffset > (uint32)( op - pDst ) )
+			return false;
+
+		uint32 nMatch = nToken & 15;
+		if ( nMatch == 15 )
+		{
+			uint32 nByte;
+			do
+			{
+				if ( ip >= pInEnd )
+					return false;
+				nByte = *ip++;
+				nMatch += nByte;
+			} while ( nByte == 255 );
+		}
+		nMatch += LZFAST_MIN_MATCH;
+
+		if ( nMatch > (uint32)( pOutEnd - op ) )
+			return false;
+
+		const uint8 *pRef = op - nOffset;
+		if ( nOffset >= 8 && op + nMatch + 8 <= pOutEnd )
+		{
+			// Each word only reads bytes that are already written
+			for ( uint32 i = 0; i < nMatch; i += 8 )
+			{
+				memcpy( op + i, pRef + i, 8 );
+			}
+		}
+		else
+		{
+			for ( uint32 i = 0; i < nMatch; ++i )
+			{
+				op[i] = pRef[i];
+			}
+		}
+		op += nMatch;
+	}
+
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Header helpers
+//-----------------------------------------------------------------------------
+LZFormat_t CLZFast::GetFormat( const unsigned char *pInput )
+{
+	if ( !pInput )
+		return LZFORMAT_NONE;
+
+	const lzss_header_t *pHeader = (const lzss_header_t *)pInput;
+	if ( pHeader->id == LZFAST_ID )
+		return LZFORMAT_LZFAST;
+	if ( pHeader->id == LZSS_ID )
+		return LZFORMAT_LZSS;
+	if ( pHeader->id == SNAPPY_ID )
+		return LZFORMAT_SNAPPY;
+	return LZFORMAT_NONE;
+}
+
+bool CLZFast::IsCompressed( const unsigned char *pInput )
+{
+	return GetFormat( pInput ) == LZFORMAT_LZFAST;
+}
+
+unsigned int CLZFast::GetActualSize( const unsigned char *pInput )
+{
+	if ( GetFormat( pInput ) == LZFORMAT_NONE )
+		return 0;
+
+	return LittleLong( ( (const lzss_header_t *)pInput )->actualSize );
+}
+
+unsigned int CLZFast::GetMaxCompressedSize( unsigned int inputlen )
+{
+	unsigned int nChunks = ( inputlen + LZFAST_CHUNK_SIZE - 1 ) / LZFAST_CHUNK_SIZE;
+	return sizeof( lzss_header_t ) + nChunks * sizeof( uint32 ) + inputlen;
+}
+
+
+//-----------------------------------------------------------------------------
+// Buffer compression. Chunks are compressed into a slot each, on several
+// threads when there are enough of them, then packed behind the header.
+//-----------------------------------------------------------------------------
+struct LZFastJob_t
+{
+	const uint8		*m_pInput;
+	int				m_nInputLen;
+	int				m_nChunks;
+	int				m_nLevel;
+	uint8			*m_pSlots;		// LZFAST_CHUNK_SIZE bytes per chunk
+	int				*m_pSizes;
+	volatile long	m_nNextChunk;
+};
+
+static unsigned LZFast_CompressWorker( void *pParam )
+{
+	LZFastJob_t *pJob = (LZFastJob_t *)pParam;
+	void *pScratch = malloc( CLZFast::GetChunkScratchSize( pJob->m_nLevel ) );
+
+	int iChunk;
+	while ( ( iChunk = ThreadInterlockedIncrement( &pJob->m_nNextChunk ) - 1 ) < pJob->m_nChunks )
+	{
+		int nOffset = iChunk * LZFAST_CHUNK_SIZE;
+		int nSize = MIN( LZFAST_CHUNK_SIZE, pJob->m_nInputLen - nOffset );
+		pJob->m_pSizes[iChunk] = CLZFast::CompressChunk( pJob->m_pInput + nOffset, nSize,
+			pJob->m_pSlots + nOffset, pJob->m_nLevel, pScratch );
+	}
+
+	free( pScratch );
+	return 0;
+}
+
+unsigned char *CLZFast::CompressNoAlloc( const unsigned char *pInput, int inputlen, unsigned char *pOutput, unsigned int *pOutputSize )
+{
+	if ( pOutputSize )
+	{
+		*pOutputSize = 0;
+	}
+
+	if ( inputlen <= (int)sizeof( lzss_header_t ) )
+		return NULL;
+
+	LZFastJob_t job;
+	job.m_pInput = pInput;
+	job.m_nInputLen = inputlen;
+	job.m_nChunks = ( inputlen + LZFAST_CHUNK_SIZE - 1 ) / LZFAST_CHUNK_SIZE;
+	job.m_nLevel = m_nLevel;
+	job.m_pSlots = (uint8 *)malloc( inputlen );
+	job.m_pSizes = new int[job.m_nChunks];
+	job.m_nNextChunk = 0;
+
+	int nThreads = 1;
+	if ( job.m_nChunks >= LZFAST_PARALLEL_MIN_CHUNKS )
+	{
+		nThreads = m_nMaxThreads ? m_nMaxThreads : GetCPUInformation()->m_nLogicalProcessors;
+		nThreads = clamp( nThreads, 1, MIN( job.m_nChunks / 2, LZFAST_MAX_THREADS ) );
+	}
+
+	ThreadHandle_t hThreads[LZFAST_MAX_THREADS];
+	int nStarted = 0;
+	for ( int i = 1; i < nThreads; i++ )
+	{
+		hThreads[nStarted] = CreateSimpleThread( LZFast_CompressWorker, &job );
+		if ( hThreads[nStarted] )
+		{
+			++nStarted;
+		}
+	}
+
+	LZFast_CompressWorker( &job );
+
+	for ( int i = 0; i < nStarted; i++ )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+	}
+
+	// Pack the chunks, giving up as soon as the output is no smaller than the input
+	lzss_header_t *pHeader = (lzss_header_t *)pOutput;
+	pHeader->id = LZFAST_ID;
+	pHeader->actualSize = LittleLong( inputlen );
+
+	unsigned char *pOut = pOutput + sizeof( lzss_header_t );
+	unsigned char *pOutLimit = pOutput + inputlen;
+	for ( int i = 0; i < job.m_nChunks && pOut; i++ )
+	{
+		int nOffset = i * LZFAST_CHUNK_SIZE;
+		int nSize = MIN( LZFAST_CHUNK_SIZE, inputlen - nOffset );
+		int nCompressed = job.m_pSizes[i];
+		int nStored = nCompressed ? nCompressed : nSize;
+		if ( pOut + sizeof( uint32 ) + nStored >= pOutLimit )
+		{
+			pOut = NULL;
+			break;
+		}
+
+		uint32 nChunkWord = LittleLong( nCompressed ? (uint32)nCompressed : ( (uint32)nSize | LZFAST_STORED ) );
+		memcpy( pOut, &nChunkWord, sizeof( nChunkWord ) );
+		pOut += sizeof( nChunkWord );
+		memcpy( pOut, nCompressed ? job.m_pSlots + nOffset : pInput + nOffset, nStored );
+		pOut += nStored;
+	}
+
+	free( job.m_pSlots );
+	delete [] job.m_pSizes;
+
+	if ( !pOut )
+		return NULL;
+
+	if ( pOutputSize )
+	{
+		*pOutputSize = pOut - pOutput;
+	}
+	return pOutput;
+}
+
+unsigned char *CLZFast::Compress( const unsigned char *pInput, int inputlen, unsigned int *pOutputSize )
+{
+	unsigned char *pOutput = new unsigned char[GetMaxCompressedSize( inputlen )];
+	if ( !CompressNoAlloc( pInput, inputlen, pOutput, pOutputSize ) )
+	{
+		delete [] pOutput;
+		return NULL;
+	}
+	return pOutput;
+}
+
+
+//-----------------------------------------------------------------------------
+// Buffer decompression
+//-----------------------------------------------------------------------------
+unsigned int CLZFast::SafeUncompress( const unsigned char *pInput, unsigned char *pOutput, unsigned int unBufSize )
+{
+	if ( !IsCompressed( pInput ) )
+		return 0;
+
+	unsigned int nActualSize = GetActualSize( pInput );
+	if ( nActualSize > unBufSize )
+		return 0;
+
+	const unsigned char *pIn = pInput + sizeof( lzss_header_t );
+	for ( unsigned int nOffset = 0; nOffset < nActualSize; nOffset += LZFAST_CHUNK_SIZE )
+	{
+		int nSize = (int)MIN( (unsigned int)LZFAST_CHUNK_SIZE, nActualSize - nOffset );
+
+		uint32 nChunkWord;
+		memcpy( &nChunkWord, pIn, sizeof( nChunkWord ) );
+		nChunkWord = LittleLong( nChunkWord );
+		pIn += sizeof( nChunkWord );
+
+		int nCompressed = nChunkWord & ~LZFAST_STORED;
+		if ( nCompressed > nSize || ( ( nChunkWord & LZFAST_STORED ) && nCompressed != nSize ) )
+			return 0;
+
+		if ( nChunkWord & LZFAST_STORED )
+		{
+			memcpy( pOutput + nOffset, pIn, nSize );
+		}
+		else if ( !UncompressChunk( pIn, nCompressed, pOutput + nOffset, nSize ) )
+		{
+			return 0;
+		}
+		pIn += nCompressed;
+	}
+
+	return nActualSize;
+}
+
+unsigned int CLZFast::Uncompress( const unsigned char *pInput, unsigned char *pOutput )
+{
+	return SafeUncompress( pInput, pOutput, GetActualSize( pInput ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// CUtlBuffer streaming
+//-----------------------------------------------------------------------------
+bool CLZFast::Compress( CUtlBuffer &input, CUtlBuffer &output )
+{
+	int nInputLen = input.TellMaxPut() - input.TellGet();
+	if ( nInputLen <= 0 )
+		return false;
+
+	// Large input that's fully resident can take the threaded path. If it
+	// doesn't get smaller, the stream below stores it instead.
+	const unsigned char *pInput = NULL;
+	if ( nInputLen >= LZFAST_PARALLEL_MIN_CHUNKS * LZFAST_CHUNK_SIZE )
+	{
+		pInput = (const unsigned char *)input.PeekGet( nInputLen, 0 );
+	}
+
+	if ( pInput )
+	{
+		unsigned char *pOutput = new unsigned char[GetMaxCompressedSize( nInputLen )];
+		unsigned int nOutputSize = 0;
+		bool bCompressed = ( CompressNoAlloc( pInput, nInputLen, pOutput, &nOutputSize ) != NULL );
+		if ( bCompressed )
+		{
+			output.Put( pOutput, nOutputSize );
+			input.SeekGet( CUtlBuffer::SEEK_CURRENT, nInputLen );
+		}
+		delete [] pOutput;
+
+		if ( bCompressed )
+			return output.IsValid();
+	}
+
+	CLZFastCompressStream stream( output, m_nLevel );
+	unsigned char *pChunk = new unsigned char[LZFAST_CHUNK_SIZE];
+	while ( nInputLen > 0 && input.IsValid() )
+	{
+		int nSize = MIN( nInputLen, LZFAST_CHUNK_SIZE );
+		input.Get( pChunk, nSize );
+		stream.Write( pChunk, nSize );
+		nInputLen -= nSize;
+	}
+	delete [] pChunk;
+
+	stream.Finish();
+	return input.IsValid() && output.IsValid();
+}
+
+bool CLZFast::Uncompress( CUtlBuffer &input, CUtlBuffer &output )
+{
+	lzss_header_t header;
+	input.Get( &header, sizeof( header ) );
+	if ( !input.IsValid() || !IsCompressed( (const unsigned char *)&header ) )
+		return false;
+
+	unsigned int nActualSize = GetActualSize( (const unsigned char *)&header );
+	unsigned char *pCompressed = new unsigned char[LZFAST_CHUNK_SIZE];
+	unsigned char *pChunk = new unsigned char[LZFAST_CHUNK_SIZE];
+
+	bool bOk = true;
+	for ( unsigned int nOffset = 0; bOk && nOffset < nActualSize; nOffset += LZFAST_CHUNK_SIZE )
+	{
+		int nSize = (int)MIN( (unsigned int)LZFAST_CHUNK_SIZE, nActualSize - nOffset );
+
+		uint32 nChunkWord = 0;
+		input.Get( &nChunkWord, sizeof( nChunkWord ) );
+		nChunkWord = LittleLong( nChunkWord );
+
+		int nCompressed = nChunkWord & ~LZFAST_STORED;
+		if ( !input.IsValid() || nCompressed > nSize || ( ( nChunkWord & LZFAST_STORED ) && nCompressed != nSize ) )
+		{
+			bOk = false;
+			break;
+		}
+
+		if ( nChunkWord & LZFAST_STORED )
+		{
+			input.Get( pChunk, nSize );
+		}
+		else
+		{
+			input.Get( pCompressed, nCompressed );
+			bOk = input.IsValid() && UncompressChunk( pCompressed, nCompressed, pChunk, nSize );
+		}
+
+		if ( bOk && input.IsValid() )
+		{
+			output.Put( pChunk, nSize );
+		}
+	}
+
+	delete [] pCompressed;
+	delete [] pChunk;
+	return bOk && input.IsValid() && output.IsValid();
+}
+
+
+//-----------------------------------------------------------------------------
+// Incremental compression
+//-----------------------------------------------------------------------------
+CLZFastCompressStream::CLZFastCompressStream( CUtlBuffer &output, int nLevel ) : m_Output( output )
+{
+	m_nLevel = nLevel;
+	m_nActualSize = 0;
+	m_nChunkBytes = 0;
+	m_bFinished = false;
+	m_pChunk = new unsigned char[LZFAST_CHUNK_SIZE];
+	m_pCompressed = new unsigned char[LZFAST_CHUNK_SIZE];
+	m_pScratch = malloc( CLZFast::GetChunkScratchSize( nLevel ) );
+
+	// Written again with the real size by Finish
+	lzss_header_t header;
+	header.id = LZFAST_ID;
+	header.actualSize = 0;
+	m_nHeaderPos = m_Output.TellPut();
+	m_Output.Put( &header, sizeof( header ) );
+}
+
+CLZFastCompressStream::~CLZFastCompressStream()
+{
+	Assert( m_bFinished );
+	delete [] m_pChunk;
+	delete [] m_pCompressed;
+	free( m_pScratch );
+}
+
+void CLZFastCompressStream::Write( const void *pData, int nBytes )
+{
+	Assert( !m_bFinished );
+	const unsigned char *pIn = (const unsigned char *)pData;
+	while ( nBytes > 0 )
+	{
+		int nCopy = MIN( nBytes, LZFAST_CHUNK_SIZE - m_nChunkBytes );
+		memcpy( m_pChunk + m_nChunkBytes, pIn, nCopy );
+		m_nChunkBytes += nCopy;
+		pIn += nCopy;
+		nBytes -= nCopy;
+
+		if ( m_nChunkBytes == LZFAST_CHUNK_SIZE )
+		{
+			FlushChunk();
+		}
+	}
+}
+
+void CLZFastCompressStream::FlushChunk()
+{
+	if ( !m_nChunkBytes )
+		return;
+
+	int nCompressed = CLZFast::CompressChunk( m_pChunk, m_nChunkBytes, m_pCompressed, m_nLevel, m_pScratch );
+	uint32 nChunkWord = LittleLong( nCompressed ? (uint32)nCompressed : ( (uint32)m_nChunkBytes | LZFAST_STORED ) );
+	m_Output.Put( &nChunkWord, sizeof( nChunkWord ) );
+	m_Output.Put( nCompressed ? m_pCompressed : m_pChunk, nCompressed ? nCompressed : m_nChunkBytes );
+
+	m_nActualSize += m_nChunkBytes;
+	m_nChunkBytes = 0;
+}
+
+unsigned int CLZFastCompressStream::Finish()
+{
+	if ( !m_bFinished )
+	{
+		FlushChunk();
+		m_bFinished = true;
+
+		int nEnd = m_Output.TellPut();
+		unsigned int nActualSize = LittleLong( m_nActualSize );
+		m_Output.SeekPut( CUtlBuffer::SEEK_HEAD, m_nHeaderPos + offsetof( lzss_header_t, actualSize ) );
+		m_Output.Put( &nActualSize, sizeof( nActualSize ) );
+		m_Output.SeekPut( CUtlBuffer::SEEK_HEAD, nEnd );
+	}
+
+	return m_Output.TellPut() - m_nHeaderPos;
+}
@@ -0,0 +1,444 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Size classed small object allocator with per-thread caches
+//
+//=============================================================================//
+
+#include "tier1/smallobjectallocator.h"
+#include "tier0/dbg.h"
+#include <memory.h>
+
+// Should be last include
+#include "tier0/memdbgon.h"
+
+// Slabs are carved into whole batches, and are at least this big
+#define SMALLOBJECT_SLAB_SIZE		65536
+
+// Batches hold about this many bytes, within [SMALLOBJECT_MIN_BATCH, SMALLOBJECT_MAX_BATCH] blocks
+#define SMALLOBJECT_BATCH_BYTES		8192
+#define SMALLOBJECT_MIN_BATCH		8
+#define SMALLOBJECT_MAX_BATCH		64
+
+//-----------------------------------------------------------------------------
+// A free block's first word links it to the next block in the same list. The
+// first block of a batch sitting in the central pool uses its second word to
+// link to the next batch; blocks are at least 16 bytes so both always fit.
+//-----------------------------------------------------------------------------
+#define NEXT_BLOCK( p )		( ((void **)(p))[0] )
+#define NEXT_BATCH( p )		( ((void **)(p))[1] )
+
+struct SmallObjectFreeList_t
+{
+	void	*m_pHead;
+	int		m_nCount;
+};
+
+class CSmallObjectThreadCache
+{
+public:
+	SmallObjectFreeList_t	m_Lists[SMALLOBJECT_NUM_SIZECLASSES];
+
+	// Allocations minus frees made on this thread, per tracked class. Objects
+	// freed on another thread than they were allocated on make these go
+	// negative; only the sum over all caches means anything.
+	int						m_nLive[SMALLOBJECT_MAX_TRACKED];
+
+	CSmallObjectThreadCache	*m_pNext;
+	bool					m_bInUse;
+};
+
+
+//-----------------------------------------------------------------------------
+// The allocator is never destroyed, so objects freed by static destructors
+// that run after this module's statics are torn down still have somewhere
+// to go.
+//-----------------------------------------------------------------------------
+CSmallObjectAllocator &SmallObjectAllocator()
+{
+	static CSmallObjectAllocator *s_pAllocator = new CSmallObjectAllocator;
+	return *s_pAllocator;
+}
+
+
+//-----------------------------------------------------------------------------
+// Size classes
+//-----------------------------------------------------------------------------
+int CSmallObjectAllocator::GetSizeClass( size_t nBytes )
+{
+	Assert( nBytes <= SMALLOBJECT_MAX_SIZE );
+	if ( nBytes <= 256 )
+		return ( nBytes > 0 ) ? (int)( nBytes - 1 ) / 16 : 0;
+	return 16 + (int)( nBytes - 257 ) / 64;
+}
+
+int CSmallObjectAllocator::GetSizeClassBytes( int nSizeClass )
+{
+	Assert( nSizeClass >= 0 && nSizeClass < SMALLOBJECT_NUM_SIZECLASSES );
+	if ( nSizeClass < 16 )
+		return ( nSizeClass + 1 ) * 16;
+	return 256 + ( nSizeClass - 15 ) * 64;
+}
+
+static int GetBatchSize( int nSizeClass )
+{
+	int nBatch = SMALLOBJECT_BATCH_BYTES / CSmallObjectAllocator::GetSizeClassBytes( nSizeClass );
+	return Clamp( nBatch, SMALLOBJECT_MIN_BATCH, SMALLOBJECT_MAX_BATCH );
+}
+
+
+//-----------------------------------------------------------------------------
+// Statistics
+//-----------------------------------------------------------------------------
+CSmallObjectAllocStats::CSmallObjectAllocStats( const char *pszName, int nSize )
+{
+	m_pszName = pszName;
+	m_nSize = nSize;
+	m_nIndex = -1;
+	m_nPeak = 0;
+	m_pNext = NULL;
+	SmallObjectAllocator().RegisterStats( this );
+}
+
+int CSmallObjectAllocStats::GetLiveCount() const
+{
+	return ( m_nIndex >= 0 ) ? SmallObjectAllocator().SumLiveCount( m_nIndex ) : 0;
+}
+
+void CSmallObjectAllocator::RegisterStats( CSmallObjectAllocStats *pStats )
+{
+	AUTO_LOCK( m_CacheMutex );
+	pStats->m_nIndex = ( m_nTracked < SMALLOBJECT_MAX_TRACKED ) ? m_nTracked++ : -1;
+	pStats->m_pNext = m_pStats;
+	m_pStats = pStats;
+}
+
+int CSmallObjectAllocator::SumLiveCount( int nIndex )
+{
+	AUTO_LOCK( m_CacheMutex );
+	int nLive = 0;
+	for ( CSmallObjectThreadCache *pCache = m_pCaches; pCache; pCache = pCache->m_pNext )
+	{
+		nLive += pCache->m_nLive[nIndex];
+	}
+	return nLive;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+CSmallObjectAllocator::CSmallObjectAllocator()
+{
+	for ( int i = 0; i < SMALLOBJECT_NUM_SIZECLASSES; i++ )
+	{
+		CentralPool_t &central = m_Central[i];
+		central.m_pBatches = NULL;
+		central.m_nBatches = 0;
+		central.m_pLoose = NULL;
+		central.m_nLoose = 0;
+		central.m_pCarve = NULL;
+		central.m_nCarveBlocks = 0;
+		central.m_nSlabs = 0;
+		central.m_nBlocks = 0;
+	}
+	m_pCaches = NULL;
+	m_pStats = NULL;
+	m_nTracked = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Thread caches. A cache released by FlushThreadCache() keeps its live
+// counts and is handed to the next thread that needs one.
+//-----------------------------------------------------------------------------
+inline CSmallObjectThreadCache *CSmallObjectAllocator::GetThreadCache()
+{
+	CSmallObjectThreadCache *pCache = m_pThreadCache;
+	if ( !pCache )
+	{
+		pCache = CreateThreadCache();
+	}
+	return pCache;
+}
+
+CSmallObjectThreadCache *CSmallObjectAllocator::CreateThreadCache()
+{
+	AUTO_LOCK( m_CacheMutex );
+
+	CSmallObjectThreadCache *pCache;
+	for ( pCache = m_pCaches; pCache; pCache = pCache->m_pNext )
+	{
+		if ( !pCache->m_bInUse )
+			break;
+	}
+
+	if ( !pCache )
+	{
+		// Cache line aligned so two threads never write the same line
+		pCache = (CSmallObjectThreadCache *)MemAlloc_AllocAligned( sizeof(CSmallObjectThreadCache), 128 );
+		memset( pCache, 0, sizeof(CSmallObjectThreadCache) );
+		pCache->m_pNext = m_pCaches;
+		m_pCaches = pCache;
+	}
+
+	pCache->m_bInUse = true;
+	m_pThreadCache = pCache;
+	return pCache;
+}
+
+void CSmallObjectAllocator::FlushThreadCache()
+{
+	CSmallObjectThreadCache *pCache = m_pThreadCache;
+	if ( !pCache )
+		return;
+
+	for ( int i = 0; i < SMALLOBJECT_NUM_SIZECLASSES; i++ )
+	{
+		if ( pCache->m_Lists[i].m_nCount )
+		{
+			Release( pCache, i, pCache->m_Lists[i].m_nCount );
+		}
+	}
+
+	AUTO_LOCK( m_CacheMutex );
+	pCache->m_bInUse = false;
+	m_pThreadCache = (CSmallObjectThreadCache *)NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Moves a batch from the central pool into an empty thread free list. Full
+// batches are reused first, then blocks left over from flushed caches, and
+// only then is a new batch carved from a slab.
+//-----------------------------------------------------------------------------
+void CSmallObjectAllocator::Refill( CSmallObjectThreadCache *pCache, int nSizeClass, CSmallObjectAllocStats *pStats )
+{
+	SmallObjectFreeList_t &list = pCache->m_Lists[nSizeClass];
+	Assert( !list.m_pHead && !list.m_nCount );
+
+	CentralPool_t &central = m_Central[nSizeClass];
+	int nBatch = GetBatchSize( nSizeClass );
+	{
+		AUTO_LOCK( central.m_Mutex );
+
+		if ( central.m_pBatches )
+		{
+			list.m_pHead = central.m_pBatches;
+			list.m_nCount = nBatch;
+			central.m_pBatches = NEXT_BATCH( list.m_pHead );
+			central.m_nBatches--;
+		}
+		else if ( central.m_pLoose )
+		{
+			// Take up to a batch worth of loose blocks
+			void *pTail = central.m_pLoose;
+			int nCount = 1;
+			while ( nCount < nBatch && NEXT_BLOCK( pTail ) )
+			{
+				pTail = NEXT_BLOCK( pTail );
+				nCount++;
+			}
+
+			list.m_pHead = central.m_pLoose;
+			list.m_nCount = nCount;
+			central.m_pLoose = NEXT_BLOCK( pTail );
+			central.m_nLoose -= nCount;
+			NEXT_BLOCK( pTail ) = NULL;
+		}
+		else
+		{
+			int nBytes = GetSizeClassBytes( nSizeClass );
+			if ( !central.m_nCarveBlocks )
+			{
+				// Slabs hold a whole number of batches, so the carve position
+				// always ends on a batch boundary
+				int nSlabBatches = MAX( 1, SMALLOBJECT_SLAB_SIZE / ( nBatch * nBytes ) );
+				central.m_nCarveBlocks = nSlabBatches * nBatch;
+				central.m_pCarve = (char *)MemAlloc_AllocAligned( central.m_nCarveBlocks * nBytes, 16 );
+				central.m_nSlabs++;
+				central.m_nBlocks += central.m_nCarveBlocks;
+			}
+
+			char *pBlock = central.m_pCarve;
+			for ( int i = 0; i < nBatch - 1; i++, pBlock += nBytes )
+			{
+				NEXT_BLOCK( pBlock ) = pBlock + nBytes;
+			}
+			NEXT_BLOCK( pBlock ) = NULL;
+
+			list.m_pHead = central.m_pCarve;
+			list.m_nCount = nBatch;
+			central.m_pCarve += nBatch * nBytes;
+			central.m_nCarveBlocks -= nBatch;
+		}
+	}
+
+	if ( pStats && pStats->m_nIndex >= 0 )
+	{
+		int nLive = SumLiveCount( pStats->m_nIndex );
+		if ( nLive > pStats->m_nPeak )
+		{
+			pStats->m_nPeak = nLive;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Moves nBlocks from the front of a thread free list to the central pool
+//-----------------------------------------------------------------------------
+void CSmallObjectAllocator::Release( CSmallObjectThreadCache *pCache, int nSizeClass, int nBlocks )
+{
+	SmallObjectFreeList_t &list = pCache->m_Lists[nSizeClass];
+	Assert( nBlocks > 0 && nBlocks <= list.m_nCount );
+
+	void *pHead = list.m_pHead;
+	void *pTail = pHead;
+	for ( int i = 1; i < nBlocks; i++ )
+	{
+		pTail = NEXT_BLOCK( pTail );
+	}
+	list.m_pHead = NEXT_BLOCK( pTail );
+	list.m_nCount -= nBlocks;
+	NEXT_BLOCK( pTail ) = NULL;
+
+	CentralPool_t &central = m_Central[nSizeClass];
+	AUTO_LOCK( central.m_Mutex );
+
+	if ( nBlocks == GetBatchSize( nSizeClass ) )
+	{
+		NEXT_BATCH( pHead ) = central.m_pBatches;
+		central.m_pBatches = pHead;
+		central.m_nBatches++;
+	}
+	else
+	{
+		NEXT_BLOCK( pTail ) = central.m_pLoose;
+		central.m_pLoose = pHead;
+		central.m_nLoose += nBlocks;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Allocation
+//-----------------------------------------------------------------------------
+void *CSmallObjectAllocator::Alloc( size_t nBytes, CSmallObjectAllocStats *pStats )
+{
+	CSmallObjectThreadCache *pCache = GetThreadCache();
+	if ( pStats && pStats->m_nIndex >= 0 )
+	{
+		pCache->m_nLive[pStats->m_nIndex]++;
+	}
+
+	if ( nBytes > SMALLOBJECT_MAX_SIZE )
+		return MemAlloc_AllocAligned( nBytes, 16 );
+
+	int nSizeClass = GetSizeClass( nBytes );
+	SmallObjectFreeList_t &list = pCache->m_Lists[nSizeClass];
+	if ( !list.m_pHead )
+	{
+		Refill( pCache, nSizeClass, pStats );
+	}
+
+	void *pMem = list.m_pHead;
+	list.m_pHead = NEXT_BLOCK( pMem );
+	list.m_nCount--;
+	return pMem;
+}
+
+void CSmallObjectAllocator::Free( void *pMem, size_t nBytes, CSmallObjectAllocStats *pStats )
+{
+	if ( !pMem )
+		return;
+
+	CSmallObjectThreadCache *pCache = GetThreadCache();
+	if ( pStats && pStats->m_nIndex >= 0 )
+	{
+		pCache->m_nLive[pStats->m_nIndex]--;
+	}
+
+	if ( nBytes > SMALLOBJECT_MAX_SIZE )
+	{
+		MemAlloc_FreeAligned( pMem );
+		return;
+	}
+
+	// Keep up to two batches so a thread that alternates allocating and
+	// freeing around a batch boundary doesn't bounce off the central pool
+	int nSizeClass = GetSizeClass( nBytes );
+	SmallObjectFreeList_t &list = pCache->m_Lists[nSizeClass];
+	NEXT_BLOCK( pMem ) = list.m_pHead;
+	list.m_pHead = pMem;
+
+	int nBatch = GetBatchSize( nSizeClass );
+	if ( ++list.m_nCount >= 2 * nBatch )
+	{
+		Release( pCache, nSizeClass, nBatch );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+void CSmallObjectAllocator::ReportStats()
+{
+	int nCached[SMALLOBJECT_NUM_SIZECLASSES];
+	int nThreads = 0;
+	{
+		AUTO_LOCK( m_CacheMutex );
+		memset( nCached, 0, sizeof(nCached) );
+		for ( CSmallObjectThreadCache *pCache = m_pCaches; pCache; pCache = pCache->m_pNext )
+		{
+			nThreads += pCache->m_bInUse;
+			for ( int i = 0; i < SMALLOBJECT_NUM_SIZECLASSES; i++ )
+			{
+				nCached[i] += pCache->m_Lists[i].m_nCount;
+			}
+		}
+	}
+
+	Msg( "Small object allocator, %d thread caches:\n", nThreads );
+	Msg( "  %5s %6s %9s %9s %9s %9s\n", "size", "slabs", "reserved", "in use", "central", "cached" );
+
+	int nTotalReserved = 0;
+	int nTotalInUse = 0;
+	for ( int i = 0; i < SMALLOBJECT_NUM_SIZECLASSES; i++ )
+	{
+		CentralPool_t &central = m_Central[i];
+		int nSlabs, nBlocks, nCentral;
+		{
+			AUTO_LOCK( central.m_Mutex );
+			nSlabs = central.m_nSlabs;
+			nBlocks = central.m_nBlocks;
+			nCentral = central.m_nBatches * GetBatchSize( i ) + central.m_nLoose + central.m_nCarveBlocks;
+		}
+
+		if ( !nSlabs )
+			continue;
+
+		int nBytes = GetSizeClassBytes( i );
+		int nInUse = nBlocks - nCentral - nCached[i];
+		nTotalReserved += nBlocks * nBytes;
+		nTotalInUse += nInUse * nBytes;
+		Msg( "  %5d %6d %8dk %9d %9d %9d\n", nBytes, nSlabs, nBlocks * nBytes / 1024, nInUse, nCentral, nCached[i] );
+	}
+	Msg( "  %dk reserved, %dk in use\n", nTotalReserved / 1024, nTotalInUse / 1024 );
+
+	Msg( "  %-32s %5s %8s %8s %9s\n", "class", "size", "live", "peak", "bytes" );
+	for ( CSmallObjectAllocStats *pStats = m_pStats; pStats; pStats = pStats->m_pNext )
+	{
+		if ( pStats->m_nIndex < 0 )
+		{
+			Msg( "  %-32s %5d %8s\n", pStats->m_pszName, pStats->m_nSize, "untracked" );
+			continue;
+		}
+
+		int nLive = pStats->GetLiveCount();
+		pStats->m_nPeak = MAX( pStats->m_nPeak, nLive );
+
+		int nBytes = ( pStats->m_nSize <= SMALLOBJECT_MAX_SIZE ) ? GetSizeClassBytes( GetSizeClass( pStats->m_nSize ) ) : pStats->m_nSize;
+		Msg( "  %-32s %5d %8d %8d %9d\n", pStats->m_pszName, pStats->m_nSize, nLive, pStats->m_nPeak, nLive * nBytes );
+	}
+}
@@ -0,0 +1,249 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks the batched collisionutils ray tests against the scalar ones
+//
+//=============================================================================//
+
+#include "tier0/fasttimer.h"
+#include "tier1/strtools.h"
+#include "vstdlib/random.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "cmodel.h"
+#include "collisionutils.h"
+#include "libtest.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define COLLISION_BATCH_SIZE		100.0f
+#define COLLISION_BATCH_SEED		1138
+#define COLLISION_BATCH_TESTS		20000
+
+enum
+{
+	COLLISION_BATCH_RAY_VS_BOXES = 0,
+	COLLISION_BATCH_RAYS_VS_BOX,
+	COLLISION_BATCH_RAYS_VS_OBB,
+	COLLISION_BATCH_RAY_VS_OBBS,
+
+	COLLISION_BATCH_COUNT
+};
+
+struct CollisionBatchResults_t
+{
+	int		m_nMismatches[COLLISION_BATCH_COUNT];
+	int		m_nFractionMismatches;
+	double	m_flScalarTime[COLLISION_BATCH_COUNT];
+	double	m_flBatchTime[COLLISION_BATCH_COUNT];
+};
+
+static Vector RandomCollisionBatchVector( IUniformRandomStream &random, float flSize )
+{
+	return Vector( random.RandomFloat( -flSize, flSize ), random.RandomFloat( -flSize, flSize ), random.RandomFloat( -flSize, flSize ) );
+}
+
+static void RandomCollisionBatchOBB( IUniformRandomStream &random, matrix3x4_t &matOBBToWorld, Vector &vecMins, Vector &vecMaxs )
+{
+	QAngle angles( random.RandomFloat( -180.0f, 180.0f ), random.RandomFloat( -180.0f, 180.0f ), random.RandomFloat( -180.0f, 180.0f ) );
+	AngleMatrix( angles, RandomCollisionBatchVector( random, COLLISION_BATCH_SIZE ), matOBBToWorld );
+	Vector vecCenter = RandomCollisionBatchVector( random, 16.0f );
+	Vector vecExtents( random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ) );
+	vecMins = vecCenter - vecExtents;
+	vecMaxs = vecCenter + vecExtents;
+}
+
+//-----------------------------------------------------------------------------
+// Runs each batched test against its scalar version on the same random
+// inputs, every other test with a swept box instead of a ray
+//-----------------------------------------------------------------------------
+static void RunCollisionBatch( int nTests, int nSeed, CollisionBatchResults_t &results )
+{
+	memset( &results, 0, sizeof( results ) );
+
+	CUniformRandomStream random;
+	random.SetSeed( nSeed );
+	CFastTimer timer;
+
+	for ( int iTest = 0; iTest < nTests; iTest++ )
+	{
+		Vector vecStart = RandomCollisionBatchVector( random, 2.0f * COLLISION_BATCH_SIZE );
+		Vector vecEnd = RandomCollisionBatchVector( random, 2.0f * COLLISION_BATCH_SIZE );
+		Vector vecExtents = ( iTest & 1 ) ? RandomCollisionBatchVector( random, 16.0f ) : vec3_origin;
+		vecExtents.x = fabs( vecExtents.x ); vecExtents.y = fabs( vecExtents.y ); vecExtents.z = fabs( vecExtents.z );
+		Ray_t ray;
+		ray.Init( vecStart, vecEnd, -vecExtents, vecExtents );
+
+		// One ray against four boxes
+		Vector vecBoxMins[4], vecBoxMaxs[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			Vector vecCenter = RandomCollisionBatchVector( random, COLLISION_BATCH_SIZE );
+			Vector vecSize( random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ), random.RandomFloat( 1.0f, 32.0f ) );
+			vecBoxMins[i] = vecCenter - vecSize;
+			vecBoxMaxs[i] = vecCenter + vecSize;
+		}
+
+		timer.Start();
+		int nScalarMask = 0;
+		for ( int i = 0; i < 4; i++ )
+		{
+			nScalarMask |= IsBoxIntersectingRay( vecBoxMins[i], vecBoxMaxs[i], ray ) ? ( 1 << i ) : 0;
+		}
+		timer.End();
+		results.m_flScalarTime[COLLISION_BATCH_RAY_VS_BOXES] += timer.GetDuration().GetSeconds();
+
+		FourVectors boxMins, boxMaxs;
+		boxMins.LoadAndSwizzle( vecBoxMins[0], vecBoxMins[1], vecBoxMins[2], vecBoxMins[3] );
+		boxMaxs.LoadAndSwizzle( vecBoxMaxs[0], vecBoxMaxs[1], vecBoxMaxs[2], vecBoxMaxs[3] );
+		timer.Start();
+		int nBatchMask = IsFourBoxesIntersectingRay( boxMins, boxMaxs, ray );
+		timer.End();
+		results.m_flBatchTime[COLLISION_BATCH_RAY_VS_BOXES] += timer.GetDuration().GetSeconds();
+		results.m_nMismatches[COLLISION_BATCH_RAY_VS_BOXES] += ( nScalarMask != nBatchMask ) ? 1 : 0;
+
+		// Four rays against one box, checking where they enter it too
+		FourVectors rayStarts, rayDeltas;
+		Vector vecStarts[4], vecDeltas[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			vecStarts[i] = RandomCollisionBatchVector( random, 2.0f * COLLISION_BATCH_SIZE );
+			vecDeltas[i] = RandomCollisionBatchVector( random, 2.0f * COLLISION_BATCH_SIZE ) - vecStarts[i];
+		}
+		rayStarts.LoadAndSwizzle( vecStarts[0], vecStarts[1], vecStarts[2], vecStarts[3] );
+		rayDeltas.LoadAndSwizzle( vecDeltas[0], vecDeltas[1], vecDeltas[2], vecDeltas[3] );
+
+		timer.Start();
+		nScalarMask = 0;
+		float flScalarFractions[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for ( int i = 0; i < 4; i++ )
+		{
+			BoxTraceInfo_t boxTrace;
+			if ( IntersectRayWithBox( vecStarts[i], vecDeltas[i], vecBoxMins[0], vecBoxMaxs[0], 0.0f, &boxTrace ) )
+			{
+				nScalarMask |= ( 1 << i );
+				flScalarFractions[i] = MAX( boxTrace.t1, 0.0f );
+			}
+		}
+		timer.End();
+		results.m_flScalarTime[COLLISION_BATCH_RAYS_VS_BOX] += timer.GetDuration().GetSeconds();
+
+		fltx4 batchFractions;
+		timer.Start();
+		nBatchMask = IsBoxIntersectingFourRays( vecBoxMins[0], vecBoxMaxs[0], rayStarts, rayDeltas, 0.0f, &batchFractions );
+		timer.End();
+		results.m_flBatchTime[COLLISION_BATCH_RAYS_VS_BOX] += timer.GetDuration().GetSeconds();
+		results.m_nMismatches[COLLISION_BATCH_RAYS_VS_BOX] += ( nScalarMask != nBatchMask ) ? 1 : 0;
+		for ( int i = 0; i < 4; i++ )
+		{
+			if ( ( nScalarMask & nBatchMask & ( 1 << i ) ) && fabs( flScalarFractions[i] - SubFloat( batchFractions, i ) ) > 1e-3f )
+			{
+				results.m_nFractionMismatches++;
+			}
+		}
+
+		// Four rays against one OBB
+		matrix3x4_t matOBBToWorld[4];
+		Vector vecOBBMins[4], vecOBBMaxs[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			RandomCollisionBatchOBB( random, matOBBToWorld[i], vecOBBMins[i], vecOBBMaxs[i] );
+		}
+
+		timer.Start();
+		nScalarMask = 0;
+		for ( int i = 0; i < 4; i++ )
+		{
+			BoxTraceInfo_t obbTrace;
+			nScalarMask |= IntersectRayWithOBB( vecStarts[i], vecDeltas[i], matOBBToWorld[0], vecOBBMins[0], vecOBBMaxs[0], 0.0f, &obbTrace ) ? ( 1 << i ) : 0;
+		}
+		timer.End();
+		results.m_flScalarTime[COLLISION_BATCH_RAYS_VS_OBB] += timer.GetDuration().GetSeconds();
+
+		timer.Start();
+		nBatchMask = IsOBBIntersectingFourRays( matOBBToWorld[0], vecOBBMins[0], vecOBBMaxs[0], rayStarts, rayDeltas );
+		timer.End();
+		results.m_flBatchTime[COLLISION_BATCH_RAYS_VS_OBB] += timer.GetDuration().GetSeconds();
+		results.m_nMismatches[COLLISION_BATCH_RAYS_VS_OBB] += ( nScalarMask != nBatchMask ) ? 1 : 0;
+
+		// One ray against four OBBs. Only exact for rays, so swept boxes may
+		// only add hits
+		timer.Start();
+		nScalarMask = 0;
+		for ( int i = 0; i < 4; i++ )
+		{
+			if ( ray.m_IsRay )
+			{
+				BoxTraceInfo_t obbTrace;
+				nScalarMask |= IntersectRayWithOBB( ray.m_Start, ray.m_Delta, matOBBToWorld[i], vecOBBMins[i], vecOBBMaxs[i], 0.0f, &obbTrace ) ? ( 1 << i ) : 0;
+			}
+			else
+			{
+				CBaseTrace obbTrace;
+				nScalarMask |= IntersectRayWithOBB( ray, matOBBToWorld[i], vecOBBMins[i], vecOBBMaxs[i], 0.0f, &obbTrace ) ? ( 1 << i ) : 0;
+			}
+		}
+		timer.End();
+		results.m_flScalarTime[COLLISION_BATCH_RAY_VS_OBBS] += timer.GetDuration().GetSeconds();
+
+		FourOBBs_t obbs;
+		for ( int i = 0; i < 4; i++ )
+		{
+			obbs.Set( i, matOBBToWorld[i], vecOBBMins[i], vecOBBMaxs[i] );
+		}
+		timer.Start();
+		nBatchMask = IsFourOBBsIntersectingRay( obbs, ray );
+		timer.End();
+		results.m_flBatchTime[COLLISION_BATCH_RAY_VS_OBBS] += timer.GetDuration().GetSeconds();
+		results.m_nMismatches[COLLISION_BATCH_RAY_VS_OBBS] += ( ray.m_IsRay ? ( nScalarMask != nBatchMask ) : ( ( nScalarMask & ~nBatchMask ) != 0 ) ) ? 1 : 0;
+	}
+}
+
+static int CountCollisionBatchFailures( const CollisionBatchResults_t &results )
+{
+	int nFailures = results.m_nFractionMismatches;
+	for ( int i = 0; i < COLLISION_BATCH_COUNT; i++ )
+	{
+		nFailures += results.m_nMismatches[i];
+	}
+	return nFailures;
+}
+
+static const char *s_pCollisionBatchNames[COLLISION_BATCH_COUNT] = { "ray vs 4 boxes", "4 rays vs box", "4 rays vs OBB", "ray vs 4 OBBs" };
+
+DEFINE_LIBTEST( collisionutils_batch, "" )
+{
+	CollisionBatchResults_t results;
+	RunCollisionBatch( COLLISION_BATCH_TESTS, COLLISION_BATCH_SEED, results );
+
+	for ( int i = 0; i < COLLISION_BATCH_COUNT; i++ )
+	{
+		if ( results.m_nMismatches[i] )
+		{
+			Warning( "%s: %s disagrees with the scalar test %d times\n", argv[0], s_pCollisionBatchNames[i], results.m_nMismatches[i] );
+		}
+	}
+	if ( results.m_nFractionMismatches )
+	{
+		Warning( "%s: %d enter fractions disagree with the scalar test\n", argv[0], results.m_nFractionMismatches );
+	}
+	return CountCollisionBatchFailures( results );
+}
+
+DEFINE_LIBBENCH( collisionutils_batch_bench, "[tests] [seed]" )
+{
+	int nTests = ( argc > 1 ) ? MAX( 1, atoi( argv[1] ) ) : 100000;
+	int nSeed = ( argc > 2 ) ? atoi( argv[2] ) : COLLISION_BATCH_SEED;
+
+	CollisionBatchResults_t results;
+	RunCollisionBatch( nTests, nSeed, results );
+
+	Msg( "%s: %d tests each\n", argv[0], nTests );
+	Msg( "  %-16s %10s %10s %11s\n", "test", "scalar ms", "batch ms", "mismatches" );
+	for ( int i = 0; i < COLLISION_BATCH_COUNT; i++ )
+	{
+		Msg( "  %-16s %10.2f %10.2f %11d\n", s_pCollisionBatchNames[i], results.m_flScalarTime[i] * 1000.0, results.m_flBatchTime[i] * 1000.0, results.m_nMismatches[i] );
+	}
+	Msg( "  enter fraction mismatches: %d\n", results.m_nFractionMismatches );
+	return CountCollisionBatchFailures( results );
+}
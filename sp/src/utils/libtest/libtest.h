@@ -0,0 +1,46 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks and benchmarks for the tier0, tier1 and mathlib code the
+//			game DLLs are built on. Each file registers its cases with
+//			DEFINE_LIBTEST, which runs by default, or DEFINE_LIBBENCH, which
+//			only runs when it's asked for by name.
+//
+//=============================================================================//
+
+#ifndef LIBTEST_H
+#define LIBTEST_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+// argv[0] is the case's name and the rest are its arguments. Returns the
+// number of failures.
+typedef int (*LibTestFunc_t)( int argc, const char **argv );
+
+class CLibTestCase
+{
+public:
+	CLibTestCase( const char *pName, const char *pUsage, LibTestFunc_t pFunc, bool bBenchmark );
+
+	static CLibTestCase *First()	{ return s_pFirst; }
+	static CLibTestCase *Find( const char *pName );
+
+	const char		*m_pName;
+	const char		*m_pUsage;
+	LibTestFunc_t	m_pFunc;
+	bool			m_bBenchmark;
+	CLibTestCase	*m_pNext;
+
+private:
+	static CLibTestCase *s_pFirst;
+};
+
+#define DEFINE_LIBTEST_CASE( _name, _usage, _bBenchmark )	\
+	static int LibTest_ ## _name( int argc, const char **argv );	\
+	static CLibTestCase s_LibTest_ ## _name( #_name, _usage, LibTest_ ## _name, _bBenchmark );	\
+	static int LibTest_ ## _name( int argc, const char **argv )
+
+#define DEFINE_LIBTEST( _name, _usage )		DEFINE_LIBTEST_CASE( _name, _usage, false )
+#define DEFINE_LIBBENCH( _name, _usage )	DEFINE_LIBTEST_CASE( _name, _usage, true )
+
+#endif // LIBTEST_H
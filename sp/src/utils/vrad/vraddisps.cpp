@@ -18,6 +18,7 @@
 #include "utlrbtree.h"
 #include "tier0/fasttimer.h"
 #include "disp_vrad.h"
+#include "vstdlib/random.h"
 
 class CBSPDispRayDistanceEnumerator;
 
@@ -123,6 +124,8 @@ public:
 	void StartTimer( const char *name );
 	void EndTimer( void );
 
+	void BenchmarkCollision( int nTests );
+
 	//=========================================================================
 	//
 	// Enumeration Methods
@@ -1554,6 +1557,116 @@ void CVRadDispMgr::EndTimer( void )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Times random rays, hull sweeps and box tests against the
+//          displacement collision trees, with and without the four-wide
+//          triangle culls, and checks that both give the same results.
+//-----------------------------------------------------------------------------
+void CVRadDispMgr::BenchmarkCollision( int nTests )
+{
+	int nTreeCount = m_DispTrees.Count();
+	if( ( nTreeCount == 0 ) || ( nTests <= 0 ) )
+		return;
+
+	// Build the tests up front so both passes run the same ones.
+	struct BenchTest_t
+	{
+		CVRADDispColl	*m_pDispTree;
+		Vector			m_vecStart;
+		Vector			m_vecEnd;
+		Vector			m_vecExtents;
+	};
+
+	CUtlVector<BenchTest_t> tests;
+	tests.SetCount( nTests );
+
+	CUniformRandomStream random;
+	random.SetSeed( 0 );
+	for( int iTest = 0; iTest < nTests; ++iTest )
+	{
+		BenchTest_t &test = tests[iTest];
+		test.m_pDispTree = m_DispTrees[random.RandomInt( 0, nTreeCount - 1 )].m_pDispTree;
+
+		Vector vecMins, vecMaxs;
+		test.m_pDispTree->GetBounds( vecMins, vecMaxs );
+		for( int iAxis = 0; iAxis < 3; ++iAxis )
+		{
+			test.m_vecStart[iAxis] = random.RandomFloat( vecMins[iAxis] - 64.0f, vecMaxs[iAxis] + 64.0f );
+			test.m_vecEnd[iAxis] = random.RandomFloat( vecMins[iAxis] - 64.0f, vecMaxs[iAxis] + 64.0f );
+			test.m_vecExtents[iAxis] = random.RandomFloat( 1.0f, 32.0f );
+		}
+	}
+
+	// Ray fraction, hull fraction and box hit for each test and pass.
+	CUtlVector<float> results[2];
+	static const char *s_pPassNames[2] = { "per-triangle", "four-wide cull" };
+
+	bool bCullFourTris = g_bDispCollCullFourTris;
+	for( int iPass = 0; iPass < 2; ++iPass )
+	{
+		g_bDispCollCullFourTris = ( iPass != 0 );
+		results[iPass].SetCount( nTests * 3 );
+
+		CFastTimer timer;
+		double flSeconds[3];
+
+		timer.Start();
+		for( int iTest = 0; iTest < nTests; ++iTest )
+		{
+			Ray_t ray;
+			ray.Init( tests[iTest].m_vecStart, tests[iTest].m_vecEnd );
+			CBaseTrace trace;
+			trace.fraction = 1.0f;
+			tests[iTest].m_pDispTree->AABBTree_Ray( ray, ray.InvDelta(), &trace, true );
+			results[iPass][iTest*3] = trace.fraction;
+		}
+		timer.End();
+		flSeconds[0] = timer.GetDuration().GetSeconds();
+
+		timer.Start();
+		for( int iTest = 0; iTest < nTests; ++iTest )
+		{
+			Ray_t ray;
+			ray.Init( tests[iTest].m_vecStart, tests[iTest].m_vecEnd, -tests[iTest].m_vecExtents, tests[iTest].m_vecExtents );
+			CBaseTrace trace;
+			trace.fraction = 1.0f;
+			tests[iTest].m_pDispTree->AABBTree_SweepAABB( ray, ray.InvDelta(), &trace );
+			results[iPass][iTest*3+1] = trace.fraction;
+		}
+		timer.End();
+		flSeconds[1] = timer.GetDuration().GetSeconds();
+
+		timer.Start();
+		for( int iTest = 0; iTest < nTests; ++iTest )
+		{
+			Vector vecMins = tests[iTest].m_vecStart - tests[iTest].m_vecExtents;
+			Vector vecMaxs = tests[iTest].m_vecStart + tests[iTest].m_vecExtents;
+			results[iPass][iTest*3+2] = tests[iTest].m_pDispTree->AABBTree_IntersectAABB( vecMins, vecMaxs ) ? 1.0f : 0.0f;
+		}
+		timer.End();
+		flSeconds[2] = timer.GetDuration().GetSeconds();
+
+		Msg( "Displacement collision (%s): %d rays %.4lf sec, %d hulls %.4lf sec, %d boxes %.4lf sec\n",
+			s_pPassNames[iPass], nTests, flSeconds[0], nTests, flSeconds[1], nTests, flSeconds[2] );
+	}
+	g_bDispCollCullFourTris = bCullFourTris;
+
+	int nMismatches = 0;
+	for( int iResult = 0; iResult < results[0].Count(); ++iResult )
+	{
+		if( results[0][iResult] != results[1][iResult] )
+		{
+			++nMismatches;
+		}
+	}
+
+	if( nMismatches )
+	{
+		Warning( "Displacement collision: %d of %d results differ between the passes!\n", nMismatches, results[0].Count() );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 bool CVRadDispMgr::BuildDispSamples( lightinfo_t *pLightInfo, facelight_t *pFaceLight, int ndxFace )